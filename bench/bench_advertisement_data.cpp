@@ -0,0 +1,320 @@
+﻿#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/advertisement_data.h"
+#include "ble/clock.h"
+
+// 统计全局的内存分配次数，用来确认解析过程中一次都没有分配
+static std::atomic<uint64_t> allocations{0};
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size != 0 ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+static void AppendAd(std::vector<uint8_t>& raw, uint8_t type, const std::vector<uint8_t>& data) {
+    raw.push_back(static_cast<uint8_t>(data.size() + 1));
+    raw.push_back(type);
+    raw.insert(raw.end(), data.begin(), data.end());
+}
+
+/**
+ * 几种典型的广播：ECG-7（与模拟设备相同）、苹果手机、iBeacon，以及广播包加扫描响应拼成的 62 字节
+ */
+static std::vector<std::pair<std::string, std::vector<uint8_t>>> MakeSamples() {
+    std::vector<std::pair<std::string, std::vector<uint8_t>>> samples;
+    std::vector<uint8_t> raw;
+    AppendAd(raw, ble::kAdFlags, {0x06});
+    AppendAd(raw, ble::kAdCompleteName, {'E', 'C', 'G', '-', '7'});
+    AppendAd(raw, ble::kAdCompleteUuid16, {0xF0, 0xFF});
+    samples.emplace_back("ecg7", raw);
+
+    raw.clear();
+    AppendAd(raw, ble::kAdFlags, {0x1A});
+    AppendAd(raw, ble::kAdTxPower, {0x0C});
+    AppendAd(raw, ble::kAdManufacturerData, {0x4C, 0x00, 0x10, 0x05, 0x41, 0x1C, 0x8E, 0x3A, 0x62});
+    samples.emplace_back("phone", raw);
+
+    raw.clear();
+    AppendAd(raw, ble::kAdFlags, {0x06});
+    AppendAd(raw, ble::kAdManufacturerData, {0x4C, 0x00, 0x02, 0x15, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+                                             15, 16, 0, 1, 0, 2, 0xC5});
+    samples.emplace_back("ibeacon", raw);
+
+    raw.clear();
+    AppendAd(raw, ble::kAdFlags, {0x06});
+    AppendAd(raw, ble::kAdIncompleteUuid16, {0x0D, 0x18, 0x0F, 0x18, 0x0A, 0x18});
+    AppendAd(raw, ble::kAdTxPower, {0xF4});
+    AppendAd(raw, ble::kAdServiceData16, {0x0F, 0x18, 0x5A});
+    AppendAd(raw, ble::kAdManufacturerData, {0x6B, 0x00, 0x01, 0x02, 0x03, 0x04});
+    // 扫描响应
+    AppendAd(raw, ble::kAdCompleteUuid128, {0x9E, 0xCA, 0xDC, 0x24, 0x0E, 0xE5, 0xA9, 0xE0, 0x93, 0xF3, 0xA3, 0xB5,
+                                            0x01, 0x00, 0x40, 0x6E});
+    AppendAd(raw, ble::kAdCompleteName, {'P', 'o', 'l', 'a', 'r', ' ', 'H', '1', '0', ' ', 'A', '1'});
+    samples.emplace_back("adv_plus_scan_response", raw);
+    return samples;
+}
+
+/**
+ * 对照组：模仿按字段取出 WinRT 对象的做法，名称、UUID 列表和厂商数据各自分配
+ */
+struct AllocatingFields {
+    std::string name;
+    std::vector<ble::Guid> uuids;
+    std::vector<std::vector<uint8_t>> manufacturer_data;
+};
+
+static void ParseAllocating(const uint8_t* raw, std::size_t length, AllocatingFields& out) {
+    out = AllocatingFields();
+    ble::AdReader reader(raw, length);
+    ble::AdStructure ad;
+    while (reader.Next(ad)) {
+        if (ad.type == ble::kAdCompleteName || ad.type == ble::kAdShortenedName) {
+            out.name.assign(reinterpret_cast<const char*>(ad.data), ad.length);
+        } else if (ad.type >= ble::kAdIncompleteUuid16 && ad.type <= ble::kAdCompleteUuid128) {
+            ble::UuidList list{};
+            list.data = ad.data;
+            list.width = ad.type <= ble::kAdCompleteUuid16 ? 2 : ad.type <= ble::kAdCompleteUuid32 ? 4 : 16;
+            list.count = ad.length / list.width;
+            for (std::size_t i = 0; i < list.count; ++i) {
+                out.uuids.push_back(list.At(i));
+            }
+        } else if (ad.type == ble::kAdManufacturerData) {
+            out.manufacturer_data.emplace_back(ad.data, ad.data + ad.length);
+        }
+    }
+}
+
+/**
+ * 参照实现：逐字节按规范走一遍，只统计结构个数、名称和是否格式错误，和解析器的结果对比
+ */
+struct ReferenceResult {
+    std::size_t structures = 0;
+    bool truncated = false;
+    std::string name;
+};
+
+static ReferenceResult ParseReference(const std::vector<uint8_t>& raw) {
+    ReferenceResult result;
+    bool complete = false;
+    std::size_t offset = 0;
+    while (offset < raw.size()) {
+        const std::size_t size = raw[offset];
+        if (size == 0) {
+            break;
+        }
+        if (offset + 1 + size > raw.size()) {
+            result.truncated = true;
+            break;
+        }
+        const uint8_t type = raw[offset + 1];
+        const std::string value(raw.begin() + static_cast<std::ptrdiff_t>(offset + 2),
+                                raw.begin() + static_cast<std::ptrdiff_t>(offset + 1 + size));
+        if (type == ble::kAdCompleteName && !complete) {
+            result.name = value;
+            complete = true;
+        } else if (type == ble::kAdShortenedName && !complete && result.name.empty()) {
+            result.name = value;
+        }
+        ++result.structures;
+        offset += 1 + size;
+    }
+    return result;
+}
+
+static bool Inside(const uint8_t* p, std::size_t length, const uint8_t* begin, const uint8_t* end) {
+    return length == 0 || (p >= begin && p + length <= end);
+}
+
+/**
+ * 检查一次解析结果：所有视图都落在缓冲区内，个数不超过容量，与参照实现一致
+ */
+static bool CheckParse(const std::vector<uint8_t>& buffer, const ble::AdvertisementData& data, bool ok) {
+    const uint8_t* begin = buffer.data();
+    const uint8_t* end = begin + buffer.size();
+    bool good = ok == !data.malformed && data.uuid_list_count <= ble::kMaxAdUuidLists &&
+                data.manufacturer_data_count <= ble::kMaxAdManufacturerData &&
+                data.service_data_count <= ble::kMaxAdServiceData &&
+                Inside(reinterpret_cast<const uint8_t*>(data.local_name.data()), data.local_name.size(), begin, end);
+    for (std::size_t i = 0; i < data.uuid_list_count; ++i) {
+        const ble::UuidList& list = data.uuid_lists[i];
+        good = good && list.count > 0 && (list.width == 2 || list.width == 4 || list.width == 16) &&
+               Inside(list.data, list.count * list.width, begin, end);
+    }
+    for (std::size_t i = 0; i < data.manufacturer_data_count; ++i) {
+        const ble::ManufacturerData& m = data.manufacturer_data[i];
+        good = good && Inside(m.data - 2, m.length + 2, begin, end);
+    }
+    for (std::size_t i = 0; i < data.service_data_count; ++i) {
+        const ble::ServiceData& s = data.service_data[i];
+        good = good && Inside(s.data - 2, s.length + 2, begin, end);
+    }
+    const ReferenceResult reference = ParseReference(buffer);
+    good = good && reference.structures == data.structures && (!reference.truncated || data.malformed) &&
+           reference.name == data.local_name;
+    return good;
+}
+
+/**
+ * 变异模糊测试：从典型广播和随机字节出发，随机改长度字节、翻转位、截断、拼接，
+ * 每个输入放在大小正好的堆缓冲区里（用 AddressSanitizer 构建时越界读会被立即发现）
+ * @param samples
+ * @param iterations
+ * @param failures 输出检查失败的输入个数
+ * @param malformed 输出被判为格式错误的输入个数
+ * @return 每个输入的平均耗时（纳秒，包括生成和检查）
+ */
+static double Fuzz(const std::vector<std::pair<std::string, std::vector<uint8_t>>>& samples, uint64_t iterations,
+                   uint64_t& failures, uint64_t& malformed) {
+    uint64_t state = 0x2545F4914F6CDD1Dull;
+    auto next = [&state] {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    };
+    failures = 0;
+    malformed = 0;
+    const uint64_t start = ble::MonotonicNowNs();
+    for (uint64_t n = 0; n < iterations; ++n) {
+        std::vector<uint8_t> input;
+        const uint64_t kind = next() % 4;
+        if (kind == 0) {
+            input.resize(next() % 300);
+            for (auto& byte : input) {
+                byte = static_cast<uint8_t>(next());
+            }
+        } else {
+            input = samples[next() % samples.size()].second;
+            if (kind == 3) {
+                const auto& other = samples[next() % samples.size()].second;
+                input.insert(input.end(), other.begin(), other.end());
+            }
+            const uint64_t mutations = 1 + next() % 4;
+            for (uint64_t m = 0; m < mutations && !input.empty(); ++m) {
+                const std::size_t at = static_cast<std::size_t>(next() % input.size());
+                switch (next() % 4) {
+                    case 0:
+                        input[at] ^= static_cast<uint8_t>(1u << (next() % 8));
+                        break;
+                    case 1:
+                        input[at] = static_cast<uint8_t>(next());
+                        break;
+                    case 2:
+                        input.resize(at);
+                        break;
+                    default:
+                        input.insert(input.begin() + static_cast<std::ptrdiff_t>(at), static_cast<uint8_t>(next()));
+                        break;
+                }
+            }
+        }
+        // 复制一份，堆缓冲区的大小正好等于输入长度
+        const std::vector<uint8_t> exact(input.begin(), input.end());
+        ble::AdvertisementData data;
+        const bool ok = ble::ParseAdvertisementData(exact.data(), exact.size(), data);
+        malformed += ok ? 0 : 1;
+        if (!CheckParse(exact, data, ok)) {
+            if (failures++ < 5) {
+                std::fprintf(stderr, "advertisement_data: fuzz input %llu (%zu bytes) parsed inconsistently:",
+                             static_cast<unsigned long long>(n), exact.size());
+                for (uint8_t byte : exact) {
+                    std::fprintf(stderr, " %02x", byte);
+                }
+                std::fprintf(stderr, "\n");
+            }
+        }
+    }
+    return static_cast<double>(ble::MonotonicNowNs() - start) / static_cast<double>(iterations);
+}
+
+int main() {
+    const auto samples = MakeSamples();
+    bool ok = true;
+
+    for (const auto& sample : samples) {
+        const std::vector<uint8_t>& raw = sample.second;
+        ble::AdvertisementData data;
+        const uint64_t before = allocations.load();
+        const double parse_ns = bench::MeasureNsPerCall([&] {
+            ble::ParseAdvertisementData(raw.data(), raw.size(), data);
+            bench::DoNotOptimize(data);
+        });
+        const uint64_t parse_allocations = allocations.load() - before;
+
+        AllocatingFields fields;
+        const uint64_t allocating_before = allocations.load();
+        uint64_t calls = 0;
+        const double allocating_ns = bench::MeasureNsPerCall([&] {
+            ParseAllocating(raw.data(), raw.size(), fields);
+            bench::DoNotOptimize(fields);
+            ++calls;
+        });
+        const double allocations_per_call =
+                static_cast<double>(allocations.load() - allocating_before) / static_cast<double>(calls);
+
+        bench::Report("advertisement_data", sample.first)
+                .Add("bytes", static_cast<double>(raw.size()))
+                .Add("parse_ns", parse_ns)
+                .Add("parse_allocations", static_cast<double>(parse_allocations))
+                .Add("allocating_ns", allocating_ns)
+                .Add("allocating_allocations_per_call", allocations_per_call)
+                .Print();
+        if (parse_allocations != 0 || !ble::ParseAdvertisementData(raw.data(), raw.size(), data)) {
+            std::fprintf(stderr, "advertisement_data: %s allocated %llu times or failed to parse\n",
+                         sample.first.c_str(), static_cast<unsigned long long>(parse_allocations));
+            ok = false;
+        }
+    }
+
+    // 解析结果的几个具体值
+    {
+        const std::vector<uint8_t>& raw = samples[3].second;
+        ble::AdvertisementData data;
+        ble::ParseAdvertisementData(raw.data(), raw.size(), data);
+        const ble::Guid nus = {0x6E400001, 0xB5A3, 0xF393, {0xE0, 0xA9, 0xE5, 0x0E, 0x24, 0xDC, 0xCA, 0x9E}};
+        const ble::Guid battery = {0x0000180F, 0x0000, 0x1000, {0x80, 0x00, 0x00, 0x80, 0x5F, 0x9B, 0x34, 0xFB}};
+        const bool values = data.local_name == "Polar H10 A1" && data.complete_name && data.has_flags &&
+                            data.flags == 0x06 && data.has_tx_power && data.tx_power == -12 &&
+                            data.uuid_list_count == 2 && !data.uuid_lists[0].complete && data.uuid_lists[0].count == 3 &&
+                            data.HasService(0x180A) && data.HasService(nus) && data.HasService(battery) &&
+                            !data.HasService(0x1810) && data.uuid_lists[1].At(0) == nus &&
+                            data.Manufacturer(0x006B) != nullptr && data.Manufacturer(0x006B)->length == 4 &&
+                            data.Manufacturer(0x004C) == nullptr && data.service_data_count == 1 &&
+                            data.service_data[0].uuid == 0x180F && data.service_data[0].length == 1;
+        if (!values) {
+            std::fprintf(stderr, "advertisement_data: parsed fields do not match the sample\n");
+            ok = false;
+        }
+    }
+
+    uint64_t failures = 0;
+    uint64_t malformed = 0;
+    const uint64_t iterations = 1000000;
+    const double fuzz_ns = Fuzz(samples, iterations, failures, malformed);
+    bench::Report("advertisement_data", "fuzz")
+            .Add("inputs", static_cast<double>(iterations))
+            .Add("malformed_fraction", static_cast<double>(malformed) / static_cast<double>(iterations))
+            .Add("ns_per_input", fuzz_ns)
+            .Add("failures", static_cast<double>(failures))
+            .Print();
+    return ok && failures == 0 ? 0 : 1;
+}
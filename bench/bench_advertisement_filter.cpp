@@ -0,0 +1,325 @@
+﻿#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/advertisement_filter.h"
+#include "ble/format.h"
+
+/**
+ * 合成的一台广播设备：地址、名称和按蓝牙格式拼好的原始广播数据
+ */
+struct SyntheticDevice {
+    uint64_t address = 0;
+    std::string name;
+    std::vector<uint8_t> raw;
+};
+
+static void AppendAd(std::vector<uint8_t>& raw, uint8_t type, const std::vector<uint8_t>& data) {
+    raw.push_back(static_cast<uint8_t>(data.size() + 1));
+    raw.push_back(type);
+    raw.insert(raw.end(), data.begin(), data.end());
+}
+
+/**
+ * 拥挤环境：大部分是手机（苹果厂商数据、没有名称），其次是信标和各种有名称的设备，约 1% 是 ECG-7
+ * @param devices
+ */
+static std::vector<SyntheticDevice> MakeDevices(std::size_t devices) {
+    std::vector<SyntheticDevice> result(devices);
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    auto next = [&state] {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        return state >> 16;
+    };
+    static const char* const kNames[] = {"Galaxy Buds", "Mi Band 6", "JBL Flip", "Tile", "LE-Bose", "Fitbit",
+                                         "ECG-6", "EC", "HRM-Pro", "Polar H10 A1B2"};
+    for (std::size_t i = 0; i < devices; ++i) {
+        SyntheticDevice& device = result[i];
+        device.address = next() & 0xFFFFFFFFFFFFull;
+        const uint64_t kind = next() % 100;
+        AppendAd(device.raw, 0x01, {0x06});
+        if (kind == 0) {
+            // ECG-7：固定的 OUI、名称和 FFF0 服务
+            device.address = 0xC0FFEE000000ull | (device.address & 0xFFFFFF);
+            device.name = "ECG-7";
+            AppendAd(device.raw, 0x09, {'E', 'C', 'G', '-', '7'});
+            AppendAd(device.raw, 0x03, {0xF0, 0xFF});
+        } else if (kind < 60) {
+            AppendAd(device.raw, 0xFF, {0x4C, 0x00, 0x10, 0x05, static_cast<uint8_t>(next()), 0x1C, 0x00});
+        } else if (kind < 75) {
+            // iBeacon 和 Eddystone
+            if (kind & 1) {
+                AppendAd(device.raw, 0xFF, {0x4C, 0x00, 0x02, 0x15, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+                                            15, 16, 0, 1, 0, 2, 0xC5});
+            } else {
+                AppendAd(device.raw, 0x03, {0xAA, 0xFE});
+                AppendAd(device.raw, 0x16, {0xAA, 0xFE, 0x10, 0xEB, 0x03, 'e', 'x', 'a', 'm', 'p', 'l', 'e'});
+            }
+        } else {
+            device.name = kNames[next() % (sizeof(kNames) / sizeof(kNames[0]))];
+            AppendAd(device.raw, 0x09, std::vector<uint8_t>(device.name.begin(), device.name.end()));
+            if (kind < 85) {
+                AppendAd(device.raw, 0x03, {0x0D, 0x18, 0x0F, 0x18});   // 心率、电池
+            } else if (kind < 90) {
+                // 自定义 128 位服务
+                AppendAd(device.raw, 0x07, {0x9E, 0xCA, 0xDC, 0x24, 0x0E, 0xE5, 0xA9, 0xE0, 0x93, 0xF3, 0xA3, 0xB5,
+                                            0x01, 0x00, 0x40, 0x6E});
+            } else {
+                AppendAd(device.raw, 0xFF, {0x75, 0x00, 0x42, 0x04});
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * 参照实现：按声明顺序逐条检查全部条件，每条规则都重新解析一遍原始广播数据
+ */
+class ReferenceFilter {
+public:
+    explicit ReferenceFilter(const std::vector<ble::AdvertisementRule>& rules) : rules_(rules) {
+        for (const auto& rule : rules_) {
+            regexes_.emplace_back(rule.name_regex.empty() ? std::string(".*") : rule.name_regex);
+        }
+    }
+
+    int Match(const ble::Advertisement& advertisement) const {
+        const std::string name(advertisement.local_name);
+        for (std::size_t i = 0; i < rules_.size(); ++i) {
+            const ble::AdvertisementRule& rule = rules_[i];
+            if (advertisement.rssi < rule.min_rssi) {
+                continue;
+            }
+            if ((advertisement.address & rule.address_mask) != (rule.address & rule.address_mask)) {
+                continue;
+            }
+            if (!rule.name.empty() && name != rule.name) {
+                continue;
+            }
+            if (!rule.name_prefix.empty() && name.compare(0, rule.name_prefix.size(), rule.name_prefix) != 0) {
+                continue;
+            }
+            if (!rule.name_regex.empty() && !std::regex_search(name, regexes_[i])) {
+                continue;
+            }
+            if (rule.manufacturer_id >= 0 && !HasManufacturer(advertisement, rule.manufacturer_id)) {
+                continue;
+            }
+            if (!rule.service_uuids.empty() && !HasAnyService(advertisement, rule.service_uuids)) {
+                continue;
+            }
+            return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+private:
+    static bool HasManufacturer(const ble::Advertisement& advertisement, int32_t id) {
+        for (std::size_t offset = 0; offset + 1 < advertisement.raw_length;) {
+            const std::size_t size = advertisement.raw[offset];
+            if (size == 0 || offset + 1 + size > advertisement.raw_length) {
+                break;
+            }
+            if (advertisement.raw[offset + 1] == 0xFF && size >= 3 &&
+                (advertisement.raw[offset + 2] | (advertisement.raw[offset + 3] << 8)) == id) {
+                return true;
+            }
+            offset += 1 + size;
+        }
+        return false;
+    }
+
+    // 把广播里的 UUID 都展开成 Guid 再比较
+    static bool HasAnyService(const ble::Advertisement& advertisement, const std::vector<ble::Guid>& wanted) {
+        std::vector<ble::Guid> found;
+        for (std::size_t offset = 0; offset + 1 < advertisement.raw_length;) {
+            const std::size_t size = advertisement.raw[offset];
+            if (size == 0 || offset + 1 + size > advertisement.raw_length) {
+                break;
+            }
+            const uint8_t type = advertisement.raw[offset + 1];
+            const uint8_t* data = advertisement.raw + offset + 2;
+            const std::size_t length = size - 1;
+            const std::size_t width = type <= 0x03 && type >= 0x02 ? 2 : type <= 0x05 && type >= 0x04 ? 4
+                                      : type <= 0x07 && type >= 0x06 ? 16 : 0;
+            for (std::size_t i = 0; width != 0 && i + width <= length; i += width) {
+                ble::Guid uuid{0, 0x0000, 0x1000, {0x80, 0x00, 0x00, 0x80, 0x5F, 0x9B, 0x34, 0xFB}};
+                if (width == 16) {
+                    for (int k = 0; k < 8; ++k) {
+                        uuid.Data4[k] = data[i + 7 - static_cast<std::size_t>(k)];
+                    }
+                    uuid.Data3 = static_cast<uint16_t>(data[i + 8] | (data[i + 9] << 8));
+                    uuid.Data2 = static_cast<uint16_t>(data[i + 10] | (data[i + 11] << 8));
+                    std::memcpy(&uuid.Data1, data + i + 12, 4);
+                } else {
+                    uuid.Data1 = 0;
+                    std::memcpy(&uuid.Data1, data + i, width);
+                }
+                found.push_back(uuid);
+            }
+            offset += 1 + size;
+        }
+        for (const auto& uuid : wanted) {
+            for (const auto& seen : found) {
+                if (seen == uuid) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    std::vector<ble::AdvertisementRule> rules_;
+    std::vector<std::regex> regexes_;
+};
+
+static ble::AdvertisementRule Rule(const char* spec) {
+    ble::AdvertisementRule rule;
+    if (!ble::ParseAdvertisementRule(spec, rule)) {
+        std::fprintf(stderr, "advertisement_filter: bad rule %s\n", spec);
+    }
+    return rule;
+}
+
+/**
+ * 用同一条广播流比较编译后的过滤器和参照实现：结果必须完全相同，并统计各步骤决定的比例
+ * @param name
+ * @param rules
+ * @param devices
+ * @param advertisements
+ */
+static bool RunCase(const char* name, const std::vector<ble::AdvertisementRule>& rules,
+                    const std::vector<SyntheticDevice>& devices, std::size_t advertisements) {
+    ble::AdvertisementFilter filter;
+    std::string error;
+    if (!filter.Compile(rules, &error)) {
+        std::fprintf(stderr, "advertisement_filter: %s failed to compile: %s\n", name, error.c_str());
+        return false;
+    }
+    ReferenceFilter reference(rules);
+
+    // 预先生成广播序列：随机设备、随机 RSSI，一半的广播不带名称（扫描响应之外的主动广播）
+    std::vector<ble::Advertisement> stream(advertisements);
+    uint64_t state = 0x243F6A8885A308D3ull;
+    for (auto& advertisement : stream) {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        const SyntheticDevice& device = devices[(state >> 33) % devices.size()];
+        advertisement.address = device.address;
+        advertisement.rssi = static_cast<int16_t>(-30 - static_cast<int>((state >> 20) % 70));
+        advertisement.local_name = (state & 1) != 0 ? std::string_view(device.name) : std::string_view();
+        advertisement.raw = device.raw.data();
+        advertisement.raw_length = device.raw.size();
+    }
+
+    std::array<uint64_t, 6> stages{};
+    uint64_t matched = 0;
+    uint64_t mismatches = 0;
+    for (const auto& advertisement : stream) {
+        ble::FilterStage stage;
+        const int result = filter.Match(advertisement, &stage);
+        ++stages[static_cast<std::size_t>(stage)];
+        matched += result >= 0;
+        if (result != reference.Match(advertisement)) {
+            if (mismatches++ < 5) {
+                std::fprintf(stderr, "advertisement_filter: %s %s rssi %d name '%.*s': compiled %d, reference %d\n",
+                             name, ble::FormatBluetoothAddress(advertisement.address).data(), advertisement.rssi,
+                             static_cast<int>(advertisement.local_name.size()), advertisement.local_name.data(),
+                             result, reference.Match(advertisement));
+            }
+        }
+    }
+
+    std::size_t index = 0;
+    const double compiled_ns = bench::MeasureNsPerCall([&] {
+        bench::DoNotOptimize(filter.Match(stream[index]));
+        index = index + 1 == stream.size() ? 0 : index + 1;
+    });
+    index = 0;
+    const double reference_ns = bench::MeasureNsPerCall([&] {
+        bench::DoNotOptimize(reference.Match(stream[index]));
+        index = index + 1 == stream.size() ? 0 : index + 1;
+    });
+
+    bench::Report report("advertisement_filter", name);
+    report.Add("rules", static_cast<double>(rules.size()))
+            .Add("direct", filter.Direct() ? 1.0 : 0.0)
+            .Add("compiled_ns", compiled_ns)
+            .Add("reference_ns", reference_ns)
+            .Add("speedup", reference_ns / compiled_ns)
+            .Add("matched_fraction", static_cast<double>(matched) / static_cast<double>(stream.size()));
+    for (std::size_t i = 0; i < stages.size(); ++i) {
+        const std::string key = std::string("decided_") + ble::FilterStageName(static_cast<ble::FilterStage>(i));
+        report.Add(key.c_str(), static_cast<double>(stages[i]) / static_cast<double>(stream.size()));
+    }
+    report.Print();
+    if (mismatches != 0) {
+        std::fprintf(stderr, "advertisement_filter: %s %llu mismatches\n", name,
+                     static_cast<unsigned long long>(mismatches));
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    const std::vector<SyntheticDevice> devices = MakeDevices(2000);
+    const std::size_t advertisements = 200000;
+    bool ok = true;
+
+    // 原来的默认目标：按名称找 ECG-7
+    ok = RunCase("name", {Rule("name=ECG-7")}, devices, advertisements) && ok;
+
+    // 命令行上给了几个目标：名称、地址和带 RSSI 的前缀，仍然逐条比较
+    ble::AdvertisementRule by_address;
+    by_address.address = devices[5].address;
+    by_address.address_mask = 0xFFFFFFFFFFFFull;
+    ok = RunCase("targets", {Rule("name=ECG-7"), by_address, Rule("prefix=HRM-,rssi=-60"), Rule("oui=c0:ff:ee,rssi=-70")},
+                 devices, advertisements) && ok;
+
+    // 现场常用的组合
+    ok = RunCase("mixed",
+                 {Rule("oui=c0:ff:ee,service=FFF0,rssi=-80"), Rule("prefix=HRM-,service=180D"),
+                  Rule("company=0x0075,rssi=-60"), Rule("service=6e400001-b5a3-f393-e0a9-e50e24dcca9e"),
+                  Rule("prefix=Polar,regex= H10 [0-9A-F]{4}$")},
+                 devices, advertisements) && ok;
+
+    // 苹果厂商数据：绝大多数广播都要解析原始数据
+    ok = RunCase("company", {Rule("company=0x004C,rssi=-50"), Rule("name=ECG-7")}, devices, advertisements) && ok;
+
+    // 最多 64 条规则：大部分是不同的名称和地址，最后几条要看数据和正则
+    std::vector<ble::AdvertisementRule> many;
+    for (std::size_t i = 0; many.size() < ble::kMaxAdvertisementRules - 4; ++i) {
+        ble::AdvertisementRule rule;
+        if (i % 2 == 0) {
+            rule.name = "Sensor-" + std::to_string(i);
+        } else {
+            rule.address = devices[i * 7 % devices.size()].address;
+            rule.address_mask = 0xFFFFFFFFFFFFull;
+        }
+        many.push_back(rule);
+    }
+    many.push_back(Rule("prefix=ECG-,rssi=-70"));
+    many.push_back(Rule("service=180F,rssi=-55"));
+    many.push_back(Rule("oui=c0:ff:ee"));
+    many.push_back(Rule("regex=^(Tile|Fitbit)$"));
+    ok = RunCase("64_rules", many, devices, advertisements) && ok;
+
+    // 规则解析：写错的规则必须被拒绝
+    ble::AdvertisementRule rule;
+    ble::AdvertisementFilter filter;
+    const bool parse_ok = ble::ParseAdvertisementRule("mac=11:22:33:44:55:66/ff:ff:ff:00:00:00,rssi=-90", rule) &&
+                          rule.address_mask == 0xFFFFFF000000ull && rule.min_rssi == -90 &&
+                          !ble::ParseAdvertisementRule("rssi=loud", rule) &&
+                          !ble::ParseAdvertisementRule("service=FFF", rule) &&
+                          !ble::ParseAdvertisementRule("colour=red", rule) &&
+                          ble::ParseAdvertisementRule("regex=a,b", rule) && rule.name_regex == "a,b" &&
+                          !filter.Compile({rule, Rule("regex=([")});
+    if (!parse_ok) {
+        std::fprintf(stderr, "advertisement_filter: rule parsing accepted a malformed rule\n");
+    }
+    return ok && parse_ok ? 0 : 1;
+}
@@ -0,0 +1,95 @@
+﻿#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/advertisement_table.h"
+#include "ble/clock.h"
+
+/**
+ * 模拟拥挤病房：devices 台设备随机交替广播，显示线程每 100ms 取一次快照输出到 /dev/null
+ * 统计扫描回调侧的更新吞吐与单次更新耗时
+ * @param devices
+ * @param updates
+ */
+static bool RunCase(std::size_t devices, uint64_t updates) {
+    std::vector<uint64_t> addresses(devices);
+    std::vector<std::string> names(devices);
+    uint64_t state = 0x243F6A8885A308D3ull;
+    for (std::size_t i = 0; i < devices; ++i) {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        addresses[i] = state >> 16;
+        names[i] = i % 4 == 0 ? "ECG-7" : "Device-" + std::to_string(i);
+    }
+
+    ble::AdvertisementTable table(devices);
+    std::atomic<bool> running(true);
+    uint64_t snapshots = 0;
+    std::thread display([&] {
+        std::FILE* null_file = std::fopen("/dev/null", "w");
+        while (running.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            ble::RenderAdvertisementTable(table.Snapshot(), ble::MonotonicNowNs(), null_file);
+            ++snapshots;
+        }
+        std::fclose(null_file);
+    });
+
+    // 每 64 次更新采样一次耗时，避免计时本身主导结果
+    std::vector<uint64_t> update_ns;
+    update_ns.reserve(updates / 64 + 1);
+    ble::Advertisement advertisement;
+    uint64_t start = ble::MonotonicNowNs();
+    for (uint64_t i = 0; i < updates; ++i) {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        std::size_t device = static_cast<std::size_t>((state >> 33) % devices);
+        advertisement.address = addresses[device];
+        advertisement.rssi = static_cast<int16_t>(-40 - static_cast<int>((state >> 20) & 0x3F));
+        // 一半是带名称的扫描响应，一半是不带名称的广播
+        advertisement.local_name = (state & 1) != 0 ? std::string_view(names[device]) : std::string_view();
+        if ((i & 63) == 0) {
+            uint64_t t0 = ble::MonotonicNowNs();
+            advertisement.timestamp_ns = t0;
+            table.Update(advertisement);
+            update_ns.push_back(ble::MonotonicNowNs() - t0);
+        } else {
+            advertisement.timestamp_ns = start + i;
+            table.Update(advertisement);
+        }
+    }
+    uint64_t elapsed = ble::MonotonicNowNs() - start;
+    running.store(false);
+    display.join();
+
+    uint64_t snapshot_start = ble::MonotonicNowNs();
+    auto entries = table.Snapshot();
+    uint64_t snapshot_ns = ble::MonotonicNowNs() - snapshot_start;
+
+    bench::Report("advertisement_table", std::to_string(devices) + "_devices")
+            .Add("updates", static_cast<double>(updates))
+            .Add("updates_per_s", static_cast<double>(updates) * 1e9 / static_cast<double>(elapsed))
+            .Add("update_p50_ns", static_cast<double>(bench::Percentile(update_ns, 50.0)))
+            .Add("update_p99_ns", static_cast<double>(bench::Percentile(update_ns, 99.0)))
+            .Add("update_max_ns", static_cast<double>(bench::Percentile(update_ns, 100.0)))
+            .Add("snapshot_ns", static_cast<double>(snapshot_ns))
+            .Add("snapshots_rendered", static_cast<double>(snapshots))
+            .Print();
+
+    if (entries.size() != devices || table.Overflow() != 0) {
+        std::fprintf(stderr, "advertisement_table: tracked %zu of %zu devices\n", entries.size(), devices);
+        return false;
+    }
+    // 全部设备都过期后表应当清空
+    table.ExpireOlderThan(~0ull);
+    return table.Size() == 0;
+}
+
+int main() {
+    bool ok = RunCase(200, 5000000);
+    ok = RunCase(20000, 5000000) && ok;
+    return ok ? 0 : 1;
+}
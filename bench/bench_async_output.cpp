@@ -0,0 +1,243 @@
+﻿#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/async_output.h"
+#include "ble/clock.h"
+#include "ble/hex_dump.h"
+
+/**
+ * 模拟一个慢终端：每次写出固定耗时 write_us，收到的数据保存下来用于校验
+ */
+struct SlowSink {
+    uint64_t write_us = 0;
+    std::mutex mutex;
+    std::string received;
+
+    void Write(const char* data, std::size_t length) {
+        if (write_us > 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(write_us));
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        received.append(data, length);
+    }
+};
+
+// 一个 ECG-7 通知：2 字节序号 + 3 帧 3 导联 16 位样本
+static void MakePayload(uint32_t sequence, uint8_t* payload) {
+    payload[0] = static_cast<uint8_t>(sequence);
+    payload[1] = static_cast<uint8_t>(sequence >> 8);
+    for (std::size_t i = 2; i < 20; ++i) {
+        payload[i] = static_cast<uint8_t>(sequence * 31 + i * 7);
+    }
+}
+
+struct CallbackTimes {
+    uint64_t p50_ns = 0;
+    uint64_t p99_ns = 0;
+    uint64_t max_ns = 0;
+};
+
+static CallbackTimes Summarize(std::vector<uint64_t>& times) {
+    CallbackTimes result;
+    result.p50_ns = bench::Percentile(times, 50);
+    result.p99_ns = bench::Percentile(times, 99);
+    result.max_ns = times.empty() ? 0 : times.back();
+    return result;
+}
+
+/**
+ * 旧的做法：回调里编码一行后直接写出并 fflush，回调耗时包含终端的耗时
+ * @param write_us
+ * @param count
+ */
+static CallbackTimes RunSync(uint64_t write_us, std::size_t count) {
+    SlowSink sink;
+    sink.write_us = write_us;
+    ble::HexDumpWriter line(nullptr, 1024);
+    std::vector<uint64_t> times;
+    times.reserve(count);
+    uint8_t payload[20];
+    for (std::size_t i = 0; i < count; ++i) {
+        MakePayload(static_cast<uint32_t>(i), payload);
+        const uint64_t start = ble::MonotonicNowNs();
+        line.AppendPacket(payload, sizeof(payload), "C0:FF:EE:00:00:07 ");
+        sink.Write(line.Data(), line.Pending());
+        line.Clear();
+        times.push_back(ble::MonotonicNowNs() - start);
+    }
+    return Summarize(times);
+}
+
+struct AsyncResult {
+    CallbackTimes callback;
+    ble::AsyncOutputStats stats;
+    bool intact = false;       // 没有丢弃时输出与输入逐字节相同；有丢弃时字节数对得上
+};
+
+/**
+ * 新的做法：回调里编码后交给 AsyncOutput，按 rate_hz 的节奏产生 count 个通知
+ * @param write_us
+ * @param count
+ * @param rate_hz
+ * @param options 块大小和块数
+ */
+static AsyncResult RunAsync(uint64_t write_us, std::size_t count, double rate_hz, ble::AsyncOutputOptions options) {
+    SlowSink sink;
+    sink.write_us = write_us;
+    options.target = ble::OutputTarget::Callback;
+    options.callback = [&sink](const char* data, std::size_t length) { sink.Write(data, length); };
+    ble::AsyncOutput output(options);
+    output.Open();
+
+    ble::HexDumpWriter line(nullptr, 1024);
+    std::string expected;
+    std::vector<uint64_t> times;
+    times.reserve(count);
+    uint8_t payload[20];
+    const auto period = std::chrono::nanoseconds(static_cast<int64_t>(1e9 / rate_hz));
+    auto next = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < count; ++i) {
+        next += period;
+        std::this_thread::sleep_until(next);
+        MakePayload(static_cast<uint32_t>(i), payload);
+        const uint64_t start = ble::MonotonicNowNs();
+        line.AppendPacket(payload, sizeof(payload), "C0:FF:EE:00:00:07 ");
+        output.Append(line.Data(), line.Pending());
+        times.push_back(ble::MonotonicNowNs() - start);
+        expected.append(line.Data(), line.Pending());
+        line.Clear();
+    }
+    output.Close();
+
+    AsyncResult result;
+    result.callback = Summarize(times);
+    result.stats = output.Stats();
+    if (result.stats.dropped_appends == 0) {
+        result.intact = sink.received == expected;
+    } else {
+        result.intact = sink.received.size() + result.stats.dropped_bytes == expected.size();
+    }
+    return result;
+}
+
+/**
+ * 边界情况：空数据不能出错；比全部空闲块还大的数据必须整段丢弃，
+ * 不能写出前半段留下半行；之后能放下的数据照常完整写出
+ * @return 行为不符合预期时返回 false
+ */
+static bool CheckAppendEdges() {
+    SlowSink sink;
+    ble::AsyncOutputOptions options;
+    options.target = ble::OutputTarget::Callback;
+    options.callback = [&sink](const char* data, std::size_t length) { sink.Write(data, length); };
+    options.block_bytes = 256;
+    options.blocks = 2;
+    ble::AsyncOutput output(options);
+
+    // 还没有打开时没有当前块，写出线程也不会归还块，空闲空间确定是 512 字节
+    bool ok = output.Append("", 0);
+    const std::string oversized(600, 'x');
+    ok &= !output.Append(oversized.data(), oversized.size());
+    std::string fits;
+    for (int i = 0; fits.size() < 300; ++i) {
+        fits += "line " + std::to_string(i) + "\n";
+    }
+    ok &= output.Append(fits.data(), fits.size());
+    ok &= output.Append("", 0);
+    output.Open();
+    output.Flush();
+    output.Close();
+
+    ble::AsyncOutputStats stats = output.Stats();
+    ok &= sink.received == fits && stats.appends == 4 && stats.dropped_appends == 1 &&
+          stats.dropped_bytes == oversized.size();
+    if (!ok) {
+        std::fprintf(stderr, "async_output: empty or oversized append mishandled (received %zu bytes)\n",
+                     sink.received.size());
+    }
+    return ok;
+}
+
+int main() {
+    bool ok = CheckAppendEdges();
+    // 终端每次写出 0 / 1ms / 10ms：同步写出时回调耗时跟着变，异步时应该基本不变
+    std::vector<uint64_t> async_p99;
+    for (uint64_t write_us : {0ull, 1000ull, 10000ull}) {
+        CallbackTimes sync = RunSync(write_us, write_us == 0 ? 4000 : 200);
+        AsyncResult async = RunAsync(write_us, 4000, 4000.0, {});
+        async_p99.push_back(async.callback.p99_ns);
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "sink_%lluus", static_cast<unsigned long long>(write_us));
+        bench::Report("async_output", name)
+                .Add("sync_callback_p50_us", static_cast<double>(sync.p50_ns) / 1e3)
+                .Add("sync_callback_p99_us", static_cast<double>(sync.p99_ns) / 1e3)
+                .Add("async_callback_p50_us", static_cast<double>(async.callback.p50_ns) / 1e3)
+                .Add("async_callback_p99_us", static_cast<double>(async.callback.p99_ns) / 1e3)
+                .Add("async_callback_max_us", static_cast<double>(async.callback.max_ns) / 1e3)
+                .Add("blocks_written", static_cast<double>(async.stats.blocks_written))
+                .Add("delay_p99_ms", static_cast<double>(async.stats.delay.p99_ns) / 1e6)
+                .Add("dropped_appends", static_cast<double>(async.stats.dropped_appends))
+                .Print();
+        if (!async.intact || async.stats.dropped_appends != 0 || async.stats.appends != 4000) {
+            std::fprintf(stderr, "async_output: output lost or corrupted with a %lluus sink\n",
+                         static_cast<unsigned long long>(write_us));
+            ok = false;
+        }
+        // 按时间刷新：4000 行约 240KB，不到 4 个 64KB 块，其余的必须靠 flush_interval_ms 写出
+        if (async.stats.delay.max_ns > 1000000000ull) {
+            std::fprintf(stderr, "async_output: block waited %.1f ms before being written\n",
+                         static_cast<double>(async.stats.delay.max_ns) / 1e6);
+            ok = false;
+        }
+    }
+    // 终端慢了 10000 倍，回调的 p99 不应跟着变大（留出调度抖动的余量）
+    if (async_p99.back() > std::max<uint64_t>(async_p99.front() * 4, 50000)) {
+        std::fprintf(stderr, "async_output: callback p99 grew from %.1fus to %.1fus with a slow sink\n",
+                     static_cast<double>(async_p99.front()) / 1e3, static_cast<double>(async_p99.back()) / 1e3);
+        ok = false;
+    }
+
+    // 终端卡住 500ms：两个 4KB 块很快写满，之后的行被丢弃并计数，回调仍然不等待
+    ble::AsyncOutputOptions small;
+    small.block_bytes = 4096;
+    small.blocks = 2;
+    AsyncResult stalled = RunAsync(500000, 2000, 4000.0, small);
+    bench::Report("async_output", "stalled_sink")
+            .Add("async_callback_p99_us", static_cast<double>(stalled.callback.p99_ns) / 1e3)
+            .Add("async_callback_max_us", static_cast<double>(stalled.callback.max_ns) / 1e3)
+            .Add("appends", static_cast<double>(stalled.stats.appends))
+            .Add("dropped_appends", static_cast<double>(stalled.stats.dropped_appends))
+            .Add("write_max_ms", static_cast<double>(stalled.stats.write.max_ns) / 1e6)
+            .Print();
+    if (stalled.stats.dropped_appends == 0 || !stalled.intact || stalled.callback.p99_ns > 50000) {
+        std::fprintf(stderr, "async_output: stalled sink was not reported as dropped output or blocked the caller\n");
+        ok = false;
+    }
+
+    // 单次 Append 的开销（Null 目标，只有复制和加锁）
+    ble::AsyncOutputOptions null_options;
+    null_options.target = ble::OutputTarget::Null;
+    null_options.blocks = 8;
+    ble::AsyncOutput null_output(null_options);
+    null_output.Open();
+    const char text[] = "C0:FF:EE:00:00:07 0102030405060708090A0B0C0D0E0F1011121314\n";
+    double append_ns = bench::MeasureNsPerCall([&] { null_output.Append(text, sizeof(text) - 1); });
+    null_output.Close();
+    // 连续追加比写出线程被调度的频率快得多，单核上大部分会落到丢弃路径，一并报告
+    ble::AsyncOutputStats null_stats = null_output.Stats();
+    bench::Report("async_output", "append_cost")
+            .Add("append_ns", append_ns)
+            .Add("dropped_fraction", static_cast<double>(null_stats.dropped_appends) /
+                                             static_cast<double>(std::max<uint64_t>(null_stats.appends, 1)))
+            .Add("hardware_threads", static_cast<double>(std::thread::hardware_concurrency()))
+            .Print();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,73 @@
+﻿#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/capture_file.h"
+#include "ble/clock.h"
+
+/**
+ * 写入 count 条通知记录再用内存映射读回，校验内容并统计读写吞吐
+ * @param payload_size
+ * @param count
+ */
+static bool RunCase(const std::string& path, std::size_t payload_size, uint64_t count) {
+    std::vector<uint8_t> payload(payload_size);
+    const ble::Guid uuid = {0x0000FFF1, 0x0000, 0x1000, {0x80, 0x00, 0x00, 0x80, 0x5F, 0x9B, 0x34, 0xFB}};
+
+    ble::CaptureWriter writer;
+    if (!writer.Open(path)) {
+        std::fprintf(stderr, "capture_file: cannot create %s\n", path.c_str());
+        return false;
+    }
+    writer.DefineCharacteristic(1, uuid);
+    uint64_t expected_sum = 0;
+    uint64_t start = ble::MonotonicNowNs();
+    for (uint64_t i = 0; i < count; ++i) {
+        payload[0] = static_cast<uint8_t>(i);
+        expected_sum += payload[0] + i;
+        writer.Append(i, 1, payload.data(), static_cast<uint16_t>(payload_size));
+    }
+    writer.Close();
+    uint64_t write_ns = ble::MonotonicNowNs() - start;
+    uint64_t file_bytes = writer.BytesWritten();
+
+    ble::CaptureReader reader;
+    start = ble::MonotonicNowNs();
+    if (!reader.Open(path)) {
+        std::fprintf(stderr, "capture_file: cannot open %s\n", path.c_str());
+        return false;
+    }
+    uint64_t sum = 0;
+    std::size_t records = reader.ForEach([&](const ble::CaptureRecord& record) {
+        sum += record.data[0] + record.timestamp_ns;
+    });
+    uint64_t read_ns = ble::MonotonicNowNs() - start;
+
+    ble::Guid found{};
+    bool ok = records == count && sum == expected_sum && !reader.Truncated() &&
+              reader.LookupCharacteristic(1, found) && found == uuid;
+    if (!ok) {
+        std::fprintf(stderr, "capture_file: round trip mismatch (%zu of %llu records)\n",
+                     records, static_cast<unsigned long long>(count));
+    }
+    std::remove(path.c_str());
+
+    bench::Report("capture_file", std::to_string(payload_size) + "B")
+            .Add("records", static_cast<double>(count))
+            .Add("file_mb", static_cast<double>(file_bytes) / 1e6)
+            .Add("write_records_per_s", static_cast<double>(count) * 1e9 / static_cast<double>(write_ns))
+            .Add("write_mb_per_s", static_cast<double>(file_bytes) * 1e3 / static_cast<double>(write_ns))
+            .Add("read_records_per_s", static_cast<double>(count) * 1e9 / static_cast<double>(read_ns))
+            .Add("read_mb_per_s", static_cast<double>(file_bytes) * 1e3 / static_cast<double>(read_ns))
+            .Print();
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    std::string path = argc > 1 ? argv[1] : "bench_capture.blecap";
+    bool ok = RunCase(path, 20, 2000000);
+    ok = RunCase(path, 244, 500000) && ok;
+    return ok ? 0 : 1;
+}
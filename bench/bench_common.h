@@ -0,0 +1,98 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ble/clock.h"
+
+namespace bench {
+
+/**
+ * 一条基准测试结果，输出为单行 JSON，方便脚本收集和跨版本对比
+ * 例如: {"bench":"spsc_ring","case":"20B","notifications_per_s":1.2e7}
+ */
+class Report {
+public:
+    Report(std::string bench, std::string name) {
+        fields_.emplace_back("bench", Quote(bench));
+        fields_.emplace_back("case", Quote(name));
+    }
+
+    Report& Add(const char* key, double value) {
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "%.6g", value);
+        fields_.emplace_back(key, buf);
+        return *this;
+    }
+
+    Report& Add(const char* key, const std::string& value) {
+        fields_.emplace_back(key, Quote(value));
+        return *this;
+    }
+
+    void Print() const {
+        std::string line = "{";
+        for (std::size_t i = 0; i < fields_.size(); ++i) {
+            if (i > 0) {
+                line += ",";
+            }
+            line += "\"" + fields_[i].first + "\":" + fields_[i].second;
+        }
+        line += "}\n";
+        std::fputs(line.c_str(), stdout);
+        std::fflush(stdout);
+    }
+
+private:
+    static std::string Quote(const std::string& s) { return "\"" + s + "\""; }
+
+    std::vector<std::pair<std::string, std::string>> fields_;
+};
+
+// 求百分位数（会对输入排序）
+inline uint64_t Percentile(std::vector<uint64_t>& values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    std::size_t index = static_cast<std::size_t>(p / 100.0 * static_cast<double>(values.size() - 1));
+    return values[index];
+}
+
+// 防止编译器把被测代码当成无用代码删掉
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+/**
+ * 重复执行 fn 直到累计时间超过 min_ns，返回每次调用的平均耗时（纳秒）
+ * @param fn
+ * @param min_ns
+ */
+template <typename Fn>
+inline double MeasureNsPerCall(Fn&& fn, uint64_t min_ns = 200000000) {
+    uint64_t iterations = 1;
+    for (;;) {
+        uint64_t start = ble::MonotonicNowNs();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            fn();
+        }
+        uint64_t elapsed = ble::MonotonicNowNs() - start;
+        if (elapsed >= min_ns) {
+            return static_cast<double>(elapsed) / static_cast<double>(iterations);
+        }
+        iterations *= 2;
+    }
+}
+
+}  // namespace bench
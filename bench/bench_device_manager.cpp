@@ -0,0 +1,104 @@
+﻿#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/clock.h"
+#include "ble/device_manager.h"
+#include "ble/sim_transport.h"
+
+/**
+ * 同时连接 devices 台同名的模拟 ECG-7，统计全部进入接收状态的耗时、
+ * 稳定后的总吞吐以及各设备的排队延迟
+ * @param devices
+ * @param rate_hz 每台设备的通知速率
+ * @param workers 解码线程数
+ * @return 有设备没连上或丢了数据时返回 false
+ */
+static bool RunCase(int devices, double rate_hz, std::size_t workers, double seconds) {
+    ble::SimulatedTransport transport({}, 1000.0);
+    for (int i = 0; i < devices; ++i) {
+        ble::SimDeviceConfig config;
+        config.address = 0xC0FFEE000000ull + static_cast<uint64_t>(i);
+        config.notification_rate_hz = rate_hz;
+        config.jitter_us = 200;
+        config.connect_latency_us = 20000;
+        config.request_latency_us = 2000;
+        transport.AddDevice(config);
+    }
+
+    ble::DeviceManagerOptions options;
+    options.targets.push_back({"ECG-7", 0});
+    options.worker_threads = workers;
+    std::atomic<uint64_t> sink_bytes(0);
+    ble::DeviceManager manager(transport, options, [&](std::size_t, const ble::NotificationSlot& slot) {
+        sink_bytes.fetch_add(slot.length, std::memory_order_relaxed);
+    });
+
+    uint64_t start = ble::MonotonicNowNs();
+    manager.Start();
+    while (manager.StreamingCount() < static_cast<std::size_t>(devices) &&
+           ble::MonotonicNowNs() - start < 10000000000ull) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    double all_streaming_ms = static_cast<double>(ble::MonotonicNowNs() - start) / 1e6;
+    std::size_t streaming = manager.StreamingCount();
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    std::vector<ble::DeviceStats> stats = manager.Stats();
+    manager.Stop();
+
+    double total_rate = 0.0;
+    double min_rate = 1e18;
+    double latency_avg = 0.0;
+    double latency_max = 0.0;
+    double connect_max = 0.0;
+    double discovery_max = 0.0;
+    uint64_t dropped = 0;
+    for (const auto& device : stats) {
+        total_rate += device.notifications_per_s;
+        min_rate = std::min(min_rate, device.notifications_per_s);
+        latency_avg += device.latency_avg_us;
+        latency_max = std::max(latency_max, device.latency_max_us);
+        connect_max = std::max(connect_max, device.connect_ms);
+        discovery_max = std::max(discovery_max, device.discovery.total_ms);
+        dropped += device.dropped;
+    }
+    if (!stats.empty()) {
+        latency_avg /= static_cast<double>(stats.size());
+    }
+
+    bench::Report("device_manager", std::to_string(devices) + "x" + std::to_string(static_cast<int>(rate_hz)) +
+                                            "Hz_w" + std::to_string(workers))
+            .Add("devices_streaming", static_cast<double>(streaming))
+            .Add("all_streaming_ms", all_streaming_ms)
+            .Add("connect_ms_max", connect_max)
+            .Add("discovery_ms_max", discovery_max)
+            .Add("target_notifications_per_s", devices * rate_hz)
+            .Add("notifications_per_s", total_rate)
+            .Add("min_device_notifications_per_s", min_rate)
+            .Add("latency_avg_us", latency_avg)
+            .Add("latency_max_us", latency_max)
+            .Add("dropped", static_cast<double>(dropped))
+            .Print();
+
+    if (streaming != static_cast<std::size_t>(devices) || dropped != 0) {
+        std::fprintf(stderr, "device_manager: %zu/%d devices streaming, %llu dropped\n", streaming, devices,
+                     static_cast<unsigned long long>(dropped));
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    bool ok = true;
+    ok &= RunCase(1, 250.0, 1, 1.0);
+    ok &= RunCase(8, 500.0, 2, 2.0);
+    ok &= RunCase(32, 500.0, 4, 2.0);
+    return ok ? 0 : 1;
+}
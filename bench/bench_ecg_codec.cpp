@@ -0,0 +1,309 @@
+﻿#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/capture_file.h"
+#include "ble/ecg_codec.h"
+#include "ble/synthetic_ecg.h"
+
+static const ble::UnpackPath kPaths[] = {ble::UnpackPath::Scalar, ble::UnpackPath::Ssse3, ble::UnpackPath::Avx2};
+
+/**
+ * 按导联分开存放的一段录音
+ */
+struct Recording {
+    std::string name;
+    std::size_t raw_sample_bytes;        // 设备上传时每个样本的字节数，用于计算压缩率
+    std::vector<std::vector<int32_t>> leads;
+
+    std::size_t Frames() const { return leads.empty() ? 0 : leads[0].size(); }
+};
+
+static Recording SyntheticRecording(std::string name, ble::SyntheticEcgOptions options, std::size_t frames,
+                                    std::size_t raw_sample_bytes) {
+    Recording recording{std::move(name), raw_sample_bytes,
+                        std::vector<std::vector<int32_t>>(options.leads, std::vector<int32_t>(frames))};
+    ble::SyntheticEcg ecg(options);
+    std::vector<int32_t*> out(options.leads);
+    for (std::size_t lead = 0; lead < options.leads; ++lead) {
+        out[lead] = recording.leads[lead].data();
+    }
+    ecg.Generate(out.data(), frames);
+    return recording;
+}
+
+// 最坏情况：整个 int32 范围的随机值，以及在最大、最小值之间来回跳变
+static Recording ExtremeRecording(std::size_t frames) {
+    Recording recording{"extreme", 4, std::vector<std::vector<int32_t>>(4, std::vector<int32_t>(frames))};
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    for (std::size_t i = 0; i < frames; ++i) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        recording.leads[0][i] = static_cast<int32_t>(state >> 32);
+        recording.leads[1][i] = i % 2 == 0 ? std::numeric_limits<int32_t>::min() : std::numeric_limits<int32_t>::max();
+        recording.leads[2][i] = -7;
+        recording.leads[3][i] = static_cast<int32_t>(i * i * 3) - 100000;
+    }
+    return recording;
+}
+
+/**
+ * 用流式编码器压缩整段录音，返回各块
+ */
+static std::vector<std::vector<uint8_t>> Compress(const Recording& recording, std::size_t chunk_frames) {
+    std::vector<std::vector<uint8_t>> blocks;
+    ble::EcgBlockEncoder encoder(recording.leads.size());
+    std::vector<const int32_t*> in(recording.leads.size());
+    auto collect = [&blocks](const uint8_t* data, std::size_t length) { blocks.emplace_back(data, data + length); };
+    for (std::size_t offset = 0; offset < recording.Frames(); offset += chunk_frames) {
+        for (std::size_t lead = 0; lead < in.size(); ++lead) {
+            in[lead] = recording.leads[lead].data() + offset;
+        }
+        encoder.Append(in.data(), std::min(chunk_frames, recording.Frames() - offset), collect);
+    }
+    encoder.Flush(collect);
+    return blocks;
+}
+
+/**
+ * 逐块解码，结果必须与原始样本逐个相同
+ */
+static bool Decompress(const Recording& recording, const std::vector<std::vector<uint8_t>>& blocks,
+                       ble::UnpackPath path) {
+    std::vector<std::vector<int32_t>> decoded(recording.leads.size(), std::vector<int32_t>(ble::kEcgBlockFrames));
+    std::vector<int32_t*> out(recording.leads.size());
+    for (std::size_t lead = 0; lead < out.size(); ++lead) {
+        out[lead] = decoded[lead].data();
+    }
+    std::size_t offset = 0;
+    for (const auto& block : blocks) {
+        std::size_t frames = ble::DecodeEcgBlock(block.data(), block.size(), out.data(), out.size(), path);
+        if (frames == 0 || offset + frames > recording.Frames()) {
+            return false;
+        }
+        for (std::size_t lead = 0; lead < out.size(); ++lead) {
+            if (!std::equal(decoded[lead].begin(), decoded[lead].begin() + frames,
+                            recording.leads[lead].begin() + offset)) {
+                return false;
+            }
+        }
+        offset += frames;
+    }
+    return offset == recording.Frames();
+}
+
+static std::size_t TotalBytes(const std::vector<std::vector<uint8_t>>& blocks) {
+    std::size_t bytes = 0;
+    for (const auto& block : blocks) {
+        bytes += block.size();
+    }
+    return bytes;
+}
+
+/**
+ * 无损：各种数据、按不同大小分块送入（包括不满一块的结尾），三种解码实现都必须原样还原；
+ * 截断或损坏的块必须被拒绝
+ */
+static bool CheckLossless(const std::vector<Recording>& recordings) {
+    for (const auto& recording : recordings) {
+        for (std::size_t chunk : {std::size_t{1}, std::size_t{3}, std::size_t{100}, std::size_t{1000}}) {
+            std::vector<std::vector<uint8_t>> blocks = Compress(recording, chunk);
+            for (ble::UnpackPath path : kPaths) {
+                if (!Decompress(recording, blocks, path)) {
+                    std::fprintf(stderr, "ecg_codec: %s chunk=%zu %s round trip differs\n", recording.name.c_str(),
+                                 chunk, ble::UnpackPathName(path));
+                    return false;
+                }
+            }
+        }
+    }
+
+    // 每种块长度 1~256 都试一遍
+    const Recording& extreme = recordings.back();
+    std::vector<uint8_t> block(ble::EcgBlockMaxBytes(extreme.leads.size()));
+    std::vector<int32_t> decoded(extreme.leads.size() * ble::kEcgBlockFrames);
+    std::vector<const int32_t*> in(extreme.leads.size());
+    std::vector<int32_t*> out(extreme.leads.size());
+    for (std::size_t lead = 0; lead < in.size(); ++lead) {
+        in[lead] = extreme.leads[lead].data();
+        out[lead] = decoded.data() + lead * ble::kEcgBlockFrames;
+    }
+    for (std::size_t frames = 1; frames <= ble::kEcgBlockFrames; ++frames) {
+        std::size_t bytes = ble::EncodeEcgBlock(in.data(), in.size(), frames, block.data());
+        if (bytes == 0 || bytes > ble::EcgBlockMaxBytes(in.size(), frames)) {
+            std::fprintf(stderr, "ecg_codec: %zu frames encoded to %zu bytes\n", frames, bytes);
+            return false;
+        }
+        for (ble::UnpackPath path : kPaths) {
+            if (ble::DecodeEcgBlock(block.data(), bytes, out.data(), out.size(), path) != frames) {
+                return false;
+            }
+            for (std::size_t lead = 0; lead < in.size(); ++lead) {
+                if (!std::equal(out[lead], out[lead] + frames, in[lead])) {
+                    std::fprintf(stderr, "ecg_codec: %zu-frame block lead %zu differs (%s)\n", frames, lead,
+                                 ble::UnpackPathName(path));
+                    return false;
+                }
+            }
+        }
+        if (ble::DecodeEcgBlock(block.data(), bytes - 1, out.data(), out.size()) != 0 ||
+            ble::DecodeEcgBlock(block.data(), bytes, out.data(), out.size() - 1) != 0) {
+            std::fprintf(stderr, "ecg_codec: truncated or mismatched block was accepted\n");
+            return false;
+        }
+    }
+    block[4] = 0x3F;   // 位宽 63
+    if (ble::DecodeEcgBlock(block.data(), block.size(), out.data(), out.size()) != 0) {
+        std::fprintf(stderr, "ecg_codec: invalid bit width was accepted\n");
+        return false;
+    }
+
+    // 恒定导联的位宽是 0，没有打包数据：块放在刚好等长的缓冲区里，解码不能越过末尾读取
+    std::vector<int32_t> flat(ble::kEcgBlockFrames, -1234);
+    const int32_t* flat_in = flat.data();
+    std::vector<int32_t> flat_out(ble::kEcgBlockFrames);
+    int32_t* flat_out_ptr = flat_out.data();
+    std::size_t flat_bytes = ble::EncodeEcgBlock(&flat_in, 1, flat.size(), block.data());
+    std::vector<uint8_t> exact(block.begin(), block.begin() + static_cast<std::ptrdiff_t>(flat_bytes));
+    for (ble::UnpackPath path : kPaths) {
+        if (flat_bytes == 0 || ble::DecodeEcgBlock(exact.data(), exact.size(), &flat_out_ptr, 1, path) != flat.size() ||
+            flat_out != flat) {
+            std::fprintf(stderr, "ecg_codec: constant lead round trip differs (%s)\n", ble::UnpackPathName(path));
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * 压缩率（相对设备上传的原始样本大小）以及编码、各解码实现的吞吐
+ */
+static bool RunThroughput(const Recording& recording, double min_ratio) {
+    std::vector<std::vector<uint8_t>> blocks = Compress(recording, ble::kEcgBlockFrames);
+    const double samples = static_cast<double>(recording.Frames() * recording.leads.size());
+    const double ratio = samples * static_cast<double>(recording.raw_sample_bytes) /
+                         static_cast<double>(TotalBytes(blocks));
+
+    const std::size_t leads = recording.leads.size();
+    std::vector<uint8_t> block(ble::EcgBlockMaxBytes(leads));
+    std::vector<const int32_t*> in(leads);
+    std::size_t offset = 0;
+    double encode_ns = bench::MeasureNsPerCall([&] {
+        for (std::size_t lead = 0; lead < leads; ++lead) {
+            in[lead] = recording.leads[lead].data() + offset;
+        }
+        bench::DoNotOptimize(ble::EncodeEcgBlock(in.data(), leads, ble::kEcgBlockFrames, block.data()));
+        offset += ble::kEcgBlockFrames;
+        if (offset + ble::kEcgBlockFrames > recording.Frames()) {
+            offset = 0;
+        }
+    });
+    const double block_samples = static_cast<double>(ble::kEcgBlockFrames * leads);
+
+    bench::Report report("ecg_codec", recording.name);
+    report.Add("leads", static_cast<double>(leads))
+            .Add("compression_ratio", ratio)
+            .Add("bits_per_sample", static_cast<double>(TotalBytes(blocks)) * 8.0 / samples)
+            .Add("encode_msamples_per_s", block_samples / encode_ns * 1e3);
+
+    std::vector<std::vector<int32_t>> decoded(leads, std::vector<int32_t>(ble::kEcgBlockFrames));
+    std::vector<int32_t*> out(leads);
+    for (std::size_t lead = 0; lead < leads; ++lead) {
+        out[lead] = decoded[lead].data();
+    }
+    double scalar_ns = 0.0;
+    for (ble::UnpackPath path : kPaths) {
+        if (!ble::UnpackPathSupported(path)) {
+            continue;
+        }
+        std::size_t index = 0;
+        double decode_ns = bench::MeasureNsPerCall([&] {
+            const auto& b = blocks[index];
+            bench::DoNotOptimize(ble::DecodeEcgBlock(b.data(), b.size(), out.data(), leads, path));
+            index = index + 2 < blocks.size() ? index + 1 : 0;   // 跳过最后一个不满的块
+        });
+        if (path == ble::UnpackPath::Scalar) {
+            scalar_ns = decode_ns;
+        }
+        std::string key = std::string("decode_") + ble::UnpackPathName(path) + "_msamples_per_s";
+        report.Add(key.c_str(), block_samples / decode_ns * 1e3);
+        if (path != ble::UnpackPath::Scalar) {
+            std::string speedup = std::string("decode_") + ble::UnpackPathName(path) + "_speedup";
+            report.Add(speedup.c_str(), scalar_ns / decode_ns);
+        }
+    }
+    report.Print();
+    if (ratio < min_ratio) {
+        std::fprintf(stderr, "ecg_codec: %s compressed only %.2fx (expected at least %.2fx)\n",
+                     recording.name.c_str(), ratio, min_ratio);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * 作为抓包文件的存储方式：块写成 kCaptureRecordEcgBlock 记录，读回后解码与原始样本相同
+ */
+static bool CheckCaptureFile(const Recording& recording, const std::string& path) {
+    std::vector<std::vector<uint8_t>> blocks = Compress(recording, 3);
+    {
+        ble::CaptureWriter writer;
+        if (!writer.Open(path)) {
+            std::fprintf(stderr, "ecg_codec: cannot create %s\n", path.c_str());
+            return false;
+        }
+        writer.DefineCharacteristic(0, ble::kEcg7DataUuid);
+        for (std::size_t i = 0; i < blocks.size(); ++i) {
+            writer.AppendEcgBlock(i, 0, blocks[i].data(), static_cast<uint16_t>(blocks[i].size()));
+        }
+    }
+    ble::CaptureReader reader;
+    std::vector<std::vector<uint8_t>> read;
+    if (reader.Open(path)) {
+        std::size_t offset = reader.Begin();
+        ble::CaptureRecord record;
+        while (reader.Next(offset, record, ble::kCaptureRecordEcgBlock)) {
+            read.emplace_back(record.data, record.data + record.length);
+        }
+    }
+    // 只认通知记录的读取方式看不到这些块
+    std::size_t notifications = reader.ForEach([](const ble::CaptureRecord&) {});
+    std::remove(path.c_str());
+    if (read != blocks || notifications != 0 || !Decompress(recording, read, ble::UnpackPath::Auto)) {
+        std::fprintf(stderr, "ecg_codec: blocks read back from the capture file differ\n");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::string path = argc > 1 ? argv[1] : "bench_ecg_codec.blecap";
+
+    // ECG-7：3 导联 250Hz 16 位；12 导联 500Hz 24 位放大的诊断级心电；两者各 5 分钟
+    ble::SyntheticEcgOptions ecg7;
+    std::vector<Recording> recordings;
+    recordings.push_back(SyntheticRecording("ecg7_3lead_250hz", ecg7, 250 * 300, 2));
+    ble::SyntheticEcgOptions diagnostic;
+    diagnostic.sample_rate_hz = 500.0;
+    diagnostic.leads = 12;
+    diagnostic.r_amplitude = 200000.0;
+    diagnostic.baseline_offset = 0.0;
+    diagnostic.wander_amplitude = 30000.0;
+    diagnostic.mains_amplitude = 2000.0;
+    diagnostic.noise_amplitude = 40.0;
+    recordings.push_back(SyntheticRecording("12lead_500hz_24bit", diagnostic, 500 * 300, 3));
+    recordings.push_back(ExtremeRecording(4096));
+
+    bool ok = CheckLossless(recordings);
+    ok = CheckCaptureFile(recordings[0], path) && ok;
+    ok = RunThroughput(recordings[0], 1.5) && ok;
+    ok = RunThroughput(recordings[1], 1.5) && ok;
+    ok = RunThroughput(recordings[2], 0.0) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,196 @@
+﻿#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/ecg_decoder.h"
+
+static const ble::SampleEncoding kEncodings[] = {ble::SampleEncoding::Int16LE, ble::SampleEncoding::Int16BE,
+                                                 ble::SampleEncoding::Int24LE, ble::SampleEncoding::Int24BE};
+static const ble::UnpackPath kPaths[] = {ble::UnpackPath::Scalar, ble::UnpackPath::Ssse3, ble::UnpackPath::Avx2};
+
+/**
+ * 与实现无关的参考解码：按字节序拼出无符号值，再减去 2^bits 得到负数
+ */
+static int32_t ReferenceSample(const uint8_t* p, ble::SampleEncoding encoding) {
+    const std::size_t bytes = ble::SampleBytes(encoding);
+    const bool big = encoding == ble::SampleEncoding::Int16BE || encoding == ble::SampleEncoding::Int24BE;
+    int64_t value = 0;
+    for (std::size_t b = 0; b < bytes; ++b) {
+        value = value * 256 + p[big ? b : bytes - 1 - b];
+    }
+    const int64_t range = int64_t(1) << (bytes * 8);
+    return static_cast<int32_t>(value >= range / 2 ? value - range : value);
+}
+
+static std::vector<uint8_t> RandomBytes(std::size_t length, uint64_t seed) {
+    std::vector<uint8_t> bytes(length);
+    for (auto& b : bytes) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        b = static_cast<uint8_t>(seed >> 24);
+    }
+    return bytes;
+}
+
+// 边界值：最大、最小、-1、0 以及字节顺序可区分的值
+static bool CheckKnownValues() {
+    struct Case {
+        ble::SampleEncoding encoding;
+        std::vector<uint8_t> bytes;
+        int32_t expected;
+    };
+    const Case cases[] = {
+            {ble::SampleEncoding::Int16LE, {0x34, 0x12}, 0x1234},
+            {ble::SampleEncoding::Int16LE, {0xFF, 0x7F}, 32767},
+            {ble::SampleEncoding::Int16LE, {0x00, 0x80}, -32768},
+            {ble::SampleEncoding::Int16LE, {0xFF, 0xFF}, -1},
+            {ble::SampleEncoding::Int16BE, {0x12, 0x34}, 0x1234},
+            {ble::SampleEncoding::Int16BE, {0x80, 0x00}, -32768},
+            {ble::SampleEncoding::Int16BE, {0xFF, 0xFE}, -2},
+            {ble::SampleEncoding::Int24LE, {0x56, 0x34, 0x12}, 0x123456},
+            {ble::SampleEncoding::Int24LE, {0xFF, 0xFF, 0x7F}, 8388607},
+            {ble::SampleEncoding::Int24LE, {0x00, 0x00, 0x80}, -8388608},
+            {ble::SampleEncoding::Int24BE, {0x12, 0x34, 0x56}, 0x123456},
+            {ble::SampleEncoding::Int24BE, {0xFF, 0xFF, 0xFF}, -1},
+            {ble::SampleEncoding::Int24BE, {0x80, 0x00, 0x01}, -8388607},
+    };
+    for (const auto& c : cases) {
+        // 重复 40 次，SIMD 路径的主循环也会处理到
+        std::vector<uint8_t> src;
+        for (int r = 0; r < 40; ++r) {
+            src.insert(src.end(), c.bytes.begin(), c.bytes.end());
+        }
+        for (ble::UnpackPath path : kPaths) {
+            std::vector<int32_t> dst(40, 0);
+            ble::UnpackSamples(src.data(), 40, c.encoding, dst.data(), path);
+            for (int32_t value : dst) {
+                if (value != c.expected) {
+                    std::fprintf(stderr, "ecg_decoder: %s/%s decoded %d, expected %d\n",
+                                 ble::SampleEncodingName(c.encoding), ble::UnpackPathName(path), value, c.expected);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// 随机数据、各种长度（覆盖 SIMD 主循环和标量尾部），所有实现都与参考解码逐个样本一致，且不写越界
+static bool CheckRandom() {
+    for (ble::SampleEncoding encoding : kEncodings) {
+        const std::size_t bytes = ble::SampleBytes(encoding);
+        for (std::size_t count = 0; count <= 100; ++count) {
+            std::vector<uint8_t> src = RandomBytes(count * bytes, count * 7919 + bytes);
+            for (ble::UnpackPath path : kPaths) {
+                std::vector<int32_t> dst(count + 1, 0x5A5A5A5A);
+                ble::UnpackSamples(src.data(), count, encoding, dst.data(), path);
+                for (std::size_t i = 0; i < count; ++i) {
+                    if (dst[i] != ReferenceSample(src.data() + i * bytes, encoding)) {
+                        std::fprintf(stderr, "ecg_decoder: %s/%s mismatch at sample %zu of %zu\n",
+                                     ble::SampleEncodingName(encoding), ble::UnpackPathName(path), i, count);
+                        return false;
+                    }
+                }
+                if (dst[count] != 0x5A5A5A5A) {
+                    std::fprintf(stderr, "ecg_decoder: %s/%s wrote past %zu samples\n",
+                                 ble::SampleEncodingName(encoding), ble::UnpackPathName(path), count);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// 解码器把交织的帧正确分到各导联，非整帧和缓冲区满时按约定计数
+static bool CheckDecoder() {
+    for (ble::SampleEncoding encoding : kEncodings) {
+        ble::EcgFormat format;
+        format.leads = 3;
+        format.encoding = encoding;
+        const std::size_t frames = 26;
+        std::vector<uint8_t> payload = RandomBytes(format.header_bytes + frames * format.FrameBytes() + 1, 42);
+
+        ble::EcgDecoder decoder(format);
+        ble::EcgLeadBuffer out(format.leads, 40);
+        std::size_t first = decoder.Decode(payload.data(), payload.size(), out);
+        std::size_t second = decoder.Decode(payload.data(), payload.size(), out);
+        bool ok = first == frames && second == 14 && out.Size() == 40 && decoder.Malformed() == 2 &&
+                  decoder.Overflow() == 12;
+        for (std::size_t f = 0; ok && f < out.Size(); ++f) {
+            for (std::size_t l = 0; l < format.leads; ++l) {
+                const uint8_t* sample = payload.data() + format.header_bytes +
+                                        (f % frames) * format.FrameBytes() + l * ble::SampleBytes(encoding);
+                ok &= out.Lead(l)[f] == ReferenceSample(sample, encoding);
+            }
+        }
+        if (!ok) {
+            std::fprintf(stderr, "ecg_decoder: decoder check failed for %s\n", ble::SampleEncodingName(encoding));
+            return false;
+        }
+    }
+    return true;
+}
+
+static void RunUnpackCase(ble::SampleEncoding encoding, ble::UnpackPath path, std::size_t count) {
+    std::vector<uint8_t> src = RandomBytes(count * ble::SampleBytes(encoding), 7);
+    std::vector<int32_t> dst(count);
+    double ns = bench::MeasureNsPerCall([&] {
+        ble::UnpackSamples(src.data(), count, encoding, dst.data(), path);
+        bench::DoNotOptimize(dst.data());
+    });
+    bench::Report("ecg_decoder", std::string("unpack_") + ble::SampleEncodingName(encoding) + "_" +
+                                         ble::UnpackPathName(path))
+            .Add("samples", static_cast<double>(count))
+            .Add("ns_per_call", ns)
+            .Add("msamples_per_s", static_cast<double>(count) / ns * 1e3)
+            .Print();
+}
+
+/**
+ * 按真实的通知粒度解码：每次一个载荷，输出写满后清空
+ */
+static void RunDecoderCase(ble::SampleEncoding encoding, std::size_t payload_size, ble::UnpackPath path) {
+    ble::EcgFormat format;
+    format.encoding = encoding;
+    std::vector<uint8_t> payload = RandomBytes(payload_size, 11);
+    const std::size_t frames = (payload_size - format.header_bytes) / format.FrameBytes();
+    ble::EcgDecoder decoder(format, path);
+    ble::EcgLeadBuffer out(format.leads, 4096);
+    double ns = bench::MeasureNsPerCall([&] {
+        if (out.Available() < frames) {
+            out.Clear();
+        }
+        bench::DoNotOptimize(decoder.Decode(payload.data(), payload.size(), out));
+    });
+    bench::Report("ecg_decoder", std::string("decode_") + ble::SampleEncodingName(encoding) + "_" +
+                                         std::to_string(payload_size) + "B_" + ble::UnpackPathName(path))
+            .Add("samples_per_payload", static_cast<double>(frames * format.leads))
+            .Add("ns_per_payload", ns)
+            .Add("msamples_per_s", static_cast<double>(frames * format.leads) / ns * 1e3)
+            .Print();
+}
+
+int main() {
+    if (!CheckKnownValues() || !CheckRandom() || !CheckDecoder()) {
+        return 1;
+    }
+    for (ble::SampleEncoding encoding : kEncodings) {
+        for (ble::UnpackPath path : kPaths) {
+            if (ble::UnpackPathSupported(path)) {
+                RunUnpackCase(encoding, path, 4096);
+            }
+        }
+    }
+    // 20 字节是 ECG-7 的默认载荷，244 字节是 BLE 4.2+ 单个通知的上限
+    for (std::size_t payload_size : {std::size_t(20), std::size_t(244)}) {
+        for (ble::SampleEncoding encoding : {ble::SampleEncoding::Int16LE, ble::SampleEncoding::Int24BE}) {
+            RunDecoderCase(encoding, payload_size, ble::UnpackPath::Scalar);
+            RunDecoderCase(encoding, payload_size, ble::UnpackPath::Auto);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,204 @@
+﻿#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/ecg_filter.h"
+#include "ble/synthetic_ecg.h"
+
+constexpr double kPi = 3.14159265358979323846;
+
+/**
+ * 按导联分开存放的测试数据
+ */
+struct LeadData {
+    std::vector<std::vector<int32_t>> input;
+    std::vector<std::vector<float>> output;
+    std::vector<const int32_t*> in;
+    std::vector<float*> out;
+
+    LeadData(std::size_t leads, std::size_t frames)
+        : input(leads, std::vector<int32_t>(frames)), output(leads, std::vector<float>(frames)) {
+        for (std::size_t l = 0; l < leads; ++l) {
+            in.push_back(input[l].data());
+            out.push_back(output[l].data());
+        }
+    }
+
+    // 从第 offset 帧开始的指针
+    std::vector<const int32_t*> In(std::size_t offset) const {
+        std::vector<const int32_t*> p;
+        for (const auto& lead : input) {
+            p.push_back(lead.data() + offset);
+        }
+        return p;
+    }
+    std::vector<float*> Out(std::size_t offset) {
+        std::vector<float*> p;
+        for (auto& lead : output) {
+            p.push_back(lead.data() + offset);
+        }
+        return p;
+    }
+};
+
+// 双精度、逐导联的参考实现（直接 I 型）
+static std::vector<double> ReferenceFilter(const std::vector<int32_t>& input,
+                                           const std::vector<ble::BiquadCoefficients>& sections) {
+    std::vector<double> x(input.begin(), input.end());
+    for (const auto& c : sections) {
+        double x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+        for (auto& v : x) {
+            double y = c.b0 * v + c.b1 * x1 + c.b2 * x2 - c.a1 * y1 - c.a2 * y2;
+            x2 = x1;
+            x1 = v;
+            y2 = y1;
+            y1 = y;
+            v = y;
+        }
+    }
+    return x;
+}
+
+// 正弦输入稳定后的输出幅度与输入幅度之比（dB）
+static double GainDb(const ble::EcgFilterConfig& config, double frequency_hz) {
+    const std::size_t frames = static_cast<std::size_t>(config.sample_rate_hz * 20);
+    LeadData data(1, frames);
+    for (std::size_t i = 0; i < frames; ++i) {
+        data.input[0][i] = static_cast<int32_t>(std::lround(
+                10000.0 * std::sin(2.0 * kPi * frequency_hz * static_cast<double>(i) / config.sample_rate_hz)));
+    }
+    ble::EcgFilter filter(1, config);
+    filter.Process(data.in.data(), data.out.data(), frames);
+    float peak = 0.0f;
+    for (std::size_t i = frames / 2; i < frames; ++i) {
+        peak = std::max(peak, std::fabs(data.output[0][i]));
+    }
+    return 20.0 * std::log10(peak / 10000.0);
+}
+
+/**
+ * 正确性：
+ * 与双精度参考实现一致；按通知大小分块处理与整块处理逐位相同（状态跨调用保留）；
+ * 通带增益接近 0dB，工频被充分衰减，直流偏置被去掉
+ */
+static bool CheckFilter() {
+    ble::EcgFilterConfig config;
+    const std::size_t leads = 5;
+    const std::size_t frames = 250 * 30;
+    LeadData whole(leads, frames);
+    ble::SyntheticEcgOptions options;
+    options.leads = leads;
+    ble::SyntheticEcg ecg(options);
+    std::vector<int32_t*> generate;
+    for (auto& lead : whole.input) {
+        generate.push_back(lead.data());
+    }
+    ecg.Generate(generate.data(), frames);
+
+    ble::EcgFilter filter(leads, config);
+    filter.Process(whole.in.data(), whole.out.data(), frames);
+
+    LeadData chunked = whole;
+    ble::EcgFilter chunk_filter(leads, config);
+    for (std::size_t offset = 0; offset < frames; offset += 3) {
+        std::size_t n = std::min<std::size_t>(3, frames - offset);
+        auto in = chunked.In(offset);
+        auto out = chunked.Out(offset);
+        chunk_filter.Process(in.data(), out.data(), n);
+    }
+
+    for (std::size_t l = 0; l < leads; ++l) {
+        std::vector<double> reference = ReferenceFilter(whole.input[l], config.Sections());
+        double max_error = 0.0;
+        double mean_tail = 0.0;
+        for (std::size_t i = 0; i < frames; ++i) {
+            max_error = std::max(max_error, std::fabs(reference[i] - whole.output[l][i]));
+            if (whole.output[l][i] != chunked.output[l][i]) {
+                std::fprintf(stderr, "ecg_filter: chunked output differs at lead %zu frame %zu\n", l, i);
+                return false;
+            }
+            if (i >= frames - 2500) {
+                mean_tail += whole.output[l][i] / 2500.0;
+            }
+        }
+        // float 状态与 double 参考的误差相对 R 波幅度（约 1000）应当很小
+        if (max_error > 1.0 || std::fabs(mean_tail) > 20.0) {
+            std::fprintf(stderr, "ecg_filter: lead %zu max error %.3f, residual mean %.1f\n", l, max_error,
+                         mean_tail);
+            return false;
+        }
+    }
+
+    double pass = GainDb(config, 10.0);
+    double notch = GainDb(config, 50.0);
+    double stop = GainDb(config, 100.0);
+    bench::Report("ecg_filter", "response_250Hz")
+            .Add("gain_10hz_db", pass)
+            .Add("gain_50hz_db", notch)
+            .Add("gain_100hz_db", stop)
+            .Print();
+    if (std::fabs(pass) > 1.0 || notch > -30.0 || stop > -12.0) {
+        std::fprintf(stderr, "ecg_filter: unexpected frequency response\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * 吞吐：跨导联向量化的实现与逐导联的双精度直接实现对比，
+ * 并测量处理一个通知（3 帧）的耗时
+ */
+static void RunCase(std::size_t leads) {
+    ble::EcgFilterConfig config;
+    const std::size_t frames = 4096;
+    LeadData data(leads, frames);
+    ble::SyntheticEcgOptions options;
+    options.leads = leads;
+    ble::SyntheticEcg ecg(options);
+    std::vector<int32_t*> generate;
+    for (auto& lead : data.input) {
+        generate.push_back(lead.data());
+    }
+    ecg.Generate(generate.data(), frames);
+
+    ble::EcgFilter filter(leads, config);
+    double block_ns = bench::MeasureNsPerCall([&] {
+        filter.Process(data.in.data(), data.out.data(), frames);
+        bench::DoNotOptimize(data.output[0][frames - 1]);
+    });
+    double notification_ns = bench::MeasureNsPerCall([&] {
+        filter.Process(data.in.data(), data.out.data(), 3);
+        bench::DoNotOptimize(data.output[0][2]);
+    });
+
+    const auto sections = config.Sections();
+    double per_lead_ns = bench::MeasureNsPerCall([&] {
+        for (std::size_t l = 0; l < leads; ++l) {
+            std::vector<double> y = ReferenceFilter(data.input[l], sections);
+            bench::DoNotOptimize(y.data());
+        }
+    });
+
+    const double samples = static_cast<double>(frames * leads);
+    bench::Report("ecg_filter", std::to_string(leads) + "leads_" + std::to_string(sections.size()) + "sections")
+            .Add("msamples_per_s", samples / block_ns * 1e3)
+            .Add("per_lead_msamples_per_s", samples / per_lead_ns * 1e3)
+            .Add("speedup", per_lead_ns / block_ns)
+            .Add("ns_per_notification", notification_ns)
+            .Add("realtime_streams_250hz", static_cast<double>(frames) / block_ns * 1e9 / 250.0)
+            .Print();
+}
+
+int main() {
+    if (!CheckFilter()) {
+        return 1;
+    }
+    for (std::size_t leads : {1, 3, 8, 12}) {
+        RunCase(leads);
+    }
+    return 0;
+}
@@ -0,0 +1,121 @@
+﻿#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#include "bench/bench_common.h"
+#include "ble/format.h"
+
+namespace {
+
+// 原来基于 wstringstream 的实现，作为对比基线
+std::wstring LegacyFormatBluetoothAddress(uint64_t address) {
+    std::wstringstream ss;
+    ss << std::hex << std::setfill(L'0');
+    for (int i = 5; i >= 0; i--) {
+        ss << std::setw(2) << ((address >> (i * 8)) & 0xFF);
+        if (i > 0) {
+            ss << L":";
+        }
+    }
+    return ss.str();
+}
+
+std::wstring LegacyGuidToString(const ble::Guid& g) {
+    std::wostringstream oss;
+    oss << std::hex << std::uppercase
+        << g.Data1 << L"-" << g.Data2 << L"-" << g.Data3 << L"-"
+        << static_cast<int>(g.Data4[0]) << static_cast<int>(g.Data4[1]) << L"-"
+        << static_cast<int>(g.Data4[2]) << static_cast<int>(g.Data4[3])
+        << static_cast<int>(g.Data4[4]) << static_cast<int>(g.Data4[5])
+        << static_cast<int>(g.Data4[6]) << static_cast<int>(g.Data4[7]);
+    return oss.str();
+}
+
+constexpr ble::Guid kFff1 = {0x0000FFF1, 0x0000, 0x1000, {0x80, 0x00, 0x00, 0x80, 0x5F, 0x9B, 0x34, 0xFB}};
+
+// 编译期就能检查格式化结果
+static_assert(ble::FormatBluetoothAddress(0xC0FFEE000007ull)[16] == '7', "MAC formatting");
+static_assert(ble::GuidToString(kFff1)[0] == '0' && ble::GuidToString(kFff1)[7] == '1', "GUID keeps leading zeros");
+
+// 格式化后再解析必须得到原值
+bool CheckRoundTrip() {
+    uint64_t address = 0x0123456789ABull;
+    for (int i = 0; i < 1000; ++i, address = (address * 6364136223846793005ull + 1) & 0xFFFFFFFFFFFFull) {
+        uint64_t parsed = 0;
+        if (!ble::ParseBluetoothAddress(ble::FormatBluetoothAddress(address).data(), parsed) || parsed != address) {
+            std::fprintf(stderr, "format: MAC round trip failed\n");
+            return false;
+        }
+        ble::Guid g = kFff1;
+        g.Data1 = static_cast<uint32_t>(address);
+        g.Data2 = static_cast<uint16_t>(address >> 32);
+        g.Data4[7] = static_cast<uint8_t>(i);
+        ble::Guid parsed_guid{};
+        if (!ble::ParseGuid(ble::GuidToString(g).data(), parsed_guid) || parsed_guid != g) {
+            std::fprintf(stderr, "format: GUID round trip failed\n");
+            return false;
+        }
+    }
+    return std::strcmp(ble::GuidToString(kFff1).data(), "0000FFF1-0000-1000-8000-00805F9B34FB") == 0;
+}
+
+}  // namespace
+
+int main() {
+    if (!CheckRoundTrip()) {
+        return 1;
+    }
+
+    uint64_t address = 0xC0FFEE000007ull;
+    double legacy_mac_ns = bench::MeasureNsPerCall([&] {
+        std::wstring s = LegacyFormatBluetoothAddress(address++);
+        bench::DoNotOptimize(s);
+    });
+    double mac_ns = bench::MeasureNsPerCall([&] {
+        ble::MacString s = ble::FormatBluetoothAddress(address++);
+        bench::DoNotOptimize(s);
+    });
+    bench::Report("format", "FormatBluetoothAddress")
+            .Add("legacy_ns_per_call", legacy_mac_ns)
+            .Add("ns_per_call", mac_ns)
+            .Add("speedup", legacy_mac_ns / mac_ns)
+            .Print();
+
+    ble::Guid uuid = kFff1;
+    double legacy_guid_ns = bench::MeasureNsPerCall([&] {
+        std::wstring s = LegacyGuidToString(uuid);
+        bench::DoNotOptimize(s);
+        ++uuid.Data1;
+    });
+    double guid_ns = bench::MeasureNsPerCall([&] {
+        ble::GuidString s = ble::GuidToString(uuid);
+        bench::DoNotOptimize(s);
+        ++uuid.Data1;
+    });
+    bench::Report("format", "GuidToString")
+            .Add("legacy_ns_per_call", legacy_guid_ns)
+            .Add("ns_per_call", guid_ns)
+            .Add("speedup", legacy_guid_ns / guid_ns)
+            .Print();
+
+    const ble::MacString mac_text = ble::FormatBluetoothAddress(0xC0FFEE000007ull);
+    double parse_mac_ns = bench::MeasureNsPerCall([&] {
+        uint64_t parsed = 0;
+        bench::DoNotOptimize(ble::ParseBluetoothAddress(std::string_view(mac_text.data(), 17), parsed));
+        bench::DoNotOptimize(parsed);
+    });
+    const ble::GuidString guid_text = ble::GuidToString(kFff1);
+    double parse_guid_ns = bench::MeasureNsPerCall([&] {
+        ble::Guid parsed{};
+        bench::DoNotOptimize(ble::ParseGuid(std::string_view(guid_text.data(), 36), parsed));
+        bench::DoNotOptimize(parsed);
+    });
+    bench::Report("format", "parse")
+            .Add("ParseBluetoothAddress_ns", parse_mac_ns)
+            .Add("ParseGuid_ns", parse_guid_ns)
+            .Print();
+    return 0;
+}
@@ -0,0 +1,251 @@
+﻿#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/clock.h"
+#include "ble/device_manager.h"
+#include "ble/gatt_cache.h"
+#include "ble/sim_transport.h"
+
+static constexpr uint64_t kAddress = 0xC0FFEE000011;
+
+/**
+ * ECG-7 的服务布局后面再加几个各带一个可读特性的服务，接近真实设备的服务数
+ * @param extra
+ */
+static std::vector<ble::SimServiceSpec> ServicesWithExtra(int extra) {
+    std::vector<ble::SimServiceSpec> services = ble::Ecg7Services();
+    for (int i = 0; i < extra; ++i) {
+        ble::SimServiceSpec service;
+        service.uuid = ble::ShortUuid(static_cast<uint16_t>(0xA000 + i));
+        service.characteristics.push_back({ble::ShortUuid(static_cast<uint16_t>(0xB000 + i)), ble::kPropertyRead});
+        services.push_back(service);
+    }
+    return services;
+}
+
+struct SessionResult {
+    bool streaming = false;
+    ble::DeviceStats stats;
+    uint64_t requests = 0;
+};
+
+/**
+ * 连接一台模拟设备直到收到第一个通知
+ * @param config
+ * @param cache 为空时不使用缓存
+ * @param validate 使用缓存前是否先核对服务列表
+ */
+static SessionResult RunSession(const ble::SimDeviceConfig& config, std::shared_ptr<ble::GattCache> cache,
+                                bool validate) {
+    ble::SimulatedTransport transport({config}, 1000.0);
+    ble::DeviceManagerOptions options;
+    options.targets.push_back({"", config.address});
+    options.worker_threads = 1;
+    options.gatt_cache = std::move(cache);
+    options.gatt_cache_validate = validate;
+    ble::DeviceManager manager(transport, options, [](std::size_t, const ble::NotificationSlot&) {});
+
+    SessionResult result;
+    const uint64_t start = ble::MonotonicNowNs();
+    manager.Start();
+    while (ble::MonotonicNowNs() - start < 10000000000ull) {
+        std::vector<ble::DeviceStats> stats = manager.Stats();
+        if (!stats.empty() && (stats[0].first_notification_ms > 0.0 || stats[0].state == ble::DeviceState::Failed)) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::vector<ble::DeviceStats> stats = manager.Stats();
+    manager.Stop();
+    if (!stats.empty()) {
+        result.stats = stats[0];
+        result.streaming = stats[0].first_notification_ms > 0.0;
+    }
+    result.requests = transport.RequestCount();
+    return result;
+}
+
+static void Print(const std::string& name, const SessionResult& session) {
+    bench::Report("gatt_cache", name)
+            .Add("cache_hit", session.stats.gatt_cache_hit ? 1.0 : 0.0)
+            .Add("gatt_requests", static_cast<double>(session.requests))
+            .Add("discovery_ms", session.stats.discovery.total_ms)
+            .Add("subscribe_ms", session.stats.subscribe_ms)
+            .Add("connect_ms", session.stats.connect_ms)
+            .Add("first_notification_ms", session.stats.first_notification_ms)
+            .Print();
+}
+
+/**
+ * 同一台设备先不带缓存连接一次，再分别用核对服务列表和直接信任缓存的方式重连，
+ * 比较从发现广播到收到第一个通知的时间
+ * @param path 缓存文件，每次重连都重新打开，验证缓存确实来自磁盘
+ * @param latency_us 每个 GATT 请求的耗时
+ * @param check_timing 延迟足够大、计时差别明显时才检查快慢
+ */
+static bool RunCase(const std::string& path, uint32_t latency_us, int extra_services, bool check_timing) {
+    std::remove(path.c_str());
+    ble::SimDeviceConfig config;
+    config.address = kAddress;
+    config.services = ServicesWithExtra(extra_services);
+    config.connect_latency_us = 20000;
+    config.request_latency_us = latency_us;
+    const std::string prefix = std::to_string(config.services.size()) + "svc_" + std::to_string(latency_us) + "us_";
+
+    SessionResult uncached = RunSession(config, nullptr, true);
+    Print(prefix + "no_cache", uncached);
+
+    auto cold_cache = std::make_shared<ble::GattCache>();
+    cold_cache->Open(path);
+    SessionResult cold = RunSession(config, cold_cache, true);
+    Print(prefix + "cold", cold);
+
+    auto validated_cache = std::make_shared<ble::GattCache>();
+    bool loaded = validated_cache->Open(path);
+    SessionResult validated = RunSession(config, validated_cache, true);
+    Print(prefix + "cached_validated", validated);
+
+    auto trusted_cache = std::make_shared<ble::GattCache>();
+    trusted_cache->Open(path);
+    SessionResult trusted = RunSession(config, trusted_cache, false);
+    Print(prefix + "cached_trusted", trusted);
+    std::remove(path.c_str());
+
+    bool ok = uncached.streaming && cold.streaming && validated.streaming && trusted.streaming && loaded &&
+              !cold.stats.gatt_cache_hit && validated.stats.gatt_cache_hit && trusted.stats.gatt_cache_hit;
+    // 完整发现：服务 1 次 + 每个服务 1 次 + CCCD；核对：服务 1 次 + CCCD；信任：只有 CCCD
+    const uint64_t services = config.services.size();
+    ok &= cold.requests == services + 2 && validated.requests == 2 && trusted.requests == 1;
+    if (check_timing) {
+        ok &= validated.stats.first_notification_ms < uncached.stats.first_notification_ms &&
+              trusted.stats.first_notification_ms < validated.stats.first_notification_ms;
+    }
+    if (!ok) {
+        std::fprintf(stderr, "gatt_cache: unexpected result for %u us latency\n", latency_us);
+    }
+    return ok;
+}
+
+/**
+ * 设备固件更新后布局变了：核对服务列表时在订阅前发现，直接信任缓存时订阅失败后发现，
+ * 两种情况都要作废缓存、完整发现后照常接收，并把新布局写回缓存
+ */
+static bool CheckStaleLayout(const std::string& path) {
+    bool ok = true;
+    for (bool validate : {true, false}) {
+        std::remove(path.c_str());
+        ble::SimDeviceConfig old_firmware;
+        old_firmware.address = kAddress;
+        old_firmware.request_latency_us = 2000;
+        auto cache = std::make_shared<ble::GattCache>();
+        cache->Open(path);
+        ok &= RunSession(old_firmware, cache, validate).streaming;
+
+        // 核对服务列表的情况：多出一个服务，句柄全部后移。
+        // 信任缓存的情况：句柄不变，但数据特性从通知改成了指示，按缓存写 CCCD 会失败
+        ble::SimDeviceConfig new_firmware = old_firmware;
+        if (validate) {
+            new_firmware.services = ServicesWithExtra(1);
+            std::swap(new_firmware.services[2], new_firmware.services[3]);
+        } else {
+            new_firmware.services[2].characteristics[0].properties = ble::kPropertyRead | ble::kPropertyIndicate;
+        }
+        SessionResult updated = RunSession(new_firmware, cache, validate);
+        ble::GattCacheStats stats = cache->Stats();
+        Print(std::string("stale_layout_") + (validate ? "validated" : "trusted"), updated);
+
+        auto reopened = std::make_shared<ble::GattCache>();
+        ble::DiscoveryResult layout;
+        bool stored = reopened->Open(path) && reopened->Lookup(kAddress, layout) &&
+                      layout.services.size() == new_firmware.services.size();
+        SessionResult again = RunSession(new_firmware, reopened, validate);
+        ok &= updated.streaming && !updated.stats.gatt_cache_hit && stats.hits == 1 && stats.invalidations == 1 &&
+              stored && again.streaming && again.stats.gatt_cache_hit;
+        if (!ok) {
+            std::fprintf(stderr, "gatt_cache: stale layout not recovered (validate=%d)\n", validate ? 1 : 0);
+        }
+    }
+    std::remove(path.c_str());
+    return ok;
+}
+
+// 损坏或截断的缓存文件必须当作空缓存，而不是读出错误的句柄
+static bool CheckCorruptFile(const std::string& path) {
+    std::remove(path.c_str());
+    ble::GattCache cache;
+    cache.Open(path);
+    ble::DiscoveryResult discovery;
+    discovery.status = ble::GattStatus::Success;
+    for (uint16_t d = 0; d < 3; ++d) {
+        discovery.services.clear();
+        for (uint16_t s = 0; s < 4; ++s) {
+            ble::DiscoveredService service;
+            service.service.uuid = ble::ShortUuid(static_cast<uint16_t>(0x1800 + s));
+            service.service.handle = static_cast<uint16_t>(1 + s * 10);
+            service.status = ble::GattStatus::Success;
+            ble::GattCharacteristicInfo characteristic;
+            characteristic.uuid = ble::ShortUuid(static_cast<uint16_t>(0x2A00 + s));
+            characteristic.handle = static_cast<uint16_t>(service.service.handle + 2);
+            characteristic.properties = ble::kPropertyNotify | d;
+            service.characteristics.push_back(characteristic);
+            discovery.services.push_back(service);
+        }
+        cache.Store(kAddress + d, discovery);
+    }
+
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    std::vector<uint8_t> data;
+    if (file != nullptr) {
+        int c;
+        while ((c = std::fgetc(file)) != EOF) {
+            data.push_back(static_cast<uint8_t>(c));
+        }
+        std::fclose(file);
+    }
+    auto write = [&](const std::vector<uint8_t>& bytes) {
+        std::FILE* out = std::fopen(path.c_str(), "wb");
+        std::fwrite(bytes.data(), 1, bytes.size(), out);
+        std::fclose(out);
+    };
+
+    bool ok = data.size() > 24;
+    ble::GattCache reopened;
+    ble::DiscoveryResult layout;
+    ok &= reopened.Open(path) && reopened.Stats().entries == 3 && reopened.Lookup(kAddress + 2, layout) &&
+          layout.services.size() == 4 && layout.services[3].characteristics.size() == 1 &&
+          layout.services[3].characteristics[0].properties == (ble::kPropertyNotify | 2u) &&
+          layout.services[3].characteristics[0].service_handle == 31;
+    for (std::size_t offset : {std::size_t(3), std::size_t(30), data.size() - 1}) {
+        std::vector<uint8_t> corrupt = data;
+        corrupt[offset] ^= 0x40;
+        write(corrupt);
+        ble::GattCache damaged;
+        ok &= !damaged.Open(path) && damaged.Stats().entries == 0;
+    }
+    std::vector<uint8_t> truncated(data.begin(), data.end() - 5);
+    write(truncated);
+    ble::GattCache damaged;
+    ok &= !damaged.Open(path) && !damaged.Lookup(kAddress, layout);
+    std::remove(path.c_str());
+    if (!ok) {
+        std::fprintf(stderr, "gatt_cache: corrupt file not rejected\n");
+    }
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    std::string path = argc > 1 ? argv[1] : "bench_gatt_cache.bin";
+    bool ok = CheckCorruptFile(path);
+    // 7.5ms 和 30ms 分别对应常见的最小和默认连接间隔
+    ok = RunCase(path, 7500, 3, false) && ok;
+    ok = RunCase(path, 30000, 3, true) && ok;
+    ok = CheckStaleLayout(path) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,104 @@
+﻿#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/clock.h"
+#include "ble/gatt_discovery.h"
+#include "ble/sim_transport.h"
+
+/**
+ * 在 ECG-7 的服务布局后面补上若干个只带一个可读特性的服务
+ * @param extra
+ */
+static std::vector<ble::SimServiceSpec> ServicesWithExtra(int extra) {
+    std::vector<ble::SimServiceSpec> services = ble::Ecg7Services();
+    for (int i = 0; i < extra; ++i) {
+        ble::SimServiceSpec service;
+        service.uuid = ble::ShortUuid(static_cast<uint16_t>(0xA000 + i));
+        service.characteristics.push_back({ble::ShortUuid(static_cast<uint16_t>(0xB000 + i)), ble::kPropertyRead});
+        services.push_back(service);
+    }
+    return services;
+}
+
+/**
+ * 连接一台每个 GATT 请求耗时 latency_us 的模拟设备，分别用顺序和并发方式完成发现
+ * @param extra_services
+ * @param latency_us
+ * @param timeout_ms 特性发现的总超时
+ * @return 结果不符合预期时返回 false
+ */
+static bool RunCase(int extra_services, uint32_t latency_us, uint32_t timeout_ms) {
+    ble::SimDeviceConfig config;
+    config.address = 0xC0FFEE000009;
+    config.services = ServicesWithExtra(extra_services);
+    config.request_latency_us = latency_us;
+    ble::SimulatedTransport transport({config});
+    auto connection = transport.ConnectAsync(config.address).get();
+    if (!connection) {
+        std::fprintf(stderr, "gatt_discovery: connect failed\n");
+        return false;
+    }
+
+    const std::size_t service_count = config.services.size();
+    const bool expect_timeout = timeout_ms * 1000 < latency_us;
+    bool ok = true;
+    double sequential_ms = 0.0;
+    ble::AbandonedRequests abandoned;
+    for (bool parallel : {false, true}) {
+        ble::DiscoveryOptions options;
+        options.parallel = parallel;
+        options.characteristics_timeout_ms = timeout_ms;
+        ble::DiscoveryResult result = ble::DiscoverGatt(*connection, options, &abandoned);
+
+        std::size_t characteristics = 0;
+        result.ForEachCharacteristic([&](const ble::GattCharacteristicInfo&) { ++characteristics; });
+        if (!parallel) {
+            sequential_ms = result.timings.total_ms;
+        }
+        bench::Report("gatt_discovery", std::to_string(service_count) + "svc_" + std::to_string(latency_us / 1000) +
+                                                "ms_" + (parallel ? "parallel" : "sequential") +
+                                                (expect_timeout ? "_timeout" : ""))
+                .Add("services", static_cast<double>(service_count))
+                .Add("characteristics", static_cast<double>(characteristics))
+                .Add("services_ms", result.timings.services_ms)
+                .Add("characteristics_ms", result.timings.characteristics_ms)
+                .Add("total_ms", result.timings.total_ms)
+                .Add("timed_out", static_cast<double>(result.timed_out))
+                .Add("abandoned", static_cast<double>(abandoned.Pending()))
+                .Add("speedup", parallel && result.timings.total_ms > 0.0 ? sequential_ms / result.timings.total_ms
+                                                                          : 1.0)
+                .Print();
+
+        if (expect_timeout) {
+            // 超时后必须按时返回，而不是等所有请求回来
+            double limit_ms = latency_us / 1000.0 + timeout_ms + 20.0;
+            ok &= result.timed_out == service_count && characteristics == 0 && result.timings.total_ms < limit_ms;
+        } else {
+            ok &= result.status == ble::GattStatus::Success && result.timed_out == 0 &&
+                  result.services.size() == service_count && characteristics == static_cast<std::size_t>(6 + extra_services);
+        }
+    }
+    // 超时的请求不再留下分离的线程，等完后列表必须为空
+    abandoned.Drain();
+    ok &= abandoned.Pending() == 0;
+    connection->Disconnect();
+    if (!ok) {
+        std::fprintf(stderr, "gatt_discovery: unexpected result for %zu services, %u us latency\n", service_count,
+                     latency_us);
+    }
+    return ok;
+}
+
+int main() {
+    bool ok = true;
+    // 7.5ms 和 30ms 分别对应常见的最小和默认连接间隔
+    ok &= RunCase(0, 7500, 5000);
+    ok &= RunCase(0, 30000, 5000);
+    ok &= RunCase(9, 30000, 5000);
+    // 每个请求 50ms 而超时只有 10ms：全部超时，发现在超时后立即返回
+    ok &= RunCase(3, 50000, 10);
+    return ok ? 0 : 1;
+}
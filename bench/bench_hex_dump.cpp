@@ -0,0 +1,122 @@
+﻿#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/hex_dump.h"
+
+// 原来回调里的写法：每个字节一次流格式设置 + 一次虚函数调用
+static void IostreamHex(std::wostream& os, const uint8_t* data, std::size_t length) {
+    for (std::size_t i = 0; i < length; ++i) {
+        os << std::hex << std::setw(2) << std::setfill(L'0') << (int)data[i] << L" ";
+    }
+}
+
+static std::vector<uint8_t> MakePayload(std::size_t length) {
+    std::vector<uint8_t> payload(length);
+    for (std::size_t i = 0; i < length; ++i) {
+        payload[i] = static_cast<uint8_t>(i * 37 + 11);
+    }
+    return payload;
+}
+
+// 查表、SIMD 和 iostream 三种实现的输出必须完全一致
+static bool CheckSameOutput() {
+    for (std::size_t length = 0; length <= 300; ++length) {
+        std::vector<uint8_t> payload = MakePayload(length);
+        std::wostringstream oss;
+        IostreamHex(oss, payload.data(), length);
+        std::wstring wide = oss.str();
+        std::string expected(wide.begin(), wide.end());
+
+        std::string scalar(length * ble::kHexCharsPerByte, '\0');
+        std::string simd(length * ble::kHexCharsPerByte, '\0');
+        ble::EncodeHexScalar(payload.data(), length, &scalar[0]);
+        ble::EncodeHex(payload.data(), length, &simd[0]);
+        if (scalar != expected || simd != expected) {
+            std::fprintf(stderr, "hex_dump: output mismatch at length %zu\n", length);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void RunFormatCase(std::size_t length) {
+    std::vector<uint8_t> payload = MakePayload(length);
+    std::vector<char> out(length * ble::kHexCharsPerByte + 16);
+    const std::string name = std::to_string(length) + "B";
+
+    std::wostringstream oss;
+    double iostream_ns = bench::MeasureNsPerCall([&] {
+        oss.str(std::wstring());
+        IostreamHex(oss, payload.data(), length);
+        bench::DoNotOptimize(oss);
+    });
+    double table_ns = bench::MeasureNsPerCall([&] {
+        bench::DoNotOptimize(ble::EncodeHexScalar(payload.data(), length, out.data()));
+    });
+    double dispatch_ns = bench::MeasureNsPerCall([&] {
+        bench::DoNotOptimize(ble::EncodeHex(payload.data(), length, out.data()));
+    });
+
+    bench::Report("hex_format", name)
+            .Add("iostream_ns", iostream_ns)
+            .Add("table_ns", table_ns)
+            .Add("dispatch_ns", dispatch_ns)
+            .Add("simd", ble::HexSimdAvailable() ? 1.0 : 0.0)
+            .Add("speedup", iostream_ns / dispatch_ns)
+            .Print();
+}
+
+/**
+ * 包含输出的完整路径：原来每个包 std::endl 刷新一次，
+ * 新实现每 batch 个包才 fwrite 一次，输出目标都是 /dev/null
+ * @param length
+ * @param batch
+ */
+static void RunSinkCase(std::size_t length, std::size_t batch) {
+    std::vector<uint8_t> payload = MakePayload(length);
+    const std::string name = std::to_string(length) + "B_batch" + std::to_string(batch);
+
+    std::wofstream wnull("/dev/null");
+    double iostream_ns = bench::MeasureNsPerCall([&] {
+        IostreamHex(wnull, payload.data(), length);
+        wnull << std::endl;
+    });
+
+    std::FILE* null_file = std::fopen("/dev/null", "wb");
+    ble::HexDumpWriter writer(null_file);
+    std::size_t in_batch = 0;
+    double writer_ns = bench::MeasureNsPerCall([&] {
+        writer.AppendPacket(payload.data(), length);
+        if (++in_batch == batch) {
+            writer.Flush();
+            in_batch = 0;
+        }
+    });
+    writer.Flush();
+    std::fclose(null_file);
+
+    bench::Report("hex_sink", name)
+            .Add("iostream_ns_per_packet", iostream_ns)
+            .Add("writer_ns_per_packet", writer_ns)
+            .Add("speedup", iostream_ns / writer_ns)
+            .Print();
+}
+
+int main() {
+    if (!CheckSameOutput()) {
+        return 1;
+    }
+    for (std::size_t length : {20, 64, 244}) {
+        RunFormatCase(length);
+    }
+    for (std::size_t length : {20, 244}) {
+        RunSinkCase(length, 64);
+    }
+    return 0;
+}
@@ -0,0 +1,245 @@
+﻿#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/clock.h"
+#include "ble/latency_histogram.h"
+
+/**
+ * 可复现的对数正态分布延迟（中位数约 50us，长尾到几毫秒）
+ */
+static std::vector<uint64_t> LatencySamples(std::size_t count, uint64_t seed) {
+    uint64_t state = seed | 1;
+    auto uniform = [&state] {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return (static_cast<double>(state >> 11) + 0.5) / 9007199254740992.0;
+    };
+    std::vector<uint64_t> values(count);
+    for (auto& value : values) {
+        double normal = std::sqrt(-2.0 * std::log(uniform())) * std::cos(6.283185307179586 * uniform());
+        value = static_cast<uint64_t>(50000.0 * std::exp(1.0 * normal));
+    }
+    return values;
+}
+
+/**
+ * 正确性：每个值都落在自己桶的范围内；百分位数与精确值的相对误差不超过桶宽
+ */
+static bool CheckAccuracy() {
+    for (uint64_t value : {0ull, 1ull, 63ull, 64ull, 127ull, 128ull, 1000ull, 65535ull, 1ull << 41, (1ull << 42) - 1}) {
+        std::size_t bucket = ble::LatencyHistogram::BucketOf(value);
+        if (bucket >= ble::kLatencyBuckets || ble::LatencyHistogram::BucketLower(bucket) > value ||
+            ble::LatencyHistogram::BucketUpper(bucket) <= value) {
+            std::fprintf(stderr, "latency_histogram: value %llu outside bucket %zu\n",
+                         static_cast<unsigned long long>(value), bucket);
+            return false;
+        }
+    }
+    if (ble::LatencyHistogram::BucketOf(~0ull) != ble::kLatencyBuckets - 1) {
+        std::fprintf(stderr, "latency_histogram: overflow value not clamped to the last bucket\n");
+        return false;
+    }
+
+    std::vector<uint64_t> values = LatencySamples(1000000, 5);
+    ble::LatencyHistogram histogram;
+    for (uint64_t value : values) {
+        histogram.Record(value);
+    }
+    ble::LatencySnapshot snapshot;
+    snapshot.Add(histogram);
+    ble::LatencySummary summary = snapshot.Summary();
+
+    std::vector<uint64_t> sorted = values;
+    std::sort(sorted.begin(), sorted.end());
+    auto exact = [&sorted](double p) {
+        std::size_t rank = std::max<std::size_t>(1, static_cast<std::size_t>(p / 100.0 * sorted.size() + 0.5));
+        return sorted[rank - 1];
+    };
+    double worst = 0.0;
+    for (double p : {50.0, 90.0, 99.0, 99.9, 99.99}) {
+        double error = std::fabs(static_cast<double>(snapshot.Percentile(p)) - static_cast<double>(exact(p))) /
+                       static_cast<double>(exact(p));
+        worst = std::max(worst, error);
+    }
+    bench::Report("latency_histogram", "accuracy_lognormal")
+            .Add("p50_us", static_cast<double>(summary.p50_ns) / 1e3)
+            .Add("p99_us", static_cast<double>(summary.p99_ns) / 1e3)
+            .Add("p999_us", static_cast<double>(summary.p999_ns) / 1e3)
+            .Add("max_us", static_cast<double>(summary.max_ns) / 1e3)
+            .Add("worst_relative_error", worst)
+            .Print();
+    if (worst > 1.0 / ble::kLatencySubBuckets || summary.max_ns != sorted.back() || summary.min_ns != sorted.front() ||
+        summary.count != values.size()) {
+        std::fprintf(stderr, "latency_histogram: percentiles are off by %.4f\n", worst);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * 多线程：各线程写自己的直方图，同时有线程不断合并读取；
+ * 结束后合并结果必须与单线程记录全部数据完全相同
+ */
+static bool CheckMerge() {
+    const std::size_t threads = 4;
+    std::vector<uint64_t> values = LatencySamples(400000, 9);
+    ble::LatencyProbes probes({"stage"});
+
+    std::atomic<bool> done(false);
+    std::size_t reads = 0;
+    std::thread reader([&] {
+        while (!done.load()) {
+            bench::DoNotOptimize(probes.Summaries());
+            ++reads;
+        }
+    });
+    std::vector<std::thread> writers;
+    for (std::size_t t = 0; t < threads; ++t) {
+        writers.emplace_back([&, t] {
+            for (std::size_t i = t; i < values.size(); i += threads) {
+                probes.Record(0, values[i]);
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    done.store(true);
+    reader.join();
+
+    ble::LatencyHistogram single;
+    for (uint64_t value : values) {
+        single.Record(value);
+    }
+    ble::LatencySnapshot expected;
+    expected.Add(single);
+    ble::LatencySummary want = expected.Summary();
+    ble::LatencySummary got = probes.Summaries()[0];
+
+    bench::Report("latency_histogram", "merge_4threads")
+            .Add("threads", static_cast<double>(probes.Threads()))
+            .Add("count", static_cast<double>(got.count))
+            .Add("concurrent_reads", static_cast<double>(reads))
+            .Print();
+    if (probes.Threads() != threads || got.count != want.count || got.p50_ns != want.p50_ns ||
+        got.p99_ns != want.p99_ns || got.p999_ns != want.p999_ns || got.max_ns != want.max_ns ||
+        got.min_ns != want.min_ns) {
+        std::fprintf(stderr, "latency_histogram: merged histogram differs from single-thread recording\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * 同一组线程在两个探针对象之间交替记录：每个线程在每个探针对象里只登记一次，
+ * 交替不会分配新的直方图，也不会把记录分散到多个直方图里
+ */
+static bool CheckAlternatingProbes() {
+    const std::size_t threads = 3;
+    const std::size_t records = 10000;
+    ble::LatencyProbes first({"stage"});
+    ble::LatencyProbes second({"stage"});
+    std::vector<std::thread> writers;
+    for (std::size_t t = 0; t < threads; ++t) {
+        writers.emplace_back([&] {
+            for (std::size_t i = 0; i < records; ++i) {
+                first.Record(0, 1000 + i);
+                second.Record(0, 2000 + i);
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    // 主线程也交替记录一次
+    first.Record(0, 1000);
+    second.Record(0, 2000);
+
+    const uint64_t first_count = first.Summaries()[0].count;
+    const uint64_t second_count = second.Summaries()[0].count;
+    bench::Report("latency_histogram", "alternating_probes")
+            .Add("first_threads", static_cast<double>(first.Threads()))
+            .Add("second_threads", static_cast<double>(second.Threads()))
+            .Add("first_count", static_cast<double>(first_count))
+            .Add("second_count", static_cast<double>(second_count))
+            .Print();
+    if (first.Threads() != threads + 1 || second.Threads() != threads + 1 ||
+        first_count != threads * records + 1 || second_count != threads * records + 1) {
+        std::fprintf(stderr, "latency_histogram: alternating probes registered extra thread histograms\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * 开销：直接记录、经线程本地查找记录、读一次时钟/TSC，以及一个完整探针（Lap：读 TSC + 记录）；
+ * 多个线程同时记录时每次的耗时不应明显变大（没有共享的缓存行），
+ * 但核数少于线程数时墙钟时间包含了其他线程的份额
+ */
+static void RunCost() {
+    std::vector<uint64_t> values = LatencySamples(4096, 13);
+    std::size_t i = 0;
+    auto next = [&] {
+        uint64_t value = values[i];
+        i = (i + 1) & 4095;
+        return value;
+    };
+
+    ble::LatencyHistogram histogram;
+    double record_ns = bench::MeasureNsPerCall([&] { histogram.Record(next()); });
+
+    ble::LatencyProbes probes({"a", "b", "c"});
+    double probes_ns = bench::MeasureNsPerCall([&] { probes.Record(1, next()); });
+
+    double clock_ns = bench::MeasureNsPerCall([] { bench::DoNotOptimize(ble::MonotonicNowNs()); });
+
+    double tick_ns = bench::MeasureNsPerCall([] { bench::DoNotOptimize(ble::TickNow()); });
+
+    uint64_t since = ble::TickNow();
+    double probe_ns = bench::MeasureNsPerCall([&] { since = probes.Lap(2, since); });
+
+    const std::size_t threads = 4;
+    std::vector<double> per_thread(threads);
+    std::vector<std::thread> workers;
+    for (std::size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            std::size_t j = t;
+            per_thread[t] = bench::MeasureNsPerCall([&] {
+                probes.Record(0, values[j]);
+                j = (j + 1) & 4095;
+            });
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    bench::Report("latency_histogram", "cost")
+            .Add("record_ns", record_ns)
+            .Add("thread_local_record_ns", probes_ns)
+            .Add("clock_read_ns", clock_ns)
+            .Add("tick_read_ns", tick_ns)
+            .Add("probe_ns", probe_ns)
+            .Add("record_4threads_ns", *std::max_element(per_thread.begin(), per_thread.end()))
+            .Add("hardware_threads", static_cast<double>(std::thread::hardware_concurrency()))
+            .Print();
+}
+
+int main() {
+    bool ok = CheckAccuracy();
+    ok = CheckMerge() && ok;
+    ok = CheckAlternatingProbes() && ok;
+    if (!ok) {
+        return 1;
+    }
+    RunCost();
+    return 0;
+}
@@ -0,0 +1,182 @@
+﻿#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/clock.h"
+#include "ble/device_manager.h"
+#include "ble/lifecycle.h"
+#include "ble/sim_transport.h"
+
+#ifndef _WIN32
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+/**
+ * 旧的等待方式：每 100ms 醒来检查一次标志，返回从置位到发现的延迟
+ */
+static uint64_t PollingWakeNs(uint64_t delay_ns) {
+    std::atomic<bool> keep_running(true);
+    std::atomic<uint64_t> stop_ns(0);
+    std::thread stopper([&] {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(delay_ns));
+        stop_ns.store(ble::MonotonicNowNs());
+        keep_running.store(false);
+    });
+    while (keep_running) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    uint64_t woke = ble::MonotonicNowNs();
+    stopper.join();
+    return woke - stop_ns.load();
+}
+
+/**
+ * Lifecycle 的等待方式，返回从 RequestStop 到等待方醒来的延迟
+ */
+static uint64_t LifecycleWakeNs(uint64_t delay_ns) {
+    ble::Lifecycle lifecycle;
+    std::thread stopper([&] {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(delay_ns));
+        lifecycle.RequestStop();
+    });
+    while (!lifecycle.WaitForStop(std::chrono::seconds(1))) {
+    }
+    uint64_t woke = ble::MonotonicNowNs();
+    stopper.join();
+    return woke - lifecycle.StopRequestedNs();
+}
+
+/**
+ * 在随机时刻请求停止，统计等待方的唤醒延迟
+ */
+static void RunWakeCase(const char* name, uint64_t (*wake)(uint64_t), int rounds) {
+    std::vector<uint64_t> latencies;
+    uint64_t seed = 0x2545F4914F6CDD1Dull;
+    for (int i = 0; i < rounds; ++i) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        latencies.push_back(wake(1000000 + seed % 100000000));
+    }
+    bench::Report("lifecycle", std::string("wake_") + name)
+            .Add("rounds", static_cast<double>(rounds))
+            .Add("p50_us", static_cast<double>(bench::Percentile(latencies, 50)) / 1e3)
+            .Add("p99_us", static_cast<double>(bench::Percentile(latencies, 99)) / 1e3)
+            .Add("max_us", static_cast<double>(*std::max_element(latencies.begin(), latencies.end())) / 1e3)
+            .Print();
+}
+
+/**
+ * devices 台模拟设备接收 seconds 秒后请求停止，测量从请求停止到排空、全部线程退出的时间，
+ * 并用载荷里的包序号确认已送达的通知全部交给了解码回调
+ * @return 有通知在停止时丢失返回 false
+ */
+static bool RunDrainCase(int devices, double rate_hz, double seconds) {
+    ble::SimulatedTransport transport({}, 1000.0);
+    for (int i = 0; i < devices; ++i) {
+        ble::SimDeviceConfig config;
+        config.address = 0xC0FFEE000000ull + static_cast<uint64_t>(i);
+        config.notification_rate_hz = rate_hz;
+        transport.AddDevice(config);
+    }
+
+    ble::Lifecycle lifecycle;
+    ble::DeviceManagerOptions options;
+    options.targets.push_back({"ECG-7", 0});
+    options.worker_threads = 2;
+    options.state_listener = [&](std::size_t, ble::DeviceState state) {
+        if (state == ble::DeviceState::Streaming) {
+            lifecycle.Advance(ble::LifecycleState::Streaming);
+        }
+    };
+    // 每台设备只有一个流，解码线程固定，按设备记录收到的通知数和最大包序号
+    std::vector<uint64_t> received(static_cast<std::size_t>(devices), 0);
+    std::vector<uint32_t> max_sequence(static_cast<std::size_t>(devices), 0);
+    ble::DeviceManager manager(transport, options, [&](std::size_t device, const ble::NotificationSlot& slot) {
+        uint32_t sequence = static_cast<uint32_t>(slot.data[0] | (slot.data[1] << 8));
+        ++received[device];
+        max_sequence[device] = std::max(max_sequence[device], sequence);
+    });
+
+    manager.Start();
+    lifecycle.WaitFor(ble::LifecycleState::Streaming);
+    std::thread stopper([&] {
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+        lifecycle.RequestStop();
+    });
+    lifecycle.WaitForStop();
+    uint64_t woke = ble::MonotonicNowNs();
+    lifecycle.Advance(ble::LifecycleState::Draining);
+    manager.Stop();
+    lifecycle.Advance(ble::LifecycleState::Stopped);
+    uint64_t stopped = ble::MonotonicNowNs();
+    stopper.join();
+
+    uint64_t total = 0;
+    std::size_t incomplete = 0;
+    for (int i = 0; i < devices; ++i) {
+        total += received[i];
+        // 没有丢包时，收到的条数应当正好是最大序号 + 1
+        if (received[i] == 0 || received[i] != max_sequence[i] + 1ull) {
+            ++incomplete;
+        }
+    }
+    const uint64_t requested = lifecycle.StopRequestedNs();
+    bench::Report("lifecycle", "drain_" + std::to_string(devices) + "x" + std::to_string(static_cast<int>(rate_hz)) +
+                                       "Hz")
+            .Add("wake_us", static_cast<double>(woke - requested) / 1e3)
+            .Add("stop_to_exit_ms", static_cast<double>(stopped - requested) / 1e6)
+            .Add("notifications", static_cast<double>(total))
+            .Add("incomplete_devices", static_cast<double>(incomplete))
+            .Print();
+    if (incomplete != 0) {
+        std::fprintf(stderr, "lifecycle: %zu devices lost notifications during drain\n", incomplete);
+        return false;
+    }
+    return true;
+}
+
+#ifndef _WIN32
+/**
+ * 排空期间的重复中断：第一次 SIGINT 请求停止，隔了比旧的去重窗口（500ms）更久的第二次 SIGINT
+ * 不能结束进程。必须在创建其他线程之前调用
+ */
+static bool CheckRepeatedInterrupt(ble::Lifecycle& lifecycle) {
+    ble::StopOnInterrupt(lifecycle);
+    kill(getpid(), SIGINT);
+    const bool stopped = lifecycle.WaitForStop(std::chrono::seconds(5));
+    std::this_thread::sleep_for(std::chrono::milliseconds(600));
+    kill(getpid(), SIGINT);
+    // 进程被结束的话不会走到这里
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    bench::Report("lifecycle", "repeated_interrupt")
+            .Add("stop_requested", stopped ? 1.0 : 0.0)
+            .Add("survived_second_signal", 1.0)
+            .Print();
+    if (!stopped) {
+        std::fprintf(stderr, "lifecycle: SIGINT did not request a stop\n");
+    }
+    return stopped;
+}
+#endif
+
+int main() {
+    bool ok = true;
+#ifndef _WIN32
+    static ble::Lifecycle interrupted;
+    ok = CheckRepeatedInterrupt(interrupted);
+#endif
+    RunWakeCase("poll_100ms", PollingWakeNs, 20);
+    RunWakeCase("condvar", LifecycleWakeNs, 20);
+    ok &= RunDrainCase(4, 250.0, 0.5);
+    ok &= RunDrainCase(32, 500.0, 1.0);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,275 @@
+﻿#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/capture_file.h"
+#include "ble/clock.h"
+#include "ble/ecg_decoder.h"
+#include "ble/minmax_pyramid.h"
+#include "ble/sim_transport.h"
+#include "ble/synthetic_ecg.h"
+
+static std::vector<std::vector<int32_t>> SyntheticLeads(std::size_t leads, std::size_t frames, uint64_t seed) {
+    ble::SyntheticEcgOptions options;
+    options.leads = leads;
+    options.seed = seed;
+    std::vector<std::vector<int32_t>> data(leads, std::vector<int32_t>(frames));
+    std::vector<int32_t*> out(leads);
+    for (std::size_t l = 0; l < leads; ++l) {
+        out[l] = data[l].data();
+    }
+    ble::SyntheticEcg(options).Generate(out.data(), frames);
+    return data;
+}
+
+static uint64_t NextRandom(uint64_t& state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+// 用不规则的分块大小追加，模拟每个通知的帧数
+static void AppendChunked(ble::MinMaxPyramid& pyramid, const std::vector<std::vector<int32_t>>& data,
+                          std::size_t begin, std::size_t end, uint64_t& state) {
+    std::vector<const int32_t*> in(data.size());
+    for (std::size_t offset = begin; offset < end;) {
+        const std::size_t n = std::min<std::size_t>(end - offset, 1 + NextRandom(state) % 50);
+        for (std::size_t l = 0; l < data.size(); ++l) {
+            in[l] = data[l].data() + offset;
+        }
+        pyramid.Append(in.data(), n);
+        offset += n;
+    }
+}
+
+static ble::MinMax Exact(const std::vector<int32_t>& lead, uint64_t first, uint64_t last) {
+    ble::MinMax result;
+    for (uint64_t i = first; i < std::min<uint64_t>(last, lead.size()); ++i) {
+        result.Add(lead[i]);
+    }
+    return result;
+}
+
+static bool Contains(const ble::MinMax& outer, const ble::MinMax& inner) {
+    return inner.Empty() || (outer.min <= inner.min && outer.max >= inner.max);
+}
+
+/**
+ * 随机查询：所选层的桶宽 B 是不超过每列样本数的最大桶宽，列边界最多偏移一个桶，
+ * 所以每列的结果必须包含列内向里缩一个桶的精确值、又被向外扩一个桶的精确值包含；
+ * 读取的桶数不超过 columns * (fanout + 1) + 1
+ */
+static bool CheckQueries(const ble::MinMaxPyramid& pyramid, const std::vector<std::vector<int32_t>>& data,
+                         std::size_t queries, uint64_t& state) {
+    const uint64_t samples = pyramid.Samples();
+    std::vector<ble::MinMax> columns(2000);
+    for (std::size_t q = 0; q < queries; ++q) {
+        const std::size_t lead = NextRandom(state) % data.size();
+        uint64_t first = NextRandom(state) % samples;
+        uint64_t last = first + 1 + NextRandom(state) % (samples - first);
+        const std::size_t count = 1 + NextRandom(state) % columns.size();
+        const std::size_t touched = pyramid.Query(lead, first, last, columns.data(), count);
+
+        const double per_column = static_cast<double>(last - first) / static_cast<double>(count);
+        uint64_t bucket = pyramid.BucketSamples(0);
+        for (std::size_t k = 1; k < pyramid.Levels(); ++k) {
+            if (static_cast<double>(pyramid.BucketSamples(k)) <= per_column) {
+                bucket = pyramid.BucketSamples(k);
+            }
+        }
+        if (touched > count * (pyramid.Options().fanout + 1) + 1) {
+            std::fprintf(stderr, "minmax_pyramid: query touched %zu buckets for %zu columns\n", touched, count);
+            return false;
+        }
+        const uint64_t first_covered = pyramid.FirstSample();
+        for (std::size_t c = 0; c < count; ++c) {
+            const uint64_t col_first = first + (last - first) * c / count;
+            const uint64_t col_last = first + (last - first) * (c + 1) / count;
+            const uint64_t inner_first = std::max(col_first, first_covered) + bucket;
+            const ble::MinMax inner = col_last > bucket ? Exact(data[lead], inner_first, col_last - bucket)
+                                                        : ble::MinMax{};
+            const ble::MinMax outer =
+                    Exact(data[lead], std::max(col_first > bucket ? col_first - bucket : 0, first_covered),
+                          std::min(col_last + bucket, samples));
+            if (!Contains(columns[c], inner) || !Contains(outer, columns[c])) {
+                std::fprintf(stderr, "minmax_pyramid: column %zu of [%llu, %llu)/%zu is [%d, %d], "
+                                     "expected within [%d, %d] and covering [%d, %d]\n",
+                             c, static_cast<unsigned long long>(first), static_cast<unsigned long long>(last), count,
+                             columns[c].min, columns[c].max, outer.min, outer.max, inner.min, inner.max);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * 正确性：一小时 3 导联随机查询；实时边缘（最新的样本即使不满一个桶也能查到）；
+ * 保留窗口之外的数据被丢弃且内存不超过上界；从录制文件回放建出的金字塔与实时建出的相同
+ */
+static bool CheckCorrectness(const std::string& path) {
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    const std::size_t frames = 250 * 3600;
+    std::vector<std::vector<int32_t>> data = SyntheticLeads(3, frames, 3);
+
+    ble::MinMaxPyramidOptions options;
+    options.window_samples = frames;
+    ble::MinMaxPyramid pyramid(3, options);
+    AppendChunked(pyramid, data, 0, frames, state);
+    if (!CheckQueries(pyramid, data, 300, state)) {
+        return false;
+    }
+
+    // 实时边缘：每追加一批就查最后 2 秒，最后一列必须包含最新的样本
+    ble::MinMaxPyramid live(3, options);
+    std::vector<ble::MinMax> columns(40);
+    std::vector<const int32_t*> in(3);
+    for (std::size_t offset = 0; offset < 250 * 60; offset += 3) {
+        for (std::size_t l = 0; l < 3; ++l) {
+            in[l] = data[l].data() + offset;
+        }
+        live.Append(in.data(), 3);
+        const uint64_t end = live.Samples();
+        live.Query(1, end > 500 ? end - 500 : 0, end, columns.data(), columns.size());
+        const int32_t newest = data[1][end - 1];
+        if (columns.back().Empty() || columns.back().min > newest || columns.back().max < newest) {
+            std::fprintf(stderr, "minmax_pyramid: newest sample at %llu is missing from the live edge\n",
+                         static_cast<unsigned long long>(end));
+            return false;
+        }
+    }
+
+    // 保留窗口：只保留最近 10000 个样本
+    ble::MinMaxPyramidOptions small = options;
+    small.window_samples = 10000;
+    ble::MinMaxPyramid windowed(3, small);
+    AppendChunked(windowed, data, 0, 150000, state);
+    windowed.Query(0, 0, 100000, columns.data(), columns.size());
+    const bool old_dropped = std::all_of(columns.begin(), columns.end(), [](const ble::MinMax& c) { return c.Empty(); });
+    if (!old_dropped || windowed.FirstSample() + 10000 + small.base_samples < 150000 ||
+        windowed.MemoryBytes() > ble::MinMaxPyramid::MemoryBytesFor(3, small) ||
+        pyramid.MemoryBytes() > ble::MinMaxPyramid::MemoryBytesFor(3, options)) {
+        std::fprintf(stderr, "minmax_pyramid: window not enforced (first=%llu, memory=%zu > %zu?)\n",
+                     static_cast<unsigned long long>(windowed.FirstSample()), windowed.MemoryBytes(),
+                     ble::MinMaxPyramid::MemoryBytesFor(3, small));
+        return false;
+    }
+    std::vector<std::vector<int32_t>> recent(3);
+    for (std::size_t l = 0; l < 3; ++l) {
+        recent[l] = data[l];
+        recent[l].resize(150000);
+    }
+    if (!CheckQueries(windowed, recent, 100, state)) {
+        return false;
+    }
+
+    // 录制的会话：合成 ECG-7 通知写进抓包文件，读回、解码后建金字塔，与直接追加的结果逐列相同
+    ble::SyntheticEcgOptions ecg;
+    ble::PayloadGenerator generator = ble::SyntheticEcg7Payload(ecg);
+    ble::CaptureWriter writer;
+    if (!writer.Open(path)) {
+        return false;
+    }
+    uint8_t payload[20];
+    for (uint64_t sequence = 0; sequence < 250 * 600 / 3; ++sequence) {
+        generator(sequence, payload, sizeof(payload));
+        writer.Append(sequence, 0, payload, sizeof(payload));
+    }
+    writer.Close();
+    ble::CaptureReader reader;
+    ble::EcgDecoder decoder;
+    ble::EcgLeadBuffer buffer(3, 3 * 250 * 600);
+    ble::MinMaxPyramid replayed(3, options);
+    if (reader.Open(path)) {
+        reader.ForEach([&](const ble::CaptureRecord& record) {
+            const std::size_t first = buffer.Size();
+            const std::size_t n = decoder.Decode(record.data, record.length, buffer);
+            const int32_t* leads[3] = {buffer.Lead(0) + first, buffer.Lead(1) + first, buffer.Lead(2) + first};
+            replayed.Append(leads, n);
+        });
+    }
+    std::remove(path.c_str());
+    ble::MinMaxPyramid direct(3, options);
+    const int32_t* leads[3] = {buffer.Lead(0), buffer.Lead(1), buffer.Lead(2)};
+    direct.Append(leads, buffer.Size());
+    std::vector<ble::MinMax> a(300);
+    std::vector<ble::MinMax> b(300);
+    replayed.Query(0, 0, replayed.Samples(), a.data(), a.size());
+    direct.Query(0, 0, direct.Samples(), b.data(), b.size());
+    const bool same = replayed.Samples() == 250 * 600 && direct.Samples() == replayed.Samples() &&
+                      std::equal(a.begin(), a.end(), b.begin(), [](const ble::MinMax& x, const ble::MinMax& y) {
+                          return x.min == y.min && x.max == y.max;
+                      });
+    if (!same) {
+        std::fprintf(stderr, "minmax_pyramid: pyramid built from a recorded session differs\n");
+        return false;
+    }
+
+    bench::Report("minmax_pyramid", "correctness")
+            .Add("levels", static_cast<double>(pyramid.Levels()))
+            .Add("memory_bytes_1h_3leads", static_cast<double>(pyramid.MemoryBytes()))
+            .Add("raw_bytes_1h_3leads", static_cast<double>(frames * 3 * sizeof(int32_t)))
+            .Print();
+    std::fprintf(stderr, "last 8 seconds of lead 0:\n");
+    a.resize(100);
+    replayed.Query(0, replayed.Samples() - 2000, replayed.Samples(), a.data(), a.size());
+    ble::RenderMinMaxColumns(a.data(), a.size(), 6, stderr);
+    return true;
+}
+
+/**
+ * 开销：追加每个样本的耗时；4 小时的数据画 1000 列，与直接扫描原始样本对比
+ */
+static void RunCost() {
+    const std::size_t frames = 250 * 3600 * 4;
+    std::vector<std::vector<int32_t>> data = SyntheticLeads(3, frames, 7);
+    ble::MinMaxPyramidOptions options;
+    options.window_samples = frames;
+    ble::MinMaxPyramid pyramid(3, options);
+
+    const uint64_t start = ble::MonotonicNowNs();
+    std::vector<const int32_t*> in(3);
+    for (std::size_t offset = 0; offset < frames; offset += 3) {
+        for (std::size_t l = 0; l < 3; ++l) {
+            in[l] = data[l].data() + offset;
+        }
+        pyramid.Append(in.data(), 3);
+    }
+    const double append_ns = static_cast<double>(ble::MonotonicNowNs() - start) / static_cast<double>(frames * 3);
+
+    std::vector<ble::MinMax> columns(1000);
+    std::size_t touched = 0;
+    double query_ns = bench::MeasureNsPerCall([&] {
+        touched = pyramid.Query(0, 0, frames, columns.data(), columns.size());
+    });
+    double zoom_ns = bench::MeasureNsPerCall([&] {
+        pyramid.Query(0, frames - 250 * 10, frames, columns.data(), columns.size());
+    });
+    double scan_ns = bench::MeasureNsPerCall([&] {
+        for (std::size_t c = 0; c < columns.size(); ++c) {
+            columns[c] = Exact(data[0], frames * c / columns.size(), frames * (c + 1) / columns.size());
+        }
+        bench::DoNotOptimize(columns);
+    });
+
+    bench::Report("minmax_pyramid", "4h_3leads_1000_columns")
+            .Add("append_ns_per_sample", append_ns)
+            .Add("query_full_range_us", query_ns / 1e3)
+            .Add("query_last_10s_us", zoom_ns / 1e3)
+            .Add("raw_scan_us", scan_ns / 1e3)
+            .Add("buckets_touched", static_cast<double>(touched))
+            .Add("memory_mb", static_cast<double>(pyramid.MemoryBytes()) / 1048576.0)
+            .Add("raw_mb", static_cast<double>(frames * 3 * sizeof(int32_t)) / 1048576.0)
+            .Print();
+}
+
+int main(int argc, char* argv[]) {
+    std::string path = argc > 1 ? argv[1] : "bench_minmax_pyramid.blecap";
+    bool ok = CheckCorrectness(path);
+    RunCost();
+    return ok ? 0 : 1;
+}
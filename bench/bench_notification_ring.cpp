@@ -0,0 +1,78 @@
+﻿#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/clock.h"
+#include "ble/notification_ring.h"
+#include "ble/synthetic_source.h"
+
+/**
+ * 合成通知源 -> SpscRing -> 批量消费者
+ * 统计持续吞吐量（通知/秒）以及单次入队耗时的 p50/p99
+ * @param payload_size
+ * @param count
+ */
+static void RunCase(std::size_t payload_size, uint64_t count) {
+    ble::SpscRing<ble::NotificationSlot> ring(4096);
+    std::vector<uint64_t> enqueue_ns(count);
+    std::atomic<bool> running(true);
+    uint64_t consumed = 0;
+    uint64_t checksum = 0;
+
+    std::thread consumer([&] {
+        ble::DrainRing(ring, running,
+                       [&](const ble::NotificationSlot& slot) {
+                           checksum += slot.data[0];
+                           ++consumed;
+                       },
+                       [](std::size_t) {});
+    });
+
+    ble::SyntheticNotificationSource::Options options;
+    options.payload_size = payload_size;
+    options.max_count = count;
+    ble::SyntheticNotificationSource source(options);
+
+    uint64_t index = 0;
+    uint64_t start = ble::MonotonicNowNs();
+    source.Start([&](const uint8_t* data, std::size_t length) {
+        // 队列满时让出 CPU 重试，只统计成功那一次入队的耗时
+        for (;;) {
+            uint64_t t0 = ble::MonotonicNowNs();
+            bool ok = ble::PushNotification(ring, t0, 0, data, length);
+            uint64_t t1 = ble::MonotonicNowNs();
+            if (ok) {
+                enqueue_ns[index++] = t1 - t0;
+                return;
+            }
+            std::this_thread::yield();
+        }
+    });
+    source.Join();
+    running.store(false, std::memory_order_release);
+    consumer.join();
+    uint64_t elapsed = ble::MonotonicNowNs() - start;
+
+    if (consumed != count) {
+        std::fprintf(stderr, "spsc_ring: consumed %llu of %llu\n",
+                     static_cast<unsigned long long>(consumed), static_cast<unsigned long long>(count));
+    }
+    bench::DoNotOptimize(checksum);
+
+    bench::Report("spsc_ring", std::to_string(payload_size) + "B")
+            .Add("notifications", static_cast<double>(count))
+            .Add("notifications_per_s", static_cast<double>(consumed) * 1e9 / static_cast<double>(elapsed))
+            .Add("enqueue_p50_ns", static_cast<double>(bench::Percentile(enqueue_ns, 50.0)))
+            .Add("enqueue_p99_ns", static_cast<double>(bench::Percentile(enqueue_ns, 99.0)))
+            .Add("full_retries", static_cast<double>(ring.Dropped()))
+            .Print();
+}
+
+int main() {
+    RunCase(20, 2000000);
+    RunCase(244, 1000000);
+    return 0;
+}
@@ -0,0 +1,146 @@
+﻿#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/capture_file.h"
+#include "ble/clock.h"
+#include "ble/hex_dump.h"
+#include "ble/notification_ring.h"
+#include "ble/replay_source.h"
+#include "ble/synthetic_source.h"
+
+/*
+ * 端到端通知处理基准：
+ *   direct  - 与 main.cpp 相同，回调线程里加锁写抓包文件并打印十六进制
+ *   ring    - 回调只入队，消费者线程成批打印和写抓包文件
+ * 通知来自合成源，或者来自命令行给出的 .blecap 抓包文件回放。
+ * 打印目标是 /dev/null，测的是本进程的处理开销而不是终端速度。
+ */
+
+namespace {
+
+const char* kNullDevice = "/dev/null";
+
+struct Notification {
+    const uint8_t* data;
+    std::size_t length;
+};
+
+// 先把通知展开到内存里，两种模式回放同一组数据
+std::vector<std::vector<uint8_t>> LoadNotifications(const std::string& replay_path, std::string& source_name) {
+    std::vector<std::vector<uint8_t>> notifications;
+    if (!replay_path.empty()) {
+        ble::ReplaySource replay;
+        if (replay.Open(replay_path)) {
+            replay.Run([&](const ble::CaptureRecord& record) {
+                notifications.emplace_back(record.data, record.data + record.length);
+            });
+            source_name = "replay";
+            return notifications;
+        }
+        std::fprintf(stderr, "pipeline: cannot open %s, falling back to synthetic source\n", replay_path.c_str());
+    }
+    ble::SyntheticNotificationSource::Options options;
+    options.payload_size = 20;
+    options.max_count = 500000;
+    ble::SyntheticNotificationSource source(options);
+    source.Start([&](const uint8_t* data, std::size_t length) {
+        notifications.emplace_back(data, data + length);
+    });
+    source.Join();
+    source_name = "synthetic";
+    return notifications;
+}
+
+void Report(const std::string& source_name, const char* mode, std::size_t count, uint64_t elapsed_ns,
+            std::vector<uint64_t>& callback_ns) {
+    bench::Report("pipeline", source_name + "_" + mode)
+            .Add("notifications", static_cast<double>(count))
+            .Add("notifications_per_s", static_cast<double>(count) * 1e9 / static_cast<double>(elapsed_ns))
+            .Add("callback_p50_ns", static_cast<double>(bench::Percentile(callback_ns, 50.0)))
+            .Add("callback_p99_ns", static_cast<double>(bench::Percentile(callback_ns, 99.0)))
+            .Print();
+}
+
+void RunDirect(const std::vector<std::vector<uint8_t>>& notifications, const std::string& source_name,
+               const std::string& capture_path) {
+    std::FILE* null_file = std::fopen(kNullDevice, "wb");
+    ble::HexDumpWriter hex_writer(null_file);
+    ble::CaptureWriter capture_writer;
+    capture_writer.Open(capture_path);
+    std::mutex capture_mutex;
+    std::vector<uint64_t> callback_ns(notifications.size());
+
+    uint64_t start = ble::MonotonicNowNs();
+    for (std::size_t i = 0; i < notifications.size(); ++i) {
+        uint64_t t0 = ble::MonotonicNowNs();
+        {
+            std::lock_guard<std::mutex> lock(capture_mutex);
+            capture_writer.Append(t0, 0, notifications[i].data(), static_cast<uint16_t>(notifications[i].size()));
+        }
+        hex_writer.AppendPacket(notifications[i].data(), notifications[i].size());
+        hex_writer.Flush();
+        callback_ns[i] = ble::MonotonicNowNs() - t0;
+    }
+    capture_writer.Close();
+    uint64_t elapsed = ble::MonotonicNowNs() - start;
+    std::fclose(null_file);
+    Report(source_name, "direct", notifications.size(), elapsed, callback_ns);
+}
+
+void RunRing(const std::vector<std::vector<uint8_t>>& notifications, const std::string& source_name,
+             const std::string& capture_path) {
+    ble::SpscRing<ble::NotificationSlot> ring(4096);
+    std::atomic<bool> running(true);
+    std::vector<uint64_t> callback_ns(notifications.size());
+
+    std::thread consumer([&] {
+        std::FILE* null_file = std::fopen(kNullDevice, "wb");
+        ble::HexDumpWriter hex_writer(null_file);
+        ble::CaptureWriter capture_writer;
+        capture_writer.Open(capture_path);
+        ble::DrainRing(ring, running,
+                       [&](const ble::NotificationSlot& slot) {
+                           capture_writer.Append(slot.timestamp_ns, slot.characteristic_id, slot.data, slot.length);
+                           hex_writer.AppendPacket(slot.data, slot.length);
+                       },
+                       [&](std::size_t) {
+                           hex_writer.Flush();
+                       });
+        capture_writer.Close();
+        hex_writer.Flush();
+        std::fclose(null_file);
+    });
+
+    uint64_t start = ble::MonotonicNowNs();
+    for (std::size_t i = 0; i < notifications.size(); ++i) {
+        uint64_t t0 = ble::MonotonicNowNs();
+        while (!ble::PushNotification(ring, t0, 0, notifications[i].data(), notifications[i].size())) {
+            std::this_thread::yield();
+        }
+        callback_ns[i] = ble::MonotonicNowNs() - t0;
+    }
+    running.store(false, std::memory_order_release);
+    consumer.join();
+    uint64_t elapsed = ble::MonotonicNowNs() - start;
+    Report(source_name, "ring", notifications.size(), elapsed, callback_ns);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string replay_path = argc > 1 ? argv[1] : "";
+    std::string capture_path = "bench_pipeline.blecap";
+    std::string source_name;
+    auto notifications = LoadNotifications(replay_path, source_name);
+
+    RunDirect(notifications, source_name, capture_path);
+    RunRing(notifications, source_name, capture_path);
+    std::remove(capture_path.c_str());
+    return 0;
+}
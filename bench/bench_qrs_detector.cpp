@@ -0,0 +1,222 @@
+﻿#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/ecg_filter.h"
+#include "ble/qrs_detector.h"
+#include "ble/synthetic_ecg.h"
+
+// ECG-7 一个通知的帧数
+constexpr std::size_t kFramesPerNotification = 3;
+
+/**
+ * 按导联分开存放的合成心电，以及 R 波真值
+ */
+struct Recording {
+    std::vector<std::vector<int32_t>> leads;
+    std::vector<const int32_t*> in;
+    std::vector<uint64_t> beats;
+
+    Recording(const ble::SyntheticEcgOptions& options, std::size_t frames)
+        : leads(options.leads, std::vector<int32_t>(frames)) {
+        ble::SyntheticEcg ecg(options);
+        std::vector<int32_t*> out;
+        for (auto& lead : leads) {
+            out.push_back(lead.data());
+            in.push_back(lead.data());
+        }
+        ecg.Generate(out.data(), frames);
+        beats = ecg.Beats();
+    }
+
+    std::vector<const int32_t*> In(std::size_t offset) const {
+        std::vector<const int32_t*> p;
+        for (const auto& lead : leads) {
+            p.push_back(lead.data() + offset);
+        }
+        return p;
+    }
+};
+
+/**
+ * 正确性：按通知大小分块送入，与真值逐拍比对
+ * 灵敏度、阳性预测值都要达到 99%（幅度突变时允许漏掉阈值恢复期间的 2%），R 波位置误差不超过 12ms，
+ * 非回溯心搏的延迟不超过 MaxLatencySamples()，
+ * 最后的平均心率与真值最近 kHeartRateAverageBeats 个 RR 间期的平均相差不超过 2%；
+ * 分块处理与整块处理的结果必须相同
+ */
+static bool CheckDetection(const std::string& name, ble::SyntheticEcgOptions options, double drop = 1.0) {
+    const double fs = options.sample_rate_hz;
+    const std::size_t frames = static_cast<std::size_t>(fs * 120);
+    Recording recording(options, frames);
+    // 后一半信号幅度突然变为 drop 倍（电极接触变差），阈值来不及下降时要靠回溯补检
+    for (auto& lead : recording.leads) {
+        for (std::size_t i = frames / 2; i < frames; ++i) {
+            lead[i] = static_cast<int32_t>(std::lround((lead[i] - options.baseline_offset) * drop +
+                                                       options.baseline_offset));
+        }
+    }
+
+    ble::QrsDetector detector(options.leads, ble::QrsDetectorOptions{fs});
+    std::vector<ble::HeartBeat> beats;
+    for (std::size_t offset = 0; offset < frames; offset += kFramesPerNotification) {
+        auto in = recording.In(offset);
+        detector.Process(in.data(), std::min(kFramesPerNotification, frames - offset), beats);
+    }
+
+    ble::QrsDetector whole(options.leads, ble::QrsDetectorOptions{fs});
+    std::vector<ble::HeartBeat> whole_beats;
+    whole.Process(recording.in.data(), frames, whole_beats);
+    bool same = whole_beats.size() == beats.size();
+    for (std::size_t i = 0; same && i < beats.size(); ++i) {
+        same = whole_beats[i].sample == beats[i].sample && whole_beats[i].detected_sample == beats[i].detected_sample;
+    }
+    if (!same) {
+        std::fprintf(stderr, "qrs_detector %s: chunked and whole-block detections differ\n", name.c_str());
+        return false;
+    }
+
+    // 只比对学习阶段之后、结尾留出判定时间之前的心搏
+    const uint64_t begin = static_cast<uint64_t>(fs * 2.5);
+    const uint64_t end = frames - detector.MaxLatencySamples() - static_cast<uint64_t>(fs);
+    const uint64_t tolerance = static_cast<uint64_t>(fs * 0.012);
+    std::size_t truth = 0;
+    std::size_t detected = 0;
+    std::size_t matched = 0;
+    uint64_t max_error = 0;
+    double signed_error = 0.0;
+    uint64_t max_latency = 0;
+    std::size_t searchbacks = 0;
+    for (uint64_t r : recording.beats) {
+        truth += r >= begin && r < end;
+    }
+    for (const auto& beat : beats) {
+        if (beat.sample < begin || beat.sample >= end) {
+            continue;
+        }
+        ++detected;
+        searchbacks += beat.searchback;
+        if (!beat.searchback) {
+            max_latency = std::max(max_latency, beat.detected_sample - beat.sample);
+        }
+        auto it = std::lower_bound(recording.beats.begin(), recording.beats.end(), beat.sample - tolerance);
+        if (it != recording.beats.end() && *it <= beat.sample + tolerance) {
+            ++matched;
+            max_error = std::max(max_error, *it > beat.sample ? *it - beat.sample : beat.sample - *it);
+            signed_error += static_cast<double>(beat.sample) - static_cast<double>(*it);
+        }
+    }
+
+    const double sensitivity = truth > 0 ? static_cast<double>(matched) / static_cast<double>(truth) : 0.0;
+    const double ppv = detected > 0 ? static_cast<double>(matched) / static_cast<double>(detected) : 0.0;
+    const double bpm = detector.HeartRateBpm();
+    double truth_bpm = 0.0;
+    auto last = std::lower_bound(recording.beats.begin(), recording.beats.end(), beats.back().sample - tolerance);
+    if (last - recording.beats.begin() >= static_cast<std::ptrdiff_t>(ble::kHeartRateAverageBeats)) {
+        truth_bpm = 60.0 * fs * static_cast<double>(ble::kHeartRateAverageBeats) /
+                    static_cast<double>(*last - *(last - ble::kHeartRateAverageBeats));
+    }
+    bench::Report("qrs_detector", name)
+            .Add("beats", static_cast<double>(truth))
+            .Add("sensitivity", sensitivity)
+            .Add("ppv", ppv)
+            .Add("max_error_ms", static_cast<double>(max_error) / fs * 1e3)
+            .Add("mean_error_ms", matched > 0 ? signed_error / static_cast<double>(matched) / fs * 1e3 : 0.0)
+            .Add("max_latency_ms", static_cast<double>(max_latency) / fs * 1e3)
+            .Add("latency_bound_ms", static_cast<double>(detector.MaxLatencySamples()) / fs * 1e3)
+            .Add("searchbacks", static_cast<double>(searchbacks))
+            .Add("average_bpm", bpm)
+            .Add("truth_bpm", truth_bpm)
+            .Print();
+
+    const double min_sensitivity = drop < 1.0 ? 0.98 : 0.99;
+    if (sensitivity < min_sensitivity || ppv < 0.99 || max_error > tolerance || max_latency > detector.MaxLatencySamples() ||
+        std::fabs(bpm - truth_bpm) > 0.02 * truth_bpm) {
+        std::fprintf(stderr, "qrs_detector %s: detection check failed\n", name.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * 单核吞吐：streams 个设备的检测器轮流各处理一个通知（3 帧），
+ * 测出每帧的平均耗时，折算成一个核能实时处理多少路 250Hz 数据流；
+ * with_filter 时每路前面再加上 EcgFilter，与 main.cpp 里的处理链一致
+ */
+static void RunStreams(std::size_t streams, bool with_filter) {
+    ble::SyntheticEcgOptions options;
+    const std::size_t frames = 250 * 20;
+    Recording recording(options, frames);
+
+    std::vector<std::unique_ptr<ble::QrsDetector>> detectors;
+    std::vector<std::unique_ptr<ble::EcgFilter>> filters;
+    for (std::size_t s = 0; s < streams; ++s) {
+        detectors.push_back(std::make_unique<ble::QrsDetector>(options.leads));
+        filters.push_back(std::make_unique<ble::EcgFilter>(options.leads, ble::EcgFilterConfig{}));
+    }
+    std::vector<std::vector<float>> filtered(options.leads, std::vector<float>(kFramesPerNotification));
+    std::vector<float*> out;
+    for (auto& lead : filtered) {
+        out.push_back(lead.data());
+    }
+
+    std::vector<ble::HeartBeat> beats;
+    std::size_t offset = 0;
+    uint64_t processed = 0;
+    double ns = bench::MeasureNsPerCall([&] {
+        auto in = recording.In(offset);
+        for (std::size_t s = 0; s < streams; ++s) {
+            if (with_filter) {
+                filters[s]->Process(in.data(), out.data(), kFramesPerNotification);
+            }
+            detectors[s]->Process(in.data(), kFramesPerNotification, beats);
+        }
+        beats.clear();
+        processed += streams * kFramesPerNotification;
+        offset += kFramesPerNotification;
+        if (offset + kFramesPerNotification > frames) {
+            offset = 0;
+        }
+    });
+    bench::DoNotOptimize(processed);
+
+    const double ns_per_frame = ns / static_cast<double>(streams * kFramesPerNotification);
+    bench::Report("qrs_detector", std::to_string(streams) + "streams" + (with_filter ? "_filtered" : ""))
+            .Add("ns_per_frame", ns_per_frame)
+            .Add("ns_per_notification", ns_per_frame * kFramesPerNotification)
+            .Add("streams_per_core_250hz", 1e9 / ns_per_frame / 250.0)
+            .Print();
+}
+
+int main() {
+    bool ok = true;
+    for (double bpm : {40.0, 72.0, 120.0, 180.0}) {
+        ble::SyntheticEcgOptions options;
+        options.heart_rate_bpm = bpm;
+        ok = CheckDetection(std::to_string(static_cast<int>(bpm)) + "bpm", options) && ok;
+    }
+    ble::SyntheticEcgOptions noisy;
+    noisy.noise_amplitude = 100.0;
+    noisy.mains_amplitude = 500.0;
+    noisy.rr_variability = 0.15;
+    ok = CheckDetection("72bpm_noisy", noisy) && ok;
+    ble::SyntheticEcgOptions fast_sampling;
+    fast_sampling.sample_rate_hz = 500.0;
+    fast_sampling.leads = 12;
+    ok = CheckDetection("72bpm_500hz_12leads", fast_sampling) && ok;
+    ok = CheckDetection("72bpm_amplitude_drop", ble::SyntheticEcgOptions{}, 0.3) && ok;
+    if (!ok) {
+        return 1;
+    }
+
+    for (std::size_t streams : {1, 64, 1024}) {
+        RunStreams(streams, false);
+        RunStreams(streams, true);
+    }
+    return 0;
+}
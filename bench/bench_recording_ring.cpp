@@ -0,0 +1,273 @@
+﻿#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/clock.h"
+#include "ble/recording_ring.h"
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// 每条记录的内容由序号决定，读回时可以逐字节核对
+static uint16_t PayloadLength(uint64_t sequence) {
+    return static_cast<uint16_t>(1 + sequence * 37 % 200);
+}
+
+static void MakePayload(uint64_t sequence, uint8_t* out) {
+    for (uint16_t i = 0; i < PayloadLength(sequence); ++i) {
+        out[i] = static_cast<uint8_t>(sequence * 131 + i);
+    }
+}
+
+static void AppendRecords(ble::RecordingRing& ring, std::size_t count) {
+    uint8_t payload[256];
+    for (std::size_t i = 0; i < count; ++i) {
+        const uint64_t sequence = ring.Stats().next_sequence;
+        MakePayload(sequence, payload);
+        ring.Append(sequence * 1000, static_cast<uint16_t>(sequence & 0xFF), payload, PayloadLength(sequence));
+    }
+}
+
+/**
+ * 读出全部记录：序号必须连续并以 next_sequence - 1 结尾，内容与写入的一致
+ * @return 记录数，不一致时返回 0
+ */
+static std::size_t Verify(const ble::RecordingRing& ring, const char* what) {
+    uint64_t expected = 0;
+    bool ok = true;
+    uint8_t payload[256];
+    std::size_t count = ring.ForEach([&](const ble::RingRecord& record) {
+        if (expected != 0 && record.sequence != expected) {
+            ok = false;
+        }
+        MakePayload(record.sequence, payload);
+        if (record.length != PayloadLength(record.sequence) || std::memcmp(record.data, payload, record.length) != 0 ||
+            record.timestamp_ns != record.sequence * 1000) {
+            ok = false;
+        }
+        expected = record.sequence + 1;
+    });
+    if (!ok || (count > 0 && expected != ring.Stats().next_sequence)) {
+        std::fprintf(stderr, "recording_ring: %s: records are not contiguous or differ from what was written\n", what);
+        return 0;
+    }
+    return count;
+}
+
+/**
+ * 写满好几轮后重新打开：从文件头恢复，记录不缺不多；
+ * 文件头损坏时逐块扫描找回写入位置；文件头落后时把后面已写完的记录补上
+ */
+static bool CheckRecovery(const std::string& path) {
+    ble::RecordingRingOptions options;
+    options.block_bytes = 4096;
+    options.blocks = 8;
+    std::remove(path.c_str());
+
+    ble::RecordingRing ring;
+    if (!ring.Open(path, options) || ring.Recovery().existing) {
+        std::fprintf(stderr, "recording_ring: cannot create %s\n", path.c_str());
+        return false;
+    }
+    AppendRecords(ring, 2000);
+    const std::size_t retained = Verify(ring, "after wrapping");
+    const uint64_t generation = ring.Stats().generation;
+    ring.Close();
+    // 最旧的一块被覆盖后，保留的数据至少有 blocks - 1 块
+    if (retained == 0 || generation == 0 || retained * (sizeof(ble::RingRecordHeader) + 100) < 6 * 4096) {
+        std::fprintf(stderr, "recording_ring: only %zu records kept after %llu wraps\n", retained,
+                     static_cast<unsigned long long>(generation));
+        return false;
+    }
+
+    if (!ring.Open(path, options) || !ring.Recovery().existing || !ring.Recovery().header_valid ||
+        ring.Recovery().last_sequence != 2000 || ring.Recovery().rolled_forward != 0 ||
+        Verify(ring, "reopened") != retained) {
+        std::fprintf(stderr, "recording_ring: clean reopen did not recover the same records\n");
+        return false;
+    }
+    AppendRecords(ring, 10);
+    ring.Close();
+
+    // 文件头落后：保存此时的文件头，再写 50 条后把旧文件头放回去
+    ble::MappedFile raw;
+    raw.OpenReadWrite(path, ble::kRingHeaderBytes + 8 * 4096);
+    ble::RecordingRingHeader saved;
+    std::memcpy(&saved, raw.Data(), sizeof(saved));
+    raw.Close();
+    ring.Open(path, options);
+    AppendRecords(ring, 50);
+    ring.Close();
+    raw.OpenReadWrite(path, ble::kRingHeaderBytes + 8 * 4096);
+    std::memcpy(raw.MutableData(), &saved, sizeof(saved));
+    raw.Close();
+    ring.Open(path, options);
+    const ble::RingRecovery stale = ring.Recovery();
+    const bool stale_ok = stale.header_valid && stale.rolled_forward == 50 && stale.last_sequence == 2060 &&
+                          Verify(ring, "stale header") > 0;
+    ring.Close();
+
+    // 文件头写到一半：校验和对不上，只能逐块扫描
+    raw.OpenReadWrite(path, ble::kRingHeaderBytes + 8 * 4096);
+    raw.MutableData()[offsetof(ble::RecordingRingHeader, write_offset)] ^= 0x5A;
+    raw.Close();
+    ring.Open(path, options);
+    const ble::RingRecovery torn = ring.Recovery();
+    const bool torn_ok = !torn.header_valid && torn.last_sequence == 2060 && Verify(ring, "torn header") > 0;
+    AppendRecords(ring, 5);
+    const bool continued = ring.Stats().next_sequence == 2066 && Verify(ring, "after torn header") > 0;
+    ring.Close();
+
+    // 尺寸不同的旧文件被重建
+    ble::RecordingRingOptions larger = options;
+    larger.blocks = 16;
+    ring.Open(path, larger);
+    const bool rebuilt = !ring.Recovery().existing && ring.ForEach([](const ble::RingRecord&) {}) == 0;
+    ring.Close();
+    std::remove(path.c_str());
+
+    bench::Report("recording_ring", "recovery")
+            .Add("retained_records", static_cast<double>(retained))
+            .Add("generations", static_cast<double>(generation))
+            .Add("stale_header_rolled_forward", static_cast<double>(stale.rolled_forward))
+            .Add("torn_header_last_sequence", static_cast<double>(torn.last_sequence))
+            .Print();
+    if (!stale_ok || !torn_ok || !continued || !rebuilt) {
+        std::fprintf(stderr, "recording_ring: recovery failed (stale=%d torn=%d continued=%d rebuilt=%d)\n", stale_ok,
+                     torn_ok, continued, rebuilt);
+        return false;
+    }
+    return true;
+}
+
+#ifndef _WIN32
+/**
+ * 子进程不停写入，每提交一条就把序号告诉父进程；父进程在随机时刻 SIGKILL 它，
+ * 然后重新打开文件：恢复出的最新序号必须不小于子进程报告的（最多多出被杀前刚提交的一条），
+ * 所有记录连续且内容正确。下一轮子进程从恢复的位置接着写。
+ */
+static bool CheckKillRecovery(const std::string& path, std::size_t rounds) {
+    ble::RecordingRingOptions options;
+    options.block_bytes = 4096;
+    options.blocks = 16;
+    std::remove(path.c_str());
+
+    auto* committed = static_cast<volatile uint64_t*>(
+            ::mmap(nullptr, sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (committed == MAP_FAILED) {
+        return false;
+    }
+    *committed = 0;
+    uint64_t state = 0x2545F4914F6CDD1Dull;
+    uint64_t rolled_forward = 0;
+    uint64_t max_records = 0;
+    bool ok = true;
+    for (std::size_t round = 0; round < rounds && ok; ++round) {
+        pid_t child = ::fork();
+        if (child == 0) {
+            ble::RecordingRing ring;
+            if (!ring.Open(path, options)) {
+                ::_exit(2);
+            }
+            uint8_t payload[256];
+            for (;;) {
+                const uint64_t sequence = ring.Stats().next_sequence;
+                MakePayload(sequence, payload);
+                ring.Append(sequence * 1000, static_cast<uint16_t>(sequence & 0xFF), payload, PayloadLength(sequence));
+                *committed = sequence;
+            }
+        }
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        ::usleep(static_cast<useconds_t>(5000 + state % 25000));
+        ::kill(child, SIGKILL);
+        int status = 0;
+        ::waitpid(child, &status, 0);
+
+        const uint64_t reported = *committed;
+        ble::RecordingRing ring;
+        if (!ring.Open(path, options)) {
+            ok = false;
+            break;
+        }
+        const ble::RingRecovery& recovery = ring.Recovery();
+        rolled_forward += recovery.rolled_forward;
+        std::size_t records = Verify(ring, "after kill");
+        max_records = std::max<uint64_t>(max_records, records);
+        if (records == 0 || recovery.last_sequence < reported || recovery.last_sequence > reported + 1) {
+            std::fprintf(stderr, "recording_ring: round %zu: child reported %llu, recovered up to %llu\n", round,
+                         static_cast<unsigned long long>(reported),
+                         static_cast<unsigned long long>(recovery.last_sequence));
+            ok = false;
+        }
+        ring.Close();
+    }
+    const uint64_t total = *committed;
+    ::munmap(const_cast<uint64_t*>(committed), sizeof(uint64_t));
+    std::remove(path.c_str());
+    bench::Report("recording_ring", "kill_and_recover")
+            .Add("rounds", static_cast<double>(rounds))
+            .Add("records_written", static_cast<double>(total))
+            .Add("records_retained", static_cast<double>(max_records))
+            .Add("header_lagging_recoveries", static_cast<double>(rolled_forward))
+            .Print();
+    return ok;
+}
+#endif
+
+/**
+ * 写入开销：20 字节的 ECG-7 通知，直接写进映射内存；同步到磁盘的耗时另外报告
+ */
+static void RunCost(const std::string& path) {
+    ble::RecordingRingOptions options;   // 64KB x 1024 = 64MB
+    std::remove(path.c_str());
+    ble::RecordingRing ring;
+    if (!ring.Open(path, options)) {
+        return;
+    }
+    uint8_t payload[20] = {};
+    uint64_t sequence = 0;
+    // 先写满一轮，之后的写入不再触发首次缺页
+    const std::size_t per_ring = ring.CapacityBytes() / ble::RingRecordSize(sizeof(payload));
+    for (std::size_t i = 0; i < per_ring; ++i) {
+        ring.Append(i, 0, payload, sizeof(payload));
+    }
+    double append_ns = bench::MeasureNsPerCall([&] {
+        payload[2] = static_cast<uint8_t>(++sequence);
+        ring.Append(sequence, 0, payload, sizeof(payload));
+    });
+    const uint64_t start = ble::MonotonicNowNs();
+    ring.Sync();
+    const double sync_ms = static_cast<double>(ble::MonotonicNowNs() - start) / 1e6;
+    const ble::RecordingRingStats stats = ring.Stats();
+    ring.Close();
+    std::remove(path.c_str());
+
+    bench::Report("recording_ring", "append_20B")
+            .Add("append_ns", append_ns)
+            .Add("records_per_s", 1e9 / append_ns)
+            .Add("capacity_mb", static_cast<double>(ring.CapacityBytes()) / 1048576.0)
+            .Add("generations", static_cast<double>(stats.generation))
+            .Add("sync_full_ring_ms", sync_ms)
+            .Print();
+}
+
+int main(int argc, char* argv[]) {
+    std::string path = argc > 1 ? argv[1] : "bench_recording_ring.ring";
+    bool ok = CheckRecovery(path);
+#ifndef _WIN32
+    ok = CheckKillRecovery(path, 20) && ok;
+#endif
+    RunCost(path);
+    return ok ? 0 : 1;
+}
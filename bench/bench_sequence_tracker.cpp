@@ -0,0 +1,270 @@
+﻿#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/clock.h"
+#include "ble/device_manager.h"
+#include "ble/sequence_tracker.h"
+#include "ble/sim_transport.h"
+
+/**
+ * 可复现的随机数
+ */
+struct Random {
+    uint64_t state;
+
+    explicit Random(uint64_t seed) : state(seed | 1) {}
+
+    double Unit() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return static_cast<double>(state >> 11) / 9007199254740992.0;
+    }
+};
+
+/**
+ * 按丢包、扣下一个包乱序送出、重复送出的概率生成到达顺序（序号不回绕）
+ */
+static std::vector<uint64_t> ArrivalOrder(uint64_t count, double loss, double reorder, double duplicate,
+                                          uint64_t seed) {
+    Random random(seed);
+    std::vector<uint64_t> order;
+    bool holding = false;
+    uint64_t held = 0;
+    for (uint64_t sequence = 0; sequence < count; ++sequence) {
+        if (random.Unit() < loss) {
+            continue;
+        }
+        if (!holding && random.Unit() < reorder) {
+            held = sequence;
+            holding = true;
+            continue;
+        }
+        order.push_back(sequence);
+        if (random.Unit() < duplicate) {
+            order.push_back(sequence);
+        }
+        if (holding) {
+            order.push_back(held);
+            holding = false;
+        }
+    }
+    return order;
+}
+
+/**
+ * 正确性：与直接从到达顺序算出的真值逐项比较（16 位序号回绕多次），
+ * 然后序号突然大幅回退，应当被识别为一次重新同步
+ */
+static bool CheckCounts(const std::string& name, double loss, double reorder, double duplicate) {
+    const uint64_t count = 300000;
+    std::vector<uint64_t> order = ArrivalOrder(count, loss, reorder, duplicate, 7);
+
+    // 真值：已见过的是重复；比之前最大序号小的新序号是乱序；从第一个到最大序号之间没见过的是丢失
+    std::vector<bool> seen(count, false);
+    uint64_t duplicates = 0;
+    uint64_t reordered = 0;
+    uint64_t highest = 0;
+    uint64_t unique = 0;
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        const uint64_t sequence = order[i];
+        if (seen[sequence]) {
+            ++duplicates;
+            continue;
+        }
+        seen[sequence] = true;
+        ++unique;
+        if (i > 0 && sequence < highest) {
+            ++reordered;
+        }
+        highest = std::max(highest, sequence);
+    }
+    const uint64_t expected = highest - order.front() + 1;
+    uint64_t before_first = 0;
+    for (uint64_t sequence : order) {
+        before_first += sequence < order.front();
+    }
+    const uint64_t lost = expected + before_first - unique;
+
+    ble::SequenceTracker tracker(16);
+    uint64_t now = 1000000000;
+    Random jitter(11);
+    for (uint64_t sequence : order) {
+        now += 4000000 + static_cast<uint64_t>(jitter.Unit() * 400000);  // 4~4.4ms
+        tracker.Record(static_cast<uint32_t>(sequence), now);
+    }
+    ble::SequenceStats stats = tracker.Snapshot();
+
+    bench::Report("sequence_tracker", name)
+            .Add("packets", static_cast<double>(stats.packets))
+            .Add("lost", static_cast<double>(stats.lost))
+            .Add("lost_truth", static_cast<double>(lost))
+            .Add("duplicates", static_cast<double>(stats.duplicates))
+            .Add("duplicates_truth", static_cast<double>(duplicates))
+            .Add("reordered", static_cast<double>(stats.reordered))
+            .Add("reordered_truth", static_cast<double>(reordered))
+            .Add("gaps", static_cast<double>(stats.gaps))
+            .Add("max_gap", static_cast<double>(stats.max_gap))
+            .Add("interval_p50_us", stats.InterArrivalPercentileUs(50))
+            .Add("interval_p99_us", stats.InterArrivalPercentileUs(99))
+            .Print();
+
+    bool ok = stats.packets == order.size() && stats.lost == lost && stats.duplicates == duplicates &&
+              stats.reordered == reordered && stats.expected == expected + before_first && stats.resyncs == 0;
+    // 4~4.4ms 的间隔落在 [4096, 5120) 的桶里，乱序/重复不影响到达间隔
+    ok = ok && stats.InterArrivalPercentileUs(50) >= 3584 && stats.InterArrivalPercentileUs(99) <= 5120;
+
+    // 设备重启，序号回退 1000 后继续递增
+    const uint64_t restart = highest - 1000;
+    for (uint64_t i = 0; i < 100; ++i) {
+        tracker.Record(static_cast<uint32_t>(restart + i), now + (i + 1) * 4000000);
+    }
+    ble::SequenceStats after = tracker.Snapshot().Since(stats);
+    ok = ok && after.resyncs == 1 && after.duplicates == 0 && after.reordered == 0 && after.lost == 0 &&
+         after.stale == 0 && after.expected == 100 && after.packets == 100;
+    if (!ok) {
+        std::fprintf(stderr, "sequence_tracker %s: counts differ from ground truth (resyncs %llu)\n", name.c_str(),
+                     static_cast<unsigned long long>(after.resyncs));
+    }
+    return ok;
+}
+
+/**
+ * 严重迟到的包：序号 50、51 被扣下，直到序号 199 之后才到达，比位图范围还早。
+ * 它们只能记为 stale，不能触发重新同步，之后按顺序到达的包也不能被算成大段丢失
+ */
+static bool CheckLatePacket() {
+    ble::SequenceTracker tracker(16);
+    uint64_t now = 1000000000;
+    auto record = [&](uint64_t sequence) {
+        now += 4000000;
+        tracker.Record(static_cast<uint32_t>(sequence), now);
+    };
+    for (uint64_t sequence = 0; sequence < 200; ++sequence) {
+        if (sequence != 50 && sequence != 51) {
+            record(sequence);
+        }
+    }
+    record(50);
+    record(51);
+    for (uint64_t sequence = 200; sequence < 300; ++sequence) {
+        record(sequence);
+    }
+    ble::SequenceStats stats = tracker.Snapshot();
+    bench::Report("sequence_tracker", "late_by_149")
+            .Add("packets", static_cast<double>(stats.packets))
+            .Add("expected", static_cast<double>(stats.expected))
+            .Add("lost", static_cast<double>(stats.lost))
+            .Add("stale", static_cast<double>(stats.stale))
+            .Add("gaps", static_cast<double>(stats.gaps))
+            .Add("resyncs", static_cast<double>(stats.resyncs))
+            .Print();
+    // 50、51 在位图范围以外，仍然记为丢失，但不能多出别的丢失或缺口
+    if (stats.packets != 300 || stats.expected != 300 || stats.lost != 2 || stats.stale != 2 || stats.gaps != 1 ||
+        stats.resyncs != 0 || stats.duplicates != 0) {
+        std::fprintf(stderr, "sequence_tracker: a single late packet resynchronised the tracker\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * 端到端：模拟设备按概率丢包、乱序、重复，经 DeviceManager 接收后，
+ * 统计值应当与注入的比例相符
+ */
+static bool CheckEndToEnd() {
+    const double loss = 0.02;
+    const double reorder = 0.01;
+    const double duplicate = 0.005;
+    ble::SimulatedTransport transport({}, 1000.0);
+    ble::SimDeviceConfig config;
+    config.address = 0xC0FFEE000001ull;
+    config.notification_rate_hz = 2000.0;
+    config.loss_rate = loss;
+    config.reorder_rate = reorder;
+    config.duplicate_rate = duplicate;
+    transport.AddDevice(config);
+
+    ble::DeviceManagerOptions options;
+    options.targets.push_back({"ECG-7", 0});
+    options.sequence_field = ble::kEcg7SequenceField;
+    ble::DeviceManager manager(transport, options, [](std::size_t, const ble::NotificationSlot&) {});
+    manager.Start();
+    uint64_t start = ble::MonotonicNowNs();
+    while (manager.StreamingCount() < 1 && ble::MonotonicNowNs() - start < 5000000000ull) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(3));
+    manager.Stop();
+
+    std::vector<ble::StreamSequenceStats> streams = manager.SequenceStatistics(0);
+    if (streams.size() != 1) {
+        std::fprintf(stderr, "sequence_tracker: expected one stream, got %zu\n", streams.size());
+        return false;
+    }
+    const ble::SequenceStats& stats = streams[0].stats;
+    const double expected = static_cast<double>(stats.expected);
+    bench::Report("sequence_tracker", "sim_2000hz")
+            .Add("packets", static_cast<double>(stats.packets))
+            .Add("loss_rate", stats.LossRate())
+            .Add("reordered_rate", static_cast<double>(stats.reordered) / expected)
+            .Add("duplicate_rate", static_cast<double>(stats.duplicates) / expected)
+            .Add("interval_p50_us", stats.InterArrivalPercentileUs(50))
+            .Add("interval_p99_us", stats.InterArrivalPercentileUs(99))
+            .Add("interval_max_us", stats.InterArrivalMaxUs())
+            .Print();
+
+    // 几千个包的比例，允许 50% 的统计误差
+    auto near = [](double value, double target) { return std::fabs(value - target) <= 0.5 * target; };
+    if (!near(stats.LossRate(), loss) || !near(static_cast<double>(stats.reordered) / expected, reorder) ||
+        !near(static_cast<double>(stats.duplicates) / expected, duplicate)) {
+        std::fprintf(stderr, "sequence_tracker: injected rates were not recovered\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * 开销：解码线程上每个通知多出的 Record() 耗时
+ */
+static void RunOverhead() {
+    std::vector<uint64_t> order = ArrivalOrder(1 << 16, 0.01, 0.01, 0.001, 3);
+    ble::SequenceTracker tracker(16);
+    std::size_t i = 0;
+    uint64_t now = 0;
+    double ns = bench::MeasureNsPerCall([&] {
+        now += 4000000;
+        tracker.Record(static_cast<uint32_t>(order[i]), now);
+        i = i + 1 == order.size() ? 0 : i + 1;
+    });
+    bench::Report("sequence_tracker", "record").Add("ns_per_notification", ns).Print();
+
+    uint8_t payload[20] = {0x34, 0x12};
+    double extract_ns = bench::MeasureNsPerCall([&] {
+        uint32_t sequence = 0;
+        payload[0] = static_cast<uint8_t>(payload[0] + 1);
+        ble::kEcg7SequenceField.Extract(payload, sizeof(payload), sequence);
+        bench::DoNotOptimize(sequence);
+    });
+    bench::Report("sequence_tracker", "extract_ecg7").Add("ns_per_notification", extract_ns).Print();
+}
+
+int main() {
+    bool ok = CheckCounts("clean", 0.0, 0.0, 0.0);
+    ok = CheckCounts("loss_reorder_dup", 0.02, 0.01, 0.005) && ok;
+    ok = CheckCounts("burst_heavy", 0.2, 0.05, 0.02) && ok;
+    ok = CheckLatePacket() && ok;
+    ok = CheckEndToEnd() && ok;
+    if (!ok) {
+        return 1;
+    }
+    RunOverhead();
+    return 0;
+}
@@ -0,0 +1,297 @@
+﻿#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/clock.h"
+#include "ble/latency_histogram.h"
+#include "ble/shared_samples.h"
+
+constexpr std::size_t kLeads = 3;
+constexpr std::size_t kFramesPerNotification = 3;   // 与 ECG-7 一个通知的帧数相同
+
+// 第 frame 帧第 lead 导联的样本，读取方据此逐个校验
+static int32_t Value(uint64_t frame, std::size_t lead) {
+    return static_cast<int32_t>(static_cast<uint32_t>(frame * 2654435761u) + static_cast<uint32_t>(lead));
+}
+
+/**
+ * 读取进程报告给父进程的结果
+ */
+struct ReaderResult {
+    uint64_t frames = 0;           // 校验通过的帧数
+    uint64_t skipped = 0;          // 被覆盖而跳过的帧数
+    uint64_t overruns = 0;         // Peek 失败或 Valid 为 false 的次数
+    uint64_t mismatches = 0;       // Valid 为 true 但内容不对的帧数，必须为 0
+    uint64_t elapsed_ns = 0;
+    ble::LatencySummary latency;   // 帧发布到被读取方看到的时间
+};
+
+/**
+ * 读取进程的主循环：零复制地校验每一帧，直到写入方关闭且已读到末尾
+ * @param name
+ * @param copy 用 Read() 复制而不是 Peek()/Valid()
+ * @param ready 打开对象后写一个字节通知父进程
+ */
+static ReaderResult RunReader(const std::string& name, bool copy, int ready) {
+    ReaderResult result;
+    ble::SharedSampleReader reader;
+    const bool opened = reader.Open(name);
+    const char byte = opened ? 1 : 0;
+    ssize_t written = write(ready, &byte, 1);
+    (void)written;
+    if (!opened) {
+        return result;
+    }
+    ble::LatencyHistogram latency;
+    std::vector<std::vector<int32_t>> buffers(kLeads, std::vector<int32_t>(4096));
+    std::vector<uint64_t> timestamps(4096);
+    int32_t* out[kLeads];
+    for (std::size_t lead = 0; lead < kLeads; ++lead) {
+        out[lead] = buffers[lead].data();
+    }
+
+    uint64_t cursor = 0;
+    const uint64_t start = ble::MonotonicNowNs();
+    for (;;) {
+        const bool closed = reader.Closed();
+        if (copy) {
+            const uint64_t first = cursor;
+            std::size_t frames = reader.Read(cursor, 4096, out, timestamps.data(), &result.skipped);
+            if (frames > 0) {
+                latency.Record(ble::MonotonicNowNs() - timestamps[frames - 1]);
+                const uint64_t base = cursor - frames;
+                for (std::size_t i = 0; i < frames; ++i) {
+                    for (std::size_t lead = 0; lead < kLeads; ++lead) {
+                        result.mismatches += out[lead][i] != Value(base + i, lead);
+                    }
+                }
+                result.frames += frames;
+                result.overruns += base != first;
+                continue;
+            }
+        } else {
+            ble::SampleSpan span;
+            if (!reader.Peek(cursor, 4096, span)) {
+                const uint64_t oldest = reader.Oldest();
+                result.skipped += oldest - cursor;
+                ++result.overruns;
+                cursor = oldest;
+                continue;
+            }
+            if (span.frames > 0) {
+                const uint64_t seen = ble::MonotonicNowNs();
+                const uint64_t published = span.timestamps[span.frames - 1];
+                uint64_t bad = 0;
+                for (std::size_t i = 0; i < span.frames; ++i) {
+                    for (std::size_t lead = 0; lead < kLeads; ++lead) {
+                        bad += span.leads[lead][i] != Value(span.first_frame + i, lead);
+                    }
+                }
+                if (!reader.Valid(span)) {
+                    // 读的过程中被覆盖：内容不对是预期的，整段丢弃
+                    ++result.overruns;
+                    continue;
+                }
+                latency.Record(seen - std::min(seen, published));
+                result.mismatches += bad;
+                result.frames += span.frames;
+                cursor += span.frames;
+                continue;
+            }
+        }
+        if (closed) {
+            break;
+        }
+        // 单核上忙等会把写入方饿死，没有新数据时让出 CPU
+        sched_yield();
+    }
+    result.elapsed_ns = ble::MonotonicNowNs() - start;
+    ble::LatencySnapshot snapshot;
+    snapshot.Add(latency);
+    result.latency = snapshot.Summary();
+    return result;
+}
+
+struct RunResult {
+    double write_ns = 0.0;         // 每次 Write（一个通知的 3 帧）的平均耗时
+    double write_frames_per_s = 0.0;
+    std::vector<ReaderResult> readers;
+};
+
+/**
+ * 创建共享内存环，fork 出 readers 个读取进程，写入 notifications 个通知大小的块
+ * @param name
+ * @param capacity
+ * @param readers
+ * @param notifications
+ * @param rate_hz 每秒的通知数，0 表示不限速
+ * @param copy 读取进程使用 Read()
+ */
+static RunResult RunProcesses(const std::string& name, std::size_t capacity, std::size_t readers,
+                              std::size_t notifications, double rate_hz, bool copy) {
+    RunResult result;
+    ble::SharedSampleWriter writer;
+    if (!writer.Create(name, kLeads, capacity, 250.0)) {
+        std::fprintf(stderr, "shared_samples: failed to create %s\n", name.c_str());
+        return result;
+    }
+    std::vector<pid_t> children;
+    std::vector<int> pipes;
+    for (std::size_t i = 0; i < readers; ++i) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            break;
+        }
+        pid_t child = fork();
+        if (child == 0) {
+            close(fds[0]);
+            ReaderResult reader = RunReader(name, copy, fds[1]);
+            ssize_t written = write(fds[1], &reader, sizeof(reader));
+            (void)written;
+            _exit(0);
+        }
+        close(fds[1]);
+        children.push_back(child);
+        pipes.push_back(fds[0]);
+    }
+    // 等所有读取方都打开对象，结果里才能包括全部帧
+    for (int fd : pipes) {
+        char byte = 0;
+        ssize_t got = read(fd, &byte, 1);
+        (void)got;
+    }
+
+    int32_t samples[kLeads][kFramesPerNotification];
+    const int32_t* in[kLeads];
+    for (std::size_t lead = 0; lead < kLeads; ++lead) {
+        in[lead] = samples[lead];
+    }
+    const auto period = std::chrono::nanoseconds(rate_hz > 0.0 ? static_cast<int64_t>(1e9 / rate_hz) : 0);
+    auto next = std::chrono::steady_clock::now();
+    double ticks = 0.0;
+    const uint64_t start = ble::MonotonicNowNs();
+    uint64_t frame = 0;
+    for (std::size_t n = 0; n < notifications; ++n) {
+        if (rate_hz > 0.0) {
+            next += period;
+            if (n % 16 == 0) {
+                std::this_thread::sleep_until(next);
+            }
+        }
+        for (std::size_t i = 0; i < kFramesPerNotification; ++i) {
+            for (std::size_t lead = 0; lead < kLeads; ++lead) {
+                samples[lead][i] = Value(frame + i, lead);
+            }
+        }
+        const uint64_t tick = ble::TickNow();
+        writer.Write(in, kFramesPerNotification, ble::MonotonicNowNs());
+        ticks += static_cast<double>(ble::TickNow() - tick);
+        frame += kFramesPerNotification;
+    }
+    const uint64_t elapsed = ble::MonotonicNowNs() - start;
+    writer.Close();
+
+    for (std::size_t i = 0; i < children.size(); ++i) {
+        ReaderResult reader;
+        ssize_t got = read(pipes[i], &reader, sizeof(reader));
+        close(pipes[i]);
+        int status = 0;
+        waitpid(children[i], &status, 0);
+        if (got == static_cast<ssize_t>(sizeof(reader))) {
+            result.readers.push_back(reader);
+        }
+    }
+    result.write_ns = ticks * ble::NsPerTick() / static_cast<double>(notifications);
+    result.write_frames_per_s = static_cast<double>(frame) * 1e9 / static_cast<double>(elapsed);
+    return result;
+}
+
+/**
+ * 报告并检查一次运行：校验过的帧内容必须全对，跳过的加上读到的正好是全部帧
+ */
+static bool Check(const char* name, const RunResult& run, std::size_t readers, uint64_t frames, bool lossless) {
+    bool ok = run.readers.size() == readers;
+    for (std::size_t i = 0; i < run.readers.size(); ++i) {
+        const ReaderResult& reader = run.readers[i];
+        char label[48];
+        std::snprintf(label, sizeof(label), "%s_reader%zu", name, i);
+        bench::Report("shared_samples", label)
+                .Add("write_ns", run.write_ns)
+                .Add("write_frames_per_s", run.write_frames_per_s)
+                .Add("read_frames_per_s", static_cast<double>(reader.frames) * 1e9 /
+                                                  static_cast<double>(std::max<uint64_t>(1, reader.elapsed_ns)))
+                .Add("frames", static_cast<double>(reader.frames))
+                .Add("skipped", static_cast<double>(reader.skipped))
+                .Add("overruns", static_cast<double>(reader.overruns))
+                .Add("latency_p50_us", static_cast<double>(reader.latency.p50_ns) / 1e3)
+                .Add("latency_p99_us", static_cast<double>(reader.latency.p99_ns) / 1e3)
+                .Print();
+        if (reader.mismatches != 0 || reader.frames + reader.skipped != frames || (lossless && reader.skipped != 0)) {
+            std::fprintf(stderr, "shared_samples: %s reader %zu read %llu + skipped %llu of %llu frames, %llu bad\n",
+                         name, i, static_cast<unsigned long long>(reader.frames),
+                         static_cast<unsigned long long>(reader.skipped), static_cast<unsigned long long>(frames),
+                         static_cast<unsigned long long>(reader.mismatches));
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// 写入方重建同名对象：还映射着旧对象的读取方看到关闭标记，重新打开后接上新对象
+static bool CheckRecreate(const std::string& name) {
+    ble::SharedSampleWriter writer;
+    ble::SharedSampleReader reader;
+    int32_t samples[kLeads] = {1, 2, 3};
+    const int32_t* in[kLeads] = {&samples[0], &samples[1], &samples[2]};
+    bool ok = writer.Create(name, kLeads, 100, 250.0) && writer.Capacity() == 128 && reader.Open(name);
+    if (ok) {
+        writer.Write(in, 1, 1);
+        const uint64_t created = reader.CreatedNs();
+        ble::SharedSampleWriter restarted;
+        ok = reader.Head() == 1 && !reader.Closed() && restarted.Create(name, kLeads, 64, 250.0) && reader.Closed();
+        ok = ok && reader.Open(name) && reader.Head() == 0 && reader.Capacity() == 64 && reader.CreatedNs() != created;
+        restarted.Close();
+        ble::SharedSampleReader gone;
+        ok = ok && reader.Closed() && !gone.Open(name);
+    }
+    if (!ok) {
+        std::fprintf(stderr, "shared_samples: recreating %s was not visible to the reader\n", name.c_str());
+    }
+    return ok;
+}
+
+int main() {
+    const std::string name = "/bench_shared_samples_" + std::to_string(getpid());
+    bool ok = CheckRecreate(name);
+
+    // 实时节奏：每秒 20000 个通知（6 万帧，相当于 80 台 ECG-7），环足够大，读取方不应丢帧
+    const std::size_t live = 20000;
+    for (std::size_t readers : {1, 4}) {
+        RunResult run = RunProcesses(name, 1 << 16, readers, live, 20000.0, false);
+        ok = Check(readers == 1 ? "live_1" : "live_4", run, readers, live * kFramesPerNotification, true) && ok;
+    }
+
+    // 不限速：写入方从不等待读取方，读得慢的读取方被覆盖后跳到最早的有效帧
+    const std::size_t burst = 2000000;
+    for (std::size_t readers : {1, 4}) {
+        RunResult run = RunProcesses(name, 1 << 16, readers, burst, 0.0, false);
+        ok = Check(readers == 1 ? "burst_1" : "burst_4", run, readers, burst * kFramesPerNotification, false) && ok;
+    }
+
+    // 只有 256 帧的环：读取方频繁被正在写的数据追上，Valid 必须拦下所有被改写过的段
+    {
+        RunResult run = RunProcesses(name, 256, 2, burst, 0.0, false);
+        ok = Check("tiny_ring_peek", run, 2, burst * kFramesPerNotification, false) && ok;
+        run = RunProcesses(name, 256, 2, burst, 0.0, true);
+        ok = Check("tiny_ring_read", run, 2, burst * kFramesPerNotification, false) && ok;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+﻿#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/clock.h"
+#include "ble/device_manager.h"
+#include "ble/sim_transport.h"
+
+/**
+ * 连接 devices 台模拟 ECG-7，订阅全部通知特性并持续 seconds 秒，
+ * 统计实际收到的通知速率与设定速率、丢包率的偏差
+ * @param devices
+ * @param rate_hz 每台设备的通知速率
+ * @param loss_rate
+ */
+static void RunCase(int devices, double rate_hz, double loss_rate, double seconds) {
+    ble::SimulatedTransport transport;
+    for (int i = 0; i < devices; ++i) {
+        ble::SimDeviceConfig config;
+        config.address = 0xC0FFEE000000ull + static_cast<uint64_t>(i);
+        config.notification_rate_hz = rate_hz;
+        config.jitter_us = 200;
+        config.loss_rate = loss_rate;
+        transport.AddDevice(config);
+    }
+
+    std::atomic<uint64_t> received(0);
+    std::atomic<uint64_t> bytes(0);
+    std::vector<std::shared_ptr<ble::BleConnection>> connections;
+    for (int i = 0; i < devices; ++i) {
+        auto connection = transport.ConnectAsync(0xC0FFEE000000ull + static_cast<uint64_t>(i)).get();
+        auto services = connection->DiscoverServicesAsync().get();
+        for (const auto& service : services.services) {
+            auto characteristics = connection->DiscoverCharacteristicsAsync(service).get();
+            for (const auto& characteristic : characteristics.characteristics) {
+                if (!characteristic.Has(ble::kPropertyNotify)) {
+                    continue;
+                }
+                connection->SubscribeAsync(characteristic, ble::SubscriptionKind::Notify,
+                                           [&](uint16_t, uint64_t, const uint8_t*, std::size_t length) {
+                                               received.fetch_add(1, std::memory_order_relaxed);
+                                               bytes.fetch_add(length, std::memory_order_relaxed);
+                                           }).get();
+            }
+        }
+        connections.push_back(connection);
+    }
+
+    uint64_t start = ble::MonotonicNowNs();
+    uint64_t received_start = received.load();
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    uint64_t count = received.load() - received_start;
+    double elapsed = static_cast<double>(ble::MonotonicNowNs() - start) / 1e9;
+    for (auto& connection : connections) {
+        connection->Disconnect();
+    }
+
+    double expected = devices * rate_hz;
+    double actual = static_cast<double>(count) / elapsed;
+    bench::Report("sim_transport", std::to_string(devices) + "x" + std::to_string(static_cast<int>(rate_hz)) + "Hz")
+            .Add("target_notifications_per_s", expected)
+            .Add("notifications_per_s", actual)
+            .Add("delivered_ratio", actual / expected)
+            .Add("configured_loss", loss_rate)
+            .Add("mb_per_s", static_cast<double>(bytes.load()) / elapsed / 1e6)
+            .Print();
+}
+
+/**
+ * 第一次连接失败的设备：再次广播时 DeviceManager 在同一个槽位上重新接入，第二次连接成功后开始接收
+ * @return 没有重新接入或没有收到数据时返回 false
+ */
+static bool CheckReconnectAfterFailure() {
+    ble::SimDeviceConfig config;
+    config.address = 0xC0FFEE0000F1ull;
+    config.connect_failures = 1;
+    ble::SimulatedTransport transport({config});
+
+    ble::DeviceManagerOptions options;
+    ble::DeviceTarget target;
+    target.address = config.address;
+    options.targets.push_back(target);
+    options.worker_threads = 1;
+    options.retry_interval_ms = 50;
+    std::atomic<unsigned> failures(0);
+    options.state_listener = [&](std::size_t, ble::DeviceState state) {
+        if (state == ble::DeviceState::Failed) {
+            failures.fetch_add(1);
+        }
+    };
+    std::atomic<uint64_t> notifications(0);
+    ble::DeviceManager manager(transport, options, [&](std::size_t, const ble::NotificationSlot&) {
+        notifications.fetch_add(1, std::memory_order_relaxed);
+    });
+
+    const uint64_t start = ble::MonotonicNowNs();
+    bool ok = manager.Start();
+    while (ok && manager.StreamingCount() == 0 && ble::MonotonicNowNs() - start < 5000000000ull) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    const double streaming_ms = static_cast<double>(ble::MonotonicNowNs() - start) / 1e6;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    std::vector<ble::DeviceStats> stats = manager.Stats();
+    manager.Stop();
+
+    bench::Report("sim_transport", "reconnect_after_failure")
+            .Add("failed_connects", static_cast<double>(failures.load()))
+            .Add("device_slots", static_cast<double>(stats.size()))
+            .Add("streaming_ms", streaming_ms)
+            .Add("notifications", static_cast<double>(notifications.load()))
+            .Print();
+    ok = ok && failures.load() == 1 && stats.size() == 1 && stats[0].state == ble::DeviceState::Streaming &&
+         notifications.load() > 0;
+    if (!ok) {
+        std::fprintf(stderr, "sim_transport: device was not admitted again after a failed connect\n");
+    }
+    return ok;
+}
+
+int main() {
+    // 真实 ECG-7 约 250Hz，下面依次是 1x、10x、100x 的负载
+    RunCase(1, 250.0, 0.0, 1.0);
+    RunCase(10, 250.0, 0.01, 1.0);
+    RunCase(10, 2500.0, 0.01, 1.0);
+    return CheckReconnectAfterFailure() ? 0 : 1;
+}
@@ -0,0 +1,412 @@
+﻿#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/clock.h"
+#include "ble/ecg_decoder.h"
+#include "ble/stream_server.h"
+
+// 发布的流编号：设备 0 的第 7 个流
+constexpr uint16_t kStreamId = 7;
+
+// 一个 ECG-7 大小的通知，字节 2..5 是连续编号，订阅者据此检查顺序和完整性
+static void MakePayload(uint32_t index, uint8_t* payload) {
+    payload[0] = static_cast<uint8_t>(index);
+    payload[1] = static_cast<uint8_t>(index >> 8);
+    std::memcpy(payload + 2, &index, sizeof(index));
+    for (std::size_t i = 6; i < 20; ++i) {
+        payload[i] = static_cast<uint8_t>(index * 31 + i * 7);
+    }
+}
+
+/**
+ * 一个订阅者：读到 expected 条通知或连接关闭为止，检查顺序、内容和流定义
+ */
+struct Reader {
+    ble::StreamClient client;
+    std::size_t expected = 0;
+    std::atomic<bool> paused{false};       // 先不读，模拟卡住的查看器
+
+    uint64_t received = 0;
+    uint64_t missed_records = 0;           // 编号的缺口，只在丢批时出现
+    bool defined = false;
+    bool intact = true;
+    std::vector<uint64_t> latency_ns;      // 每批第一条记录从发布到收到的时间
+    std::thread thread;
+
+    void Run() {
+        ble::StreamBatchHeader header;
+        std::vector<uint8_t> records;
+        uint32_t next = 0;
+        while (paused.load(std::memory_order_acquire)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        while (received < expected && client.ReadBatch(header, records)) {
+            const uint64_t now = ble::MonotonicNowNs();
+            bool first = true;
+            ble::ForEachStreamRecord(records.data(), records.size(),
+                                     [&](const ble::CaptureRecordHeader& record, const uint8_t* payload) {
+                if (record.kind == ble::kCaptureRecordDefinition) {
+                    ble::CaptureCharacteristicDefinition definition;
+                    std::memcpy(&definition, payload, sizeof(definition));
+                    defined = defined || (record.characteristic_id == kStreamId && definition.uuid == ble::kEcg7DataUuid);
+                    return true;
+                }
+                if (first) {
+                    latency_ns.push_back(now - std::min(now, record.timestamp_ns));
+                    first = false;
+                }
+                uint32_t index;
+                std::memcpy(&index, payload + 2, sizeof(index));
+                uint8_t expected_payload[20];
+                MakePayload(index, expected_payload);
+                if (!defined || record.characteristic_id != kStreamId || record.length != 20 ||
+                    std::memcmp(payload, expected_payload, 20) != 0 || index < next) {
+                    intact = false;
+                }
+                missed_records += index - std::min(index, next);
+                next = index + 1;
+                ++received;
+                return true;
+            });
+        }
+    }
+};
+
+struct FanoutResult {
+    double publish_ns = 0.0;               // 每次 Publish 的平均耗时
+    double records_per_s = 0.0;            // 所有订阅者合计收到的通知速率
+    uint64_t latency_p50_ns = 0;
+    uint64_t latency_p99_ns = 0;
+    ble::StreamServerStats stats;
+    std::vector<ble::StreamSubscriberStats> subscribers;   // 关闭前的快照
+    std::vector<std::unique_ptr<Reader>> readers;
+};
+
+/**
+ * 启动服务器和 clients 个订阅者，发布 count 条通知
+ * @param options
+ * @param clients
+ * @param count
+ * @param rate_hz 0 表示不限速
+ * @param tcp 用 TCP 回环连接，否则用 Unix 域套接字
+ * @param stalled 额外几个先不读数据的订阅者，发布完成后才开始读
+ */
+static FanoutResult RunFanout(ble::StreamServerOptions options, std::size_t clients, std::size_t count,
+                              double rate_hz, bool tcp, std::size_t stalled = 0) {
+    FanoutResult result;
+    ble::StreamServer server(options);
+    if (!server.Open()) {
+        std::fprintf(stderr, "stream_server: failed to open the server\n");
+        return result;
+    }
+    for (std::size_t i = 0; i < clients + stalled; ++i) {
+        auto reader = std::make_unique<Reader>();
+        reader->expected = count;
+        const bool ok = tcp ? reader->client.ConnectTcp(server.TcpPort())
+                            : reader->client.ConnectUnix(options.unix_path);
+        if (!ok) {
+            std::fprintf(stderr, "stream_server: client %zu failed to connect\n", i);
+            return result;
+        }
+        if (i >= clients) {
+            // 接收缓冲区尽量小，让积压尽快落到服务器的发送队列上
+            reader->client.SetReceiveBuffer(4096);
+            reader->paused.store(true);
+        }
+        result.readers.push_back(std::move(reader));
+    }
+    // 等服务器接受全部连接，否则前面的批会错过一部分订阅者
+    while (server.Stats().subscribers < clients + stalled) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    for (auto& reader : result.readers) {
+        Reader* r = reader.get();
+        reader->thread = std::thread([r] { r->Run(); });
+    }
+
+    uint8_t payload[20];
+    const auto period = std::chrono::nanoseconds(rate_hz > 0.0 ? static_cast<int64_t>(1e9 / rate_hz) : 0);
+    auto next = std::chrono::steady_clock::now();
+    double publish_ns = 0.0;
+    const uint64_t start = ble::MonotonicNowNs();
+    for (std::size_t i = 0; i < count; ++i) {
+        if (rate_hz > 0.0) {
+            // 按 1ms 的节奏成组发布，近似设备的通知间隔
+            next += period;
+            if (i % 32 == 0) {
+                std::this_thread::sleep_until(next);
+            }
+        }
+        MakePayload(static_cast<uint32_t>(i), payload);
+        const uint64_t tick = ble::TickNow();
+        server.Publish(ble::MonotonicNowNs(), kStreamId, ble::kEcg7DataUuid, payload, sizeof(payload));
+        publish_ns += static_cast<double>(ble::TickNow() - tick);
+    }
+    server.Flush();
+    for (std::size_t i = 0; i < clients; ++i) {
+        result.readers[i]->thread.join();
+    }
+    const uint64_t elapsed = ble::MonotonicNowNs() - start;
+    result.subscribers = server.Subscribers();
+    result.stats = server.Stats();
+    // 卡住的订阅者这时才开始读，读完积压后连接被 Close 断开
+    for (std::size_t i = clients; i < result.readers.size(); ++i) {
+        result.readers[i]->paused.store(false, std::memory_order_release);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    if (stalled > 0) {
+        // 最后的丢批要等下一个批到达才能从缺口看出来
+        MakePayload(static_cast<uint32_t>(count), payload);
+        server.Publish(ble::MonotonicNowNs(), kStreamId, ble::kEcg7DataUuid, payload, sizeof(payload));
+        server.Flush();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        result.stats = server.Stats();
+    }
+    server.Close();
+    for (std::size_t i = clients; i < result.readers.size(); ++i) {
+        result.readers[i]->thread.join();
+    }
+
+    result.publish_ns = publish_ns * ble::NsPerTick() / static_cast<double>(count);
+    uint64_t received = 0;
+    std::vector<uint64_t> latency;
+    for (std::size_t i = 0; i < clients; ++i) {
+        received += result.readers[i]->received;
+        latency.insert(latency.end(), result.readers[i]->latency_ns.begin(), result.readers[i]->latency_ns.end());
+    }
+    result.records_per_s = static_cast<double>(received) * 1e9 / static_cast<double>(elapsed);
+    result.latency_p50_ns = bench::Percentile(latency, 50);
+    result.latency_p99_ns = bench::Percentile(latency, 99);
+    return result;
+}
+
+// 不丢批的订阅者必须按顺序收到全部通知
+static bool CheckComplete(const char* name, const FanoutResult& result, std::size_t clients, std::size_t count) {
+    for (std::size_t i = 0; i < clients && i < result.readers.size(); ++i) {
+        const Reader& reader = *result.readers[i];
+        if (reader.received != count || reader.missed_records != 0 || !reader.intact ||
+            reader.client.MissedBatches() != 0) {
+            std::fprintf(stderr, "stream_server: %s client %zu received %llu of %zu (missed %llu, intact %d)\n", name,
+                         i, static_cast<unsigned long long>(reader.received), count,
+                         static_cast<unsigned long long>(reader.missed_records), reader.intact ? 1 : 0);
+            return false;
+        }
+    }
+    return result.readers.size() >= clients;
+}
+
+/**
+ * 卡住的订阅者恰好丢掉了带某个流定义的批：恢复读取后，在这个流的第一条通知之前
+ * 必须先收到补发的定义快照，而不是一直收到无法解释的流编号
+ * @return 行为不符合预期时返回 false
+ */
+static bool CheckDroppedDefinition(const std::string& path) {
+    constexpr uint16_t kLateStream = 9;
+    const ble::Guid late_uuid = ble::kEcg7DataUuid;
+    ble::StreamServerOptions options;
+    options.unix_path = path;
+    options.max_queued_bytes = 64 * 1024;
+    options.policy = ble::SlowSubscriberPolicy::Drop;
+    ble::StreamServer server(options);
+    ble::StreamClient client;
+    if (!server.Open() || !client.ConnectUnix(path)) {
+        std::fprintf(stderr, "stream_server: failed to set up the dropped definition check\n");
+        return false;
+    }
+    client.SetReceiveBuffer(4096);
+
+    // 先用 kStreamId 把积压填到上限，直到服务器开始丢批
+    auto dropped = [&server] {
+        std::vector<ble::StreamSubscriberStats> subscribers = server.Subscribers();
+        return subscribers.empty() ? 0 : subscribers[0].dropped_batches;
+    };
+    uint8_t payload[20];
+    const uint64_t deadline = ble::MonotonicNowNs() + 5000000000ull;
+    uint32_t index = 0;
+    while (dropped() == 0 && ble::MonotonicNowNs() < deadline) {
+        for (int i = 0; i < 64; ++i, ++index) {
+            MakePayload(index, payload);
+            server.Publish(ble::MonotonicNowNs(), kStreamId, ble::kEcg7DataUuid, payload, sizeof(payload));
+        }
+        server.Flush();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    // 新流的定义和第一条通知放在一个与刚被丢弃的批同样大的批里，订阅者仍然卡着，这一批一定被丢弃
+    const uint64_t before = dropped();
+    MakePayload(index++, payload);
+    server.Publish(ble::MonotonicNowNs(), kLateStream, late_uuid, payload, sizeof(payload));
+    for (int i = 0; i < 63; ++i, ++index) {
+        MakePayload(index, payload);
+        server.Publish(ble::MonotonicNowNs(), kStreamId, ble::kEcg7DataUuid, payload, sizeof(payload));
+    }
+    server.Flush();
+    while (dropped() == before && ble::MonotonicNowNs() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    const bool definition_dropped = dropped() > before;
+
+    // 订阅者恢复读取，新流继续发布，直到订阅者收到它的一条通知
+    std::atomic<bool> done{false};
+    bool defined_before_data = false;
+    bool late_data = false;
+    std::thread reader([&] {
+        ble::StreamBatchHeader header;
+        std::vector<uint8_t> records;
+        bool defined = false;
+        while (!late_data && client.ReadBatch(header, records)) {
+            ble::ForEachStreamRecord(records.data(), records.size(),
+                                     [&](const ble::CaptureRecordHeader& record, const uint8_t* data) {
+                if (record.characteristic_id != kLateStream) {
+                    return true;
+                }
+                if (record.kind == ble::kCaptureRecordDefinition) {
+                    ble::CaptureCharacteristicDefinition definition;
+                    std::memcpy(&definition, data, sizeof(definition));
+                    defined = defined || definition.uuid == late_uuid;
+                    return true;
+                }
+                defined_before_data = defined;
+                late_data = true;
+                return false;
+            });
+        }
+        done.store(true);
+    });
+    while (!done.load() && ble::MonotonicNowNs() < deadline + 5000000000ull) {
+        MakePayload(index++, payload);
+        server.Publish(ble::MonotonicNowNs(), kLateStream, late_uuid, payload, sizeof(payload));
+        server.Flush();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::vector<ble::StreamSubscriberStats> subscribers = server.Subscribers();
+    const uint64_t resyncs = subscribers.empty() ? 0 : subscribers[0].resyncs;
+    const uint64_t total_dropped = dropped();
+    server.Close();
+    reader.join();
+    client.Close();
+
+    bench::Report("stream_server", "dropped_definition")
+            .Add("dropped_batches", static_cast<double>(total_dropped))
+            .Add("resyncs", static_cast<double>(resyncs))
+            .Add("defined_before_data", defined_before_data ? 1.0 : 0.0)
+            .Print();
+    const bool ok = definition_dropped && late_data && defined_before_data && resyncs > 0;
+    if (!ok) {
+        std::fprintf(stderr, "stream_server: stream definition lost with a dropped batch (dropped=%d data=%d)\n",
+                     definition_dropped ? 1 : 0, late_data ? 1 : 0);
+    }
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    const std::string path = argc > 1 ? argv[1] : "bench_stream_server.sock";
+    bool ok = true;
+
+    // 不限速发布，订阅者数从 1 增加到 64：发布耗时和批缓冲区个数不应随订阅者数增长
+    const std::size_t count = 100000;
+    for (std::size_t clients : {1, 8, 32, 64}) {
+        ble::StreamServerOptions options;
+        options.unix_path = path;
+        options.max_queued_bytes = 64 * 1024 * 1024;   // 这里只测吞吐，不让慢订阅者丢批
+        FanoutResult result = RunFanout(options, clients, count, 0.0, false);
+        char name[32];
+        std::snprintf(name, sizeof(name), "unix_%zu_clients", clients);
+        bench::Report("stream_server", name)
+                .Add("publish_ns", result.publish_ns)
+                .Add("delivered_records_per_s", result.records_per_s)
+                .Add("batches", static_cast<double>(result.stats.batches))
+                .Add("wire_mb", static_cast<double>(result.stats.bytes) / (1024.0 * 1024.0))
+                .Add("pool_batches", static_cast<double>(result.stats.pool_batches))
+                .Add("latency_p50_ms", static_cast<double>(result.latency_p50_ns) / 1e6)
+                .Add("latency_p99_ms", static_cast<double>(result.latency_p99_ns) / 1e6)
+                .Print();
+        ok = CheckComplete(name, result, clients, count) && ok;
+        // 同一个批被所有订阅者共享：缓冲区个数最多是全部数据的批数，与订阅者数无关
+        if (result.stats.pool_batches > result.stats.batches + 2) {
+            std::fprintf(stderr, "stream_server: %zu batch buffers for %llu batches\n", result.stats.pool_batches,
+                         static_cast<unsigned long long>(result.stats.batches));
+            ok = false;
+        }
+    }
+
+    // 实时节奏：约 8000 个通知每秒（相当于上百台 ECG-7），延迟主要来自 flush_interval_ms
+    {
+        ble::StreamServerOptions options;
+        options.unix_path = path;
+        FanoutResult result = RunFanout(options, 16, 8000, 8000.0, false);
+        bench::Report("stream_server", "unix_16_clients_live")
+                .Add("publish_ns", result.publish_ns)
+                .Add("batches", static_cast<double>(result.stats.batches))
+                .Add("pool_batches", static_cast<double>(result.stats.pool_batches))
+                .Add("latency_p50_ms", static_cast<double>(result.latency_p50_ns) / 1e6)
+                .Add("latency_p99_ms", static_cast<double>(result.latency_p99_ns) / 1e6)
+                .Print();
+        ok = CheckComplete("live", result, 16, 8000) && ok;
+        if (result.latency_p50_ns > 50000000ull) {
+            std::fprintf(stderr, "stream_server: live latency p50 %.1f ms\n",
+                         static_cast<double>(result.latency_p50_ns) / 1e6);
+            ok = false;
+        }
+    }
+
+    // TCP 回环
+    {
+        ble::StreamServerOptions options;
+        options.tcp = true;
+        options.max_queued_bytes = 64 * 1024 * 1024;
+        FanoutResult result = RunFanout(options, 8, count, 0.0, true);
+        bench::Report("stream_server", "tcp_8_clients")
+                .Add("publish_ns", result.publish_ns)
+                .Add("delivered_records_per_s", result.records_per_s)
+                .Add("latency_p50_ms", static_cast<double>(result.latency_p50_ns) / 1e6)
+                .Add("latency_p99_ms", static_cast<double>(result.latency_p99_ns) / 1e6)
+                .Print();
+        ok = CheckComplete("tcp", result, 8, count) && ok;
+    }
+
+    // 一个订阅者卡住：它的积压到上限后新批被丢弃，其他订阅者照常收到全部数据；
+    // 它恢复读取后从 sequence 的缺口看到的丢批数与服务器的计数一致
+    for (ble::SlowSubscriberPolicy policy : {ble::SlowSubscriberPolicy::Drop, ble::SlowSubscriberPolicy::Disconnect}) {
+        const bool drop = policy == ble::SlowSubscriberPolicy::Drop;
+        ble::StreamServerOptions options;
+        options.unix_path = path;
+        options.max_queued_bytes = 256 * 1024;
+        options.policy = policy;
+        FanoutResult result = RunFanout(options, 8, 40000, 40000.0, false, 1);
+        uint64_t server_dropped = 0;
+        for (const auto& subscriber : result.subscribers) {
+            server_dropped += subscriber.dropped_batches;
+        }
+        const Reader& slow = *result.readers.back();
+        bench::Report("stream_server", drop ? "stalled_client_drop" : "stalled_client_disconnect")
+                .Add("dropped_batches", static_cast<double>(result.stats.dropped_batches))
+                .Add("slow_disconnects", static_cast<double>(result.stats.slow_disconnects))
+                .Add("stalled_received", static_cast<double>(slow.received))
+                .Add("stalled_missed_batches", static_cast<double>(slow.client.MissedBatches()))
+                .Add("latency_p99_ms", static_cast<double>(result.latency_p99_ns) / 1e6)
+                .Print();
+        ok = CheckComplete(drop ? "stalled_drop" : "stalled_disconnect", result, 8, 40000) && ok;
+        if (drop && (server_dropped == 0 || slow.client.MissedBatches() != server_dropped || !slow.intact ||
+                     result.stats.slow_disconnects != 0)) {
+            std::fprintf(stderr, "stream_server: stalled client dropped %llu batches, client saw %llu missing\n",
+                         static_cast<unsigned long long>(server_dropped),
+                         static_cast<unsigned long long>(slow.client.MissedBatches()));
+            ok = false;
+        }
+        if (!drop && (result.stats.slow_disconnects != 1 || result.stats.dropped_batches != 0)) {
+            std::fprintf(stderr, "stream_server: stalled client was not disconnected\n");
+            ok = false;
+        }
+    }
+    ok = CheckDroppedDefinition(path) && ok;
+    return ok ? 0 : 1;
+}
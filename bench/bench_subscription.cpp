@@ -0,0 +1,197 @@
+﻿#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench/bench_common.h"
+#include "ble/clock.h"
+#include "ble/gatt_discovery.h"
+#include "ble/sim_transport.h"
+#include "ble/subscription.h"
+
+/**
+ * ECG-7 的服务布局加上一个带 notify_count 个通知特性和一个指示特性的服务
+ * @param notify_count
+ */
+static std::vector<ble::SimServiceSpec> ServicesWithStreams(int notify_count) {
+    std::vector<ble::SimServiceSpec> services = ble::Ecg7Services();
+    ble::SimServiceSpec extra;
+    extra.uuid = ble::ShortUuid(0xFFE0);
+    for (int i = 0; i < notify_count; ++i) {
+        extra.characteristics.push_back({ble::ShortUuid(static_cast<uint16_t>(0xFFE1 + i)), ble::kPropertyNotify});
+    }
+    extra.characteristics.push_back({ble::ShortUuid(0xFFEF), ble::kPropertyIndicate});
+    services.push_back(extra);
+    return services;
+}
+
+/**
+ * 对比逐个写 CCCD 与 SubscriptionSet 一次性启用全部订阅的耗时，
+ * 并确认每个订阅都收到了数据
+ * @param notify_count 额外的通知特性数
+ * @param latency_us 每个 GATT 请求的耗时
+ * @return 有订阅未启用或没有收到数据时返回 false
+ */
+static bool RunCase(int notify_count, uint32_t latency_us) {
+    ble::SimDeviceConfig config;
+    config.address = 0xC0FFEE00000A;
+    config.services = ServicesWithStreams(notify_count);
+    config.request_latency_us = latency_us;
+    ble::SimulatedTransport transport({config});
+
+    bool ok = true;
+    for (bool batched : {false, true}) {
+        auto connection = transport.ConnectAsync(config.address).get();
+        ble::DiscoveryResult discovery = ble::DiscoverGatt(*connection);
+
+        std::array<std::atomic<uint64_t>, 64> received{};
+        std::vector<ble::SubscriptionRequest> requests;
+        discovery.ForEachCharacteristic([&](const ble::GattCharacteristicInfo& characteristic) {
+            ble::SubscriptionRequest request;
+            if (!ble::PreferredSubscriptionKind(characteristic, request.kind) || requests.size() >= received.size()) {
+                return;
+            }
+            request.characteristic = characteristic;
+            std::atomic<uint64_t>* counter = &received[requests.size()];
+            request.handler = [counter](uint16_t, uint64_t, const uint8_t*, std::size_t) {
+                counter->fetch_add(1, std::memory_order_relaxed);
+            };
+            requests.push_back(std::move(request));
+        });
+        const std::size_t expected = requests.size();
+
+        ble::SubscriptionSet subscriptions(connection);
+        uint64_t start = ble::MonotonicNowNs();
+        if (batched) {
+            subscriptions.Activate(std::move(requests));
+        } else {
+            // 旧流程：一个特性写完 CCCD 再写下一个
+            for (auto& request : requests) {
+                std::vector<ble::SubscriptionRequest> single;
+                single.push_back(std::move(request));
+                subscriptions.Activate(std::move(single));
+            }
+        }
+        double total_ms = static_cast<double>(ble::MonotonicNowNs() - start) / 1e6;
+
+        const std::size_t active = subscriptions.ActiveCount();
+        std::vector<ble::SubscriptionRecord> records = subscriptions.Records();
+        double max_activation = 0.0;
+        for (const auto& record : records) {
+            max_activation = std::max(max_activation, record.activation_ms);
+        }
+
+        // 每个订阅 250Hz，等 100ms 足够每个流都收到数据
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        std::size_t streams_with_data = 0;
+        for (std::size_t i = 0; i < expected; ++i) {
+            streams_with_data += received[i].load() > 0 ? 1 : 0;
+        }
+        subscriptions.UnsubscribeAll();
+        connection->Disconnect();
+
+        bench::Report("subscription", std::to_string(expected) + "chr_" + std::to_string(latency_us / 1000) + "ms_" +
+                                              (batched ? "batched" : "sequential"))
+                .Add("subscriptions", static_cast<double>(expected))
+                .Add("active", static_cast<double>(active))
+                .Add("streams_with_data", static_cast<double>(streams_with_data))
+                .Add("total_ms", total_ms)
+                .Add("max_activation_ms", max_activation)
+                .Print();
+
+        if (active != expected || streams_with_data != expected) {
+            std::fprintf(stderr, "subscription: %zu/%zu activated, %zu/%zu streams received data\n", active,
+                         expected, streams_with_data, expected);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+/**
+ * CCCD 写入总在 latency_ms 之后才完成、结果为 status 的连接，只统计取消订阅的次数
+ */
+class LateConnection : public ble::BleConnection {
+public:
+    LateConnection(uint32_t latency_ms, ble::GattStatus status) : latency_ms_(latency_ms), status_(status) {}
+
+    uint64_t Address() const override { return 0xC0FFEE00000B; }
+    std::string Name() const override { return "late"; }
+
+    std::future<ble::ServicesResult> DiscoverServicesAsync() override {
+        std::promise<ble::ServicesResult> result;
+        result.set_value({});
+        return result.get_future();
+    }
+
+    std::future<ble::CharacteristicsResult> DiscoverCharacteristicsAsync(const ble::GattServiceInfo&) override {
+        std::promise<ble::CharacteristicsResult> result;
+        result.set_value({});
+        return result.get_future();
+    }
+
+    std::future<ble::GattStatus> RestoreCharacteristicsAsync(const std::vector<ble::GattCharacteristicInfo>&) override {
+        std::promise<ble::GattStatus> result;
+        result.set_value(ble::GattStatus::Success);
+        return result.get_future();
+    }
+
+    std::future<ble::GattStatus> SubscribeAsync(const ble::GattCharacteristicInfo&, ble::SubscriptionKind,
+                                                ble::NotificationHandler) override {
+        // 与 WinRT 一样，回调在 CCCD 写入完成前就已注册
+        return std::async(std::launch::async, [latency_ms = latency_ms_, status = status_] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(latency_ms));
+            return status;
+        });
+    }
+
+    void Unsubscribe(const ble::GattCharacteristicInfo&) override { unsubscribed.fetch_add(1); }
+    void Disconnect() override {}
+
+    std::atomic<unsigned> unsubscribed{0};
+
+private:
+    uint32_t latency_ms_;
+    ble::GattStatus status_;
+};
+
+/**
+ * 超时之后才完成的订阅：不论迟到的结果成功还是失败，已注册的回调都要被取消
+ * @param status 迟到的结果
+ */
+static bool CheckLateCompletion(ble::GattStatus status) {
+    auto connection = std::make_shared<LateConnection>(50, status);
+    ble::AbandonedRequests abandoned;
+    std::size_t activated;
+    {
+        ble::SubscriptionSet subscriptions(connection, &abandoned);
+        std::vector<ble::SubscriptionRequest> requests(1);
+        requests[0].characteristic.uuid = ble::ShortUuid(0xFFF1);
+        requests[0].characteristic.properties = ble::kPropertyNotify;
+        activated = subscriptions.Activate(std::move(requests), 10);
+    }
+    abandoned.Drain();
+    if (activated != 0 || connection->unsubscribed.load() != 1) {
+        std::fprintf(stderr, "subscription: late %s completion unsubscribed %u times\n", ble::GattStatusName(status),
+                     connection->unsubscribed.load());
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    bool ok = true;
+    ok &= CheckLateCompletion(ble::GattStatus::Success);
+    ok &= CheckLateCompletion(ble::GattStatus::AccessDenied);
+    ok &= RunCase(0, 30000);
+    ok &= RunCase(3, 30000);
+    ok &= RunCase(6, 7500);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,41 @@
+# 由 run_benchmarks 目标调用：
+#   BENCHMARKS  基准测试可执行文件列表，用 | 分隔
+#   OUTPUT      汇总结果文件（JSON Lines）
+#   SOURCE_DIR  源码目录，用来记录 git 版本
+
+execute_process(
+        COMMAND git describe --always --dirty
+        WORKING_DIRECTORY ${SOURCE_DIR}
+        OUTPUT_VARIABLE revision
+        OUTPUT_STRIP_TRAILING_WHITESPACE
+        ERROR_QUIET
+)
+if (NOT revision)
+    set(revision "unknown")
+endif ()
+string(TIMESTAMP now "%Y-%m-%dT%H:%M:%SZ" UTC)
+
+# 第一行记录本次运行的版本和时间，后面每行是一条基准测试结果
+file(WRITE ${OUTPUT} "{\"suite\":\"bluetoothTest\",\"revision\":\"${revision}\",\"timestamp\":\"${now}\",\"system\":\"${CMAKE_HOST_SYSTEM_NAME}\"}\n")
+
+string(REPLACE "|" ";" BENCHMARKS "${BENCHMARKS}")
+
+set(failed)
+foreach (bench ${BENCHMARKS})
+    get_filename_component(name ${bench} NAME_WE)
+    message(STATUS "Running ${name}")
+    execute_process(
+            COMMAND ${bench}
+            OUTPUT_VARIABLE output
+            RESULT_VARIABLE result
+    )
+    file(APPEND ${OUTPUT} "${output}")
+    if (NOT result EQUAL 0)
+        list(APPEND failed ${name})
+    endif ()
+endforeach ()
+
+message(STATUS "Benchmark results written to ${OUTPUT}")
+if (failed)
+    message(FATAL_ERROR "Benchmarks failed: ${failed}")
+endif ()
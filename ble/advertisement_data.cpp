@@ -0,0 +1,213 @@
+﻿#include "ble/advertisement_data.h"
+
+#include <cstring>
+
+namespace ble {
+
+namespace {
+
+// 基础 UUID 00000000-0000-1000-8000-00805F9B34FB 按广播字节序的前 12 字节，后 4 字节是短值
+constexpr uint8_t kBaseUuidPrefix[12] = {0xFB, 0x34, 0x9B, 0x5F, 0x80, 0x00, 0x00, 0x80, 0x00, 0x10, 0x00, 0x00};
+
+uint32_t ReadLe(const uint8_t* data, std::size_t bytes) {
+    uint32_t value = 0;
+    for (std::size_t i = 0; i < bytes; ++i) {
+        value |= static_cast<uint32_t>(data[i]) << (i * 8);
+    }
+    return value;
+}
+
+}  // namespace
+
+bool UuidList::Short(std::size_t i, uint32_t& value) const {
+    const uint8_t* uuid = data + i * width;
+    if (width == 16) {
+        if (std::memcmp(uuid, kBaseUuidPrefix, sizeof(kBaseUuidPrefix)) != 0) {
+            return false;
+        }
+        value = ReadLe(uuid + 12, 4);
+        return true;
+    }
+    value = ReadLe(uuid, width);
+    return true;
+}
+
+Guid UuidList::At(std::size_t i) const {
+    const uint8_t* uuid = data + i * width;
+    // 短 UUID 先补成完整的 128 位
+    uint8_t expanded[16] = {};
+    if (width != 16) {
+        std::memcpy(expanded, kBaseUuidPrefix, sizeof(kBaseUuidPrefix));
+        std::memcpy(expanded + 12, uuid, width);
+        uuid = expanded;
+    }
+    Guid result;
+    for (int k = 0; k < 8; ++k) {
+        result.Data4[k] = uuid[7 - k];
+    }
+    result.Data3 = static_cast<uint16_t>(ReadLe(uuid + 8, 2));
+    result.Data2 = static_cast<uint16_t>(ReadLe(uuid + 10, 2));
+    result.Data1 = ReadLe(uuid + 12, 4);
+    return result;
+}
+
+void GuidToAdBytes(const Guid& uuid, uint8_t* out) {
+    for (int k = 0; k < 8; ++k) {
+        out[k] = uuid.Data4[7 - k];
+    }
+    out[8] = static_cast<uint8_t>(uuid.Data3);
+    out[9] = static_cast<uint8_t>(uuid.Data3 >> 8);
+    out[10] = static_cast<uint8_t>(uuid.Data2);
+    out[11] = static_cast<uint8_t>(uuid.Data2 >> 8);
+    for (int k = 0; k < 4; ++k) {
+        out[12 + k] = static_cast<uint8_t>(uuid.Data1 >> (k * 8));
+    }
+}
+
+bool AdvertisementData::HasService(uint32_t short_uuid) const {
+    for (std::size_t l = 0; l < uuid_list_count; ++l) {
+        const UuidList& list = uuid_lists[l];
+        for (std::size_t i = 0; i < list.count; ++i) {
+            uint32_t value;
+            if (list.Short(i, value) && value == short_uuid) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool AdvertisementData::HasService(const uint8_t* uuid128) const {
+    for (std::size_t l = 0; l < uuid_list_count; ++l) {
+        const UuidList& list = uuid_lists[l];
+        if (list.width != 16) {
+            continue;
+        }
+        for (std::size_t i = 0; i < list.count; ++i) {
+            if (std::memcmp(list.data + i * 16, uuid128, 16) == 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool AdvertisementData::HasService(const Guid& uuid) const {
+    uint8_t bytes[16];
+    GuidToAdBytes(uuid, bytes);
+    // 基础 UUID 形式的在任何宽度的列表里都可能出现
+    if (std::memcmp(bytes, kBaseUuidPrefix, sizeof(kBaseUuidPrefix)) == 0) {
+        return HasService(uuid.Data1);
+    }
+    return HasService(bytes);
+}
+
+const ManufacturerData* AdvertisementData::Manufacturer(uint16_t company) const {
+    for (std::size_t i = 0; i < manufacturer_data_count; ++i) {
+        if (manufacturer_data[i].company == company) {
+            return &manufacturer_data[i];
+        }
+    }
+    return nullptr;
+}
+
+bool ParseAdvertisementData(const uint8_t* raw, std::size_t length, AdvertisementData& out) {
+    // 只重置标量和计数，数组里超出计数的元素不会被读到，不必清零
+    out.local_name = std::string_view();
+    out.complete_name = false;
+    out.has_flags = false;
+    out.flags = 0;
+    out.has_tx_power = false;
+    out.tx_power = 0;
+    out.uuid_list_count = 0;
+    out.manufacturer_data_count = 0;
+    out.service_data_count = 0;
+    out.structures = 0;
+    out.overflow = 0;
+    out.malformed = false;
+    AdReader reader(raw, length);
+    AdStructure ad;
+    while (reader.Next(ad)) {
+        ++out.structures;
+        switch (ad.type) {
+            case kAdFlags:
+                if (ad.length == 0) {
+                    out.malformed = true;
+                } else if (!out.has_flags) {
+                    out.has_flags = true;
+                    out.flags = ad.data[0];
+                }
+                break;
+            case kAdIncompleteUuid16:
+            case kAdCompleteUuid16:
+            case kAdIncompleteUuid32:
+            case kAdCompleteUuid32:
+            case kAdIncompleteUuid128:
+            case kAdCompleteUuid128: {
+                // 0x02/0x03 是 16 位，0x04/0x05 是 32 位，0x06/0x07 是 128 位
+                const uint8_t width = ad.type <= kAdCompleteUuid16 ? 2 : ad.type <= kAdCompleteUuid32 ? 4 : 16;
+                if (ad.length % width != 0) {
+                    out.malformed = true;
+                }
+                if (ad.length < width) {
+                    break;
+                }
+                if (out.uuid_list_count == kMaxAdUuidLists) {
+                    ++out.overflow;
+                    break;
+                }
+                UuidList& list = out.uuid_lists[out.uuid_list_count++];
+                list.data = ad.data;
+                list.count = ad.length / width;
+                list.width = width;
+                list.complete = (ad.type & 1) != 0;
+                break;
+            }
+            case kAdShortenedName:
+            case kAdCompleteName:
+                if (ad.type == kAdCompleteName ? !out.complete_name : out.local_name.empty()) {
+                    out.local_name = std::string_view(reinterpret_cast<const char*>(ad.data), ad.length);
+                    out.complete_name = ad.type == kAdCompleteName;
+                }
+                break;
+            case kAdTxPower:
+                if (ad.length != 1) {
+                    out.malformed = true;
+                } else if (!out.has_tx_power) {
+                    out.has_tx_power = true;
+                    out.tx_power = static_cast<int8_t>(ad.data[0]);
+                }
+                break;
+            case kAdServiceData16:
+                if (ad.length < 2) {
+                    out.malformed = true;
+                } else if (out.service_data_count == kMaxAdServiceData) {
+                    ++out.overflow;
+                } else {
+                    ServiceData& data = out.service_data[out.service_data_count++];
+                    data.uuid = static_cast<uint16_t>(ReadLe(ad.data, 2));
+                    data.data = ad.data + 2;
+                    data.length = ad.length - 2;
+                }
+                break;
+            case kAdManufacturerData:
+                if (ad.length < 2) {
+                    out.malformed = true;
+                } else if (out.manufacturer_data_count == kMaxAdManufacturerData) {
+                    ++out.overflow;
+                } else {
+                    ManufacturerData& data = out.manufacturer_data[out.manufacturer_data_count++];
+                    data.company = static_cast<uint16_t>(ReadLe(ad.data, 2));
+                    data.data = ad.data + 2;
+                    data.length = ad.length - 2;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    out.malformed = out.malformed || reader.Malformed();
+    return !out.malformed;
+}
+
+}  // namespace ble
@@ -0,0 +1,167 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "ble/guid.h"
+
+namespace ble {
+
+// 常用的 AD 类型（蓝牙核心规范补充 CSS 第 A 部分）
+enum AdType : uint8_t {
+    kAdFlags = 0x01,
+    kAdIncompleteUuid16 = 0x02,
+    kAdCompleteUuid16 = 0x03,
+    kAdIncompleteUuid32 = 0x04,
+    kAdCompleteUuid32 = 0x05,
+    kAdIncompleteUuid128 = 0x06,
+    kAdCompleteUuid128 = 0x07,
+    kAdShortenedName = 0x08,
+    kAdCompleteName = 0x09,
+    kAdTxPower = 0x0A,
+    kAdServiceData16 = 0x16,
+    kAdManufacturerData = 0xFF,
+};
+
+/**
+ * 一个 AD 结构（长度-类型-值），data 指向原始缓冲区
+ */
+struct AdStructure {
+    uint8_t type = 0;
+    const uint8_t* data = nullptr;
+    std::size_t length = 0;
+};
+
+/**
+ * 逐个取出原始广播数据里的 AD 结构，不复制也不分配内存
+ *
+ *   AdReader reader(raw, length);
+ *   AdStructure ad;
+ *   while (reader.Next(ad)) { ... }
+ *   if (reader.Malformed()) { ... }   // 最后一个结构的长度超出了缓冲区
+ */
+class AdReader {
+public:
+    AdReader(const uint8_t* raw, std::size_t length) : raw_(raw), length_(raw != nullptr ? length : 0) {}
+
+    bool Next(AdStructure& ad) {
+        if (offset_ >= length_) {
+            return false;
+        }
+        const std::size_t size = raw_[offset_];
+        // 长度为 0 表示有效数据到此为止，后面是填充
+        if (size == 0) {
+            offset_ = length_;
+            return false;
+        }
+        if (size > length_ - offset_ - 1) {
+            malformed_ = true;
+            offset_ = length_;
+            return false;
+        }
+        ad.type = raw_[offset_ + 1];
+        ad.data = raw_ + offset_ + 2;
+        ad.length = size - 1;
+        offset_ += 1 + size;
+        return true;
+    }
+
+    bool Malformed() const { return malformed_; }
+
+private:
+    const uint8_t* raw_;
+    std::size_t length_;
+    std::size_t offset_ = 0;
+    bool malformed_ = false;
+};
+
+/*
+ * UuidList、ManufacturerData、ServiceData 没有默认初始值：AdvertisementData 在扫描回调里
+ * 作为局部变量使用，数组部分不必每次清零，只有计数以内的元素有意义
+ */
+
+/**
+ * 一个服务 UUID 列表（16、32 或 128 位），元素按广播里的小端序存放
+ */
+struct UuidList {
+    const uint8_t* data;
+    std::size_t count;
+    uint8_t width;       // 每个 UUID 的字节数：2、4 或 16
+    bool complete;       // AD 类型是“完整列表”
+
+    // 第 i 个 UUID 的短值；128 位的 UUID 不是基础 UUID 形式时返回 false
+    bool Short(std::size_t i, uint32_t& value) const;
+
+    Guid At(std::size_t i) const;
+};
+
+struct ManufacturerData {
+    uint16_t company;        // 蓝牙 SIG 分配的公司编号
+    const uint8_t* data;     // 公司编号之后的数据
+    std::size_t length;
+};
+
+struct ServiceData {
+    uint16_t uuid;
+    const uint8_t* data;
+    std::size_t length;
+};
+
+// 各类字段在一条广播里最多保留的个数，超出的被忽略并计入 AdvertisementData::overflow
+constexpr std::size_t kMaxAdUuidLists = 6;
+constexpr std::size_t kMaxAdManufacturerData = 4;
+constexpr std::size_t kMaxAdServiceData = 4;
+
+/**
+ * 解析后的广播数据，所有指针和名称都指向传入的原始缓冲区，缓冲区释放后失效
+ *
+ * 广播包和扫描响应可以拼在一起解析，同一种字段出现多次时：
+ * 完整名称优先于缩短的名称，Flags 和发射功率取第一次出现的值，列表类字段全部保留。
+ */
+struct AdvertisementData {
+    std::string_view local_name;
+    bool complete_name = false;
+    bool has_flags = false;
+    uint8_t flags = 0;
+    bool has_tx_power = false;
+    int8_t tx_power = 0;             // dBm
+    UuidList uuid_lists[kMaxAdUuidLists];
+    std::size_t uuid_list_count = 0;
+    ManufacturerData manufacturer_data[kMaxAdManufacturerData];
+    std::size_t manufacturer_data_count = 0;
+    ServiceData service_data[kMaxAdServiceData];
+    std::size_t service_data_count = 0;
+    std::size_t structures = 0;      // 有效 AD 结构的个数
+    std::size_t overflow = 0;        // 因为超出容量被忽略的字段数
+    bool malformed = false;          // 某个结构的长度超出缓冲区，或已知类型的长度不对
+
+    // 列表里有这个 16/32 位 UUID（也检查基础 UUID 形式的 128 位 UUID）
+    bool HasService(uint32_t short_uuid) const;
+
+    // 列表里有这个 128 位 UUID，参数是广播里的字节序（小端）
+    bool HasService(const uint8_t* uuid128) const;
+
+    bool HasService(const Guid& uuid) const;
+
+    // 指定公司的厂商数据，没有时返回 nullptr
+    const ManufacturerData* Manufacturer(uint16_t company) const;
+};
+
+/**
+ * 解析原始广播数据，不分配内存，可以直接在扫描回调里调用
+ * @param raw 一个或多个 AD 结构，可以是广播包加扫描响应
+ * @param length
+ * @param out 先被清空；出错时保留出错之前解析出的字段
+ * @return 数据格式完全正确时返回 true
+ */
+bool ParseAdvertisementData(const uint8_t* raw, std::size_t length, AdvertisementData& out);
+
+/**
+ * 把 128 位 UUID 转成广播里的字节序
+ * @param uuid
+ * @param out 16 字节
+ */
+void GuidToAdBytes(const Guid& uuid, uint8_t* out);
+
+}  // namespace ble
@@ -0,0 +1,384 @@
+﻿#include "ble/advertisement_filter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "ble/advertisement_data.h"
+#include "ble/format.h"
+
+namespace ble {
+
+namespace {
+
+unsigned LowestBit(uint64_t value) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctzll(value));
+#endif
+}
+
+// 蓝牙基础 UUID 除 Data1 以外的部分
+constexpr uint8_t kBaseUuidData4[8] = {0x80, 0x00, 0x00, 0x80, 0x5F, 0x9B, 0x34, 0xFB};
+
+bool IsBaseUuid(const Guid& uuid) {
+    return uuid.Data2 == 0x0000 && uuid.Data3 == 0x1000 && std::memcmp(uuid.Data4, kBaseUuidData4, 8) == 0;
+}
+
+}  // namespace
+
+const char* FilterStageName(FilterStage stage) {
+    switch (stage) {
+        case FilterStage::Table:
+            return "table";
+        case FilterStage::Address:
+            return "address";
+        case FilterStage::Name:
+            return "name";
+        case FilterStage::Data:
+            return "data";
+        case FilterStage::Regex:
+            return "regex";
+        case FilterStage::Matched:
+            return "matched";
+    }
+    return "unknown";
+}
+
+bool AdvertisementFilter::Compile(const std::vector<AdvertisementRule>& rules, std::string* error) {
+    rules_.clear();
+    regexes_.clear();
+    by_rssi_.fill(0);
+    by_first_byte_.fill(0);
+    address_rules_ = 0;
+    data_rules_ = 0;
+    service_rules_ = 0;
+    direct_ = false;
+    if (rules.size() > kMaxAdvertisementRules) {
+        if (error != nullptr) {
+            *error = "too many rules";
+        }
+        return false;
+    }
+
+    std::vector<CompiledRule> compiled;
+    std::vector<std::regex> regexes;
+    std::array<uint64_t, 256> by_rssi{};
+    std::array<uint64_t, 257> by_first_byte{};
+    uint64_t address_rules = 0;
+    uint64_t data_rules = 0;
+    uint64_t service_rules = 0;
+    bool direct = rules.size() <= kDirectMatchRules;
+    for (std::size_t i = 0; i < rules.size(); ++i) {
+        const AdvertisementRule& rule = rules[i];
+        const uint64_t bit = 1ull << i;
+        // compiled 与 rules 按下标一一对应
+        compiled.emplace_back();
+        CompiledRule& out = compiled.back();
+
+        // 完整名称优先于前缀；两者都给时只有名称本身以前缀开头才可能匹配，否则这条规则不进任何表
+        if (!rule.name.empty() && rule.name.compare(0, rule.name_prefix.size(), rule.name_prefix) != 0) {
+            direct = false;
+            continue;
+        }
+        out.min_rssi = rule.min_rssi;
+        for (int rssi = -128; rssi < 128; ++rssi) {
+            if (rssi >= rule.min_rssi) {
+                by_rssi[static_cast<std::size_t>(rssi + 128)] |= bit;
+            }
+        }
+        if (!rule.name.empty() || !rule.name_prefix.empty()) {
+            out.exact_name = !rule.name.empty();
+            out.name = out.exact_name ? rule.name : rule.name_prefix;
+            by_first_byte[static_cast<uint8_t>(out.name[0])] |= bit;
+        } else {
+            for (auto& entry : by_first_byte) {
+                entry |= bit;
+            }
+        }
+        if (rule.address_mask != 0) {
+            out.address_mask = rule.address_mask & 0xFFFFFFFFFFFFull;
+            out.address = rule.address & out.address_mask;
+            address_rules |= bit;
+        }
+        for (const auto& uuid : rule.service_uuids) {
+            if (IsBaseUuid(uuid)) {
+                out.short_uuids.push_back(uuid.Data1);
+            } else {
+                out.long_uuids.emplace_back();
+                GuidToAdBytes(uuid, out.long_uuids.back().data());
+            }
+        }
+        out.manufacturer_id = rule.manufacturer_id;
+        if (!rule.service_uuids.empty() || rule.manufacturer_id >= 0) {
+            data_rules |= bit;
+        }
+        if (!rule.service_uuids.empty()) {
+            service_rules |= bit;
+        }
+        if (!rule.service_uuids.empty() || rule.manufacturer_id >= 0 || !rule.name_regex.empty()) {
+            direct = false;
+        }
+        if (!rule.name_regex.empty()) {
+            try {
+                regexes.emplace_back(rule.name_regex, std::regex::ECMAScript | std::regex::optimize);
+            } catch (const std::regex_error&) {
+                if (error != nullptr) {
+                    *error = "invalid regex: " + rule.name_regex;
+                }
+                return false;
+            }
+            out.regex = static_cast<int>(regexes.size() - 1);
+            // 空名称的结果编译时就能确定，不匹配空串的正则不必出现在空名称的表项里
+            if (!std::regex_search(std::string(), regexes.back())) {
+                by_first_byte[256] &= ~bit;
+            }
+        }
+    }
+    rules_ = std::move(compiled);
+    regexes_ = std::move(regexes);
+    by_rssi_ = by_rssi;
+    by_first_byte_ = by_first_byte;
+    address_rules_ = address_rules;
+    data_rules_ = data_rules;
+    service_rules_ = service_rules;
+    direct_ = direct;
+    return true;
+}
+
+int AdvertisementFilter::Match(const Advertisement& advertisement, FilterStage* stage) const {
+    if (direct_) {
+        return MatchDirect(advertisement, stage);
+    }
+    FilterStage reached = FilterStage::Table;
+    auto decide = [&](FilterStage at, int result) {
+        if (stage != nullptr) {
+            *stage = at;
+        }
+        return result;
+    };
+
+    // 两次查表：RSSI 和名称首字节
+    const int rssi = std::min<int>(127, std::max<int>(-128, advertisement.rssi));
+    const std::string_view name = advertisement.local_name;
+    uint64_t candidates = by_rssi_[static_cast<std::size_t>(rssi + 128)] &
+                          by_first_byte_[name.empty() ? 256 : static_cast<uint8_t>(name[0])];
+    if (candidates == 0) {
+        return decide(reached, -1);
+    }
+
+    if ((candidates & address_rules_) != 0) {
+        reached = FilterStage::Address;
+        for (uint64_t pending = candidates & address_rules_; pending != 0; pending &= pending - 1) {
+            const unsigned i = LowestBit(pending);
+            const CompiledRule& rule = rules_[i];
+            if ((advertisement.address & rule.address_mask) != rule.address) {
+                candidates &= ~(1ull << i);
+            }
+        }
+        if (candidates == 0) {
+            return decide(reached, -1);
+        }
+    }
+
+    for (uint64_t pending = candidates; pending != 0; pending &= pending - 1) {
+        const unsigned i = LowestBit(pending);
+        const CompiledRule& rule = rules_[i];
+        if (rule.name.empty()) {
+            continue;
+        }
+        reached = FilterStage::Name;
+        const bool ok = rule.exact_name ? name == rule.name
+                                        : name.size() >= rule.name.size() &&
+                                          std::memcmp(name.data(), rule.name.data(), rule.name.size()) == 0;
+        if (!ok) {
+            candidates &= ~(1ull << i);
+        }
+    }
+    if (candidates == 0) {
+        return decide(reached, -1);
+    }
+
+    // 编号最小的候选已经没有剩下的条件，不必再解析广播数据
+    const unsigned first = LowestBit(candidates);
+    if ((data_rules_ & (1ull << first)) == 0 && rules_[first].regex < 0) {
+        return decide(FilterStage::Matched, static_cast<int>(first));
+    }
+
+    if ((candidates & data_rules_) != 0 && (candidates & service_rules_) == 0) {
+        // 只剩厂商编号要查：直接找 0xFF 结构，不必完整解析
+        reached = FilterStage::Data;
+        const uint64_t pending = candidates & data_rules_;
+        uint64_t found = 0;
+        AdReader reader(advertisement.raw, advertisement.raw_length);
+        AdStructure ad;
+        while (reader.Next(ad)) {
+            if (ad.type != kAdManufacturerData || ad.length < 2) {
+                continue;
+            }
+            const int32_t company = ad.data[0] | (ad.data[1] << 8);
+            for (uint64_t rest = pending; rest != 0; rest &= rest - 1) {
+                const unsigned i = LowestBit(rest);
+                if (rules_[i].manufacturer_id == company) {
+                    found |= 1ull << i;
+                }
+            }
+        }
+        candidates &= ~(pending & ~found);
+        if (candidates == 0) {
+            return decide(reached, -1);
+        }
+    } else if ((candidates & data_rules_) != 0) {
+        reached = FilterStage::Data;
+        AdvertisementData data;
+        ParseAdvertisementData(advertisement.raw, advertisement.raw_length, data);
+        for (uint64_t pending = candidates & data_rules_; pending != 0; pending &= pending - 1) {
+            const unsigned i = LowestBit(pending);
+            const CompiledRule& rule = rules_[i];
+            bool ok = rule.manufacturer_id < 0 || data.Manufacturer(static_cast<uint16_t>(rule.manufacturer_id)) != nullptr;
+            if (ok && (!rule.short_uuids.empty() || !rule.long_uuids.empty())) {
+                ok = false;
+                for (std::size_t k = 0; k < rule.short_uuids.size() && !ok; ++k) {
+                    ok = data.HasService(rule.short_uuids[k]);
+                }
+                for (std::size_t k = 0; k < rule.long_uuids.size() && !ok; ++k) {
+                    ok = data.HasService(rule.long_uuids[k].data());
+                }
+            }
+            if (!ok) {
+                candidates &= ~(1ull << i);
+            }
+        }
+        if (candidates == 0) {
+            return decide(reached, -1);
+        }
+    }
+
+    // 正则最贵，按编号从小到大逐条试，第一条匹配的就是结果
+    for (uint64_t pending = candidates; pending != 0; pending &= pending - 1) {
+        const unsigned i = LowestBit(pending);
+        const CompiledRule& rule = rules_[i];
+        if (rule.regex < 0) {
+            return decide(FilterStage::Matched, static_cast<int>(i));
+        }
+        reached = FilterStage::Regex;
+        if (std::regex_search(name.begin(), name.end(), regexes_[static_cast<std::size_t>(rule.regex)])) {
+            return decide(FilterStage::Matched, static_cast<int>(i));
+        }
+    }
+    return decide(reached, -1);
+}
+
+int AdvertisementFilter::MatchDirect(const Advertisement& advertisement, FilterStage* stage) const {
+    FilterStage reached = FilterStage::Table;
+    const std::string_view name = advertisement.local_name;
+    for (std::size_t i = 0; i < rules_.size(); ++i) {
+        const CompiledRule& rule = rules_[i];
+        if (advertisement.rssi < rule.min_rssi) {
+            continue;
+        }
+        if ((advertisement.address & rule.address_mask) != rule.address) {
+            reached = std::max(reached, FilterStage::Address);
+            continue;
+        }
+        if (!rule.name.empty()) {
+            // 长度先筛掉绝大多数名称，同长度的才比较内容
+            const bool ok = rule.exact_name ? name.size() == rule.name.size()
+                                            : name.size() >= rule.name.size();
+            if (!ok || std::memcmp(name.data(), rule.name.data(), rule.name.size()) != 0) {
+                reached = std::max(reached, ok ? FilterStage::Name : FilterStage::Table);
+                continue;
+            }
+        }
+        if (stage != nullptr) {
+            *stage = FilterStage::Matched;
+        }
+        return static_cast<int>(i);
+    }
+    if (stage != nullptr) {
+        *stage = reached;
+    }
+    return -1;
+}
+
+bool ParseAdvertisementRule(std::string_view spec, AdvertisementRule& rule) {
+    AdvertisementRule result;
+    while (!spec.empty()) {
+        const std::size_t equals = spec.find('=');
+        if (equals == std::string_view::npos) {
+            return false;
+        }
+        const std::string_view key = spec.substr(0, equals);
+        std::string_view value;
+        if (key == "regex") {
+            value = spec.substr(equals + 1);
+            spec = {};
+        } else {
+            const std::size_t comma = spec.find(',', equals);
+            value = spec.substr(equals + 1, comma == std::string_view::npos ? std::string_view::npos : comma - equals - 1);
+            spec = comma == std::string_view::npos ? std::string_view() : spec.substr(comma + 1);
+        }
+        if (value.empty()) {
+            return false;
+        }
+        const std::string text(value);
+        char* end = nullptr;
+        if (key == "name") {
+            result.name = text;
+        } else if (key == "prefix") {
+            result.name_prefix = text;
+        } else if (key == "regex") {
+            result.name_regex = text;
+        } else if (key == "mac") {
+            const std::size_t slash = value.find('/');
+            result.address_mask = 0xFFFFFFFFFFFFull;
+            if (!ParseBluetoothAddress(value.substr(0, slash), result.address) ||
+                (slash != std::string_view::npos && !ParseBluetoothAddress(value.substr(slash + 1), result.address_mask))) {
+                return false;
+            }
+        } else if (key == "oui") {
+            // 三个字节补成完整地址再解析
+            if (!ParseBluetoothAddress(text + ":00:00:00", result.address)) {
+                return false;
+            }
+            result.address_mask = 0xFFFFFF000000ull;
+        } else if (key == "rssi") {
+            const long rssi = std::strtol(text.c_str(), &end, 10);
+            if (*end != '\0' || rssi < -128 || rssi > 127) {
+                return false;
+            }
+            result.min_rssi = static_cast<int16_t>(rssi);
+        } else if (key == "service") {
+            Guid uuid{};
+            if (value.size() == 4 || value.size() == 8) {
+                uint32_t short_uuid = 0;
+                if (!detail::GetHex(value, 0, static_cast<int>(value.size()), short_uuid)) {
+                    return false;
+                }
+                uuid = Guid{short_uuid, 0x0000, 0x1000, {}};
+                std::memcpy(uuid.Data4, kBaseUuidData4, 8);
+            } else if (!ParseGuid(value, uuid)) {
+                return false;
+            }
+            result.service_uuids.push_back(uuid);
+        } else if (key == "company") {
+            const unsigned long id = std::strtoul(text.c_str(), &end, 0);
+            if (*end != '\0' || id > 0xFFFF) {
+                return false;
+            }
+            result.manufacturer_id = static_cast<int32_t>(id);
+        } else {
+            return false;
+        }
+    }
+    rule = std::move(result);
+    return true;
+}
+
+}  // namespace ble
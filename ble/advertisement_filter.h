@@ -0,0 +1,122 @@
+﻿#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ble/guid.h"
+#include "ble/transport.h"
+
+namespace ble {
+
+/**
+ * 一条广播过滤规则，所有给出的条件都满足才算匹配（没给的条件不检查）
+ */
+struct AdvertisementRule {
+    std::string name;                   // 广播名称完全相同
+    std::string name_prefix;            // 广播名称以此开头
+    std::string name_regex;             // ECMAScript 正则，在名称中搜索（需要整名匹配时自己加 ^ $）
+    uint64_t address = 0;               // (地址 & address_mask) == address
+    uint64_t address_mask = 0;          // 0 表示不检查地址；OUI 是 0xFFFFFF000000
+    int16_t min_rssi = -128;            // RSSI 不低于此值（dBm）
+    std::vector<Guid> service_uuids;    // 广播里的服务 UUID 列表包含其中任意一个
+    int32_t manufacturer_id = -1;       // 厂商数据（AD 类型 0xFF）的公司编号，-1 表示不检查
+};
+
+// 一个过滤器最多的规则数，候选规则用一个 64 位掩码表示
+constexpr std::size_t kMaxAdvertisementRules = 64;
+
+// 不超过这么多条的简单规则（只有 RSSI、地址和名称）不查表，直接逐条比较
+constexpr std::size_t kDirectMatchRules = 4;
+
+/**
+ * 一条广播在哪一步被决定，用于统计过滤器检查了多少字段
+ */
+enum class FilterStage {
+    Table,      // RSSI 和名称首字节查表后已没有候选规则
+    Address,
+    Name,
+    Data,       // 需要解析原始广播数据（服务 UUID、厂商编号）
+    Regex,
+    Matched,
+};
+
+const char* FilterStageName(FilterStage stage);
+
+/**
+ * 编译后的广播过滤器，规则之间是“或”的关系
+ *
+ * 编译时为 RSSI（256 个取值）和名称首字节（256 个取值加上空名称）各建一张表，
+ * 表项是可能匹配的规则的位掩码。匹配时先查两张表求与，拥挤环境里绝大多数广播
+ * 在这一步就没有候选规则了，只读了 RSSI 和名称的第一个字节；
+ * 剩下的候选规则再按代价从低到高检查：地址掩码、名称比较、原始广播数据（只解析一次）、正则。
+ * 规则不超过 kDirectMatchRules 条、而且只有 RSSI、地址和名称条件时（默认的按名称找 ECG-7 就是这样），
+ * 查表和位掩码的开销比直接比较还大，这时按顺序逐条比较长度和内容。
+ * Match 不修改任何状态，可以在多个扫描线程上同时调用。
+ */
+class AdvertisementFilter {
+public:
+    AdvertisementFilter() = default;
+
+    /**
+     * 编译规则，替换原有的规则
+     * @param rules 不超过 kMaxAdvertisementRules 条
+     * @param error 失败时写入原因，可以为 nullptr
+     * @return 规则太多或正则写错时返回 false，过滤器此时不匹配任何广播
+     */
+    bool Compile(const std::vector<AdvertisementRule>& rules, std::string* error = nullptr);
+
+    /**
+     * @param advertisement
+     * @param stage 写入做出决定的那一步，可以为 nullptr
+     * @return 匹配的第一条规则的下标，不匹配时返回 -1
+     */
+    int Match(const Advertisement& advertisement, FilterStage* stage = nullptr) const;
+
+    // 是否走逐条比较的快速路径
+    bool Direct() const { return direct_; }
+
+    std::size_t Rules() const { return rules_.size(); }
+
+private:
+    int MatchDirect(const Advertisement& advertisement, FilterStage* stage) const;
+
+    struct CompiledRule {
+        int16_t min_rssi = -128;
+        uint64_t address = 0;
+        uint64_t address_mask = 0;
+        bool exact_name = false;
+        std::string name;                         // 完整名称或前缀
+        std::vector<uint32_t> short_uuids;        // 能写成 16/32 位的服务 UUID
+        std::vector<std::array<uint8_t, 16>> long_uuids;  // 其余的，按广播里的字节序（小端）
+        int32_t manufacturer_id = -1;
+        int regex = -1;                           // regexes_ 的下标
+    };
+
+    std::vector<CompiledRule> rules_;
+    std::vector<std::regex> regexes_;
+    std::array<uint64_t, 256> by_rssi_{};         // 下标是 RSSI + 128
+    std::array<uint64_t, 257> by_first_byte_{};   // 下标 256 表示空名称
+    uint64_t address_rules_ = 0;                  // 需要检查地址的规则
+    uint64_t data_rules_ = 0;                     // 需要解析原始广播数据的规则
+    uint64_t service_rules_ = 0;                  // 其中要查服务 UUID 的，其余只查厂商编号
+    bool direct_ = false;                         // 见 kDirectMatchRules
+};
+
+/**
+ * 解析命令行上的一条规则，例如 "prefix=ECG-,service=FFF0,rssi=-80"
+ *
+ * 条件之间用逗号分隔：name=、prefix=、mac=地址[/掩码]、oui=c0:ff:ee、rssi=、
+ * service=（16 位十六进制或完整 UUID）、company=（十六进制 0x004C 或十进制）、regex=。
+ * 正则里可能有逗号，所以 regex= 之后直到末尾都是正则，只能放在最后
+ * @param spec
+ * @param rule
+ * @return 格式不对时返回 false
+ */
+bool ParseAdvertisementRule(std::string_view spec, AdvertisementRule& rule);
+
+}  // namespace ble
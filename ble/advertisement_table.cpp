@@ -0,0 +1,148 @@
+﻿#include "ble/advertisement_table.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "ble/format.h"
+
+namespace ble {
+
+AdvertisementTable::AdvertisementTable(std::size_t capacity, float rssi_alpha) : rssi_alpha_(rssi_alpha) {
+    // 线性探测在装载率超过 75% 后探测长度会迅速变长
+    std::size_t slots = 16;
+    while (slots * 3 / 4 < capacity) {
+        slots *= 2;
+    }
+    slots_.resize(slots);
+    for (auto& entry : slots_) {
+        entry.address = kEmpty;
+    }
+    mask_ = slots - 1;
+    max_size_ = slots * 3 / 4;
+}
+
+std::size_t AdvertisementTable::Slot(uint64_t address) const {
+    // 斐波那契哈希，厂商前缀相同的地址也能打散
+    return static_cast<std::size_t>((address * 0x9E3779B97F4A7C15ull) >> 32) & mask_;
+}
+
+void AdvertisementTable::Update(const Advertisement& advertisement) {
+    const uint64_t address = advertisement.address & 0xFFFFFFFFFFFFull;
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::size_t index = Slot(address);
+    while (slots_[index].address != address && slots_[index].address != kEmpty) {
+        index = (index + 1) & mask_;
+    }
+    AdvertisementEntry& entry = slots_[index];
+
+    if (entry.address == kEmpty) {
+        if (size_ >= max_size_) {
+            ++overflow_;
+            return;
+        }
+        ++size_;
+        entry.address = address;
+        entry.first_seen_ns = advertisement.timestamp_ns;
+        entry.count = 0;
+        entry.rssi_smoothed = advertisement.rssi;
+        entry.name_length = 0;
+    } else {
+        entry.rssi_smoothed += rssi_alpha_ * (static_cast<float>(advertisement.rssi) - entry.rssi_smoothed);
+    }
+    entry.last_seen_ns = advertisement.timestamp_ns;
+    entry.rssi_last = advertisement.rssi;
+    ++entry.count;
+
+    // 被动扫描的广播和扫描响应交替到达，只有带名称的那一条才更新名称
+    if (!advertisement.local_name.empty()) {
+        std::size_t length = std::min(advertisement.local_name.size(), sizeof(entry.name));
+        entry.name_length = static_cast<uint8_t>(length);
+        std::memcpy(entry.name, advertisement.local_name.data(), length);
+    }
+}
+
+std::vector<AdvertisementEntry> AdvertisementTable::Snapshot() const {
+    std::vector<AdvertisementEntry> entries;
+    entries.reserve(Size());
+    // 每次持锁只复制 kSnapshotChunk 个槽，两段之间放开锁，扫描回调最多等一段的复制时间
+    for (std::size_t begin = 0; begin < slots_.size(); begin += kSnapshotChunk) {
+        const std::size_t end = std::min(begin + kSnapshotChunk, slots_.size());
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (std::size_t i = begin; i < end; ++i) {
+            if (slots_[i].address != kEmpty) {
+                entries.push_back(slots_[i]);
+            }
+        }
+    }
+    // 两段之间的删除会把探测链尾部回绕的元素挪到表尾，同一台设备可能被复制两次，只保留一份
+    std::sort(entries.begin(), entries.end(), [](const AdvertisementEntry& a, const AdvertisementEntry& b) {
+        return a.address < b.address;
+    });
+    entries.erase(std::unique(entries.begin(), entries.end(),
+                              [](const AdvertisementEntry& a, const AdvertisementEntry& b) {
+                                  return a.address == b.address;
+                              }),
+                  entries.end());
+    std::sort(entries.begin(), entries.end(), [](const AdvertisementEntry& a, const AdvertisementEntry& b) {
+        return a.rssi_smoothed > b.rssi_smoothed;
+    });
+    return entries;
+}
+
+void AdvertisementTable::EraseAt(std::size_t index) {
+    // 线性探测的删除：把后面探测链上的元素往前挪，不留墓碑
+    std::size_t hole = index;
+    std::size_t next = (hole + 1) & mask_;
+    while (slots_[next].address != kEmpty) {
+        std::size_t home = Slot(slots_[next].address);
+        // home 不在 (hole, next] 区间内时，这个元素可以挪到 hole
+        bool movable = hole <= next ? (home <= hole || home > next) : (home <= hole && home > next);
+        if (movable) {
+            slots_[hole] = slots_[next];
+            hole = next;
+        }
+        next = (next + 1) & mask_;
+    }
+    slots_[hole].address = kEmpty;
+    --size_;
+}
+
+std::size_t AdvertisementTable::ExpireOlderThan(uint64_t cutoff_ns) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::size_t removed = 0;
+    for (std::size_t i = 0; i < slots_.size();) {
+        if (slots_[i].address != kEmpty && slots_[i].last_seen_ns < cutoff_ns) {
+            // 挪过来的元素也要检查，所以不前进
+            EraseAt(i);
+            ++removed;
+        } else {
+            ++i;
+        }
+    }
+    return removed;
+}
+
+std::size_t AdvertisementTable::Size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+}
+
+uint64_t AdvertisementTable::Overflow() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return overflow_;
+}
+
+void RenderAdvertisementTable(const std::vector<AdvertisementEntry>& entries, uint64_t now_ns, std::FILE* out) {
+    std::fprintf(out, "%-17s  %-29s  %8s  %6s  %8s\n", "MAC", "Name", "Count", "RSSI", "Age(ms)");
+    for (const auto& entry : entries) {
+        MacString mac = FormatBluetoothAddress(entry.address);
+        double age_ms = now_ns > entry.last_seen_ns ? static_cast<double>(now_ns - entry.last_seen_ns) / 1e6 : 0.0;
+        std::fprintf(out, "%s  %-29.*s  %8llu  %6.1f  %8.0f\n", mac.data(), entry.name_length, entry.name,
+                     static_cast<unsigned long long>(entry.count), entry.rssi_smoothed, age_ms);
+    }
+    std::fprintf(out, "%zu devices\n", entries.size());
+    std::fflush(out);
+}
+
+}  // namespace ble
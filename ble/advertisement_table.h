@@ -0,0 +1,90 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#include "ble/transport.h"
+
+namespace ble {
+
+/**
+ * 一台设备的广播汇总
+ */
+struct AdvertisementEntry {
+    uint64_t address;
+    uint64_t first_seen_ns;
+    uint64_t last_seen_ns;
+    uint64_t count;           // 收到的广播条数
+    float rssi_smoothed;      // 指数平滑后的 RSSI
+    int16_t rssi_last;
+    uint8_t name_length;
+    char name[29];            // 广播名称最长 29 字节（31 字节广播数据去掉 AD 头）
+};
+
+/**
+ * 以 48 位蓝牙地址为键的开放寻址哈希表（线性探测）
+ *
+ * 扫描回调里只做 Update()：一次哈希、几次探测、覆盖写入，不分配内存；
+ * 低频的显示线程调用 Snapshot() 复制出当前内容再慢慢排版输出。
+ * 两边共用一把锁，但 Snapshot() 分段复制、每段之间放开锁，
+ * 设备再多回调等锁的时间也不超过复制 kSnapshotChunk 个槽，与表的大小无关。
+ */
+class AdvertisementTable {
+public:
+    /**
+     * @param capacity 最多跟踪的设备数，会向上取整到 2 的幂并留出 25% 空槽
+     * @param rssi_alpha RSSI 指数平滑系数，越大越跟随最新值
+     */
+    explicit AdvertisementTable(std::size_t capacity = 4096, float rssi_alpha = 0.2f);
+
+    /**
+     * 记录一条广播，表已满时新设备会被丢弃并计入 Overflow()
+     * @param advertisement
+     */
+    void Update(const Advertisement& advertisement);
+
+    /**
+     * 复制出当前所有设备，按平滑后的 RSSI 从强到弱排序
+     *
+     * 分段复制，各段不是同一时刻的内容：复制期间新出现的设备可能不在结果里，
+     * 同时有 ExpireOlderThan() 删除时，被挪动位置的设备也可能缺一次，下一次快照会补上
+     */
+    std::vector<AdvertisementEntry> Snapshot() const;
+
+    /**
+     * 删除 last_seen 早于 cutoff_ns 的设备，给新设备腾出位置
+     * @return 删除的设备数
+     */
+    std::size_t ExpireOlderThan(uint64_t cutoff_ns);
+
+    std::size_t Size() const;
+    uint64_t Overflow() const;
+
+private:
+    static constexpr uint64_t kEmpty = ~0ull;
+    static constexpr std::size_t kSnapshotChunk = 256;   // Snapshot() 每次持锁复制的槽数
+
+    std::size_t Slot(uint64_t address) const;
+    void EraseAt(std::size_t index);
+
+    mutable std::mutex mutex_;
+    std::vector<AdvertisementEntry> slots_;
+    std::size_t mask_;
+    std::size_t max_size_;
+    std::size_t size_ = 0;
+    uint64_t overflow_ = 0;
+    float rssi_alpha_;
+};
+
+/**
+ * 把快照渲染成一张表：MAC、名称、广播条数、平滑 RSSI、距上次广播的时间
+ * @param entries
+ * @param now_ns
+ * @param out
+ */
+void RenderAdvertisementTable(const std::vector<AdvertisementEntry>& entries, uint64_t now_ns, std::FILE* out);
+
+}  // namespace ble
@@ -0,0 +1,218 @@
+﻿#include "ble/async_output.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "ble/clock.h"
+
+namespace ble {
+
+const char* OutputTargetName(OutputTarget target) {
+    switch (target) {
+        case OutputTarget::Console:
+            return "console";
+        case OutputTarget::File:
+            return "file";
+        case OutputTarget::Null:
+            return "null";
+        case OutputTarget::Callback:
+            return "callback";
+    }
+    return "unknown";
+}
+
+AsyncOutput::AsyncOutput(AsyncOutputOptions options) : options_(std::move(options)) {
+    options_.blocks = std::max<std::size_t>(options_.blocks, 2);
+    options_.block_bytes = std::max<std::size_t>(options_.block_bytes, 256);
+    for (std::size_t i = 0; i < options_.blocks; ++i) {
+        auto block = std::make_unique<Block>();
+        block->data.resize(options_.block_bytes);
+        free_.push_back(std::move(block));
+    }
+    full_.reserve(options_.blocks);
+}
+
+AsyncOutput::~AsyncOutput() {
+    Close();
+}
+
+bool AsyncOutput::Open() {
+    if (writer_.joinable()) {
+        return true;
+    }
+    if (options_.target == OutputTarget::Console) {
+        file_ = stdout;
+    } else if (options_.target == OutputTarget::File) {
+        file_ = std::fopen(options_.path.c_str(), "wb");
+        if (file_ == nullptr) {
+            return false;
+        }
+        owns_file_ = true;
+    }
+    stopping_ = false;
+    writer_ = std::thread(&AsyncOutput::WriterLoop, this);
+    return true;
+}
+
+bool AsyncOutput::Append(const char* data, std::size_t length) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++appends_;
+    if (length == 0) {
+        return true;
+    }
+    bytes_ += length;
+    // 先确认当前块的剩余空间加上空闲块放得下全部数据，否则整段丢弃，
+    // 不会只写出前半段、在输出里留下半行
+    std::size_t room = free_.size() * options_.block_bytes;
+    if (current_ != nullptr) {
+        room += current_->data.size() - current_->size;
+    }
+    if (room < length) {
+        // 写出线程跟不上：宁可丢弃也不让调用方等待 I/O
+        ++dropped_appends_;
+        dropped_bytes_ += length;
+        return false;
+    }
+    // 比一个块还大的数据按块切开，这种情况只在调用方一次攒了很多行时出现
+    while (length > 0) {
+        if (current_ != nullptr && current_->size == current_->data.size()) {
+            Submit();
+        }
+        if (current_ == nullptr) {
+            current_ = std::move(free_.back());
+            free_.pop_back();
+            current_->size = 0;
+            current_->first_ns = MonotonicNowNs();
+        }
+        const std::size_t n = std::min(length, current_->data.size() - current_->size);
+        std::memcpy(current_->data.data() + current_->size, data, n);
+        current_->size += n;
+        data += n;
+        length -= n;
+    }
+    if (current_->size == current_->data.size()) {
+        Submit();
+    }
+    return true;
+}
+
+void AsyncOutput::Submit() {
+    full_.push_back(std::move(current_));
+    writer_cv_.notify_one();
+}
+
+void AsyncOutput::Flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (current_ != nullptr && current_->size > 0) {
+        Submit();
+    }
+    if (!writer_.joinable()) {
+        return;
+    }
+    flushed_cv_.wait(lock, [this] { return full_.empty() && !writing_; });
+}
+
+void AsyncOutput::Close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (current_ != nullptr && current_->size > 0) {
+            Submit();
+        }
+        stopping_ = true;
+    }
+    writer_cv_.notify_one();
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+    if (owns_file_) {
+        std::fclose(file_);
+        owns_file_ = false;
+    }
+    file_ = nullptr;
+}
+
+void AsyncOutput::WriterLoop() {
+    const uint64_t interval_ns = static_cast<uint64_t>(options_.flush_interval_ms) * 1000000;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        // 当前块有数据时最多等到它满 flush_interval_ms，否则等一个完整的间隔
+        uint64_t wait_ns = interval_ns;
+        if (current_ != nullptr && current_->size > 0) {
+            const uint64_t age_ns = MonotonicNowNs() - current_->first_ns;
+            wait_ns = age_ns < interval_ns ? interval_ns - age_ns : 0;
+        }
+        writer_cv_.wait_for(lock, std::chrono::nanoseconds(wait_ns), [this] { return !full_.empty() || stopping_; });
+        // 没写满的块超过 flush_interval_ms 也交出去，终端上的输出不会停在半截
+        if (full_.empty() && current_ != nullptr && current_->size > 0 &&
+            MonotonicNowNs() - current_->first_ns >= interval_ns) {
+            Submit();
+        }
+        if (full_.empty()) {
+            if (stopping_) {
+                break;
+            }
+            continue;
+        }
+        std::vector<std::unique_ptr<Block>> batch;
+        batch.swap(full_);
+        full_.reserve(options_.blocks);
+        writing_ = true;
+        lock.unlock();
+        for (auto& block : batch) {
+            WriteBlock(*block);
+        }
+        if (file_ != nullptr) {
+            std::fflush(file_);
+        }
+        lock.lock();
+        for (auto& block : batch) {
+            free_.push_back(std::move(block));
+        }
+        writing_ = false;
+        flushed_cv_.notify_all();
+    }
+}
+
+void AsyncOutput::WriteBlock(Block& block) {
+    const uint64_t start_ns = MonotonicNowNs();
+    switch (options_.target) {
+        case OutputTarget::Console:
+        case OutputTarget::File:
+            std::fwrite(block.data.data(), 1, block.size, file_);
+            break;
+        case OutputTarget::Callback:
+            if (options_.callback) {
+                options_.callback(block.data.data(), block.size);
+            }
+            break;
+        case OutputTarget::Null:
+            break;
+    }
+    const uint64_t end_ns = MonotonicNowNs();
+    write_.Record(end_ns - start_ns);
+    delay_.Record(end_ns - block.first_ns);
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++blocks_written_;
+}
+
+AsyncOutputStats AsyncOutput::Stats() const {
+    AsyncOutputStats stats;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats.appends = appends_;
+        stats.bytes = bytes_;
+        stats.dropped_appends = dropped_appends_;
+        stats.dropped_bytes = dropped_bytes_;
+        stats.blocks_written = blocks_written_;
+    }
+    LatencySnapshot delay;
+    delay.Add(delay_);
+    stats.delay = delay.Summary();
+    LatencySnapshot write;
+    write.Add(write_);
+    stats.write = write.Summary();
+    return stats;
+}
+
+}  // namespace ble
@@ -0,0 +1,118 @@
+﻿#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ble/latency_histogram.h"
+
+namespace ble {
+
+enum class OutputTarget {
+    Console,    // stdout
+    File,       // options.path
+    Null,       // 丢弃，只统计
+    Callback,   // options.callback，用于测试或转发到其他地方
+};
+
+const char* OutputTargetName(OutputTarget target);
+
+struct AsyncOutputOptions {
+    OutputTarget target = OutputTarget::Console;
+    std::string path;                        // target 为 File 时的文件名
+    std::function<void(const char* data, std::size_t length)> callback;  // target 为 Callback 时使用
+    std::size_t block_bytes = 64 * 1024;     // 每个输出块的大小
+    std::size_t blocks = 2;                  // 块数，至少 2：一个在填充，一个在写出
+    uint32_t flush_interval_ms = 50;         // 未写满的块最多等这么久就写出
+};
+
+/**
+ * 输出统计，所有值都是累计的
+ */
+struct AsyncOutputStats {
+    uint64_t appends = 0;            // Append 调用数，包括被丢弃的；调用方按批追加时一次包含多行
+    uint64_t bytes = 0;
+    uint64_t dropped_appends = 0;    // 所有块都在等待写出，只能整段丢弃的 Append 次数
+    uint64_t dropped_bytes = 0;
+    uint64_t blocks_written = 0;
+    LatencySummary delay;            // 每个块从第一次写入到写出完成的时间
+    LatencySummary write;            // 每次写出（fwrite/回调）本身的耗时
+};
+
+/**
+ * 在独立线程上写出的批量输出
+ *
+ * 调用方（解码线程）只把一行数据复制进当前块，持锁时间就是一次 memcpy，不做任何 I/O；
+ * 块写满或超过 flush_interval_ms 后交给写出线程，调用方换一个空闲块继续填充（双缓冲）。
+ * 终端或文件慢到所有块都在排队时，新数据直接丢弃并计数，调用方永远不会被输出阻塞。
+ */
+class AsyncOutput {
+public:
+    explicit AsyncOutput(AsyncOutputOptions options = {});
+    ~AsyncOutput();
+
+    AsyncOutput(const AsyncOutput&) = delete;
+    AsyncOutput& operator=(const AsyncOutput&) = delete;
+
+    /**
+     * 打开输出目标并启动写出线程
+     * @return 文件打不开时返回 false
+     */
+    bool Open();
+
+    /**
+     * 追加数据，可以在多个线程上调用
+     * @return 空闲块放不下整段数据、数据被整段丢弃时返回 false
+     */
+    bool Append(const char* data, std::size_t length);
+
+    // 把已经追加的数据全部写出后返回
+    void Flush();
+
+    // 写出剩余数据，停止写出线程并关闭文件
+    void Close();
+
+    AsyncOutputStats Stats() const;
+
+private:
+    struct Block {
+        std::vector<char> data;
+        std::size_t size = 0;
+        uint64_t first_ns = 0;       // 第一次写入的时间
+    };
+
+    void WriterLoop();
+    void Submit();                   // 持锁调用：把当前块交给写出线程
+    void WriteBlock(Block& block);
+
+    AsyncOutputOptions options_;
+    std::FILE* file_ = nullptr;
+    bool owns_file_ = false;
+
+    mutable std::mutex mutex_;
+    std::condition_variable writer_cv_;    // 有块要写出或要停止
+    std::condition_variable flushed_cv_;   // 写出线程写完一批
+    std::vector<std::unique_ptr<Block>> free_;
+    std::vector<std::unique_ptr<Block>> full_;   // 按提交顺序写出
+    std::unique_ptr<Block> current_;
+    bool writing_ = false;
+    bool stopping_ = false;
+    std::thread writer_;
+
+    uint64_t appends_ = 0;
+    uint64_t bytes_ = 0;
+    uint64_t dropped_appends_ = 0;
+    uint64_t dropped_bytes_ = 0;
+    uint64_t blocks_written_ = 0;
+    LatencyHistogram delay_;          // 只由写出线程记录
+    LatencyHistogram write_;
+};
+
+}  // namespace ble
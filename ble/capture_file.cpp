@@ -0,0 +1,170 @@
+﻿#include "ble/capture_file.h"
+
+#include <cstring>
+
+#include "ble/clock.h"
+
+namespace ble {
+
+CaptureWriter::CaptureWriter(std::size_t buffer_size) : buffer_(buffer_size) {}
+
+bool CaptureWriter::Open(const std::string& path) {
+    Close();
+    file_ = std::fopen(path.c_str(), "wb");
+    if (file_ == nullptr) {
+        return false;
+    }
+    // 已经自己做了缓冲，关掉 stdio 的缓冲避免二次拷贝
+    std::setvbuf(file_, nullptr, _IONBF, 0);
+
+    CaptureFileHeader header{};
+    std::memcpy(header.magic, kCaptureMagic, sizeof(header.magic));
+    header.version = kCaptureVersion;
+    header.header_size = sizeof(CaptureFileHeader);
+    header.start_time_ns = MonotonicNowNs();
+    std::memcpy(buffer_.data(), &header, sizeof(header));
+    used_ = sizeof(header);
+    record_count_ = 0;
+    bytes_written_ = 0;
+    return true;
+}
+
+bool CaptureWriter::DefineCharacteristic(uint16_t characteristic_id, const Guid& uuid) {
+    CaptureCharacteristicDefinition definition{uuid};
+    return AppendRecord(MonotonicNowNs(), characteristic_id, kCaptureRecordDefinition,
+                        reinterpret_cast<const uint8_t*>(&definition), sizeof(definition));
+}
+
+bool CaptureWriter::Append(uint64_t timestamp_ns, uint16_t characteristic_id, const uint8_t* data, uint16_t length) {
+    if (!AppendRecord(timestamp_ns, characteristic_id, kCaptureRecordNotification, data, length)) {
+        return false;
+    }
+    ++record_count_;
+    return true;
+}
+
+bool CaptureWriter::AppendEcgBlock(uint64_t timestamp_ns, uint16_t characteristic_id, const uint8_t* block,
+                                   uint16_t length) {
+    if (!AppendRecord(timestamp_ns, characteristic_id, kCaptureRecordEcgBlock, block, length)) {
+        return false;
+    }
+    ++record_count_;
+    return true;
+}
+
+bool CaptureWriter::AppendRecord(uint64_t timestamp_ns, uint16_t characteristic_id, uint8_t kind,
+                                 const uint8_t* data, uint16_t length) {
+    if (file_ == nullptr) {
+        return false;
+    }
+    std::size_t record_size = CaptureRecordSize(length);
+    if (used_ + record_size > buffer_.size()) {
+        if (!Flush()) {
+            return false;
+        }
+        if (record_size > buffer_.size()) {
+            buffer_.resize(record_size);
+        }
+    }
+
+    CaptureRecordHeader header{};
+    header.timestamp_ns = timestamp_ns;
+    header.characteristic_id = characteristic_id;
+    header.length = length;
+    header.kind = kind;
+
+    uint8_t* out = buffer_.data() + used_;
+    std::memcpy(out, &header, sizeof(header));
+    std::memcpy(out + sizeof(header), data, length);
+    // 对齐填充写 0，保证文件内容是确定的
+    std::memset(out + sizeof(header) + length, 0, record_size - sizeof(header) - length);
+    used_ += record_size;
+    return true;
+}
+
+bool CaptureWriter::Flush() {
+    if (file_ == nullptr) {
+        return false;
+    }
+    if (used_ == 0) {
+        return true;
+    }
+    std::size_t written = std::fwrite(buffer_.data(), 1, used_, file_);
+    bytes_written_ += written;
+    bool ok = written == used_;
+    used_ = 0;
+    return ok;
+}
+
+void CaptureWriter::Close() {
+    if (file_ == nullptr) {
+        return;
+    }
+    Flush();
+    std::fclose(file_);
+    file_ = nullptr;
+}
+
+bool CaptureReader::Open(const std::string& path) {
+    definitions_.clear();
+    truncated_ = false;
+    if (!file_.OpenReadOnly(path) || file_.Size() < sizeof(CaptureFileHeader)) {
+        return false;
+    }
+    std::memcpy(&header_, file_.Data(), sizeof(header_));
+    return std::memcmp(header_.magic, kCaptureMagic, sizeof(kCaptureMagic)) == 0 &&
+           header_.version == kCaptureVersion &&
+           header_.header_size == sizeof(CaptureFileHeader);
+}
+
+bool CaptureReader::Next(std::size_t& offset, CaptureRecord& record, uint8_t kind) {
+    const uint8_t* base = file_.Data();
+    const std::size_t size = file_.Size();
+    while (offset < size) {
+        if (size - offset < sizeof(CaptureRecordHeader)) {
+            truncated_ = true;
+            return false;
+        }
+        // 记录按 8 字节对齐，映射地址按页对齐，可以直接按结构体访问
+        const auto* header = reinterpret_cast<const CaptureRecordHeader*>(base + offset);
+        std::size_t record_size = CaptureRecordSize(header->length);
+        if (size - offset < sizeof(CaptureRecordHeader) + header->length) {
+            truncated_ = true;
+            return false;
+        }
+        const uint8_t* payload = base + offset + sizeof(CaptureRecordHeader);
+        offset += record_size;
+
+        if (header->kind == kCaptureRecordDefinition) {
+            if (header->length >= sizeof(CaptureCharacteristicDefinition)) {
+                CaptureCharacteristicDefinition definition;
+                std::memcpy(&definition, payload, sizeof(definition));
+                definitions_.emplace_back(header->characteristic_id, definition.uuid);
+            }
+            continue;
+        }
+        if (header->kind != kind) {
+            // 其他类型或未知类型的记录，跳过以兼容后续版本
+            continue;
+        }
+        record.timestamp_ns = header->timestamp_ns;
+        record.characteristic_id = header->characteristic_id;
+        record.length = header->length;
+        record.data = payload;
+        return true;
+    }
+    return false;
+}
+
+bool CaptureReader::LookupCharacteristic(uint16_t characteristic_id, Guid& uuid) const {
+    // 后登记的覆盖先登记的
+    for (auto it = definitions_.rbegin(); it != definitions_.rend(); ++it) {
+        if (it->first == characteristic_id) {
+            uuid = it->second;
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace ble
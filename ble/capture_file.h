@@ -0,0 +1,189 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ble/guid.h"
+#include "ble/mapped_file.h"
+
+namespace ble {
+
+/*
+ * 通知抓包文件格式（.blecap，小端序，只追加写）
+ *
+ *   CaptureFileHeader                     32 字节
+ *   { CaptureRecordHeader + 载荷 + 填充 } 重复，每条记录按 8 字节对齐
+ *
+ * kind = kCaptureRecordNotification 时载荷就是通知原始数据；
+ * kind = kCaptureRecordDefinition   时载荷是 CaptureCharacteristicDefinition，
+ * 用来把 characteristic_id 映射到特性 UUID，这样每条通知只需存 2 字节的编号；
+ * kind = kCaptureRecordEcgBlock     时载荷是 EncodeEcgBlock() 压缩的一块解码后样本（ecg_codec.h），
+ * 时间戳是块内最后一个通知的时间戳。按压缩方式录制时 ECG 数据流只写这种记录，不写原始通知。
+ */
+
+constexpr char kCaptureMagic[8] = {'B', 'L', 'E', 'C', 'A', 'P', '\0', '\1'};
+constexpr uint16_t kCaptureVersion = 1;
+
+constexpr uint8_t kCaptureRecordNotification = 0;
+constexpr uint8_t kCaptureRecordDefinition = 1;
+constexpr uint8_t kCaptureRecordEcgBlock = 2;
+
+struct CaptureFileHeader {
+    char magic[8];
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t flags;
+    uint64_t start_time_ns;  // 开始录制时的单调时间戳
+    uint64_t reserved;
+};
+
+struct CaptureRecordHeader {
+    uint64_t timestamp_ns;
+    uint16_t characteristic_id;
+    uint16_t length;
+    uint8_t kind;
+    uint8_t reserved[3];
+};
+
+struct CaptureCharacteristicDefinition {
+    Guid uuid;
+};
+
+static_assert(sizeof(CaptureFileHeader) == 32, "unexpected capture header size");
+static_assert(sizeof(CaptureRecordHeader) == 16, "unexpected capture record size");
+
+// 记录按 8 字节对齐后的总长度
+constexpr std::size_t CaptureRecordSize(std::size_t payload_length) {
+    return (sizeof(CaptureRecordHeader) + payload_length + 7) & ~static_cast<std::size_t>(7);
+}
+
+/**
+ * 带缓冲的抓包写入器，不是线程安全的，多个回调线程需要外部加锁或经由队列
+ */
+class CaptureWriter {
+public:
+    explicit CaptureWriter(std::size_t buffer_size = 256 * 1024);
+    ~CaptureWriter() { Close(); }
+
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+    /**
+     * 创建新的抓包文件并写入文件头，已存在的文件会被覆盖
+     * @param path
+     */
+    bool Open(const std::string& path);
+
+    bool IsOpen() const { return file_ != nullptr; }
+
+    /**
+     * 登记特性编号对应的 UUID，同一个编号只需登记一次
+     * @param characteristic_id
+     * @param uuid
+     */
+    bool DefineCharacteristic(uint16_t characteristic_id, const Guid& uuid);
+
+    /**
+     * 追加一条通知记录，数据先进缓冲区，缓冲区满时才真正写文件
+     * @param timestamp_ns
+     * @param characteristic_id
+     * @param data
+     * @param length
+     */
+    bool Append(uint64_t timestamp_ns, uint16_t characteristic_id, const uint8_t* data, uint16_t length);
+
+    /**
+     * 追加一块压缩后的 ECG 样本
+     * @param timestamp_ns
+     * @param characteristic_id
+     * @param block EncodeEcgBlock() 的输出
+     * @param length
+     */
+    bool AppendEcgBlock(uint64_t timestamp_ns, uint16_t characteristic_id, const uint8_t* block, uint16_t length);
+
+    // 把缓冲区写入文件
+    bool Flush();
+
+    void Close();
+
+    uint64_t RecordCount() const { return record_count_; }
+    uint64_t BytesWritten() const { return bytes_written_; }
+
+private:
+    bool AppendRecord(uint64_t timestamp_ns, uint16_t characteristic_id, uint8_t kind,
+                      const uint8_t* data, uint16_t length);
+
+    std::FILE* file_ = nullptr;
+    std::vector<uint8_t> buffer_;
+    std::size_t used_ = 0;
+    uint64_t record_count_ = 0;
+    uint64_t bytes_written_ = 0;
+};
+
+/**
+ * 一条通知记录，data 直接指向映射内存，不做拷贝
+ */
+struct CaptureRecord {
+    uint64_t timestamp_ns;
+    uint16_t characteristic_id;
+    uint16_t length;
+    const uint8_t* data;
+};
+
+/**
+ * 内存映射读取抓包文件，遍历时不拷贝载荷
+ */
+class CaptureReader {
+public:
+    bool Open(const std::string& path);
+
+    const CaptureFileHeader& Header() const { return header_; }
+
+    /**
+     * 从 offset 位置读取下一条 kind 类型的记录（默认是通知），UUID 定义和其他类型的记录会被自动跳过
+     * 初始 offset 取 Begin()，到达文件末尾或遇到不完整的记录时返回 false
+     * @param offset
+     * @param record
+     * @param kind
+     */
+    bool Next(std::size_t& offset, CaptureRecord& record, uint8_t kind = kCaptureRecordNotification);
+
+    std::size_t Begin() const { return sizeof(CaptureFileHeader); }
+
+    // 依次对每条通知记录调用 fn(const CaptureRecord&)，返回记录条数
+    template <typename Fn>
+    std::size_t ForEach(Fn&& fn) {
+        std::size_t offset = Begin();
+        std::size_t count = 0;
+        CaptureRecord record;
+        while (Next(offset, record)) {
+            fn(record);
+            ++count;
+        }
+        return count;
+    }
+
+    /**
+     * 查找特性编号对应的 UUID（只有已经遍历过的定义记录才能查到）
+     * @return 找不到时返回 false
+     */
+    bool LookupCharacteristic(uint16_t characteristic_id, Guid& uuid) const;
+
+    // 文件末尾有被截断的记录（例如进程在写入途中被杀掉）
+    bool Truncated() const { return truncated_; }
+
+    const uint8_t* Data() const { return file_.Data(); }
+    std::size_t Size() const { return file_.Size(); }
+
+private:
+    MappedFile file_;
+    CaptureFileHeader header_{};
+    std::vector<std::pair<uint16_t, Guid>> definitions_;
+    bool truncated_ = false;
+};
+
+}  // namespace ble
@@ -0,0 +1,50 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#endif
+
+namespace ble {
+
+// 单调时钟（纳秒），所有模块的时间戳都来自这里，便于跨模块比较
+inline uint64_t MonotonicNowNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/**
+ * 低开销的时间戳，只用来求短间隔：x86 上直接读 TSC（几纳秒，要求 CPU 的 TSC 频率恒定且各核同步，
+ * 近十年的 x86 都满足），其他平台就是 MonotonicNowNs()。换算成纳秒要乘以 NsPerTick()。
+ */
+inline uint64_t TickNow() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    return __rdtsc();
+#else
+    return MonotonicNowNs();
+#endif
+}
+
+// 每个 tick 的纳秒数，第一次调用时对照 MonotonicNowNs() 校准（约 10ms）
+inline double NsPerTick() {
+    static const double ns_per_tick = [] {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+        uint64_t ns0 = MonotonicNowNs();
+        uint64_t tick0 = TickNow();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        uint64_t ns1 = MonotonicNowNs();
+        uint64_t tick1 = TickNow();
+        return tick1 > tick0 ? static_cast<double>(ns1 - ns0) / static_cast<double>(tick1 - tick0) : 1.0;
+#else
+        return 1.0;
+#endif
+    }();
+    return ns_per_tick;
+}
+
+}  // namespace ble
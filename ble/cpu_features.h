@@ -0,0 +1,67 @@
+﻿#pragma once
+
+// 运行时检测 CPU 指令集，SIMD 路径只在支持的 CPU 上启用
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define BLE_X86 1
+#else
+#define BLE_X86 0
+#endif
+
+#if BLE_X86 && defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+// GCC/Clang 需要给使用 SIMD 内建函数的函数单独打开指令集；MSVC 不需要
+#if BLE_X86 && (defined(__GNUC__) || defined(__clang__))
+#define BLE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define BLE_TARGET(isa)
+#endif
+
+namespace ble {
+
+inline bool CpuHasSsse3() {
+#if BLE_X86 && (defined(__GNUC__) || defined(__clang__))
+    return __builtin_cpu_supports("ssse3");
+#elif BLE_X86 && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 9)) != 0;
+#else
+    return false;
+#endif
+}
+
+inline bool CpuHasSse42() {
+#if BLE_X86 && (defined(__GNUC__) || defined(__clang__))
+    return __builtin_cpu_supports("sse4.2");
+#elif BLE_X86 && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    return false;
+#endif
+}
+
+inline bool CpuHasAvx2() {
+#if BLE_X86 && (defined(__GNUC__) || defined(__clang__))
+    return __builtin_cpu_supports("avx2");
+#elif BLE_X86 && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    // 还要确认操作系统保存了 YMM 寄存器（OSXSAVE + XCR0）
+    bool os_avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 &&
+                  (_xgetbv(0) & 0x6) == 0x6;
+    if (!os_avx) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return false;
+#endif
+}
+
+}  // namespace ble
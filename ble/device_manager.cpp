@@ -0,0 +1,550 @@
+﻿#include "ble/device_manager.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "ble/clock.h"
+
+namespace ble {
+
+const char* DeviceStateName(DeviceState state) {
+    switch (state) {
+        case DeviceState::Idle:
+            return "Idle";
+        case DeviceState::Connecting:
+            return "Connecting";
+        case DeviceState::Streaming:
+            return "Streaming";
+        case DeviceState::Failed:
+            return "Failed";
+        case DeviceState::Disconnected:
+            return "Disconnected";
+    }
+    return "Unknown";
+}
+
+DeviceManager::DeviceManager(BleTransport& transport, DeviceManagerOptions options, NotificationSink sink)
+    : transport_(transport), options_(std::move(options)), sink_(std::move(sink)) {
+    if (options_.worker_threads == 0) {
+        options_.worker_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // 设备槽位一次性分配好，解码线程遍历时不需要加锁
+    devices_.resize(options_.max_devices);
+    for (auto& device : devices_) {
+        device = std::make_unique<Device>();
+    }
+    // 目标按原来的顺序排在前面，然后是额外的过滤规则
+    std::vector<AdvertisementRule> rules;
+    for (const auto& target : options_.targets) {
+        AdvertisementRule rule;
+        if (target.address != 0) {
+            rule.address = target.address;
+            rule.address_mask = 0xFFFFFFFFFFFFull;
+        } else if (!target.name.empty()) {
+            rule.name = target.name;
+        } else {
+            continue;
+        }
+        rules.push_back(std::move(rule));
+    }
+    rules.insert(rules.end(), options_.filters.begin(), options_.filters.end());
+    filter_valid_ = filter_.Compile(rules);
+}
+
+DeviceManager::~DeviceManager() {
+    Stop();
+}
+
+bool DeviceManager::Start() {
+    if (!filter_valid_) {
+        return false;
+    }
+    stopping_.store(false);
+    workers_running_.store(true);
+    for (std::size_t i = 0; i < options_.worker_threads; ++i) {
+        workers_.emplace_back(&DeviceManager::WorkerLoop, this, i);
+    }
+    return transport_.StartScan([this](const Advertisement& advertisement) {
+        OnAdvertisement(advertisement);
+    });
+}
+
+void DeviceManager::Stop() {
+    stopping_.store(true);
+    if (workers_.empty()) {
+        return;
+    }
+    transport_.StopScan();
+
+    // 等待还没完成的连接任务，它们会看到 stopping_ 后尽快返回
+    std::size_t count = device_count_.load();
+    for (std::size_t i = 0; i < count; ++i) {
+        Device& device = *devices_[i];
+        std::lock_guard<std::mutex> lock(task_mutex_);
+        if (device.task.valid()) {
+            device.task.wait();
+        }
+    }
+    // 各设备同时断开，断开后不会再有新的通知入队
+    std::vector<std::future<void>> disconnects;
+    for (std::size_t i = 0; i < count; ++i) {
+        disconnects.push_back(std::async(std::launch::async, [this, i] {
+            Device& device = *devices_[i];
+            if (device.subscriptions) {
+                device.subscriptions->UnsubscribeAll();
+            }
+            if (device.connection) {
+                device.connection->Disconnect();
+            }
+            if (device.state.load() == DeviceState::Streaming) {
+                SetState(i, DeviceState::Disconnected);
+            }
+        }));
+    }
+    for (auto& disconnect : disconnects) {
+        disconnect.wait();
+    }
+    // 断开后超时的 GATT 请求也会尽快结束，等它们结束再停解码线程
+    abandoned_.Drain();
+    // 解码线程看到 workers_running_ 为 false 后会把队列清空再退出
+    workers_running_.store(false);
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+    workers_.clear();
+}
+
+void DeviceManager::SetState(std::size_t index, DeviceState state) {
+    devices_[index]->state.store(state);
+    if (options_.state_listener) {
+        options_.state_listener(index, state);
+    }
+}
+
+bool DeviceManager::Matches(const Advertisement& advertisement) const {
+    return filter_.Match(advertisement) >= 0;
+}
+
+bool DeviceManager::Selected(const GattCharacteristicInfo& characteristic) const {
+    if (options_.characteristics.empty()) {
+        return true;
+    }
+    for (const auto& uuid : options_.characteristics) {
+        if (uuid == characteristic.uuid) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void DeviceManager::OnAdvertisement(const Advertisement& advertisement) {
+    if (stopping_.load(std::memory_order_relaxed) || !Matches(advertisement)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(task_mutex_);
+    auto known = device_by_address_.find(advertisement.address);
+    if (known != device_by_address_.end()) {
+        // 连接失败或断开后再次出现：在原来的槽位上重新连接，解码回调看到的设备编号不变
+        const std::size_t index = known->second;
+        Device& device = *devices_[index];
+        const DeviceState state = device.state.load();
+        if (state != DeviceState::Failed && state != DeviceState::Disconnected) {
+            return;
+        }
+        // 一直连不上的设备不会随每条广播反复重连
+        const uint64_t now = MonotonicNowNs();
+        if (now - device.failed_ns.load() < static_cast<uint64_t>(options_.retry_interval_ms) * 1000000) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> device_lock(device.mutex);
+            device.name = std::string(advertisement.local_name);
+            device.found_ns = advertisement.timestamp_ns != 0 ? advertisement.timestamp_ns : now;
+        }
+        device.streaming_ns.store(0);
+        device.first_notification_ns.store(0, std::memory_order_relaxed);
+        SetState(index, DeviceState::Connecting);
+        // 上一个任务设置 Failed 后就返回了，这里替换它的 future 不会等待
+        device.task = std::async(std::launch::async, &DeviceManager::ConnectDevice, this, index);
+        return;
+    }
+    std::size_t index = device_count_.load();
+    if (index >= devices_.size()) {
+        return;
+    }
+    Device& device = *devices_[index];
+    device.address = advertisement.address;
+    device.name = std::string(advertisement.local_name);
+    device.found_ns = advertisement.timestamp_ns != 0 ? advertisement.timestamp_ns : MonotonicNowNs();
+    SetState(index, DeviceState::Connecting);
+    device_by_address_[advertisement.address] = index;
+    // 先把设备信息写好再公开数量，解码线程和统计只访问 index < device_count_ 的设备
+    device_count_.store(index + 1);
+
+    // 连接、发现、订阅放到异步任务里，扫描回调立刻返回
+    device.task = std::async(std::launch::async, &DeviceManager::ConnectDevice, this, index);
+}
+
+void DeviceManager::ConnectDevice(std::size_t index) {
+    Device& device = *devices_[index];
+    auto connection = transport_.ConnectAsync(device.address).get();
+    if (!connection || stopping_.load()) {
+        Fail(index);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(device.mutex);
+        device.connection = connection;
+    }
+
+    bool cached = false;
+    DiscoveryResult discovery = DiscoverOrRestore(device, cached);
+    DiscoveryTimings timings = discovery.timings;
+    if (discovery.status != GattStatus::Success || stopping_.load()) {
+        Fail(index);
+        return;
+    }
+
+    uint64_t subscribe_start = MonotonicNowNs();
+    std::vector<std::unique_ptr<Stream>> streams;
+    if (Subscribe(device, discovery, streams) == 0 || stopping_.load()) {
+        Fail(index);
+        return;
+    }
+    std::vector<SubscriptionRecord> records = device.subscriptions->Records();
+    if (cached && std::any_of(records.begin(), records.end(), [](const SubscriptionRecord& record) {
+            return record.status == GattStatus::ProtocolError;
+        })) {
+        // 缓存的句柄在设备上已经失效：作废缓存，完整发现后重新订阅
+        device.subscriptions->UnsubscribeAll();
+        options_.gatt_cache->Invalidate(device.address);
+        for (auto& stream : streams) {
+            device.owned_streams.push_back(std::move(stream));
+        }
+        streams.clear();
+        discovery = DiscoverGatt(*connection, options_.discovery, &abandoned_);
+        timings = discovery.timings;
+        cached = false;
+        if (discovery.status != GattStatus::Success || stopping_.load()) {
+            Fail(index);
+            return;
+        }
+        options_.gatt_cache->Store(device.address, discovery);
+        subscribe_start = MonotonicNowNs();
+        if (Subscribe(device, discovery, streams) == 0 || stopping_.load()) {
+            Fail(index);
+            return;
+        }
+        records = device.subscriptions->Records();
+    }
+    const double subscribe_ms = static_cast<double>(MonotonicNowNs() - subscribe_start) / 1e6;
+
+    // 只公开启用成功的流；失败的流对象也保留，迟到的回调不会访问已释放的内存
+    std::size_t stream_count = 0;
+    for (std::size_t i = 0; i < streams.size(); ++i) {
+        if (records[i].state == SubscriptionState::Active) {
+            device.streams[i].store(streams[i].get(), std::memory_order_release);
+            ++stream_count;
+        }
+        device.owned_streams.push_back(std::move(streams[i]));
+    }
+    if (stream_count == 0) {
+        Fail(index);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(device.mutex);
+        device.discovery = timings;
+        device.subscribe_ms = subscribe_ms;
+        device.gatt_cache_hit = cached;
+    }
+    device.streaming_ns.store(MonotonicNowNs());
+    SetState(index, DeviceState::Streaming);
+}
+
+void DeviceManager::Fail(std::size_t index) {
+    // 不再占着连接，设备再次广播时可以重新接入
+    ReleaseConnection(*devices_[index]);
+    devices_[index]->failed_ns.store(MonotonicNowNs());
+    SetState(index, DeviceState::Failed);
+}
+
+void DeviceManager::ReleaseConnection(Device& device) {
+    for (auto& stream : device.streams) {
+        stream.store(nullptr, std::memory_order_release);
+    }
+    std::shared_ptr<BleConnection> connection;
+    SubscriptionSet* subscriptions = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(device.mutex);
+        connection = std::move(device.connection);
+        if (device.subscriptions) {
+            subscriptions = device.subscriptions.get();
+            device.retired_subscriptions.push_back(std::move(device.subscriptions));
+        }
+    }
+    if (subscriptions != nullptr) {
+        subscriptions->UnsubscribeAll();
+    }
+    if (connection) {
+        connection->Disconnect();
+    }
+}
+
+DiscoveryResult DeviceManager::DiscoverOrRestore(Device& device, bool& cached) {
+    cached = false;
+    GattCache* cache = options_.gatt_cache.get();
+    DiscoveryResult layout;
+    if (cache != nullptr && cache->Lookup(device.address, layout)) {
+        // 命中时最多一次服务发现，不再逐个服务查询特性
+        DiscoveryResult restored = RestoreGatt(*device.connection, layout, options_.gatt_cache_validate,
+                                               options_.discovery, &abandoned_);
+        if (restored.status == GattStatus::Success) {
+            cached = true;
+            return restored;
+        }
+        if (restored.status == GattStatus::ProtocolError) {
+            cache->Invalidate(device.address);
+        }
+    }
+    // 所有服务的特性查询并发进行，带超时，单个服务失败不影响其他服务
+    DiscoveryResult discovery = DiscoverGatt(*device.connection, options_.discovery, &abandoned_);
+    if (cache != nullptr) {
+        cache->Store(device.address, discovery);
+    }
+    return discovery;
+}
+
+std::size_t DeviceManager::Subscribe(Device& device, const DiscoveryResult& discovery,
+                                     std::vector<std::unique_ptr<Stream>>& streams) {
+    // 每个选中的特性一个流，所有 CCCD 写入同时发出，不会停在第一个特性上
+    std::vector<SubscriptionRequest> requests;
+    discovery.ForEachCharacteristic([&](const GattCharacteristicInfo& characteristic) {
+        SubscriptionKind kind;
+        if (requests.size() >= kMaxStreamsPerDevice || !Selected(characteristic) ||
+            !PreferredSubscriptionKind(characteristic, kind)) {
+            return;
+        }
+        auto stream = std::make_unique<Stream>(options_.ring_capacity, options_.sequence_field.Bits());
+        stream->characteristic = characteristic;
+        Stream* raw = stream.get();
+        auto stream_index = static_cast<uint16_t>(requests.size());
+
+        // 通知回调是该流队列唯一的生产者
+        SubscriptionRequest request;
+        request.characteristic = characteristic;
+        request.kind = kind;
+        request.handler = [raw, stream_index](uint16_t, uint64_t timestamp_ns, const uint8_t* data,
+                                              std::size_t length) {
+            PushNotification(raw->ring, timestamp_ns, stream_index, data, length);
+        };
+        requests.push_back(std::move(request));
+        streams.push_back(std::move(stream));
+    });
+    if (requests.empty() || stopping_.load()) {
+        return 0;
+    }
+    const std::size_t count = requests.size();
+    auto subscriptions = std::make_unique<SubscriptionSet>(device.connection, &abandoned_);
+    subscriptions->Activate(std::move(requests), options_.subscribe_timeout_ms);
+    std::lock_guard<std::mutex> lock(device.mutex);
+    if (device.subscriptions) {
+        device.retired_subscriptions.push_back(std::move(device.subscriptions));
+    }
+    device.subscriptions = std::move(subscriptions);
+    return count;
+}
+
+std::size_t DeviceManager::DrainDevice(std::size_t index) {
+    Device& device = *devices_[index];
+    std::size_t total = 0;
+    uint64_t first_timestamp = 0;
+    for (std::size_t s = 0; s < kMaxStreamsPerDevice; ++s) {
+        Stream* stream = device.streams[s].load(std::memory_order_acquire);
+        if (stream == nullptr) {
+            continue;
+        }
+        uint64_t now = MonotonicNowNs();
+        uint64_t bytes = 0;
+        uint64_t latency_sum = 0;
+        uint64_t latency_max = stream->latency_max_ns.load(std::memory_order_relaxed);
+        std::size_t n = stream->ring.PopBatch(
+                [&](const NotificationSlot& slot) {
+                    uint64_t latency = now > slot.timestamp_ns ? now - slot.timestamp_ns : 0;
+                    latency_sum += latency;
+                    latency_max = std::max(latency_max, latency);
+                    bytes += slot.length;
+                    if (first_timestamp == 0 || slot.timestamp_ns < first_timestamp) {
+                        first_timestamp = slot.timestamp_ns;
+                    }
+                    uint32_t sequence;
+                    if (options_.sequence_field.Extract(slot.data, slot.length, sequence)) {
+                        stream->sequence.Record(sequence, slot.timestamp_ns);
+                    } else {
+                        stream->sequence.Record(slot.timestamp_ns);
+                    }
+                    sink_(index, slot);
+                },
+                options_.batch_size);
+        if (n > 0) {
+            stream->notifications.store(stream->notifications.load(std::memory_order_relaxed) + n,
+                                        std::memory_order_relaxed);
+            stream->bytes.store(stream->bytes.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+            stream->latency_sum_ns.store(stream->latency_sum_ns.load(std::memory_order_relaxed) + latency_sum,
+                                         std::memory_order_relaxed);
+            stream->latency_max_ns.store(latency_max, std::memory_order_relaxed);
+            total += n;
+        }
+    }
+    if (first_timestamp != 0 && device.first_notification_ns.load(std::memory_order_relaxed) == 0) {
+        device.first_notification_ns.store(first_timestamp, std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void DeviceManager::WorkerLoop(std::size_t worker) {
+    unsigned idle_rounds = 0;
+    for (;;) {
+        bool running = workers_running_.load(std::memory_order_acquire);
+        std::size_t count = device_count_.load(std::memory_order_acquire);
+        std::size_t processed = 0;
+        // 设备 i 固定由 i % worker_threads 号线程处理
+        for (std::size_t i = worker; i < count; i += options_.worker_threads) {
+            processed += DrainDevice(i);
+        }
+        if (processed > 0) {
+            idle_rounds = 0;
+            continue;
+        }
+        if (!running) {
+            // 停止前的最后一轮也没有数据了
+            return;
+        }
+        if (options_.worker_idle) {
+            options_.worker_idle();
+        }
+        if (idle_rounds < 128) {
+            ++idle_rounds;
+        }
+        if (idle_rounds < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+}
+
+std::vector<DeviceStats> DeviceManager::Stats() const {
+    std::vector<DeviceStats> result;
+    std::size_t count = device_count_.load(std::memory_order_acquire);
+    uint64_t now = MonotonicNowNs();
+    for (std::size_t i = 0; i < count; ++i) {
+        const Device& device = *devices_[i];
+        DeviceStats stats;
+        stats.index = i;
+        stats.address = device.address;
+        stats.state = device.state.load();
+        uint64_t latency_sum = 0;
+        uint64_t latency_max = 0;
+        for (std::size_t s = 0; s < kMaxStreamsPerDevice; ++s) {
+            const Stream* stream = device.streams[s].load(std::memory_order_acquire);
+            if (stream == nullptr) {
+                continue;
+            }
+            ++stats.streams;
+            stats.notifications += stream->notifications.load(std::memory_order_relaxed);
+            stats.bytes += stream->bytes.load(std::memory_order_relaxed);
+            stats.dropped += stream->ring.Dropped();
+            SequenceStats sequence = stream->sequence.Snapshot();
+            stats.lost += sequence.lost;
+            stats.duplicates += sequence.duplicates;
+            stats.reordered += sequence.reordered;
+            latency_sum += stream->latency_sum_ns.load(std::memory_order_relaxed);
+            latency_max = std::max(latency_max, stream->latency_max_ns.load(std::memory_order_relaxed));
+        }
+        std::lock_guard<std::mutex> lock(device.mutex);
+        stats.name = device.name;
+        uint64_t streaming_ns = device.streaming_ns.load();
+        if (streaming_ns != 0) {
+            stats.discovery = device.discovery;
+            stats.subscribe_ms = device.subscribe_ms;
+            stats.gatt_cache_hit = device.gatt_cache_hit;
+            stats.connect_ms = static_cast<double>(streaming_ns - device.found_ns) / 1e6;
+            if (now > streaming_ns) {
+                stats.notifications_per_s = static_cast<double>(stats.notifications) * 1e9 /
+                                            static_cast<double>(now - streaming_ns);
+            }
+        }
+        uint64_t first_notification_ns = device.first_notification_ns.load(std::memory_order_relaxed);
+        if (first_notification_ns > device.found_ns) {
+            stats.first_notification_ms = static_cast<double>(first_notification_ns - device.found_ns) / 1e6;
+        }
+        if (stats.notifications > 0) {
+            stats.latency_avg_us = static_cast<double>(latency_sum) / static_cast<double>(stats.notifications) / 1e3;
+        }
+        stats.latency_max_us = static_cast<double>(latency_max) / 1e3;
+        result.push_back(std::move(stats));
+    }
+    return result;
+}
+
+std::size_t DeviceManager::StreamingCount() const {
+    std::size_t count = device_count_.load(std::memory_order_acquire);
+    std::size_t streaming = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        if (devices_[i]->state.load() == DeviceState::Streaming) {
+            ++streaming;
+        }
+    }
+    return streaming;
+}
+
+uint64_t DeviceManager::DeviceAddress(std::size_t device_index) const {
+    return device_index < device_count_.load(std::memory_order_acquire) ? devices_[device_index]->address : 0;
+}
+
+bool DeviceManager::StreamUuid(std::size_t device_index, uint16_t stream_index, Guid& uuid) const {
+    if (device_index >= device_count_.load(std::memory_order_acquire) || stream_index >= kMaxStreamsPerDevice) {
+        return false;
+    }
+    const Stream* stream = devices_[device_index]->streams[stream_index].load(std::memory_order_acquire);
+    if (stream == nullptr) {
+        return false;
+    }
+    uuid = stream->characteristic.uuid;
+    return true;
+}
+
+std::vector<StreamSequenceStats> DeviceManager::SequenceStatistics(std::size_t device_index) const {
+    std::vector<StreamSequenceStats> result;
+    if (device_index >= device_count_.load(std::memory_order_acquire)) {
+        return result;
+    }
+    const Device& device = *devices_[device_index];
+    for (std::size_t s = 0; s < kMaxStreamsPerDevice; ++s) {
+        const Stream* stream = device.streams[s].load(std::memory_order_acquire);
+        if (stream == nullptr) {
+            continue;
+        }
+        StreamSequenceStats entry;
+        entry.stream = static_cast<uint16_t>(s);
+        entry.characteristic = stream->characteristic.uuid;
+        entry.stats = stream->sequence.Snapshot();
+        result.push_back(entry);
+    }
+    return result;
+}
+
+std::vector<SubscriptionRecord> DeviceManager::Subscriptions(std::size_t device_index) const {
+    if (device_index >= device_count_.load(std::memory_order_acquire)) {
+        return {};
+    }
+    const Device& device = *devices_[device_index];
+    std::lock_guard<std::mutex> lock(device.mutex);
+    if (device.streaming_ns.load() == 0 || !device.subscriptions) {
+        return {};
+    }
+    return device.subscriptions->Records();
+}
+
+}  // namespace ble
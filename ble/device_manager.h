@@ -0,0 +1,221 @@
+﻿#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "ble/advertisement_filter.h"
+#include "ble/gatt_cache.h"
+#include "ble/gatt_discovery.h"
+#include "ble/notification_ring.h"
+#include "ble/sequence_tracker.h"
+#include "ble/subscription.h"
+#include "ble/transport.h"
+
+namespace ble {
+
+/**
+ * 要连接的目标：address 非 0 时按地址匹配，否则按广播名称匹配（同名的多台设备都会连接）
+ */
+struct DeviceTarget {
+    std::string name;
+    uint64_t address = 0;
+};
+
+enum class DeviceState {
+    Idle,
+    Connecting,
+    Streaming,
+    Failed,
+    Disconnected,
+};
+
+const char* DeviceStateName(DeviceState state);
+
+struct DeviceManagerOptions {
+    std::vector<DeviceTarget> targets;
+    std::vector<AdvertisementRule> filters;  // 额外的过滤规则，与 targets 合起来不超过 kMaxAdvertisementRules 条
+    std::size_t max_devices = 64;      // 最多同时连接的设备数
+    std::size_t worker_threads = 0;    // 解码线程数，0 表示 CPU 核数
+    std::size_t ring_capacity = 1024;  // 每个通知流的队列长度（2 的幂）
+    std::size_t batch_size = 64;       // 解码线程每次最多从一个流取出的通知数
+    DiscoveryOptions discovery;        // 服务/特性发现的并发方式和超时
+    std::shared_ptr<GattCache> gatt_cache;  // 非空时命中缓存的设备跳过特性发现，完整发现的结果写回缓存
+    bool gatt_cache_validate = true;   // 使用缓存前先做一次服务发现核对布局
+    std::vector<Guid> characteristics; // 要订阅的特性，为空时订阅所有支持通知或指示的特性
+    uint32_t subscribe_timeout_ms = 5000;
+    uint32_t retry_interval_ms = 1000; // 连接失败后至少隔这么久，设备再次广播时才重新接入
+    SequenceField sequence_field;      // 通知载荷里包序号的位置，所有流共用；默认没有序号
+    // 设备状态变化时调用，可能来自扫描线程、连接任务或 Stop()，实现里不要阻塞
+    std::function<void(std::size_t device_index, DeviceState state)> state_listener;
+    // 解码线程一轮没有取到任何通知时在该线程上调用，可以在这里交出解码回调攒下的数据；空闲时每次休眠前都会调用
+    std::function<void()> worker_idle;
+};
+
+// 每台设备最多订阅的通知特性数
+constexpr std::size_t kMaxStreamsPerDevice = 8;
+
+/**
+ * 一台设备的吞吐和延迟统计（延迟指通知到达到被解码线程处理的时间）
+ */
+struct DeviceStats {
+    std::size_t index = 0;
+    uint64_t address = 0;
+    std::string name;
+    DeviceState state = DeviceState::Idle;
+    std::size_t streams = 0;
+    uint64_t notifications = 0;
+    uint64_t bytes = 0;
+    uint64_t dropped = 0;              // 队列满被丢弃的通知
+    uint64_t lost = 0;                 // 按包序号判断没有收到的通知（空中丢包）
+    uint64_t duplicates = 0;
+    uint64_t reordered = 0;
+    double notifications_per_s = 0.0;  // 从开始接收数据起的平均速率
+    double latency_avg_us = 0.0;
+    double latency_max_us = 0.0;
+    double connect_ms = 0.0;           // 从发现广播到全部订阅完成
+    DiscoveryTimings discovery;        // 其中服务/特性发现各阶段的耗时
+    double subscribe_ms = 0.0;         // 其中启用全部订阅的耗时
+    bool gatt_cache_hit = false;       // 使用了缓存的 GATT 布局
+    double first_notification_ms = 0.0;  // 从发现广播到收到第一个通知，还没有通知时为 0
+};
+
+/**
+ * 一个通知流的序号和到达间隔统计
+ */
+struct StreamSequenceStats {
+    uint16_t stream = 0;
+    Guid characteristic{};
+    SequenceStats stats;
+};
+
+/**
+ * 多设备并发接收管理器
+ *
+ * 扫描回调里只做目标匹配和登记，连接、发现、订阅都在各设备自己的异步任务里完成，
+ * 不会阻塞扫描；选中的特性一次性全部启用通知/指示，任务随即结束。每个订阅的特性有独立的 SpscRing（生产者是该特性的通知回调），
+ * 设备按编号平均分给若干解码线程，每个队列只有一个消费者，
+ * 同一设备的数据总在同一个线程上按顺序处理。
+ * 连接失败或断开的设备再次广播时重新接入，沿用原来的编号和槽位。
+ */
+class DeviceManager {
+public:
+    /**
+     * 解码回调，在解码线程上调用
+     * @param device_index 设备编号（0 ~ max_devices-1，连接后不变，重新接入也不变）
+     * @param slot slot.characteristic_id 是设备内的流编号
+     */
+    using NotificationSink = std::function<void(std::size_t device_index, const NotificationSlot& slot)>;
+
+    DeviceManager(BleTransport& transport, DeviceManagerOptions options, NotificationSink sink);
+    ~DeviceManager();
+
+    DeviceManager(const DeviceManager&) = delete;
+    DeviceManager& operator=(const DeviceManager&) = delete;
+
+    // 启动解码线程并开始扫描
+    bool Start();
+
+    // 停止扫描、断开所有设备，处理完队列里剩余的数据后返回
+    void Stop();
+
+    std::vector<DeviceStats> Stats() const;
+
+    std::size_t StreamingCount() const;
+
+    uint64_t DeviceAddress(std::size_t device_index) const;
+
+    /**
+     * 查询某个流对应的特性 UUID
+     * @return 流不存在时返回 false
+     */
+    bool StreamUuid(std::size_t device_index, uint16_t stream_index, Guid& uuid) const;
+
+    /**
+     * 某台设备的订阅登记表，设备还在连接时返回空
+     * @param device_index
+     */
+    std::vector<SubscriptionRecord> Subscriptions(std::size_t device_index) const;
+
+    /**
+     * 某台设备各个流的丢包、重复、乱序和到达间隔统计（累计值），在解码线程上采集
+     * @param device_index
+     */
+    std::vector<StreamSequenceStats> SequenceStatistics(std::size_t device_index) const;
+
+private:
+    struct Stream {
+        Stream(std::size_t capacity, unsigned sequence_bits) : ring(capacity), sequence(sequence_bits) {}
+
+        GattCharacteristicInfo characteristic;
+        SpscRing<NotificationSlot> ring;
+        SequenceTracker sequence;  // 只由解码线程写入
+        // 以下统计只由负责该设备的解码线程写入
+        std::atomic<uint64_t> notifications{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> latency_sum_ns{0};
+        std::atomic<uint64_t> latency_max_ns{0};
+    };
+
+    struct Device {
+        std::atomic<DeviceState> state{DeviceState::Idle};
+        uint64_t address = 0;                   // 登记后不变，同一地址重新接入时沿用这个槽位
+        // 以下连接信息在重新接入时会被改写，用 mutex 保护
+        mutable std::mutex mutex;
+        std::string name;
+        uint64_t found_ns = 0;
+        DiscoveryTimings discovery;
+        double subscribe_ms = 0.0;
+        bool gatt_cache_hit = false;
+        std::shared_ptr<BleConnection> connection;
+        std::unique_ptr<SubscriptionSet> subscriptions;
+        std::atomic<uint64_t> streaming_ns{0};  // 非 0 表示本次连接已开始接收
+        std::atomic<uint64_t> first_notification_ns{0};  // 只由解码线程写入，重新接入时清零
+        std::atomic<uint64_t> failed_ns{0};     // 最近一次连接失败的时间
+        std::array<std::atomic<Stream*>, kMaxStreamsPerDevice> streams{};
+        // 以下只由连接任务访问：流对象和旧的订阅表保留到析构，迟到的回调和解码线程不会访问已释放的内存
+        std::vector<std::unique_ptr<Stream>> owned_streams;
+        std::vector<std::unique_ptr<SubscriptionSet>> retired_subscriptions;
+        std::future<void> task;
+    };
+
+    void SetState(std::size_t index, DeviceState state);
+    bool Matches(const Advertisement& advertisement) const;
+    bool Selected(const GattCharacteristicInfo& characteristic) const;
+    void OnAdvertisement(const Advertisement& advertisement);
+    void ConnectDevice(std::size_t index);
+    void Fail(std::size_t index);
+    void ReleaseConnection(Device& device);
+    DiscoveryResult DiscoverOrRestore(Device& device, bool& cached);
+    std::size_t Subscribe(Device& device, const DiscoveryResult& discovery,
+                          std::vector<std::unique_ptr<Stream>>& streams);
+    void WorkerLoop(std::size_t worker);
+    std::size_t DrainDevice(std::size_t index);
+
+    BleTransport& transport_;
+    DeviceManagerOptions options_;
+    NotificationSink sink_;
+    AbandonedRequests abandoned_;      // 超时的 GATT 请求，Stop 时等它们结束，比各设备的 SubscriptionSet 后销毁
+
+    std::vector<std::unique_ptr<Device>> devices_;
+    std::atomic<std::size_t> device_count_{0};
+    AdvertisementFilter filter_;       // targets 和 filters 编译后的结果，扫描线程只读
+    bool filter_valid_ = false;
+    std::unordered_map<uint64_t, std::size_t> device_by_address_;
+    std::mutex task_mutex_;  // 保护 device_by_address_ 和各设备的 task
+
+    std::atomic<bool> stopping_{false};
+    std::atomic<bool> workers_running_{false};
+    std::vector<std::thread> workers_;
+};
+
+}  // namespace ble
@@ -0,0 +1,315 @@
+﻿#include "ble/ecg_codec.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "ble/cpu_features.h"
+
+namespace ble {
+
+namespace {
+
+constexpr std::size_t kBlockHeaderBytes = 4;
+constexpr std::size_t kLeadHeaderBytes = 5;
+constexpr uint8_t kBlockVersion = 0;
+// 打包区最多的 32 位字数：位宽 32 时每路 kEcgBlockFrames / 8 个字，再加一行 0 作为跨字读取的余量
+constexpr std::size_t kLaneWords = kEcgBlockFrames + kEcgBlockLanes;
+
+inline uint32_t ZigZag(uint32_t value) {
+    return (value << 1) ^ static_cast<uint32_t>(static_cast<int32_t>(value) >> 31);
+}
+
+inline uint32_t UnZigZag(uint32_t value) {
+    return (value >> 1) ^ (0u - (value & 1));
+}
+
+inline unsigned BitWidth(uint32_t value) {
+    unsigned width = 0;
+    while (value != 0) {
+        ++width;
+        value >>= 1;
+    }
+    return width;
+}
+
+// 每一路的残差个数（位置数），向上取整
+inline std::size_t Positions(std::size_t frames) {
+    return (frames + kEcgBlockLanes - 1) / kEcgBlockLanes;
+}
+
+// 一个导联打包后的字节数：每路 positions * width 位，按 32 位字取整
+inline std::size_t PackedBytes(std::size_t frames, unsigned width) {
+    return (Positions(frames) * width + 31) / 32 * kEcgBlockLanes * 4;
+}
+
+inline uint32_t LoadWord(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) |
+           (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline void StoreWord(uint8_t* p, uint32_t value) {
+    p[0] = static_cast<uint8_t>(value);
+    p[1] = static_cast<uint8_t>(value >> 8);
+    p[2] = static_cast<uint8_t>(value >> 16);
+    p[3] = static_cast<uint8_t>(value >> 24);
+}
+
+/**
+ * 求一个导联的残差（已 zigzag），values 按帧序，长度补齐到 8 的倍数（补 0）
+ */
+void Residuals(const int32_t* in, std::size_t frames, EcgPredictor predictor, uint32_t* values) {
+    uint32_t previous = static_cast<uint32_t>(in[0]);
+    uint32_t delta = 0;
+    values[0] = 0;
+    for (std::size_t i = 1; i < frames; ++i) {
+        const uint32_t x = static_cast<uint32_t>(in[i]);
+        const uint32_t d = x - previous;
+        values[i] = ZigZag(predictor == EcgPredictor::Delta ? d : d - delta);
+        delta = d;
+        previous = x;
+    }
+    for (std::size_t i = frames; i < Positions(frames) * kEcgBlockLanes; ++i) {
+        values[i] = 0;
+    }
+}
+
+/**
+ * 把 8 路交织的位流解成 zigzag 残差；8 路的移位量相同，
+ * 内层循环宽度是编译期常量 8，会被编译成 SIMD 指令序列
+ */
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((always_inline))
+#endif
+inline void UnpackLanes(const uint8_t* packed, std::size_t positions, unsigned width, uint32_t* values) {
+    if (width == 0) {
+        std::fill(values, values + positions * kEcgBlockLanes, 0u);
+        return;
+    }
+    const uint64_t mask = (uint64_t{1} << width) - 1;
+    const std::size_t words = (positions * width + 31) / 32;
+    uint32_t lanes[kLaneWords];
+    std::memcpy(lanes, packed, words * kEcgBlockLanes * 4);
+    // 最后一个字之后补一行 0，跨字读取不用判断边界
+    std::fill(lanes + words * kEcgBlockLanes, lanes + (words + 1) * kEcgBlockLanes, 0u);
+    for (std::size_t p = 0; p < positions; ++p) {
+        const std::size_t bit = p * width;
+        const std::size_t word = bit / 32;
+        const unsigned shift = static_cast<unsigned>(bit % 32);
+        const uint32_t* low = lanes + word * kEcgBlockLanes;
+        const uint32_t* high = low + kEcgBlockLanes;
+        uint32_t* out = values + p * kEcgBlockLanes;
+        for (std::size_t l = 0; l < kEcgBlockLanes; ++l) {
+            const uint64_t pair = static_cast<uint64_t>(low[l]) | (static_cast<uint64_t>(high[l]) << 32);
+            out[l] = UnZigZag(static_cast<uint32_t>((pair >> shift) & mask));
+        }
+    }
+}
+
+// 残差还原成样本：一阶是一次前缀和，二阶是两次
+inline void Integrate(const uint32_t* residuals, std::size_t frames, EcgPredictor predictor, uint32_t first,
+                      int32_t* out) {
+    uint32_t x = first;
+    out[0] = static_cast<int32_t>(x);
+    if (predictor == EcgPredictor::Delta) {
+        for (std::size_t i = 1; i < frames; ++i) {
+            x += residuals[i];
+            out[i] = static_cast<int32_t>(x);
+        }
+    } else {
+        uint32_t delta = 0;
+        for (std::size_t i = 1; i < frames; ++i) {
+            delta += residuals[i];
+            x += delta;
+            out[i] = static_cast<int32_t>(x);
+        }
+    }
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((always_inline))
+#endif
+inline void DecodeLead(const uint8_t* packed, std::size_t frames, unsigned width, EcgPredictor predictor,
+                       uint32_t first, int32_t* out) {
+    uint32_t residuals[kEcgBlockFrames];
+    UnpackLanes(packed, Positions(frames), width, residuals);
+    Integrate(residuals, frames, predictor, first, out);
+}
+
+void DecodeLeadGeneric(const uint8_t* packed, std::size_t frames, unsigned width, EcgPredictor predictor,
+                       uint32_t first, int32_t* out) {
+    DecodeLead(packed, frames, width, predictor, first, out);
+}
+
+#if BLE_X86
+// 同一份代码按 AVX2 再编译一次，8 路正好一个 YMM 寄存器
+BLE_TARGET("avx2")
+void DecodeLeadAvx2(const uint8_t* packed, std::size_t frames, unsigned width, EcgPredictor predictor,
+                    uint32_t first, int32_t* out) {
+    DecodeLead(packed, frames, width, predictor, first, out);
+}
+#endif
+
+/**
+ * 参考实现：按帧序逐个残差从所在路的位流里取出
+ */
+void DecodeLeadScalar(const uint8_t* packed, std::size_t frames, unsigned width, EcgPredictor predictor,
+                      uint32_t first, int32_t* out) {
+    uint32_t residuals[kEcgBlockFrames];
+    if (width == 0) {
+        // 没有打包数据，packed 之后可能就是缓冲区末尾
+        std::fill(residuals, residuals + frames, 0u);
+        Integrate(residuals, frames, predictor, first, out);
+        return;
+    }
+    const std::size_t words = (Positions(frames) * width + 31) / 32;
+    for (std::size_t i = 0; i < frames; ++i) {
+        const std::size_t lane = i % kEcgBlockLanes;
+        const std::size_t bit = i / kEcgBlockLanes * width;
+        uint64_t pair = LoadWord(packed + ((bit / 32) * kEcgBlockLanes + lane) * 4);
+        if (bit / 32 + 1 < words) {
+            pair |= static_cast<uint64_t>(LoadWord(packed + ((bit / 32 + 1) * kEcgBlockLanes + lane) * 4)) << 32;
+        }
+        const uint64_t mask = (uint64_t{1} << width) - 1;
+        residuals[i] = UnZigZag(static_cast<uint32_t>((pair >> (bit % 32)) & mask));
+    }
+    Integrate(residuals, frames, predictor, first, out);
+}
+
+}  // namespace
+
+const char* EcgPredictorName(EcgPredictor predictor) {
+    switch (predictor) {
+        case EcgPredictor::Delta:
+            return "delta";
+        case EcgPredictor::SecondOrder:
+            return "second_order";
+    }
+    return "unknown";
+}
+
+std::size_t EncodeEcgBlock(const int32_t* const* in, std::size_t leads, std::size_t frames, uint8_t* out) {
+    if (leads == 0 || leads > kMaxEcgLeads || frames == 0 || frames > kEcgBlockFrames) {
+        return 0;
+    }
+    out[0] = static_cast<uint8_t>(frames);
+    out[1] = static_cast<uint8_t>(frames >> 8);
+    out[2] = static_cast<uint8_t>(leads);
+    out[3] = kBlockVersion;
+    uint8_t* lead_header = out + kBlockHeaderBytes;
+    uint8_t* packed = lead_header + leads * kLeadHeaderBytes;
+
+    const std::size_t positions = Positions(frames);
+    uint32_t delta[kEcgBlockFrames];
+    uint32_t second[kEcgBlockFrames];
+    for (std::size_t lead = 0; lead < leads; ++lead) {
+        // 两种预测器都试一遍，取位宽小的；相同时用一阶，解码少一次前缀和
+        Residuals(in[lead], frames, EcgPredictor::Delta, delta);
+        Residuals(in[lead], frames, EcgPredictor::SecondOrder, second);
+        uint32_t delta_bits = 0;
+        uint32_t second_bits = 0;
+        for (std::size_t i = 0; i < frames; ++i) {
+            delta_bits |= delta[i];
+            second_bits |= second[i];
+        }
+        const bool use_second = BitWidth(second_bits) < BitWidth(delta_bits);
+        const EcgPredictor predictor = use_second ? EcgPredictor::SecondOrder : EcgPredictor::Delta;
+        const unsigned width = BitWidth(use_second ? second_bits : delta_bits);
+        const uint32_t* values = use_second ? second : delta;
+
+        lead_header[0] = static_cast<uint8_t>((static_cast<unsigned>(predictor) << 6) | width);
+        StoreWord(lead_header + 1, static_cast<uint32_t>(in[lead][0]));
+        lead_header += kLeadHeaderBytes;
+
+        const std::size_t words = (positions * width + 31) / 32;
+        uint32_t lanes[kLaneWords] = {};
+        for (std::size_t p = 0; p < positions && width > 0; ++p) {
+            const std::size_t bit = p * width;
+            const std::size_t word = bit / 32;
+            const unsigned shift = static_cast<unsigned>(bit % 32);
+            for (std::size_t l = 0; l < kEcgBlockLanes; ++l) {
+                const uint64_t value = static_cast<uint64_t>(values[p * kEcgBlockLanes + l]) << shift;
+                lanes[word * kEcgBlockLanes + l] |= static_cast<uint32_t>(value);
+                lanes[(word + 1) * kEcgBlockLanes + l] |= static_cast<uint32_t>(value >> 32);
+            }
+        }
+        for (std::size_t i = 0; i < words * kEcgBlockLanes; ++i) {
+            StoreWord(packed + i * 4, lanes[i]);
+        }
+        packed += words * kEcgBlockLanes * 4;
+    }
+    return static_cast<std::size_t>(packed - out);
+}
+
+bool PeekEcgBlock(const uint8_t* data, std::size_t length, std::size_t& frames, std::size_t& leads) {
+    if (length < kBlockHeaderBytes || data[3] != kBlockVersion) {
+        return false;
+    }
+    frames = static_cast<std::size_t>(data[0] | (data[1] << 8));
+    leads = data[2];
+    return frames > 0 && frames <= kEcgBlockFrames && leads > 0 && leads <= kMaxEcgLeads;
+}
+
+std::size_t DecodeEcgBlock(const uint8_t* data, std::size_t length, int32_t* const* out, std::size_t leads,
+                           UnpackPath path) {
+    std::size_t frames = 0;
+    std::size_t block_leads = 0;
+    if (!PeekEcgBlock(data, length, frames, block_leads) || block_leads != leads ||
+        length < kBlockHeaderBytes + leads * kLeadHeaderBytes) {
+        return 0;
+    }
+    auto decode = DecodeLeadGeneric;
+    if (path == UnpackPath::Scalar) {
+        decode = DecodeLeadScalar;
+    }
+#if BLE_X86
+    static const bool avx2 = CpuHasAvx2();
+    if (avx2 && (path == UnpackPath::Auto || path == UnpackPath::Avx2)) {
+        decode = DecodeLeadAvx2;
+    }
+#endif
+
+    const uint8_t* lead_header = data + kBlockHeaderBytes;
+    const uint8_t* packed = lead_header + leads * kLeadHeaderBytes;
+    const uint8_t* end = data + length;
+    for (std::size_t lead = 0; lead < leads; ++lead, lead_header += kLeadHeaderBytes) {
+        const unsigned width = lead_header[0] & 0x3F;
+        const unsigned predictor = lead_header[0] >> 6;
+        const std::size_t bytes = PackedBytes(frames, width);
+        if (width > 32 || predictor > static_cast<unsigned>(EcgPredictor::SecondOrder) ||
+            static_cast<std::size_t>(end - packed) < bytes) {
+            return 0;
+        }
+        decode(packed, frames, width, static_cast<EcgPredictor>(predictor), LoadWord(lead_header + 1), out[lead]);
+        packed += bytes;
+    }
+    return frames;
+}
+
+EcgBlockEncoder::EcgBlockEncoder(std::size_t leads)
+    : leads_(std::min(leads, kMaxEcgLeads)),
+      pending_samples_(leads_, std::vector<int32_t>(kEcgBlockFrames)),
+      encoded_(EcgBlockMaxBytes(leads_)) {}
+
+std::size_t EcgBlockEncoder::Buffer(const int32_t* const* in, std::size_t offset, std::size_t frames) {
+    const std::size_t n = std::min(frames, kEcgBlockFrames - pending_);
+    for (std::size_t lead = 0; lead < leads_; ++lead) {
+        std::memcpy(pending_samples_[lead].data() + pending_, in[lead] + offset, n * sizeof(int32_t));
+    }
+    pending_ += n;
+    return n;
+}
+
+std::size_t EcgBlockEncoder::Encode() {
+    const int32_t* in[kMaxEcgLeads];
+    for (std::size_t lead = 0; lead < leads_; ++lead) {
+        in[lead] = pending_samples_[lead].data();
+    }
+    const std::size_t bytes = EncodeEcgBlock(in, leads_, pending_, encoded_.data());
+    frames_ += pending_;
+    encoded_bytes_ += bytes;
+    ++blocks_;
+    pending_ = 0;
+    return bytes;
+}
+
+}  // namespace ble
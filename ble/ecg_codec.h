@@ -0,0 +1,125 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ble/ecg_decoder.h"
+
+namespace ble {
+
+/*
+ * ECG 样本块的无损压缩格式（小端序）
+ *
+ *   uint16 frames            本块的帧数，1 ~ kEcgBlockFrames
+ *   uint8  leads
+ *   uint8  version           目前为 0
+ *   { uint8 descriptor, int32 first } 每个导联一组，descriptor 高 2 位是预测器，低 6 位是位宽（0~32）
+ *   各导联的打包数据，依次排列
+ *
+ * 每个导联先用预测器求残差（一阶差分或二阶预测，第一帧残差为 0，首个样本单独存放），
+ * zigzag 后按本块、本导联残差的最大位宽打包。打包是 8 路交织的：第 j 个残差属于第 j % 8 路，
+ * 每一路是独立的位流，按 32 位字存放，8 路的第 k 个字相邻。这样解码时 8 路的移位量完全相同，
+ * 一次处理 8 个残差，正好是一个 AVX2 寄存器。
+ * 所有运算都按 32 位无符号整数回绕，任何 int32 输入都能原样还原。
+ */
+
+// 每块最多的帧数
+constexpr std::size_t kEcgBlockFrames = 256;
+
+// 打包的路数
+constexpr std::size_t kEcgBlockLanes = 8;
+
+enum class EcgPredictor : uint8_t {
+    Delta = 0,        // x[i] - x[i-1]
+    SecondOrder = 1,  // x[i] - (2 * x[i-1] - x[i-2])
+};
+
+const char* EcgPredictorName(EcgPredictor predictor);
+
+// frames 帧、每个导联位宽都是 32 时的块大小，编码结果不会超过它
+constexpr std::size_t EcgBlockMaxBytes(std::size_t leads, std::size_t frames = kEcgBlockFrames) {
+    return 4 + leads * (5 + (frames + kEcgBlockLanes - 1) / kEcgBlockLanes * kEcgBlockLanes * 4);
+}
+
+/**
+ * 编码一块
+ * @param in 各导联样本的起始位置
+ * @param leads 不超过 kMaxEcgLeads
+ * @param frames 1 ~ kEcgBlockFrames
+ * @param out 至少 EcgBlockMaxBytes(leads, frames) 字节
+ * @return 编码后的字节数，参数不合法时返回 0
+ */
+std::size_t EncodeEcgBlock(const int32_t* const* in, std::size_t leads, std::size_t frames, uint8_t* out);
+
+/**
+ * 读出块头里的帧数和导联数
+ * @return 块头不完整或不合法时返回 false
+ */
+bool PeekEcgBlock(const uint8_t* data, std::size_t length, std::size_t& frames, std::size_t& leads);
+
+/**
+ * 解码一块
+ * @param data
+ * @param length
+ * @param out 各导联输出的起始位置，每个至少 kEcgBlockFrames 个元素，导联数必须与块头一致
+ * @param leads
+ * @param path Scalar 是逐个残差解包的参考实现；Ssse3 是不指定指令集编译的 8 路实现
+ *             （x86-64 上编译器用 SSE2）；Avx2 是同一份代码按 AVX2 编译
+ * @return 解码的帧数，数据不完整或不合法时返回 0
+ */
+std::size_t DecodeEcgBlock(const uint8_t* data, std::size_t length, int32_t* const* out, std::size_t leads,
+                           UnpackPath path = UnpackPath::Auto);
+
+/**
+ * 流式编码：样本按任意帧数追加，每凑满 kEcgBlockFrames 帧编码成一块交给回调，
+ * 用于把录制的会话按块压缩存储。一个编码器只应在一个线程上使用。
+ */
+class EcgBlockEncoder {
+public:
+    explicit EcgBlockEncoder(std::size_t leads);
+
+    /**
+     * 追加 frames 帧，每编码出一块调用一次 on_block(const uint8_t* data, std::size_t length)
+     * @param in 各导联样本的起始位置
+     * @param frames
+     * @param on_block
+     */
+    template <typename Fn>
+    void Append(const int32_t* const* in, std::size_t frames, Fn&& on_block) {
+        std::size_t done = 0;
+        while (done < frames) {
+            done += Buffer(in, done, frames - done);
+            if (pending_ == kEcgBlockFrames) {
+                on_block(encoded_.data(), Encode());
+            }
+        }
+    }
+
+    // 把不满一块的剩余帧编码出来（会话结束时调用）
+    template <typename Fn>
+    void Flush(Fn&& on_block) {
+        if (pending_ > 0) {
+            on_block(encoded_.data(), Encode());
+        }
+    }
+
+    std::size_t Leads() const { return leads_; }
+    uint64_t Frames() const { return frames_; }            // 已编码的帧数
+    uint64_t EncodedBytes() const { return encoded_bytes_; }
+    uint64_t Blocks() const { return blocks_; }
+
+private:
+    std::size_t Buffer(const int32_t* const* in, std::size_t offset, std::size_t frames);
+    std::size_t Encode();
+
+    std::size_t leads_;
+    std::vector<std::vector<int32_t>> pending_samples_;   // 各导联还没编码的帧
+    std::size_t pending_ = 0;
+    std::vector<uint8_t> encoded_;
+    uint64_t frames_ = 0;
+    uint64_t encoded_bytes_ = 0;
+    uint64_t blocks_ = 0;
+};
+
+}  // namespace ble
@@ -0,0 +1,302 @@
+﻿#include "ble/ecg_decoder.h"
+
+#include <algorithm>
+#include <array>
+
+#include "ble/cpu_features.h"
+
+#if BLE_X86
+#include <immintrin.h>
+#endif
+
+namespace ble {
+
+namespace {
+
+constexpr std::size_t kSimdMinSamples = 16;
+
+bool IsBigEndian(SampleEncoding encoding) {
+    return encoding == SampleEncoding::Int16BE || encoding == SampleEncoding::Int24BE;
+}
+
+void UnpackScalar(const uint8_t* src, std::size_t count, SampleEncoding encoding, int32_t* dst) {
+    switch (encoding) {
+        case SampleEncoding::Int16LE:
+            for (std::size_t i = 0; i < count; ++i, src += 2) {
+                dst[i] = static_cast<int16_t>(src[0] | (src[1] << 8));
+            }
+            break;
+        case SampleEncoding::Int16BE:
+            for (std::size_t i = 0; i < count; ++i, src += 2) {
+                dst[i] = static_cast<int16_t>((src[0] << 8) | src[1]);
+            }
+            break;
+        case SampleEncoding::Int24LE:
+            // 放到高 24 位再算术右移完成符号扩展
+            for (std::size_t i = 0; i < count; ++i, src += 3) {
+                uint32_t value = (static_cast<uint32_t>(src[0]) << 8) | (static_cast<uint32_t>(src[1]) << 16) |
+                                 (static_cast<uint32_t>(src[2]) << 24);
+                dst[i] = static_cast<int32_t>(value) >> 8;
+            }
+            break;
+        case SampleEncoding::Int24BE:
+            for (std::size_t i = 0; i < count; ++i, src += 3) {
+                uint32_t value = (static_cast<uint32_t>(src[2]) << 8) | (static_cast<uint32_t>(src[1]) << 16) |
+                                 (static_cast<uint32_t>(src[0]) << 24);
+                dst[i] = static_cast<int32_t>(value) >> 8;
+            }
+            break;
+    }
+}
+
+#if BLE_X86
+/**
+ * pshufb 掩码：把每个 24 位样本的字节按从低到高的顺序放进 int32 的高位字节，
+ * 低位字节清零，之后算术右移即可得到符号扩展后的值。字节序只影响掩码。
+ */
+struct UnpackMasks {
+    std::array<std::array<int8_t, 16>, 2> int24;                 // [大端]，前 12 字节 -> 4 个样本
+    std::array<int8_t, 16> swap16;                               // 16 位大端转小端
+};
+
+constexpr UnpackMasks MakeUnpackMasks() {
+    UnpackMasks m{};
+    for (int big = 0; big < 2; ++big) {
+        for (int j = 0; j < 4; ++j) {
+            m.int24[big][4 * j + 0] = -128;
+            m.int24[big][4 * j + 1] = static_cast<int8_t>(big ? 3 * j + 2 : 3 * j);
+            m.int24[big][4 * j + 2] = static_cast<int8_t>(3 * j + 1);
+            m.int24[big][4 * j + 3] = static_cast<int8_t>(big ? 3 * j : 3 * j + 2);
+        }
+    }
+    for (int j = 0; j < 16; ++j) {
+        m.swap16[j] = static_cast<int8_t>(j ^ 1);
+    }
+    return m;
+}
+
+constexpr UnpackMasks kUnpackMasks = MakeUnpackMasks();
+
+inline __m128i LoadMask(const std::array<int8_t, 16>& mask) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask.data()));
+}
+
+/**
+ * 只处理 24 位样本。16 位样本的标量循环会被编译器自动向量化，
+ * 实测比 pshufb 两次加移位的版本还快，SSSE3 路径对 16 位样本直接用标量实现
+ */
+BLE_TARGET("ssse3")
+void UnpackSsse3(const uint8_t* src, std::size_t count, SampleEncoding encoding, int32_t* dst) {
+    std::size_t i = 0;
+    if (SampleBytes(encoding) == 3) {
+        const __m128i mask = LoadMask(kUnpackMasks.int24[IsBigEndian(encoding) ? 1 : 0]);
+        // 每次用 12 字节 -> 4 个样本，但要读 16 字节，所以末尾留出 4 字节余量
+        for (; i * 3 + 16 <= count * 3; i += 4) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_srai_epi32(_mm_shuffle_epi8(bytes, mask), 8));
+        }
+    }
+    UnpackScalar(src + i * SampleBytes(encoding), count - i, encoding, dst + i);
+}
+
+BLE_TARGET("avx2")
+void UnpackAvx2(const uint8_t* src, std::size_t count, SampleEncoding encoding, int32_t* dst) {
+    const int big = IsBigEndian(encoding) ? 1 : 0;
+    std::size_t i = 0;
+    if (SampleBytes(encoding) == 2) {
+        const __m128i swap = LoadMask(kUnpackMasks.swap16);
+        // 每次 32 字节 -> 16 个样本，vpmovsxwd 直接完成符号扩展
+        for (; i + 16 <= count; i += 16) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2 + 16));
+            if (big) {
+                a = _mm_shuffle_epi8(a, swap);
+                b = _mm_shuffle_epi8(b, swap);
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_cvtepi16_epi32(a));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 8), _mm256_cvtepi16_epi32(b));
+        }
+    } else if (count * 3 >= 28) {
+        const __m128i mask128 = LoadMask(kUnpackMasks.int24[big]);
+        const __m256i mask = _mm256_inserti128_si256(_mm256_castsi128_si256(mask128), mask128, 1);
+        // 每次 24 字节 -> 8 个样本：两个 128 位通道分别从偏移 0 和 12 读取，最多读到偏移 28
+        for (; i * 3 + 28 <= count * 3; i += 8) {
+            const uint8_t* p = src + i * 3;
+            __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 12));
+            __m256i bytes = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                                _mm256_srai_epi32(_mm256_shuffle_epi8(bytes, mask), 8));
+        }
+    }
+    // 尾部不超过 15 个样本，直接用标量；不调用非 VEX 编码的 SSSE3 版本，避免 AVX/SSE 切换的开销
+    _mm256_zeroupper();
+    UnpackScalar(src + i * SampleBytes(encoding), count - i, encoding, dst + i);
+}
+#endif
+
+UnpackPath ResolvePath(UnpackPath path) {
+    static const UnpackPath best = UnpackPathSupported(UnpackPath::Avx2)    ? UnpackPath::Avx2
+                                 : UnpackPathSupported(UnpackPath::Ssse3) ? UnpackPath::Ssse3
+                                 : UnpackPath::Scalar;
+    if (path == UnpackPath::Auto) {
+        return best;
+    }
+    return UnpackPathSupported(path) ? path : UnpackPath::Scalar;
+}
+
+/**
+ * 把交织的帧分发到各导联，导联数是编译期常量时内层循环会被完全展开
+ */
+template <std::size_t Leads>
+void ScatterFixed(const int32_t* frames, std::size_t count, int32_t* const* leads) {
+    for (std::size_t f = 0; f < count; ++f) {
+        for (std::size_t l = 0; l < Leads; ++l) {
+            leads[l][f] = frames[f * Leads + l];
+        }
+    }
+}
+
+void Scatter(const int32_t* frames, std::size_t count, std::size_t lead_count, int32_t* const* leads) {
+    switch (lead_count) {
+        case 2:
+            ScatterFixed<2>(frames, count, leads);
+            return;
+        case 3:
+            ScatterFixed<3>(frames, count, leads);
+            return;
+        case 4:
+            ScatterFixed<4>(frames, count, leads);
+            return;
+        case 8:
+            ScatterFixed<8>(frames, count, leads);
+            return;
+        default:
+            for (std::size_t f = 0; f < count; ++f) {
+                for (std::size_t l = 0; l < lead_count; ++l) {
+                    leads[l][f] = frames[f * lead_count + l];
+                }
+            }
+    }
+}
+
+}  // namespace
+
+const char* SampleEncodingName(SampleEncoding encoding) {
+    switch (encoding) {
+        case SampleEncoding::Int16LE:
+            return "int16le";
+        case SampleEncoding::Int16BE:
+            return "int16be";
+        case SampleEncoding::Int24LE:
+            return "int24le";
+        case SampleEncoding::Int24BE:
+            return "int24be";
+    }
+    return "unknown";
+}
+
+const char* UnpackPathName(UnpackPath path) {
+    switch (path) {
+        case UnpackPath::Auto:
+            return "auto";
+        case UnpackPath::Scalar:
+            return "scalar";
+        case UnpackPath::Ssse3:
+            return "ssse3";
+        case UnpackPath::Avx2:
+            return "avx2";
+    }
+    return "unknown";
+}
+
+bool UnpackPathSupported(UnpackPath path) {
+    switch (path) {
+        case UnpackPath::Auto:
+        case UnpackPath::Scalar:
+            return true;
+        case UnpackPath::Ssse3: {
+            static const bool supported = CpuHasSsse3();
+            return supported;
+        }
+        case UnpackPath::Avx2: {
+            static const bool supported = CpuHasAvx2();
+            return supported;
+        }
+    }
+    return false;
+}
+
+void UnpackSamples(const uint8_t* src, std::size_t count, SampleEncoding encoding, int32_t* dst, UnpackPath path) {
+    // 样本太少时 SIMD 主循环一次都跑不满，标量更快。
+    // ECG-7 的 20 字节载荷只有 9 个样本，实际设备的数据总是走这里
+    if (count < kSimdMinSamples) {
+        UnpackScalar(src, count, encoding, dst);
+        return;
+    }
+    switch (ResolvePath(path)) {
+#if BLE_X86
+        case UnpackPath::Avx2:
+            UnpackAvx2(src, count, encoding, dst);
+            return;
+        case UnpackPath::Ssse3:
+            UnpackSsse3(src, count, encoding, dst);
+            return;
+#endif
+        default:
+            UnpackScalar(src, count, encoding, dst);
+            return;
+    }
+}
+
+EcgLeadBuffer::EcgLeadBuffer(std::size_t leads, std::size_t capacity)
+    : leads_(leads), capacity_(capacity), stride_((capacity + 15) & ~static_cast<std::size_t>(15)),
+      data_(leads * stride_) {}
+
+EcgDecoder::EcgDecoder(EcgFormat format, UnpackPath path) : format_(format), path_(ResolvePath(path)) {
+    // 一个通知最多 244 字节，按 1 字节样本估算也足够
+    scratch_.resize(256);
+}
+
+std::size_t EcgDecoder::Decode(const uint8_t* payload, std::size_t length, EcgLeadBuffer& out) {
+    if (length < format_.header_bytes || format_.leads == 0 || format_.leads > kMaxEcgLeads ||
+        out.Leads() != format_.leads) {
+        ++malformed_;
+        return 0;
+    }
+    const std::size_t frame_bytes = format_.FrameBytes();
+    const std::size_t body = length - format_.header_bytes;
+    std::size_t frames = body / frame_bytes;
+    if (body % frame_bytes != 0) {
+        ++malformed_;
+    }
+    if (frames > out.Available()) {
+        overflow_ += frames - out.Available();
+        frames = out.Available();
+    }
+    if (frames == 0) {
+        return 0;
+    }
+
+    const uint8_t* body_start = payload + format_.header_bytes;
+    if (format_.leads == 1) {
+        // 单导联不需要分发，直接展开到输出
+        UnpackSamples(body_start, frames, format_.encoding, out.Lead(0) + out.Size(), path_);
+    } else {
+        const std::size_t samples = frames * format_.leads;
+        if (scratch_.size() < samples) {
+            scratch_.resize(samples);
+        }
+        UnpackSamples(body_start, samples, format_.encoding, scratch_.data(), path_);
+        int32_t* leads[kMaxEcgLeads];
+        for (std::size_t l = 0; l < format_.leads; ++l) {
+            leads[l] = out.Lead(l) + out.Size();
+        }
+        Scatter(scratch_.data(), frames, format_.leads, leads);
+    }
+    out.Grow(frames);
+    frames_ += frames;
+    return frames;
+}
+
+}  // namespace ble
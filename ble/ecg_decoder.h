@@ -0,0 +1,139 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ble/guid.h"
+
+namespace ble {
+
+// 样本的存储格式：有符号整数，紧密排列，没有填充位
+enum class SampleEncoding {
+    Int16LE,
+    Int16BE,
+    Int24LE,
+    Int24BE,
+};
+
+constexpr std::size_t SampleBytes(SampleEncoding encoding) {
+    return encoding == SampleEncoding::Int16LE || encoding == SampleEncoding::Int16BE ? 2 : 3;
+}
+
+const char* SampleEncodingName(SampleEncoding encoding);
+
+// 解码器支持的最多导联数（标准 12 导联再留些余量）
+constexpr std::size_t kMaxEcgLeads = 16;
+
+/**
+ * 通知载荷的布局：header_bytes 字节的包头（ECG-7 是小端序包序号），
+ * 之后是按帧交织的样本，每帧依次是各导联的一个样本
+ */
+struct EcgFormat {
+    std::size_t leads = 3;
+    SampleEncoding encoding = SampleEncoding::Int16LE;
+    std::size_t header_bytes = 2;
+
+    constexpr std::size_t FrameBytes() const { return leads * SampleBytes(encoding); }
+};
+
+// ECG-7 的默认布局：2 字节序号 + 3 导联 16 位小端样本（20 字节载荷正好 3 帧）
+constexpr EcgFormat kEcg7Format{};
+
+// ECG-7 的数据特性 FFF1
+constexpr Guid kEcg7DataUuid{0x0000FFF1, 0x0000, 0x1000, {0x80, 0x00, 0x00, 0x80, 0x5F, 0x9B, 0x34, 0xFB}};
+
+enum class UnpackPath {
+    Auto,     // 当前 CPU 支持的最快实现
+    Scalar,
+    Ssse3,
+    Avx2,
+};
+
+const char* UnpackPathName(UnpackPath path);
+
+// 当前 CPU 能否使用该实现（Auto 和 Scalar 总是可以）
+bool UnpackPathSupported(UnpackPath path);
+
+/**
+ * 把 count 个紧密排列的样本展开成 int32（带符号扩展），顺序不变
+ * @param src 至少 count * SampleBytes(encoding) 字节
+ * @param count
+ * @param encoding
+ * @param dst 至少 count 个元素
+ * @param path 指定的实现不被支持时退回标量实现
+ */
+void UnpackSamples(const uint8_t* src, std::size_t count, SampleEncoding encoding, int32_t* dst,
+                   UnpackPath path = UnpackPath::Auto);
+
+/**
+ * 按导联分开存放的样本缓冲区（structure of arrays）
+ *
+ * 每个导联的样本在内存里连续，滤波、检测等逐导联处理的算法可以直接顺序读写。
+ * 所有导联的长度相同，缓冲区在构造时一次分配好。
+ */
+class EcgLeadBuffer {
+public:
+    /**
+     * @param leads
+     * @param capacity 每个导联最多存放的样本数
+     */
+    EcgLeadBuffer(std::size_t leads, std::size_t capacity);
+
+    std::size_t Leads() const { return leads_; }
+    std::size_t Size() const { return size_; }
+    std::size_t Capacity() const { return capacity_; }
+    std::size_t Available() const { return capacity_ - size_; }
+
+    int32_t* Lead(std::size_t lead) { return data_.data() + lead * stride_; }
+    const int32_t* Lead(std::size_t lead) const { return data_.data() + lead * stride_; }
+
+    // 解码器写完 frames 帧后调用
+    void Grow(std::size_t frames) { size_ += frames; }
+
+    void Clear() { size_ = 0; }
+
+private:
+    std::size_t leads_;
+    std::size_t capacity_;
+    std::size_t stride_;   // 导联之间的间隔，取整到 64 字节，每个导联从新的缓存行开始
+    std::size_t size_ = 0;
+    std::vector<int32_t> data_;
+};
+
+/**
+ * ECG 通知载荷的流式解码器
+ *
+ * 每个载荷先整体展开成 int32（SIMD 路径在这里），再按导联分发到 EcgLeadBuffer。
+ * 一个解码器只应在一个线程上使用。
+ */
+class EcgDecoder {
+public:
+    explicit EcgDecoder(EcgFormat format = kEcg7Format, UnpackPath path = UnpackPath::Auto);
+
+    /**
+     * 解码一个载荷，帧追加到 out 末尾；out 放不下时只解码放得下的帧
+     * @param payload
+     * @param length
+     * @param out 导联数必须与格式一致，且不超过 kMaxEcgLeads
+     * @return 解码的帧数
+     */
+    std::size_t Decode(const uint8_t* payload, std::size_t length, EcgLeadBuffer& out);
+
+    const EcgFormat& Format() const { return format_; }
+    uint64_t Frames() const { return frames_; }
+
+    // 长度不是整帧的载荷数（多余字节被忽略）和因 out 已满被丢弃的帧数
+    uint64_t Malformed() const { return malformed_; }
+    uint64_t Overflow() const { return overflow_; }
+
+private:
+    EcgFormat format_;
+    UnpackPath path_;
+    std::vector<int32_t> scratch_;
+    uint64_t frames_ = 0;
+    uint64_t malformed_ = 0;
+    uint64_t overflow_ = 0;
+};
+
+}  // namespace ble
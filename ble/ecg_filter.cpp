@@ -0,0 +1,169 @@
+﻿#include "ble/ecg_filter.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "ble/cpu_features.h"
+
+namespace ble {
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+// 每组处理的导联数，正好一个 AVX2 寄存器
+constexpr std::size_t kLaneMultiple = 8;
+
+struct Rbj {
+    double cos_w0;
+    double alpha;
+};
+
+Rbj Prepare(double sample_rate_hz, double frequency_hz, double q) {
+    double w0 = 2.0 * kPi * frequency_hz / sample_rate_hz;
+    return {std::cos(w0), std::sin(w0) / (2.0 * q)};
+}
+
+BiquadCoefficients Normalize(double b0, double b1, double b2, double a0, double a1, double a2) {
+    return {b0 / a0, b1 / a0, b2 / a0, a1 / a0, a2 / a0};
+}
+
+/**
+ * 处理一组 8 个导联：状态先读到局部数组，逐帧通过各节后再写回。
+ * 局部数组与输入输出不会别名，宽度又是编译期常量 8，
+ * 每一节的运算会被编译成一条 8 路（或两条 4 路）SIMD 指令序列。
+ */
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((always_inline))
+#endif
+inline void FilterGroup(const int32_t* const* in, float* const* out, std::size_t frames, std::size_t leads,
+                        std::size_t sections, const float* coefficients, float* state) {
+    float z1[kMaxBiquadSections][kLaneMultiple];
+    float z2[kMaxBiquadSections][kLaneMultiple];
+    for (std::size_t s = 0; s < sections; ++s) {
+        for (std::size_t l = 0; l < kLaneMultiple; ++l) {
+            z1[s][l] = state[(s * 2 + 0) * kLaneMultiple + l];
+            z2[s][l] = state[(s * 2 + 1) * kLaneMultiple + l];
+        }
+    }
+    for (std::size_t f = 0; f < frames; ++f) {
+        float x[kLaneMultiple] = {};
+        for (std::size_t l = 0; l < leads; ++l) {
+            x[l] = static_cast<float>(in[l][f]);
+        }
+        for (std::size_t s = 0; s < sections; ++s) {
+            const float b0 = coefficients[s * 5 + 0];
+            const float b1 = coefficients[s * 5 + 1];
+            const float b2 = coefficients[s * 5 + 2];
+            const float a1 = coefficients[s * 5 + 3];
+            const float a2 = coefficients[s * 5 + 4];
+            for (std::size_t l = 0; l < kLaneMultiple; ++l) {
+                float y = b0 * x[l] + z1[s][l];
+                z1[s][l] = b1 * x[l] - a1 * y + z2[s][l];
+                z2[s][l] = b2 * x[l] - a2 * y;
+                x[l] = y;
+            }
+        }
+        for (std::size_t l = 0; l < leads; ++l) {
+            out[l][f] = x[l];
+        }
+    }
+    for (std::size_t s = 0; s < sections; ++s) {
+        for (std::size_t l = 0; l < kLaneMultiple; ++l) {
+            state[(s * 2 + 0) * kLaneMultiple + l] = z1[s][l];
+            state[(s * 2 + 1) * kLaneMultiple + l] = z2[s][l];
+        }
+    }
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((always_inline))
+#endif
+inline void FilterFrames(const int32_t* const* in, float* const* out, std::size_t frames, std::size_t leads,
+                         std::size_t sections, const float* coefficients, float* state) {
+    // 导联按 8 个一组，各组之间没有依赖
+    for (std::size_t first = 0; first < leads; first += kLaneMultiple) {
+        FilterGroup(in + first, out + first, frames, std::min(kLaneMultiple, leads - first), sections,
+                    coefficients, state + first / kLaneMultiple * sections * 2 * kLaneMultiple);
+    }
+}
+
+void FilterFramesGeneric(const int32_t* const* in, float* const* out, std::size_t frames, std::size_t leads,
+                         std::size_t sections, const float* coefficients, float* state) {
+    FilterFrames(in, out, frames, leads, sections, coefficients, state);
+}
+
+#if BLE_X86
+// 同一份代码按 AVX2 再编译一次，8 个导联正好一个 YMM 寄存器
+BLE_TARGET("avx2")
+void FilterFramesAvx2(const int32_t* const* in, float* const* out, std::size_t frames, std::size_t leads,
+                      std::size_t sections, const float* coefficients, float* state) {
+    FilterFrames(in, out, frames, leads, sections, coefficients, state);
+}
+#endif
+
+}  // namespace
+
+BiquadCoefficients DesignHighPass(double sample_rate_hz, double cutoff_hz, double q) {
+    Rbj p = Prepare(sample_rate_hz, cutoff_hz, q);
+    return Normalize((1.0 + p.cos_w0) / 2.0, -(1.0 + p.cos_w0), (1.0 + p.cos_w0) / 2.0,
+                     1.0 + p.alpha, -2.0 * p.cos_w0, 1.0 - p.alpha);
+}
+
+BiquadCoefficients DesignLowPass(double sample_rate_hz, double cutoff_hz, double q) {
+    Rbj p = Prepare(sample_rate_hz, cutoff_hz, q);
+    return Normalize((1.0 - p.cos_w0) / 2.0, 1.0 - p.cos_w0, (1.0 - p.cos_w0) / 2.0,
+                     1.0 + p.alpha, -2.0 * p.cos_w0, 1.0 - p.alpha);
+}
+
+BiquadCoefficients DesignNotch(double sample_rate_hz, double center_hz, double q) {
+    Rbj p = Prepare(sample_rate_hz, center_hz, q);
+    return Normalize(1.0, -2.0 * p.cos_w0, 1.0, 1.0 + p.alpha, -2.0 * p.cos_w0, 1.0 - p.alpha);
+}
+
+std::vector<BiquadCoefficients> EcgFilterConfig::Sections() const {
+    std::vector<BiquadCoefficients> sections;
+    const double nyquist = sample_rate_hz / 2.0;
+    if (highpass_hz > 0.0) {
+        sections.push_back(DesignHighPass(sample_rate_hz, highpass_hz));
+    }
+    // 采样率太低时工频已经在奈奎斯特频率以上，陷波没有意义
+    if (notch_hz > 0.0 && notch_hz < nyquist) {
+        sections.push_back(DesignNotch(sample_rate_hz, notch_hz, notch_q));
+    }
+    if (lowpass_hz > 0.0 && lowpass_hz < nyquist) {
+        sections.push_back(DesignLowPass(sample_rate_hz, lowpass_hz));
+    }
+    return sections;
+}
+
+EcgFilter::EcgFilter(std::size_t leads, std::vector<BiquadCoefficients> sections)
+    : leads_(leads),
+      sections_(std::min(sections.size(), kMaxBiquadSections)),
+      coefficients_(sections_ * 5),
+      state_((leads + kLaneMultiple - 1) / kLaneMultiple * sections_ * 2 * kLaneMultiple, 0.0f) {
+    for (std::size_t s = 0; s < sections_; ++s) {
+        coefficients_[s * 5 + 0] = static_cast<float>(sections[s].b0);
+        coefficients_[s * 5 + 1] = static_cast<float>(sections[s].b1);
+        coefficients_[s * 5 + 2] = static_cast<float>(sections[s].b2);
+        coefficients_[s * 5 + 3] = static_cast<float>(sections[s].a1);
+        coefficients_[s * 5 + 4] = static_cast<float>(sections[s].a2);
+    }
+}
+
+void EcgFilter::Process(const int32_t* const* in, float* const* out, std::size_t frames) {
+#if BLE_X86
+    static const bool avx2 = CpuHasAvx2();
+    if (avx2) {
+        FilterFramesAvx2(in, out, frames, leads_, sections_, coefficients_.data(), state_.data());
+        return;
+    }
+#endif
+    FilterFramesGeneric(in, out, frames, leads_, sections_, coefficients_.data(), state_.data());
+}
+
+void EcgFilter::Reset() {
+    std::fill(state_.begin(), state_.end(), 0.0f);
+}
+
+}  // namespace ble
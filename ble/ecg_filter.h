@@ -0,0 +1,79 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ble {
+
+/**
+ * 二阶节（biquad）系数，已按 a0 归一化：
+ * y[n] = b0 x[n] + b1 x[n-1] + b2 x[n-2] - a1 y[n-1] - a2 y[n-2]
+ */
+struct BiquadCoefficients {
+    double b0 = 1.0;
+    double b1 = 0.0;
+    double b2 = 0.0;
+    double a1 = 0.0;
+    double a2 = 0.0;
+};
+
+// RBJ Audio EQ Cookbook 的设计公式，q = 0.7071 时高通/低通为二阶 Butterworth
+BiquadCoefficients DesignHighPass(double sample_rate_hz, double cutoff_hz, double q = 0.70710678);
+BiquadCoefficients DesignLowPass(double sample_rate_hz, double cutoff_hz, double q = 0.70710678);
+BiquadCoefficients DesignNotch(double sample_rate_hz, double center_hz, double q);
+
+// 级联的最多节数，多出的节被忽略
+constexpr std::size_t kMaxBiquadSections = 8;
+
+/**
+ * 常用的心电滤波组合，截止频率为 0 的环节不启用
+ */
+struct EcgFilterConfig {
+    double sample_rate_hz = 250.0;
+    double highpass_hz = 0.5;    // 去基线漂移（诊断模式常用 0.05Hz，监护模式 0.5Hz）
+    double notch_hz = 50.0;      // 工频陷波，北美用 60Hz
+    double notch_q = 30.0;       // 越大陷波越窄
+    double lowpass_hz = 40.0;    // 去肌电和高频噪声
+
+    // 按 高通 -> 陷波 -> 低通 的顺序生成级联的二阶节
+    std::vector<BiquadCoefficients> Sections() const;
+};
+
+/**
+ * 多导联 biquad 级联滤波器
+ *
+ * 所有导联共用一组系数。导联按 8 个一组，同一时刻一组导联的样本放在一个 SIMD 寄存器里
+ * 一起通过各节，向量化的方向是跨导联而不是沿时间（IIR 沿时间有递推依赖）。
+ * 不足 8 个的组用 0 补齐。
+ * 状态在调用之间保留，一个通知解出的几帧可以直接接着上一个通知滤波；
+ * 采用转置直接 II 型，每个样本的输出只依赖当前和过去的输入，没有块延迟。
+ * 一个滤波器只应在一个线程上使用。
+ */
+class EcgFilter {
+public:
+    EcgFilter(std::size_t leads, std::vector<BiquadCoefficients> sections);
+    EcgFilter(std::size_t leads, const EcgFilterConfig& config) : EcgFilter(leads, config.Sections()) {}
+
+    /**
+     * 滤波 frames 帧
+     * @param in 各导联输入的起始位置（例如 EcgLeadBuffer::Lead(l) + offset）
+     * @param out 各导联输出的起始位置，可以与输入不同类型但不能重叠
+     * @param frames
+     */
+    void Process(const int32_t* const* in, float* const* out, std::size_t frames);
+
+    // 清空状态，重新连接或数据中断后调用
+    void Reset();
+
+    std::size_t Leads() const { return leads_; }
+    std::size_t Sections() const { return sections_; }
+
+private:
+    std::size_t leads_;
+    std::size_t sections_;
+    std::vector<float> coefficients_;   // [节][b0 b1 b2 a1 a2]
+    std::vector<float> state_;          // [导联组][节][z1/z2][8]
+};
+
+}  // namespace ble
@@ -0,0 +1,154 @@
+﻿#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "ble/guid.h"
+
+namespace ble {
+
+/*
+ * 不分配内存的 MAC 地址 / GUID 格式化与解析
+ *
+ * 结果写进栈上的定长 std::array，末尾带 '\0'，可以直接 .data() 输出，
+ * 在日志等热点路径里随便用。全部是 constexpr，编译期常量也能直接格式化。
+ */
+
+using MacString = std::array<char, 18>;   // "c0:ff:ee:00:00:07" + '\0'
+using GuidString = std::array<char, 37>;  // "0000FFF1-0000-1000-8000-00805F9B34FB" + '\0'
+
+namespace detail {
+
+constexpr char kHexLower[] = "0123456789abcdef";
+constexpr char kHexUpper[] = "0123456789ABCDEF";
+
+// 十六进制字符 -> 数值，非法字符返回 -1
+constexpr int HexValue(char c) {
+    return c >= '0' && c <= '9' ? c - '0'
+         : c >= 'a' && c <= 'f' ? c - 'a' + 10
+         : c >= 'A' && c <= 'F' ? c - 'A' + 10
+         : -1;
+}
+
+// 把 value 的低 digits 个半字节按大写写到 out[pos...]
+template <std::size_t N>
+constexpr void PutHexUpper(std::array<char, N>& out, std::size_t pos, uint32_t value, int digits) {
+    for (int i = digits - 1; i >= 0; --i) {
+        out[pos++] = kHexUpper[(value >> (i * 4)) & 0xF];
+    }
+}
+
+// 从 text[pos...] 读取 digits 个十六进制字符
+constexpr bool GetHex(std::string_view text, std::size_t pos, int digits, uint32_t& value) {
+    value = 0;
+    for (int i = 0; i < digits; ++i) {
+        int v = HexValue(text[pos + static_cast<std::size_t>(i)]);
+        if (v < 0) {
+            return false;
+        }
+        value = (value << 4) | static_cast<uint32_t>(v);
+    }
+    return true;
+}
+
+}  // namespace detail
+
+/**
+ * 格式化 MAC 地址（小写，冒号分隔），例如 c0:ff:ee:00:00:07
+ * @param address 48 位蓝牙地址
+ */
+constexpr MacString FormatBluetoothAddress(uint64_t address) {
+    MacString out{};
+    for (int i = 0; i < 6; ++i) {
+        uint32_t byte = static_cast<uint32_t>((address >> ((5 - i) * 8)) & 0xFF);
+        out[i * 3] = detail::kHexLower[byte >> 4];
+        out[i * 3 + 1] = detail::kHexLower[byte & 0xF];
+        out[i * 3 + 2] = i < 5 ? ':' : '\0';
+    }
+    return out;
+}
+
+/**
+ * 格式化 GUID 为标准的 8-4-4-4-12 大写字符串，每段都保留前导 0
+ * @param g
+ */
+constexpr GuidString GuidToString(const Guid& g) {
+    GuidString out{};
+    detail::PutHexUpper(out, 0, g.Data1, 8);
+    out[8] = '-';
+    detail::PutHexUpper(out, 9, g.Data2, 4);
+    out[13] = '-';
+    detail::PutHexUpper(out, 14, g.Data3, 4);
+    out[18] = '-';
+    detail::PutHexUpper(out, 19, g.Data4[0], 2);
+    detail::PutHexUpper(out, 21, g.Data4[1], 2);
+    out[23] = '-';
+    for (int i = 0; i < 6; ++i) {
+        detail::PutHexUpper(out, 24 + static_cast<std::size_t>(i) * 2, g.Data4[2 + i], 2);
+    }
+    out[36] = '\0';
+    return out;
+}
+
+/**
+ * 解析 "c0:ff:ee:00:00:07"（也接受 '-' 分隔和大写）
+ * @return 格式不对时返回 false
+ */
+constexpr bool ParseBluetoothAddress(std::string_view text, uint64_t& address) {
+    if (text.size() != 17) {
+        return false;
+    }
+    uint64_t result = 0;
+    for (std::size_t i = 0; i < 6; ++i) {
+        uint32_t byte = 0;
+        if (!detail::GetHex(text, i * 3, 2, byte)) {
+            return false;
+        }
+        if (i < 5 && text[i * 3 + 2] != ':' && text[i * 3 + 2] != '-') {
+            return false;
+        }
+        result = (result << 8) | byte;
+    }
+    address = result;
+    return true;
+}
+
+/**
+ * 解析 8-4-4-4-12 格式的 GUID，大小写均可，可以带花括号
+ * @return 格式不对时返回 false
+ */
+constexpr bool ParseGuid(std::string_view text, Guid& g) {
+    if (text.size() == 38 && text.front() == '{' && text.back() == '}') {
+        text = text.substr(1, 36);
+    }
+    if (text.size() != 36 || text[8] != '-' || text[13] != '-' || text[18] != '-' || text[23] != '-') {
+        return false;
+    }
+    Guid result{};
+    uint32_t value = 0;
+    if (!detail::GetHex(text, 0, 8, value)) {
+        return false;
+    }
+    result.Data1 = value;
+    if (!detail::GetHex(text, 9, 4, value)) {
+        return false;
+    }
+    result.Data2 = static_cast<uint16_t>(value);
+    if (!detail::GetHex(text, 14, 4, value)) {
+        return false;
+    }
+    result.Data3 = static_cast<uint16_t>(value);
+    constexpr std::size_t kData4Positions[8] = {19, 21, 24, 26, 28, 30, 32, 34};
+    for (std::size_t i = 0; i < 8; ++i) {
+        if (!detail::GetHex(text, kData4Positions[i], 2, value)) {
+            return false;
+        }
+        result.Data4[i] = static_cast<uint8_t>(value);
+    }
+    g = result;
+    return true;
+}
+
+}  // namespace ble
@@ -0,0 +1,277 @@
+﻿#include "ble/gatt_cache.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace ble {
+
+/*
+ * 缓存文件格式（小端序，每次更新整个文件写到 .tmp 后改名替换，写到一半断电也不会留下半个文件）
+ *
+ *   文件头 24 字节：magic "BLEGATT\1"、u16 版本、u16 文件头长度、u32 条目数、u64 校验和
+ *   每台设备一个条目：
+ *     u64 地址、u16 服务数、u16 特性数、u32 保留
+ *     服务：16 字节 UUID、u16 句柄
+ *     特性：16 字节 UUID、u16 句柄、u16 服务句柄、u32 属性，按所属服务的顺序排列
+ *
+ * 校验和是文件头之后全部字节的 FNV-1a，对不上时整个文件当作空缓存。
+ */
+
+namespace {
+
+constexpr char kMagic[8] = {'B', 'L', 'E', 'G', 'A', 'T', 'T', '\1'};
+constexpr uint16_t kVersion = 1;
+constexpr std::size_t kHeaderSize = 24;
+constexpr std::size_t kEntryHeaderSize = 16;
+constexpr std::size_t kServiceSize = 18;
+constexpr std::size_t kCharacteristicSize = 24;
+
+uint64_t Fnv1a(const uint8_t* data, std::size_t size) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (std::size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+void PutLe(std::vector<uint8_t>& out, uint64_t value, std::size_t bytes) {
+    for (std::size_t i = 0; i < bytes; ++i) {
+        out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+}
+
+uint64_t GetLe(const uint8_t* data, std::size_t bytes) {
+    uint64_t value = 0;
+    for (std::size_t i = 0; i < bytes; ++i) {
+        value |= static_cast<uint64_t>(data[i]) << (i * 8);
+    }
+    return value;
+}
+
+void PutGuid(std::vector<uint8_t>& out, const Guid& uuid) {
+    PutLe(out, uuid.Data1, 4);
+    PutLe(out, uuid.Data2, 2);
+    PutLe(out, uuid.Data3, 2);
+    out.insert(out.end(), uuid.Data4, uuid.Data4 + 8);
+}
+
+Guid GetGuid(const uint8_t* data) {
+    Guid uuid;
+    uuid.Data1 = static_cast<uint32_t>(GetLe(data, 4));
+    uuid.Data2 = static_cast<uint16_t>(GetLe(data + 4, 2));
+    uuid.Data3 = static_cast<uint16_t>(GetLe(data + 6, 2));
+    std::memcpy(uuid.Data4, data + 8, 8);
+    return uuid;
+}
+
+bool ReadFile(const std::string& path, std::vector<uint8_t>& data) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    uint8_t buffer[4096];
+    std::size_t n;
+    while ((n = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.insert(data.end(), buffer, buffer + n);
+    }
+    bool ok = std::ferror(file) == 0;
+    std::fclose(file);
+    return ok;
+}
+
+// 先写临时文件再改名替换，读者只会看到旧文件或完整的新文件
+bool ReplaceFile(const std::string& path, const std::vector<uint8_t>& data) {
+    const std::string temporary = path + ".tmp";
+    std::FILE* file = std::fopen(temporary.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    bool ok = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+    ok = std::fclose(file) == 0 && ok;
+    if (ok) {
+#ifdef _WIN32
+        ok = MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        ok = std::rename(temporary.c_str(), path.c_str()) == 0;
+#endif
+    }
+    if (!ok) {
+        std::remove(temporary.c_str());
+    }
+    return ok;
+}
+
+/**
+ * 解析文件头之后的条目
+ * @return 长度、计数或句柄有任何不一致时返回 false
+ */
+bool ParseEntries(const uint8_t* data, std::size_t size, uint32_t entries,
+                  std::unordered_map<uint64_t, std::vector<DiscoveredService>>& out) {
+    std::size_t offset = 0;
+    for (uint32_t e = 0; e < entries; ++e) {
+        if (size - offset < kEntryHeaderSize) {
+            return false;
+        }
+        const uint64_t address = GetLe(data + offset, 8);
+        const std::size_t service_count = GetLe(data + offset + 8, 2);
+        const std::size_t characteristic_count = GetLe(data + offset + 10, 2);
+        offset += kEntryHeaderSize;
+        if (size - offset < service_count * kServiceSize + characteristic_count * kCharacteristicSize) {
+            return false;
+        }
+        std::vector<DiscoveredService> services(service_count);
+        for (auto& service : services) {
+            service.service.uuid = GetGuid(data + offset);
+            service.service.handle = static_cast<uint16_t>(GetLe(data + offset + 16, 2));
+            service.status = GattStatus::Success;
+            offset += kServiceSize;
+        }
+        // 特性按服务顺序排列，逐个归到句柄相同的服务下
+        std::size_t current = 0;
+        for (std::size_t c = 0; c < characteristic_count; ++c) {
+            GattCharacteristicInfo info;
+            info.uuid = GetGuid(data + offset);
+            info.handle = static_cast<uint16_t>(GetLe(data + offset + 16, 2));
+            info.service_handle = static_cast<uint16_t>(GetLe(data + offset + 18, 2));
+            info.properties = static_cast<uint32_t>(GetLe(data + offset + 20, 4));
+            offset += kCharacteristicSize;
+            while (current < services.size() && services[current].service.handle != info.service_handle) {
+                ++current;
+            }
+            if (current == services.size()) {
+                return false;
+            }
+            services[current].characteristics.push_back(info);
+        }
+        out[address] = std::move(services);
+    }
+    return offset == size;
+}
+
+}  // namespace
+
+bool GattCache::Open(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_ = path;
+    entries_.clear();
+    std::vector<uint8_t> data;
+    if (!ReadFile(path, data) || data.size() < kHeaderSize || std::memcmp(data.data(), kMagic, 8) != 0 ||
+        GetLe(data.data() + 8, 2) != kVersion || GetLe(data.data() + 10, 2) != kHeaderSize) {
+        return false;
+    }
+    const auto entries = static_cast<uint32_t>(GetLe(data.data() + 12, 4));
+    const uint64_t checksum = GetLe(data.data() + 16, 8);
+    const uint8_t* body = data.data() + kHeaderSize;
+    const std::size_t body_size = data.size() - kHeaderSize;
+    if (Fnv1a(body, body_size) != checksum || !ParseEntries(body, body_size, entries, entries_)) {
+        entries_.clear();
+        return false;
+    }
+    stats_.entries = entries_.size();
+    return true;
+}
+
+bool GattCache::Lookup(uint64_t address, DiscoveryResult& layout) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(address);
+    if (it == entries_.end()) {
+        ++stats_.misses;
+        return false;
+    }
+    ++stats_.hits;
+    layout = DiscoveryResult();
+    layout.status = GattStatus::Success;
+    layout.services = it->second;
+    return true;
+}
+
+bool GattCache::Store(uint64_t address, const DiscoveryResult& discovery) {
+    if (discovery.status != GattStatus::Success || discovery.services.empty()) {
+        return false;
+    }
+    std::size_t characteristics = 0;
+    for (const auto& service : discovery.services) {
+        // 有服务的特性没查到时下次仍需完整发现，不缓存残缺的布局
+        if (service.status != GattStatus::Success) {
+            return false;
+        }
+        characteristics += service.characteristics.size();
+    }
+    if (discovery.services.size() > 0xFFFF || characteristics > 0xFFFF) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& services = entries_[address];
+    services = discovery.services;
+    for (auto& service : services) {
+        for (auto& characteristic : service.characteristics) {
+            characteristic.service_handle = service.service.handle;
+        }
+    }
+    stats_.entries = entries_.size();
+    return WriteLocked();
+}
+
+void GattCache::Invalidate(uint64_t address) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.erase(address) == 0) {
+        return;
+    }
+    ++stats_.invalidations;
+    stats_.entries = entries_.size();
+    WriteLocked();
+}
+
+GattCacheStats GattCache::Stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+bool GattCache::WriteLocked() {
+    if (path_.empty()) {
+        return true;
+    }
+    std::vector<uint8_t> data(kMagic, kMagic + 8);
+    PutLe(data, kVersion, 2);
+    PutLe(data, kHeaderSize, 2);
+    PutLe(data, entries_.size(), 4);
+    PutLe(data, 0, 8);  // 校验和最后填
+    for (const auto& entry : entries_) {
+        std::size_t characteristics = 0;
+        for (const auto& service : entry.second) {
+            characteristics += service.characteristics.size();
+        }
+        PutLe(data, entry.first, 8);
+        PutLe(data, entry.second.size(), 2);
+        PutLe(data, characteristics, 2);
+        PutLe(data, 0, 4);
+        for (const auto& service : entry.second) {
+            PutGuid(data, service.service.uuid);
+            PutLe(data, service.service.handle, 2);
+        }
+        for (const auto& service : entry.second) {
+            for (const auto& characteristic : service.characteristics) {
+                PutGuid(data, characteristic.uuid);
+                PutLe(data, characteristic.handle, 2);
+                PutLe(data, characteristic.service_handle, 2);
+                PutLe(data, characteristic.properties, 4);
+            }
+        }
+    }
+    const uint64_t checksum = Fnv1a(data.data() + kHeaderSize, data.size() - kHeaderSize);
+    for (std::size_t i = 0; i < 8; ++i) {
+        data[16 + i] = static_cast<uint8_t>(checksum >> (i * 8));
+    }
+    if (!ReplaceFile(path_, data)) {
+        ++stats_.write_failures;
+        return false;
+    }
+    ++stats_.writes;
+    return true;
+}
+
+}  // namespace ble
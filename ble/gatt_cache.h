@@ -0,0 +1,77 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ble/gatt_discovery.h"
+
+namespace ble {
+
+/**
+ * 缓存的使用情况
+ */
+struct GattCacheStats {
+    std::size_t entries = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t invalidations = 0;   // 连接后发现缓存与设备不一致而作废的次数
+    uint64_t writes = 0;
+    uint64_t write_failures = 0;
+};
+
+/**
+ * 以设备地址为键的 GATT 服务/特性布局缓存，保存在磁盘上，下次启动和每次重连都能直接使用
+ *
+ * 只缓存完整成功的发现结果（每个服务的特性查询都成功）。句柄和属性原样保存，
+ * 连接后由 RestoreGatt 核对，设备固件更新导致布局变化时调用 Invalidate 再重新发现。
+ * 没有调用 Open 时只保存在内存里。各连接任务可以同时调用。
+ */
+class GattCache {
+public:
+    GattCache() = default;
+
+    GattCache(const GattCache&) = delete;
+    GattCache& operator=(const GattCache&) = delete;
+
+    /**
+     * 读入缓存文件，文件不存在或已损坏时从空缓存开始，之后的 Store 会重新创建它
+     * @param path
+     * @return 文件存在且有效时返回 true
+     */
+    bool Open(const std::string& path);
+
+    /**
+     * @param address
+     * @param layout 命中时写入缓存的布局（status 为 Success，没有计时）
+     */
+    bool Lookup(uint64_t address, DiscoveryResult& layout);
+
+    /**
+     * 保存一次发现结果并重写缓存文件；结果不完整时不保存
+     * @param address
+     * @param discovery
+     * @return 保存并写入文件时返回 true
+     */
+    bool Store(uint64_t address, const DiscoveryResult& discovery);
+
+    // 删除一台设备的缓存并重写文件
+    void Invalidate(uint64_t address);
+
+    GattCacheStats Stats() const;
+
+    const std::string& Path() const { return path_; }
+
+private:
+    bool WriteLocked();
+
+    mutable std::mutex mutex_;
+    std::string path_;
+    std::unordered_map<uint64_t, std::vector<DiscoveredService>> entries_;
+    GattCacheStats stats_;
+};
+
+}  // namespace ble
@@ -0,0 +1,165 @@
+﻿#include "ble/gatt_discovery.h"
+
+#include <chrono>
+#include <utility>
+
+#include "ble/clock.h"
+
+namespace ble {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * 放弃一个超时的 future，交给调用方的 AbandonedRequests 在关闭时等待
+ * @param future
+ * @param abandoned 为 nullptr 时只能在这里等任务结束，结果仍然算超时
+ */
+template <typename T>
+void Abandon(std::future<T> future, AbandonedRequests* abandoned) {
+    if (abandoned != nullptr) {
+        abandoned->Add(std::move(future));
+    } else {
+        future.wait();
+    }
+}
+
+double ElapsedMs(uint64_t start_ns) {
+    return static_cast<double>(MonotonicNowNs() - start_ns) / 1e6;
+}
+
+/**
+ * 在 deadline 前等待特性查询结果，超时则放弃
+ * @return 是否在 deadline 前完成
+ */
+bool Collect(std::future<CharacteristicsResult>& pending, Clock::time_point deadline, DiscoveredService& out,
+             AbandonedRequests* abandoned) {
+    if (pending.wait_until(deadline) != std::future_status::ready) {
+        out.status = GattStatus::Timeout;
+        Abandon(std::move(pending), abandoned);
+        return false;
+    }
+    CharacteristicsResult result = pending.get();
+    out.status = result.status;
+    if (result.status == GattStatus::Success) {
+        out.characteristics = std::move(result.characteristics);
+    }
+    return true;
+}
+
+}  // namespace
+
+DiscoveryResult DiscoverGatt(BleConnection& connection, const DiscoveryOptions& options,
+                             AbandonedRequests* abandoned) {
+    DiscoveryResult result;
+    const uint64_t start = MonotonicNowNs();
+
+    auto services_future = connection.DiscoverServicesAsync();
+    if (services_future.wait_for(std::chrono::milliseconds(options.services_timeout_ms)) !=
+        std::future_status::ready) {
+        Abandon(std::move(services_future), abandoned);
+        result.status = GattStatus::Timeout;
+        result.timings.services_ms = result.timings.total_ms = ElapsedMs(start);
+        return result;
+    }
+    ServicesResult services = services_future.get();
+    result.status = services.status;
+    result.timings.services_ms = ElapsedMs(start);
+    if (services.status != GattStatus::Success) {
+        result.timings.total_ms = result.timings.services_ms;
+        return result;
+    }
+
+    const uint64_t characteristics_start = MonotonicNowNs();
+    const auto deadline = Clock::now() + std::chrono::milliseconds(options.characteristics_timeout_ms);
+    result.services.resize(services.services.size());
+    if (options.parallel) {
+        // 先把所有请求发出去，再按顺序收结果
+        std::vector<std::future<CharacteristicsResult>> pending;
+        pending.reserve(services.services.size());
+        for (std::size_t i = 0; i < services.services.size(); ++i) {
+            result.services[i].service = services.services[i];
+            pending.push_back(connection.DiscoverCharacteristicsAsync(services.services[i]));
+        }
+        for (std::size_t i = 0; i < pending.size(); ++i) {
+            if (!Collect(pending[i], deadline, result.services[i], abandoned)) {
+                ++result.timed_out;
+            }
+        }
+    } else {
+        for (std::size_t i = 0; i < services.services.size(); ++i) {
+            result.services[i].service = services.services[i];
+            auto pending = connection.DiscoverCharacteristicsAsync(services.services[i]);
+            if (!Collect(pending, deadline, result.services[i], abandoned)) {
+                ++result.timed_out;
+            }
+        }
+    }
+    result.timings.characteristics_ms = ElapsedMs(characteristics_start);
+    result.timings.total_ms = ElapsedMs(start);
+    return result;
+}
+
+DiscoveryResult RestoreGatt(BleConnection& connection, const DiscoveryResult& cached, bool validate_services,
+                            const DiscoveryOptions& options, AbandonedRequests* abandoned) {
+    DiscoveryResult result;
+    const uint64_t start = MonotonicNowNs();
+    const auto timeout = std::chrono::milliseconds(options.services_timeout_ms);
+
+    if (validate_services) {
+        auto services_future = connection.DiscoverServicesAsync();
+        if (services_future.wait_for(timeout) != std::future_status::ready) {
+            Abandon(std::move(services_future), abandoned);
+            result.status = GattStatus::Timeout;
+            result.timings.services_ms = result.timings.total_ms = ElapsedMs(start);
+            return result;
+        }
+        ServicesResult services = services_future.get();
+        result.timings.services_ms = ElapsedMs(start);
+        result.status = services.status;
+        if (services.status == GattStatus::Success) {
+            // 服务增删或句柄移动都说明固件或数据库变了
+            bool same = services.services.size() == cached.services.size();
+            for (std::size_t i = 0; same && i < services.services.size(); ++i) {
+                same = services.services[i].uuid == cached.services[i].service.uuid &&
+                       services.services[i].handle == cached.services[i].service.handle;
+            }
+            if (!same) {
+                result.status = GattStatus::ProtocolError;
+            }
+        }
+        if (result.status != GattStatus::Success) {
+            result.timings.total_ms = result.timings.services_ms;
+            return result;
+        }
+    }
+
+    const uint64_t characteristics_start = MonotonicNowNs();
+    std::vector<GattCharacteristicInfo> characteristics;
+    cached.ForEachCharacteristic([&](const GattCharacteristicInfo& characteristic) {
+        characteristics.push_back(characteristic);
+    });
+    auto restore = connection.RestoreCharacteristicsAsync(characteristics);
+    if (restore.wait_for(timeout) != std::future_status::ready) {
+        Abandon(std::move(restore), abandoned);
+        result.status = GattStatus::Timeout;
+    } else {
+        result.status = restore.get();
+    }
+    if (result.status == GattStatus::Success) {
+        result.services = cached.services;
+    }
+    result.timings.characteristics_ms = ElapsedMs(characteristics_start);
+    result.timings.total_ms = ElapsedMs(start);
+    return result;
+}
+
+std::future<DiscoveryResult> DiscoverGattAsync(std::shared_ptr<BleConnection> connection, DiscoveryOptions options,
+                                               AbandonedRequests* abandoned) {
+    return std::async(std::launch::async, [connection = std::move(connection), options, abandoned] {
+        return DiscoverGatt(*connection, options, abandoned);
+    });
+}
+
+}  // namespace ble
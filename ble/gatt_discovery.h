@@ -0,0 +1,90 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include "ble/transport.h"
+
+namespace ble {
+
+struct DiscoveryOptions {
+    uint32_t services_timeout_ms = 5000;         // 服务发现的超时
+    uint32_t characteristics_timeout_ms = 5000;  // 全部特性发现的总超时（从发出第一个请求算起）
+    bool parallel = true;                        // false 时逐个服务依次查询，用于对比
+};
+
+/**
+ * 各阶段耗时（毫秒）
+ */
+struct DiscoveryTimings {
+    double services_ms = 0.0;
+    double characteristics_ms = 0.0;
+    double total_ms = 0.0;
+};
+
+struct DiscoveredService {
+    GattServiceInfo service;
+    GattStatus status = GattStatus::Unreachable;  // 该服务的特性查询结果
+    std::vector<GattCharacteristicInfo> characteristics;
+};
+
+struct DiscoveryResult {
+    GattStatus status = GattStatus::Unreachable;  // 服务发现本身的结果
+    std::vector<DiscoveredService> services;
+    DiscoveryTimings timings;
+    std::size_t timed_out = 0;                    // 超时的特性查询数
+
+    // 依次访问所有查询成功的特性
+    template <typename Fn>
+    void ForEachCharacteristic(Fn&& fn) const {
+        for (const auto& service : services) {
+            for (const auto& characteristic : service.characteristics) {
+                fn(characteristic);
+            }
+        }
+    }
+};
+
+/**
+ * 发现一个连接上的全部服务和特性
+ *
+ * 服务列表回来后，所有服务的特性查询同时发出，再统一等待，
+ * 总耗时接近一次服务发现加一次最慢的特性查询，而不是随服务数线性增长。
+ * 单个查询失败或超时只影响对应的服务，其余结果照常返回。
+ * 这是阻塞调用，应在连接任务里调用，不要放在扫描回调里。
+ * @param connection
+ * @param options
+ * @param abandoned 超时的请求放到这里，由调用方在关闭时等待；为 nullptr 时返回前等它们结束
+ */
+DiscoveryResult DiscoverGatt(BleConnection& connection, const DiscoveryOptions& options = {},
+                             AbandonedRequests* abandoned = nullptr);
+
+/**
+ * 用之前保存的布局（例如 GattCache 里的）代替 DiscoverGatt，不查询任何服务的特性
+ *
+ * validate_services 为 true 时先做一次服务发现，服务的 UUID 和句柄与 cached 完全一致才使用缓存；
+ * 为 false 时直接信任缓存，过期的布局要等订阅失败才会发现。
+ * 然后让后端按缓存准备特性对象（RestoreCharacteristicsAsync），这一步不产生 GATT 请求。
+ * @param connection
+ * @param cached
+ * @param validate_services
+ * @param options 使用其中的 services_timeout_ms
+ * @param abandoned 同 DiscoverGatt
+ * @return status 为 Success 时 services 就是 cached 的布局；布局与设备不一致时为 ProtocolError
+ */
+DiscoveryResult RestoreGatt(BleConnection& connection, const DiscoveryResult& cached, bool validate_services,
+                            const DiscoveryOptions& options = {}, AbandonedRequests* abandoned = nullptr);
+
+/**
+ * DiscoverGatt 的异步版本，connection 在完成前保持有效
+ * @param connection
+ * @param options
+ * @param abandoned 在完成前保持有效
+ */
+std::future<DiscoveryResult> DiscoverGattAsync(std::shared_ptr<BleConnection> connection,
+                                               DiscoveryOptions options = {}, AbandonedRequests* abandoned = nullptr);
+
+}  // namespace ble
@@ -0,0 +1,29 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace ble {
+
+/**
+ * 与 winrt::guid / Windows GUID 内存布局相同的 UUID，
+ * 在 Windows 上可以直接 memcpy 互相转换
+ */
+struct Guid {
+    uint32_t Data1;
+    uint16_t Data2;
+    uint16_t Data3;
+    uint8_t Data4[8];
+};
+
+static_assert(sizeof(Guid) == 16, "Guid must match the GUID layout");
+
+inline bool operator==(const Guid& a, const Guid& b) {
+    return std::memcmp(&a, &b, sizeof(Guid)) == 0;
+}
+
+inline bool operator!=(const Guid& a, const Guid& b) {
+    return !(a == b);
+}
+
+}  // namespace ble
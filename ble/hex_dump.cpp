@@ -0,0 +1,170 @@
+﻿#include "ble/hex_dump.h"
+
+#include <array>
+#include <cstring>
+
+#include "ble/cpu_features.h"
+
+#if BLE_X86
+#include <immintrin.h>
+#endif
+
+namespace ble {
+
+namespace {
+
+// 256 项查找表，每项 4 字节："xx " 加一个填充字节，整项 memcpy 后指针只前进 3
+struct HexTable {
+    std::array<std::array<char, 4>, 256> entries;
+};
+
+constexpr HexTable MakeHexTable() {
+    HexTable table{};
+    const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < 256; ++i) {
+        table.entries[i] = {digits[i >> 4], digits[i & 0xF], ' ', ' '};
+    }
+    return table;
+}
+
+constexpr HexTable kHexTable = MakeHexTable();
+
+// 超过这个长度才值得走 SIMD 路径
+constexpr std::size_t kSimdMinLength = 32;
+
+#if BLE_X86
+/**
+ * 16 个输入字节 -> 48 个输出字符，分成 3 个 16 字节寄存器。
+ * 先把高/低半字节交织成 32 字节的 "字符对" 流 (P0, P1)，
+ * 再用 pshufb 把字符对按 "xx " 的位置散开，空位填空格。
+ */
+struct HexShuffleMasks {
+    std::array<std::array<int8_t, 16>, 3> from_p0;
+    std::array<std::array<int8_t, 16>, 3> from_p1;
+    std::array<std::array<int8_t, 16>, 3> spaces;
+};
+
+constexpr HexShuffleMasks MakeHexShuffleMasks() {
+    HexShuffleMasks m{};
+    for (int k = 0; k < 3; ++k) {
+        for (int j = 0; j < 16; ++j) {
+            int g = k * 16 + j;
+            int pos = g % 3;
+            int pair_index = (g / 3) * 2 + pos;
+            m.from_p0[k][j] = -128;
+            m.from_p1[k][j] = -128;
+            m.spaces[k][j] = 0;
+            if (pos == 2) {
+                m.spaces[k][j] = ' ';
+            } else if (pair_index < 16) {
+                m.from_p0[k][j] = static_cast<int8_t>(pair_index);
+            } else {
+                m.from_p1[k][j] = static_cast<int8_t>(pair_index - 16);
+            }
+        }
+    }
+    return m;
+}
+
+constexpr HexShuffleMasks kHexShuffleMasks = MakeHexShuffleMasks();
+
+BLE_TARGET("ssse3")
+char* EncodeHexSsse3(const uint8_t* data, std::size_t length, char* out) {
+    const __m128i digits = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7',
+                                         '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    const __m128i low_mask = _mm_set1_epi8(0x0F);
+
+    __m128i p0_masks[3], p1_masks[3], space_masks[3];
+    for (int k = 0; k < 3; ++k) {
+        p0_masks[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(kHexShuffleMasks.from_p0[k].data()));
+        p1_masks[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(kHexShuffleMasks.from_p1[k].data()));
+        space_masks[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(kHexShuffleMasks.spaces[k].data()));
+    }
+
+    std::size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(bytes, 4), low_mask));
+        __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(bytes, low_mask));
+        __m128i p0 = _mm_unpacklo_epi8(hi, lo);
+        __m128i p1 = _mm_unpackhi_epi8(hi, lo);
+        for (int k = 0; k < 3; ++k) {
+            __m128i v = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(p0, p0_masks[k]),
+                                                  _mm_shuffle_epi8(p1, p1_masks[k])),
+                                     space_masks[k]);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + k * 16), v);
+        }
+        out += 48;
+    }
+    return EncodeHexScalar(data + i, length - i, out);
+}
+#endif
+
+}  // namespace
+
+char* EncodeHexScalar(const uint8_t* data, std::size_t length, char* out) {
+    if (length == 0) {
+        return out;
+    }
+    // 前 length - 1 个字节整项拷贝（多写的填充字节会被下一项覆盖），最后一个只拷 3 字节，不越界
+    for (std::size_t i = 0; i + 1 < length; ++i) {
+        std::memcpy(out, kHexTable.entries[data[i]].data(), 4);
+        out += kHexCharsPerByte;
+    }
+    std::memcpy(out, kHexTable.entries[data[length - 1]].data(), kHexCharsPerByte);
+    return out + kHexCharsPerByte;
+}
+
+bool HexSimdAvailable() {
+    static const bool available = CpuHasSsse3();
+    return available;
+}
+
+char* EncodeHex(const uint8_t* data, std::size_t length, char* out) {
+#if BLE_X86
+    if (length >= kSimdMinLength && HexSimdAvailable()) {
+        return EncodeHexSsse3(data, length, out);
+    }
+#endif
+    return EncodeHexScalar(data, length, out);
+}
+
+HexDumpWriter::HexDumpWriter(std::FILE* out, std::size_t capacity)
+    : out_(out), buffer_(capacity) {}
+
+void HexDumpWriter::Reserve(std::size_t bytes) {
+    if (size_ + bytes > buffer_.size()) {
+        Flush();
+        // 单个数据包比整个缓冲区还大时只能扩容
+        if (bytes > buffer_.size()) {
+            buffer_.resize(bytes);
+        }
+    }
+}
+
+void HexDumpWriter::AppendPacket(const uint8_t* data, std::size_t length, const char* prefix) {
+    std::size_t prefix_length = prefix != nullptr ? std::strlen(prefix) : 0;
+    Reserve(prefix_length + length * kHexCharsPerByte + 1);
+
+    char* out = buffer_.data() + size_;
+    if (prefix_length > 0) {
+        std::memcpy(out, prefix, prefix_length);
+        out += prefix_length;
+    }
+    out = EncodeHex(data, length, out);
+    *out++ = '\n';
+    size_ = static_cast<std::size_t>(out - buffer_.data());
+}
+
+void HexDumpWriter::Flush() {
+    if (size_ == 0) {
+        return;
+    }
+    if (out_ != nullptr) {
+        std::fwrite(buffer_.data(), 1, size_, out_);
+        std::fflush(out_);
+    }
+    size_ = 0;
+}
+
+}  // namespace ble
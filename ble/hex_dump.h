@@ -0,0 +1,66 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace ble {
+
+// 每个字节输出 "xx "（两位小写十六进制加一个空格），与原来 std::wcout 的格式一致
+constexpr std::size_t kHexCharsPerByte = 3;
+
+/**
+ * 查表法十六进制编码，out 至少要有 length * 3 字节
+ * @return 写入结束位置
+ */
+char* EncodeHexScalar(const uint8_t* data, std::size_t length, char* out);
+
+/**
+ * 自动选择实现：支持 SSSE3 且数据较长时走 SIMD 路径，否则查表
+ * @return 写入结束位置
+ */
+char* EncodeHex(const uint8_t* data, std::size_t length, char* out);
+
+// 当前 CPU 是否会使用 SIMD 路径
+bool HexSimdAvailable();
+
+/**
+ * 可复用的十六进制输出缓冲区
+ *
+ * 每个数据包编码成一行追加到缓冲区，调用方在一批数据包处理完后调用 Flush()，
+ * 整批只做一次 fwrite。缓冲区在构造时分配，之后不再分配内存。
+ */
+class HexDumpWriter {
+public:
+    explicit HexDumpWriter(std::FILE* out, std::size_t capacity = 64 * 1024);
+    ~HexDumpWriter() { Flush(); }
+
+    HexDumpWriter(const HexDumpWriter&) = delete;
+    HexDumpWriter& operator=(const HexDumpWriter&) = delete;
+
+    /**
+     * 追加一行：可选前缀 + 数据的十六进制 + 换行，缓冲区放不下时先自动刷新
+     * @param data
+     * @param length
+     */
+    void AppendPacket(const uint8_t* data, std::size_t length, const char* prefix = nullptr);
+
+    // 把缓冲区内容一次性写出
+    void Flush();
+
+    std::size_t Pending() const { return size_; }
+    const char* Data() const { return buffer_.data(); }
+
+    // 只清空不写出（基准测试和单独取结果时用）
+    void Clear() { size_ = 0; }
+
+private:
+    void Reserve(std::size_t bytes);
+
+    std::FILE* out_;
+    std::vector<char> buffer_;
+    std::size_t size_ = 0;
+};
+
+}  // namespace ble
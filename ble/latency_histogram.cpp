@@ -0,0 +1,193 @@
+﻿#include "ble/latency_histogram.h"
+
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace ble {
+
+namespace {
+
+unsigned HighestBit(uint64_t value) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return static_cast<unsigned>(index);
+#else
+    return 63u - static_cast<unsigned>(__builtin_clzll(value));
+#endif
+}
+
+std::atomic<uint64_t> next_probes_id{1};
+
+}  // namespace
+
+std::size_t LatencyHistogram::BucketOf(uint64_t value_ns) {
+    if (value_ns < kLatencySubBuckets) {
+        return static_cast<std::size_t>(value_ns);
+    }
+    const unsigned shift = std::min(HighestBit(value_ns), kLatencyMaxBits) - kLatencySubBucketBits;
+    // value >> shift 落在 [64, 128)，超出范围的值截到最后一个桶
+    const uint64_t sub = std::min<uint64_t>(value_ns >> shift, 2 * kLatencySubBuckets - 1) - kLatencySubBuckets;
+    return kLatencySubBuckets + shift * kLatencySubBuckets + static_cast<std::size_t>(sub);
+}
+
+uint64_t LatencyHistogram::BucketLower(std::size_t bucket) {
+    if (bucket < kLatencySubBuckets) {
+        return bucket;
+    }
+    const std::size_t shift = (bucket - kLatencySubBuckets) / kLatencySubBuckets;
+    const std::size_t sub = (bucket - kLatencySubBuckets) % kLatencySubBuckets;
+    return static_cast<uint64_t>(kLatencySubBuckets + sub) << shift;
+}
+
+uint64_t LatencyHistogram::BucketUpper(std::size_t bucket) {
+    return BucketLower(bucket + 1);
+}
+
+void LatencyHistogram::Record(uint64_t value_ns) {
+    Add(counts_[BucketOf(value_ns)], 1);
+    Add(count_, 1);
+    Add(sum_, value_ns);
+    if (value_ns < min_.load(std::memory_order_relaxed)) {
+        min_.store(value_ns, std::memory_order_relaxed);
+    }
+    if (value_ns > max_.load(std::memory_order_relaxed)) {
+        max_.store(value_ns, std::memory_order_relaxed);
+    }
+}
+
+LatencySnapshot::LatencySnapshot() : counts_(kLatencyBuckets, 0) {}
+
+void LatencySnapshot::Add(const LatencyHistogram& histogram) {
+    // 读的同时写者还在记录，count_ 和各桶之和可能差几个，百分位数按各桶之和计算
+    for (std::size_t b = 0; b < kLatencyBuckets; ++b) {
+        const uint64_t n = histogram.counts_[b].load(std::memory_order_relaxed);
+        counts_[b] += n;
+        count_ += n;
+    }
+    sum_ += histogram.sum_.load(std::memory_order_relaxed);
+    min_ = std::min(min_, histogram.min_.load(std::memory_order_relaxed));
+    max_ = std::max(max_, histogram.max_.load(std::memory_order_relaxed));
+}
+
+void LatencySnapshot::Add(const LatencySnapshot& other) {
+    for (std::size_t b = 0; b < kLatencyBuckets; ++b) {
+        counts_[b] += other.counts_[b];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+}
+
+uint64_t LatencySnapshot::Percentile(double p) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    // 第 rank 个（从 1 起）值所在的桶
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(p / 100.0 * static_cast<double>(count_) + 0.5));
+    uint64_t seen = 0;
+    for (std::size_t b = 0; b < kLatencyBuckets; ++b) {
+        seen += counts_[b];
+        if (seen >= rank) {
+            const uint64_t lower = LatencyHistogram::BucketLower(b);
+            const uint64_t middle = lower + (LatencyHistogram::BucketUpper(b) - lower) / 2;
+            return std::min(middle, max_);
+        }
+    }
+    return max_;
+}
+
+LatencySummary LatencySnapshot::Summary() const {
+    LatencySummary summary;
+    summary.count = count_;
+    if (count_ == 0) {
+        return summary;
+    }
+    summary.mean_ns = static_cast<double>(sum_) / static_cast<double>(count_);
+    summary.min_ns = min_;
+    summary.p50_ns = Percentile(50);
+    summary.p99_ns = Percentile(99);
+    summary.p999_ns = Percentile(99.9);
+    summary.max_ns = max_;
+    return summary;
+}
+
+struct LatencyProbes::ThreadHistograms {
+    explicit ThreadHistograms(std::size_t stages) : histograms(stages) {}
+
+    std::vector<LatencyHistogram> histograms;
+};
+
+LatencyProbes::LatencyProbes(std::vector<std::string> stages)
+    : stages_(std::move(stages)), ns_per_tick_(NsPerTick()), id_(next_probes_id.fetch_add(1)) {}
+
+LatencyProbes::~LatencyProbes() = default;
+
+LatencyProbes::ThreadHistograms& LatencyProbes::Local() {
+    // 每个线程按探针对象缓存自己的直方图，在几个探针对象之间交替记录时也只登记一次。
+    // 程序里通常只有一两个探针对象，线性查找比哈希表快；
+    // 编号从不重复，已经析构的探针对象留下的项不会再被命中
+    struct Entry {
+        uint64_t id;
+        ThreadHistograms* histograms;
+    };
+    thread_local std::vector<Entry> cache;
+    for (const Entry& entry : cache) {
+        if (entry.id == id_) {
+            return *entry.histograms;
+        }
+    }
+    auto histograms = std::make_unique<ThreadHistograms>(stages_.size());
+    ThreadHistograms* local = histograms.get();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        threads_.push_back(std::move(histograms));
+    }
+    cache.push_back({id_, local});
+    return *local;
+}
+
+void LatencyProbes::Record(std::size_t stage, uint64_t latency_ns) {
+    Local().histograms[stage].Record(latency_ns);
+}
+
+std::vector<LatencySummary> LatencyProbes::Summaries() const {
+    std::vector<LatencySnapshot> merged(stages_.size());
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& thread : threads_) {
+            for (std::size_t s = 0; s < stages_.size(); ++s) {
+                merged[s].Add(thread->histograms[s]);
+            }
+        }
+    }
+    std::vector<LatencySummary> summaries;
+    for (const auto& snapshot : merged) {
+        summaries.push_back(snapshot.Summary());
+    }
+    return summaries;
+}
+
+std::size_t LatencyProbes::Threads() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return threads_.size();
+}
+
+void RenderLatencyTable(const std::vector<std::string>& stages, const std::vector<LatencySummary>& summaries,
+                        std::FILE* out) {
+    std::fprintf(out, "%-10s  %10s  %9s  %9s  %9s  %9s  %9s\n", "Stage", "Count", "Mean(us)", "p50(us)", "p99(us)",
+                 "p99.9(us)", "Max(us)");
+    for (std::size_t s = 0; s < stages.size() && s < summaries.size(); ++s) {
+        const LatencySummary& summary = summaries[s];
+        std::fprintf(out, "%-10s  %10llu  %9.1f  %9.1f  %9.1f  %9.1f  %9.1f\n", stages[s].c_str(),
+                     static_cast<unsigned long long>(summary.count), summary.mean_ns / 1e3,
+                     static_cast<double>(summary.p50_ns) / 1e3, static_cast<double>(summary.p99_ns) / 1e3,
+                     static_cast<double>(summary.p999_ns) / 1e3, static_cast<double>(summary.max_ns) / 1e3);
+    }
+    std::fflush(out);
+}
+
+}  // namespace ble
@@ -0,0 +1,160 @@
+﻿#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ble/clock.h"
+
+namespace ble {
+
+// 每个 2 的幂区间分成 64 个桶，相对误差不超过 1/64（约 1.6%）
+constexpr unsigned kLatencySubBucketBits = 6;
+constexpr std::size_t kLatencySubBuckets = std::size_t{1} << kLatencySubBucketBits;
+// 能区分的最大值约 2^42 ns（73 分钟），更大的值都记在最后一个桶
+constexpr unsigned kLatencyMaxBits = 42;
+// 桶数：线性区一组，最高位为 6~42 的值各一组
+constexpr std::size_t kLatencyBuckets = kLatencySubBuckets * (kLatencyMaxBits - kLatencySubBucketBits + 2);
+
+/**
+ * 一组延迟的摘要（纳秒）
+ */
+struct LatencySummary {
+    uint64_t count = 0;
+    double mean_ns = 0.0;
+    uint64_t min_ns = 0;
+    uint64_t p50_ns = 0;
+    uint64_t p99_ns = 0;
+    uint64_t p999_ns = 0;
+    uint64_t max_ns = 0;        // 精确值，不是桶的边界
+};
+
+/**
+ * 延迟直方图（HdrHistogram 的对数-线性分桶）
+ *
+ * 小于 64ns 的值每纳秒一个桶，之后每个 2 的幂区间均分成 64 个桶，
+ * 所以任何值所在桶的宽度都不超过它的 1/64。Record() 只做一次求最高位、
+ * 几次移位和一次计数，只能由一个线程调用；计数是 relaxed 原子变量，
+ * 其他线程可以随时 MergeInto() 读出。
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram() = default;
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void Record(uint64_t value_ns);
+
+    static std::size_t BucketOf(uint64_t value_ns);
+    static uint64_t BucketLower(std::size_t bucket);
+    static uint64_t BucketUpper(std::size_t bucket);
+
+private:
+    friend class LatencySnapshot;
+
+    static void Add(std::atomic<uint64_t>& counter, uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    std::array<std::atomic<uint64_t>, kLatencyBuckets> counts_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> min_{~0ull};
+    std::atomic<uint64_t> max_{0};
+};
+
+/**
+ * 若干直方图合并后的普通计数，用来求百分位数
+ */
+class LatencySnapshot {
+public:
+    LatencySnapshot();
+
+    void Add(const LatencyHistogram& histogram);
+    void Add(const LatencySnapshot& other);
+
+    uint64_t Count() const { return count_; }
+
+    // p 为 0~100，返回所在桶的中点（不超过精确的最大值），没有数据时返回 0
+    uint64_t Percentile(double p) const;
+
+    LatencySummary Summary() const;
+
+private:
+    std::vector<uint64_t> counts_;
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t min_ = ~0ull;
+    uint64_t max_ = 0;
+};
+
+/**
+ * 按线程分开的多阶段延迟探针
+ *
+ * 每个线程第一次 Record() 时登记自己的一组直方图（每个阶段一个），之后只写自己的，
+ * 线程之间没有共享的缓存行；Summaries() 在任何线程上把所有线程的直方图合并。
+ * 线程退出后它的直方图仍然保留，直到探针对象销毁。
+ */
+class LatencyProbes {
+public:
+    explicit LatencyProbes(std::vector<std::string> stages);
+    ~LatencyProbes();
+
+    LatencyProbes(const LatencyProbes&) = delete;
+    LatencyProbes& operator=(const LatencyProbes&) = delete;
+
+    /**
+     * 在当前线程的直方图里记录一个阶段的耗时
+     * @param stage 构造时给出的阶段序号
+     * @param latency_ns
+     */
+    void Record(std::size_t stage, uint64_t latency_ns);
+
+    /**
+     * 记录从 since（TickNow() 的返回值）到现在的耗时，返回现在的 tick，
+     * 可以直接作为下一个阶段的起点；一次探针就是一次 TickNow() 加一次 Record()
+     * @param stage
+     * @param since
+     */
+    uint64_t Lap(std::size_t stage, uint64_t since) {
+        const uint64_t now = TickNow();
+        Record(stage, static_cast<uint64_t>(static_cast<double>(now - since) * ns_per_tick_));
+        return now;
+    }
+
+    const std::vector<std::string>& Stages() const { return stages_; }
+
+    // 合并所有线程后各阶段的摘要，顺序与 Stages() 相同
+    std::vector<LatencySummary> Summaries() const;
+
+    // 已登记的线程数
+    std::size_t Threads() const;
+
+private:
+    struct ThreadHistograms;
+
+    ThreadHistograms& Local();
+
+    std::vector<std::string> stages_;
+    double ns_per_tick_;
+    uint64_t id_;                    // 区分先后创建在同一地址上的探针对象
+    mutable std::mutex mutex_;       // 保护 threads_ 的登记
+    std::vector<std::unique_ptr<ThreadHistograms>> threads_;
+};
+
+/**
+ * 渲染成一张表：阶段、次数、平均、p50、p99、p99.9、最大值（微秒）
+ * @param stages
+ * @param summaries
+ * @param out
+ */
+void RenderLatencyTable(const std::vector<std::string>& stages, const std::vector<LatencySummary>& summaries,
+                        std::FILE* out);
+
+}  // namespace ble
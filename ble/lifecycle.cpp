@@ -0,0 +1,138 @@
+﻿#include "ble/lifecycle.h"
+
+#include <thread>
+
+#include "ble/clock.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <pthread.h>
+#endif
+
+namespace ble {
+
+const char* LifecycleStateName(LifecycleState state) {
+    switch (state) {
+        case LifecycleState::Scanning:
+            return "Scanning";
+        case LifecycleState::Connecting:
+            return "Connecting";
+        case LifecycleState::Streaming:
+            return "Streaming";
+        case LifecycleState::Draining:
+            return "Draining";
+        case LifecycleState::Stopped:
+            return "Stopped";
+    }
+    return "Unknown";
+}
+
+LifecycleState Lifecycle::State() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return state_;
+}
+
+bool Lifecycle::Advance(LifecycleState state) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (state <= state_) {
+            return false;
+        }
+        state_ = state;
+        if (state >= LifecycleState::Draining && stop_requested_ns_ == 0) {
+            stop_requested_ns_ = MonotonicNowNs();
+        }
+    }
+    changed_.notify_all();
+    return true;
+}
+
+void Lifecycle::RequestStop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stop_requested_ns_ != 0) {
+            return;
+        }
+        stop_requested_ns_ = MonotonicNowNs();
+    }
+    changed_.notify_all();
+}
+
+bool Lifecycle::StopRequested() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stop_requested_ns_ != 0;
+}
+
+uint64_t Lifecycle::StopRequestedNs() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stop_requested_ns_;
+}
+
+void Lifecycle::WaitForStop() const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this] { return stop_requested_ns_ != 0; });
+}
+
+void Lifecycle::WaitFor(LifecycleState state) const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this, state] { return state_ >= state; });
+}
+
+#ifdef _WIN32
+
+namespace {
+
+Lifecycle* interrupt_target = nullptr;
+
+BOOL WINAPI ConsoleCtrlHandler(DWORD type) {
+    if (type != CTRL_C_EVENT && type != CTRL_BREAK_EVENT && type != CTRL_CLOSE_EVENT) {
+        return FALSE;
+    }
+    // 排空期间再按 Ctrl+C 不打断排空；超过 kDrainTimeoutNs 还没退出时交给系统默认处理，直接结束卡住的进程
+    if (interrupt_target->StopRequested()) {
+        return MonotonicNowNs() - interrupt_target->StopRequestedNs() > kDrainTimeoutNs ? FALSE : TRUE;
+    }
+    interrupt_target->RequestStop();
+    return TRUE;
+}
+
+}  // namespace
+
+void StopOnInterrupt(Lifecycle& lifecycle) {
+    interrupt_target = &lifecycle;
+    SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
+}
+
+#else
+
+void StopOnInterrupt(Lifecycle& lifecycle) {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    // 之后创建的线程都继承这个屏蔽字，信号只会被下面的线程收到
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    std::thread([&lifecycle, signals] {
+        int signal = 0;
+        sigwait(&signals, &signal);
+        lifecycle.RequestStop();
+        // 之后的信号（timeout 等工具会把同一个信号同时发给进程和进程组，用户也会多按几次）
+        // 都不打断排空；请求停止超过 kDrainTimeoutNs 还没退出说明排空卡住了，这时才直接结束进程
+        for (;;) {
+            sigwait(&signals, &signal);
+            if (MonotonicNowNs() - lifecycle.StopRequestedNs() > kDrainTimeoutNs) {
+                std::_Exit(128 + signal);
+            }
+            std::fprintf(stderr, "Draining buffered data, interrupt again after %.0f s to exit immediately\n",
+                         static_cast<double>(kDrainTimeoutNs) / 1e9);
+        }
+    }).detach();
+}
+
+#endif
+
+}  // namespace ble
@@ -0,0 +1,83 @@
+﻿#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+namespace ble {
+
+// 程序的运行阶段，只会向后推进
+enum class LifecycleState {
+    Scanning,
+    Connecting,
+    Streaming,
+    Draining,   // 已请求停止，正在处理剩余数据
+    Stopped,
+};
+
+const char* LifecycleStateName(LifecycleState state);
+
+// 请求停止后留给排空的时间：在此之前重复的中断信号都被忽略，之后再收到才直接结束进程
+constexpr uint64_t kDrainTimeoutNs = 5000000000;
+
+/**
+ * 程序生命周期控制器
+ *
+ * 代替 while (keep_running) Sleep(100) 轮询：等待方阻塞在条件变量上，
+ * 状态变化或请求停止时立即被唤醒，平时没有任何定时唤醒。
+ * 所有方法都可以在任意线程调用（信号处理函数除外，见 StopOnInterrupt）。
+ */
+class Lifecycle {
+public:
+    LifecycleState State() const;
+
+    /**
+     * 推进到 state，已经处于相同或更靠后的阶段时不变
+     * @return 状态是否改变
+     */
+    bool Advance(LifecycleState state);
+
+    // 请求停止并唤醒所有等待者，重复调用无影响
+    void RequestStop();
+
+    bool StopRequested() const;
+
+    // 请求停止时的单调时间戳，未请求时为 0
+    uint64_t StopRequestedNs() const;
+
+    /**
+     * 等待停止请求
+     * @param timeout
+     * @return 超时前收到停止请求时返回 true
+     */
+    template <typename Rep, typename Period>
+    bool WaitForStop(std::chrono::duration<Rep, Period> timeout) const {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return changed_.wait_for(lock, timeout, [this] { return stop_requested_ns_ != 0; });
+    }
+
+    void WaitForStop() const;
+
+    // 等待进入 state 或更靠后的阶段
+    void WaitFor(LifecycleState state) const;
+
+private:
+    mutable std::mutex mutex_;
+    mutable std::condition_variable changed_;
+    LifecycleState state_ = LifecycleState::Scanning;
+    uint64_t stop_requested_ns_ = 0;
+};
+
+/**
+ * Ctrl+C / SIGTERM 时请求停止
+ *
+ * POSIX 上屏蔽这两个信号后由专门的线程 sigwait 接收，条件变量不必在信号处理函数里操作，
+ * 因此必须在创建其他线程之前调用；Windows 上控制台处理函数本来就在独立线程上运行。
+ * 第一次中断请求停止、开始排空；排空期间重复的中断不打断排空，
+ * 请求停止超过 kDrainTimeoutNs 进程还没退出时，再次中断才直接结束进程。一个进程只应调用一次。
+ * @param lifecycle 在进程结束前保持有效
+ */
+void StopOnInterrupt(Lifecycle& lifecycle);
+
+}  // namespace ble
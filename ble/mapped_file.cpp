@@ -0,0 +1,218 @@
+﻿#include "ble/mapped_file.h"
+
+#include <algorithm>
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ble {
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        Close();
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(is_open_, other.is_open_);
+        std::swap(writable_, other.writable_);
+#ifdef _WIN32
+        std::swap(file_handle_, other.file_handle_);
+        std::swap(mapping_handle_, other.mapping_handle_);
+#endif
+    }
+    return *this;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::OpenReadOnly(const std::string& path) {
+    Close();
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return false;
+    }
+    file_handle_ = file;
+    is_open_ = true;
+    size_ = static_cast<std::size_t>(size.QuadPart);
+    if (size_ == 0) {
+        return true;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        Close();
+        return false;
+    }
+    mapping_handle_ = mapping;
+    data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (data_ == nullptr) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool MappedFile::OpenReadWrite(const std::string& path, std::size_t size) {
+    Close();
+    if (size == 0) {
+        return false;
+    }
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    file_handle_ = file;
+    is_open_ = true;
+    LARGE_INTEGER current;
+    if (!GetFileSizeEx(file, &current)) {
+        Close();
+        return false;
+    }
+    if (static_cast<std::size_t>(current.QuadPart) != size) {
+        LARGE_INTEGER target;
+        target.QuadPart = static_cast<LONGLONG>(size);
+        if (!SetFilePointerEx(file, target, nullptr, FILE_BEGIN) || !SetEndOfFile(file)) {
+            Close();
+            return false;
+        }
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        Close();
+        return false;
+    }
+    mapping_handle_ = mapping;
+    data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0));
+    if (data_ == nullptr) {
+        Close();
+        return false;
+    }
+    size_ = size;
+    writable_ = true;
+    return true;
+}
+
+bool MappedFile::Sync(std::size_t offset, std::size_t length) {
+    if (!writable_ || offset >= size_) {
+        return false;
+    }
+    length = std::min(length, size_ - offset);
+    return FlushViewOfFile(data_ + offset, length) && FlushFileBuffers(file_handle_);
+}
+
+void MappedFile::Close() {
+    if (data_ != nullptr) {
+        UnmapViewOfFile(data_);
+    }
+    if (mapping_handle_ != nullptr) {
+        CloseHandle(mapping_handle_);
+    }
+    if (file_handle_ != nullptr) {
+        CloseHandle(file_handle_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+    is_open_ = false;
+    writable_ = false;
+    file_handle_ = nullptr;
+    mapping_handle_ = nullptr;
+}
+
+#else
+
+bool MappedFile::OpenReadOnly(const std::string& path) {
+    Close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    is_open_ = true;
+    size_ = static_cast<std::size_t>(st.st_size);
+    if (size_ > 0) {
+        void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd);
+            Close();
+            return false;
+        }
+        data_ = static_cast<const uint8_t*>(p);
+        // 顺序读取为主，提示内核预读
+        ::madvise(p, size_, MADV_SEQUENTIAL);
+    }
+    // 映射建立后文件描述符就不需要了
+    ::close(fd);
+    return true;
+}
+
+bool MappedFile::OpenReadWrite(const std::string& path, std::size_t size) {
+    Close();
+    if (size == 0) {
+        return false;
+    }
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 ||
+        (static_cast<std::size_t>(st.st_size) != size && ::ftruncate(fd, static_cast<off_t>(size)) != 0)) {
+        ::close(fd);
+        return false;
+    }
+    void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    data_ = static_cast<const uint8_t*>(p);
+    size_ = size;
+    is_open_ = true;
+    writable_ = true;
+    return true;
+}
+
+bool MappedFile::Sync(std::size_t offset, std::size_t length) {
+    if (!writable_ || offset >= size_) {
+        return false;
+    }
+    length = std::min(length, size_ - offset);
+    // msync 要求起始地址按页对齐
+    static const std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    const std::size_t begin = offset / page * page;
+    return ::msync(const_cast<uint8_t*>(data_) + begin, offset + length - begin, MS_SYNC) == 0;
+}
+
+void MappedFile::Close() {
+    if (data_ != nullptr) {
+        ::munmap(const_cast<uint8_t*>(data_), size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+    is_open_ = false;
+    writable_ = false;
+}
+
+#endif
+
+}  // namespace ble
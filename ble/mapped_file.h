@@ -0,0 +1,63 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ble {
+
+/**
+ * 内存映射文件（POSIX 用 mmap，Windows 用 CreateFileMapping），可以只读或读写映射
+ */
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { Close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    /**
+     * 映射整个文件，失败时返回 false，空文件也算成功（Data() 为 nullptr）
+     * @param path
+     */
+    bool OpenReadOnly(const std::string& path);
+
+    /**
+     * 读写方式共享映射，文件不存在时创建，大小不是 size 时截断或用 0 扩展到 size。
+     * 对映射内存的写入就是对文件的写入，进程被杀掉也不会丢失（由内核写回）；
+     * 要防止断电丢失需要调用 Sync()
+     * @param path
+     * @param size 必须大于 0
+     */
+    bool OpenReadWrite(const std::string& path, std::size_t size);
+
+    /**
+     * 把 [offset, offset + length) 范围内修改过的页写回磁盘，写完才返回
+     * @param offset
+     * @param length
+     */
+    bool Sync(std::size_t offset, std::size_t length);
+
+    void Close();
+
+    const uint8_t* Data() const { return data_; }
+    // 只读映射时返回 nullptr
+    uint8_t* MutableData() { return writable_ ? const_cast<uint8_t*>(data_) : nullptr; }
+    std::size_t Size() const { return size_; }
+    bool IsOpen() const { return is_open_; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    std::size_t size_ = 0;
+    bool is_open_ = false;
+    bool writable_ = false;
+#ifdef _WIN32
+    void* file_handle_ = nullptr;
+    void* mapping_handle_ = nullptr;
+#endif
+};
+
+}  // namespace ble
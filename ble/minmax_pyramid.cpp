@@ -0,0 +1,185 @@
+﻿#include "ble/minmax_pyramid.h"
+
+#include <algorithm>
+#include <string>
+
+namespace ble {
+
+std::vector<MinMaxPyramid::Level> MinMaxPyramid::MakeLevels(const MinMaxPyramidOptions& options) {
+    std::vector<Level> levels;
+    const uint64_t window = std::max<uint64_t>(options.window_samples, 1);
+    uint64_t bucket = std::max<std::size_t>(options.base_samples, 1);
+    // 桶宽超过保留窗口的层没有意义，至少保留第 0 层
+    do {
+        levels.push_back({bucket, static_cast<std::size_t>((window + bucket - 1) / bucket + 1)});
+        bucket *= std::max<std::size_t>(options.fanout, 2);
+    } while (bucket <= window);
+    return levels;
+}
+
+MinMaxPyramid::MinMaxPyramid(std::size_t leads, MinMaxPyramidOptions options)
+    : options_(options), levels_(MakeLevels(options)), leads_(leads) {
+    options_.fanout = std::max<std::size_t>(options_.fanout, 2);
+    options_.base_samples = static_cast<std::size_t>(levels_[0].bucket);
+    for (auto& lead : leads_) {
+        lead.buckets.resize(levels_.size());
+        lead.pending.resize(levels_.size());
+    }
+}
+
+void MinMaxPyramid::Append(const int32_t* const* in, std::size_t frames) {
+    const uint64_t base = levels_[0].bucket;
+    std::size_t done = 0;
+    while (done < frames) {
+        // 一次处理到第 0 层的桶边界为止
+        const std::size_t n = static_cast<std::size_t>(std::min<uint64_t>(frames - done, base - samples_ % base));
+        for (std::size_t l = 0; l < leads_.size(); ++l) {
+            MinMax& pending = leads_[l].pending[0];
+            int32_t lo = pending.min;
+            int32_t hi = pending.max;
+            const int32_t* samples = in[l] + done;
+            for (std::size_t i = 0; i < n; ++i) {
+                lo = std::min(lo, samples[i]);
+                hi = std::max(hi, samples[i]);
+            }
+            pending.min = lo;
+            pending.max = hi;
+        }
+        samples_ += n;
+        done += n;
+        if (samples_ % base == 0) {
+            for (auto& lead : leads_) {
+                CompleteBucket(lead, 0, lead.pending[0], samples_ / base);
+                lead.pending[0] = MinMax{};
+            }
+        }
+    }
+}
+
+void MinMaxPyramid::CompleteBucket(LeadLevels& lead, std::size_t level, const MinMax& value, uint64_t completed) {
+    std::vector<MinMax>& ring = lead.buckets[level];
+    if (ring.size() < levels_[level].capacity) {
+        // 按需增长，但不超过本层容量，占用的内存不会因为 vector 的倍增超出上界
+        if (ring.size() == ring.capacity()) {
+            ring.reserve(std::min<std::size_t>(levels_[level].capacity, std::max<std::size_t>(64, ring.size() * 2)));
+        }
+        ring.push_back(value);
+    } else {
+        ring[(completed - 1) % levels_[level].capacity] = value;
+    }
+    if (level + 1 == levels_.size()) {
+        return;
+    }
+    MinMax& parent = lead.pending[level + 1];
+    parent.Add(value);
+    if (completed % options_.fanout == 0) {
+        CompleteBucket(lead, level + 1, parent, completed / options_.fanout);
+        parent = MinMax{};
+    }
+}
+
+uint64_t MinMaxPyramid::FirstSample() const {
+    const uint64_t completed = samples_ / levels_[0].bucket;
+    const uint64_t capacity = levels_[0].capacity;
+    return (completed > capacity ? completed - capacity : 0) * levels_[0].bucket;
+}
+
+std::size_t MinMaxPyramid::Query(std::size_t lead, uint64_t first, uint64_t last, MinMax* out,
+                                 std::size_t columns) const {
+    std::fill(out, out + columns, MinMax{});
+    if (lead >= leads_.size() || columns == 0 || last <= first) {
+        return 0;
+    }
+    // 桶宽不超过每列样本数的最高层
+    const double per_column = static_cast<double>(last - first) / static_cast<double>(columns);
+    std::size_t level = 0;
+    while (level + 1 < levels_.size() && static_cast<double>(levels_[level + 1].bucket) <= per_column) {
+        ++level;
+    }
+    const uint64_t bucket = levels_[level].bucket;
+    const uint64_t capacity = levels_[level].capacity;
+    const uint64_t completed = samples_ / bucket;
+    // 高层的环形缓冲区可能还留着更早的桶，统一从 FirstSample() 之后的第一个完整桶开始
+    const uint64_t oldest = std::max(completed > capacity ? completed - capacity : 0,
+                                     (FirstSample() + bucket - 1) / bucket);
+    const std::vector<MinMax>& ring = leads_[lead].buckets[level];
+
+    // 最后一个不完整的桶：各层 pending 合起来正好覆盖 [completed * bucket, samples_)
+    MinMax tail;
+    for (std::size_t k = 0; k <= level; ++k) {
+        tail.Add(leads_[lead].pending[k]);
+    }
+
+    std::size_t touched = 0;
+    const uint64_t span = last - first;
+    uint64_t begin = first / bucket;
+    for (std::size_t c = 0; c < columns; ++c) {
+        // 列边界向下对齐到桶边界，最后一列的右边界向上取整
+        const uint64_t end = c + 1 == columns ? (last + bucket - 1) / bucket
+                                              : (first + span * (c + 1) / columns) / bucket;
+        const uint64_t from = std::max(begin, oldest);
+        const uint64_t to = std::min(end, completed);
+        for (uint64_t b = from; b < to; ++b) {
+            out[c].Add(ring[b % capacity]);
+            ++touched;
+        }
+        if (begin <= completed && completed < end && !tail.Empty()) {
+            out[c].Add(tail);
+            ++touched;
+        }
+        begin = std::max(begin, end);
+    }
+    return touched;
+}
+
+std::size_t MinMaxPyramid::MemoryBytes() const {
+    std::size_t bytes = 0;
+    for (const auto& lead : leads_) {
+        for (const auto& ring : lead.buckets) {
+            bytes += ring.capacity() * sizeof(MinMax);
+        }
+        bytes += lead.pending.capacity() * sizeof(MinMax);
+    }
+    return bytes;
+}
+
+std::size_t MinMaxPyramid::MemoryBytesFor(std::size_t leads, const MinMaxPyramidOptions& options) {
+    std::size_t bytes = 0;
+    for (const Level& level : MakeLevels(options)) {
+        bytes += (level.capacity + 1) * sizeof(MinMax);
+    }
+    return bytes * leads;
+}
+
+void RenderMinMaxColumns(const MinMax* columns, std::size_t count, std::size_t rows, std::FILE* out) {
+    MinMax range;
+    for (std::size_t c = 0; c < count; ++c) {
+        if (!columns[c].Empty()) {
+            range.Add(columns[c]);
+        }
+    }
+    if (range.Empty() || rows == 0) {
+        return;
+    }
+    const double height = std::max(1.0, static_cast<double>(range.max) - static_cast<double>(range.min));
+    std::string line(count, ' ');
+    for (std::size_t r = 0; r < rows; ++r) {
+        // 第 r 行覆盖的数值范围，第 0 行在最上面
+        const double hi = range.max - height * static_cast<double>(r) / static_cast<double>(rows);
+        const double lo = range.max - height * static_cast<double>(r + 1) / static_cast<double>(rows);
+        for (std::size_t c = 0; c < count; ++c) {
+            const MinMax& column = columns[c];
+            const bool hit = !column.Empty() && column.max >= lo && column.min <= hi;
+            line[c] = hit ? '#' : ' ';
+        }
+        if (r == 0) {
+            std::fprintf(out, "%s %d\n", line.c_str(), range.max);
+        } else if (r + 1 == rows) {
+            std::fprintf(out, "%s %d\n", line.c_str(), range.min);
+        } else {
+            std::fprintf(out, "%s\n", line.c_str());
+        }
+    }
+}
+
+}  // namespace ble
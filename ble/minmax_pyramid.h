@@ -0,0 +1,121 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <vector>
+
+namespace ble {
+
+/**
+ * 一段样本的最小值和最大值；没有样本时 min > max
+ */
+struct MinMax {
+    int32_t min = std::numeric_limits<int32_t>::max();
+    int32_t max = std::numeric_limits<int32_t>::min();
+
+    bool Empty() const { return min > max; }
+
+    void Add(int32_t value) {
+        min = value < min ? value : min;
+        max = value > max ? value : max;
+    }
+
+    void Add(const MinMax& other) {
+        min = other.min < min ? other.min : min;
+        max = other.max > max ? other.max : max;
+    }
+};
+
+struct MinMaxPyramidOptions {
+    std::size_t base_samples = 16;        // 第 0 层每个桶的样本数
+    std::size_t fanout = 4;               // 上一层每个桶合并下一层的桶数，至少 2
+    uint64_t window_samples = 250 * 3600; // 每个导联保留的最近样本数，更早的桶被覆盖
+};
+
+/**
+ * 多分辨率的最小值/最大值金字塔，用来在任意缩放级别下画长时间的波形
+ *
+ * 第 k 层每个桶覆盖 base_samples * fanout^k 个样本，只存这段样本的 min/max；
+ * 样本追加时逐层合并，每个样本的摊还开销是常数。画 columns 列时选桶宽不超过每列样本数的最高层，
+ * 每列只读约 fanout 个桶，与时间范围的长短无关。列边界对齐到所选层的桶边界，
+ * 偏差小于一个桶（也就小于一列），每个样本恰好落在一列里。每列样本数少于 base_samples 时
+ * 最细只到第 0 层，这时应该直接画原始样本。
+ *
+ * 内存有上界：每层是容量为 window_samples / 桶宽 + 1 的环形缓冲区，按实际写入逐渐增长，
+ * 每个导联最多约 window_samples / base_samples * 8 * fanout / (fanout - 1) 字节，
+ * 默认参数下约为保留窗口内原始 int32 样本的 1/6（250Hz 一小时约 600KB）。MemoryBytesFor() 给出精确值。
+ *
+ * 实时使用时随解码追加；回看录制的会话时把解码出的样本按顺序追加即可，window_samples 设为录制长度。
+ * 一个金字塔只应在一个线程上使用，实时显示时读写需要外部加锁。
+ */
+class MinMaxPyramid {
+public:
+    MinMaxPyramid(std::size_t leads, MinMaxPyramidOptions options = {});
+
+    /**
+     * 追加 frames 帧
+     * @param in 各导联样本的起始位置
+     * @param frames
+     */
+    void Append(const int32_t* const* in, std::size_t frames);
+
+    // 已追加的样本数（每个导联）
+    uint64_t Samples() const { return samples_; }
+
+    // 仍然覆盖的最早样本序号
+    uint64_t FirstSample() const;
+
+    /**
+     * 把 [first, last) 分成 columns 列，求每列的 min/max；超出覆盖范围的部分为空
+     * @param lead
+     * @param first
+     * @param last
+     * @param out 至少 columns 个元素
+     * @param columns
+     * @return 读取的桶数，约为 columns * fanout
+     */
+    std::size_t Query(std::size_t lead, uint64_t first, uint64_t last, MinMax* out, std::size_t columns) const;
+
+    std::size_t Leads() const { return leads_.size(); }
+    std::size_t Levels() const { return levels_.size(); }
+    uint64_t BucketSamples(std::size_t level) const { return levels_[level].bucket; }
+    const MinMaxPyramidOptions& Options() const { return options_; }
+
+    // 当前占用的字节数
+    std::size_t MemoryBytes() const;
+
+    // 写满保留窗口后占用的字节数
+    static std::size_t MemoryBytesFor(std::size_t leads, const MinMaxPyramidOptions& options);
+
+private:
+    struct Level {
+        uint64_t bucket;            // 每个桶的样本数
+        std::size_t capacity;       // 环形缓冲区的桶数
+    };
+
+    struct LeadLevels {
+        std::vector<std::vector<MinMax>> buckets;   // [层]，环形，第 i 个完整的桶存在 i % capacity
+        std::vector<MinMax> pending;                // [层]，本层最后一个完整桶之后已合并的部分
+    };
+
+    static std::vector<Level> MakeLevels(const MinMaxPyramidOptions& options);
+    void CompleteBucket(LeadLevels& lead, std::size_t level, const MinMax& value, uint64_t completed);
+
+    MinMaxPyramidOptions options_;
+    std::vector<Level> levels_;
+    std::vector<LeadLevels> leads_;
+    uint64_t samples_ = 0;
+};
+
+/**
+ * 把每列的 min/max 画成 rows 行的字符图，纵轴范围取所有列的最小、最大值
+ * @param columns
+ * @param count
+ * @param rows
+ * @param out
+ */
+void RenderMinMaxColumns(const MinMax* columns, std::size_t count, std::size_t rows, std::FILE* out);
+
+}  // namespace ble
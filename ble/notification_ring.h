@@ -0,0 +1,185 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+namespace ble {
+
+constexpr std::size_t kCacheLineSize = 64;
+
+// ATT_MTU 最大 247，去掉 3 字节 ATT 头后单个通知最多 244 字节
+constexpr std::size_t kMaxNotificationPayload = 244;
+
+/**
+ * 固定大小的通知槽位，回调直接写入，不做任何堆分配
+ */
+struct NotificationSlot {
+    uint64_t timestamp_ns;       // 收到通知时的单调时间戳
+    uint16_t characteristic_id;  // 特性编号（由订阅方分配）
+    uint16_t length;             // 有效载荷长度
+    uint8_t data[kMaxNotificationPayload];
+};
+
+static_assert(sizeof(NotificationSlot) == 256, "NotificationSlot should stay one 256-byte block");
+
+/**
+ * 有界的单生产者/单消费者无锁环形队列
+ *
+ * 生产者（GATT 通知回调）与消费者（打印/解码线程）各自独占一个索引，
+ * 两个索引分别放在独立的缓存行上，避免伪共享。容量必须是 2 的幂，
+ * 所有槽位在构造时一次性分配，之后的入队/出队都不会分配内存。
+ */
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(std::size_t capacity)
+        : mask_(capacity - 1), slots_(new T[capacity]) {
+        // 容量不是 2 的幂时无法用掩码取模
+        if (capacity < 2 || (capacity & (capacity - 1)) != 0) {
+            std::abort();
+        }
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    std::size_t Capacity() const { return mask_ + 1; }
+
+    /**
+     * 生产者侧：申请一个可写槽位，队列已满时返回 nullptr 并计入丢弃
+     * 写完后必须调用 CommitWrite()
+     */
+    T* BeginWrite() {
+        std::size_t head = head_.load(std::memory_order_relaxed);
+        if (head - cached_tail_ > mask_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head - cached_tail_ > mask_) {
+                dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+        }
+        return &slots_[head & mask_];
+    }
+
+    void CommitWrite() {
+        head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool TryPush(const T& value) {
+        T* slot = BeginWrite();
+        if (slot == nullptr) {
+            return false;
+        }
+        *slot = value;
+        CommitWrite();
+        return true;
+    }
+
+    /**
+     * 消费者侧：一次最多取出 max_batch 个元素，对每个元素调用 handler(const T&)
+     * 整批处理完才归还槽位，返回本批元素个数
+     */
+    template <typename Handler>
+    std::size_t PopBatch(Handler&& handler, std::size_t max_batch) {
+        std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if (cached_head_ == tail) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (cached_head_ == tail) {
+                return 0;
+            }
+        }
+        std::size_t count = std::min(cached_head_ - tail, max_batch);
+        for (std::size_t i = 0; i < count; ++i) {
+            handler(static_cast<const T&>(slots_[(tail + i) & mask_]));
+        }
+        tail_.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    // 近似的当前元素个数，仅用于统计
+    std::size_t SizeApprox() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    // 因队列已满而丢弃的元素个数
+    uint64_t Dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    // 生产者独占的缓存行
+    alignas(kCacheLineSize) std::atomic<std::size_t> head_{0};
+    std::size_t cached_tail_ = 0;
+    std::atomic<uint64_t> dropped_{0};
+
+    // 消费者独占的缓存行
+    alignas(kCacheLineSize) std::atomic<std::size_t> tail_{0};
+    std::size_t cached_head_ = 0;
+
+    // 只读成员
+    alignas(kCacheLineSize) const std::size_t mask_;
+    const std::unique_ptr<T[]> slots_;
+};
+
+/**
+ * 在回调里把一条通知写入环形队列，超过 kMaxNotificationPayload 的部分会被截断
+ * @return 队列已满时返回 false
+ */
+inline bool PushNotification(SpscRing<NotificationSlot>& ring, uint64_t timestamp_ns,
+                             uint16_t characteristic_id, const uint8_t* data, std::size_t length) {
+    NotificationSlot* slot = ring.BeginWrite();
+    if (slot == nullptr) {
+        return false;
+    }
+    std::size_t n = std::min(length, kMaxNotificationPayload);
+    slot->timestamp_ns = timestamp_ns;
+    slot->characteristic_id = characteristic_id;
+    slot->length = static_cast<uint16_t>(n);
+    std::memcpy(slot->data, data, n);
+    ring.CommitWrite();
+    return true;
+}
+
+/**
+ * 消费者循环：成批取出数据交给 handler，直到 running 变为 false 且队列已清空
+ *
+ * 队列为空时先自旋，再让出时间片，最后短暂休眠，
+ * 数据连续到达时不会有固定 20ms 的轮询延迟。
+ */
+template <typename T, typename Handler, typename BatchDone>
+void DrainRing(SpscRing<T>& ring, const std::atomic<bool>& running, Handler&& handler,
+               BatchDone&& batch_done, std::size_t max_batch = 64) {
+    unsigned idle_rounds = 0;
+    for (;;) {
+        std::size_t n = ring.PopBatch(handler, max_batch);
+        if (n > 0) {
+            batch_done(n);
+            idle_rounds = 0;
+            continue;
+        }
+        if (!running.load(std::memory_order_acquire)) {
+            // 再检查一次，防止停止前最后写入的数据被遗漏
+            if (ring.SizeApprox() == 0) {
+                return;
+            }
+            continue;
+        }
+        if (idle_rounds < 128) {
+            ++idle_rounds;
+        }
+        if (idle_rounds < 64) {
+            continue;
+        } else if (idle_rounds < 128) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        }
+    }
+}
+
+}  // namespace ble
@@ -0,0 +1,263 @@
+﻿#include "ble/qrs_detector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+
+namespace ble {
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+// 每次交给带通滤波器的帧数
+constexpr std::size_t kBlockFrames = 64;
+
+// Pan–Tompkins 的经验参数
+constexpr double kSearchbackRr = 1.66;     // 超过平均 RR 的这个倍数没有心搏就回溯
+constexpr double kTWaveMs = 360.0;         // 上一拍之后这段时间内的峰要检查是不是 T 波
+
+// 定位 R 波那一路的通带
+constexpr double kShapeHighPassHz = 0.5;
+constexpr double kShapeLowPassHz = 25.0;
+
+uint64_t MsToSamples(double ms, double sample_rate_hz) {
+    return static_cast<uint64_t>(std::llround(ms * sample_rate_hz / 1000.0));
+}
+
+std::complex<double> Response(const std::vector<BiquadCoefficients>& sections, double w) {
+    const std::complex<double> z1 = std::polar(1.0, -w);
+    const std::complex<double> z2 = z1 * z1;
+    std::complex<double> h = 1.0;
+    for (const auto& c : sections) {
+        h *= (c.b0 + c.b1 * z1 + c.b2 * z2) / (1.0 + c.a1 * z1 + c.a2 * z2);
+    }
+    return h;
+}
+
+/**
+ * 级联在 frequency_hz 处的群延迟（样本），用相位的中心差分估计
+ */
+double GroupDelaySamples(const std::vector<BiquadCoefficients>& sections, double sample_rate_hz,
+                         double frequency_hz) {
+    const double w = 2.0 * kPi * frequency_hz / sample_rate_hz;
+    const double dw = 1e-4;
+    return -std::arg(Response(sections, w + dw) / Response(sections, w - dw)) / (2.0 * dw);
+}
+
+std::vector<BiquadCoefficients> BandpassSections(const QrsDetectorOptions& options) {
+    return {DesignHighPass(options.sample_rate_hz, options.bandpass_low_hz),
+            DesignLowPass(options.sample_rate_hz, options.bandpass_high_hz)};
+}
+
+std::vector<BiquadCoefficients> ShapeSections(const QrsDetectorOptions& options) {
+    return {DesignHighPass(options.sample_rate_hz, kShapeHighPassHz),
+            DesignLowPass(options.sample_rate_hz, kShapeLowPassHz)};
+}
+
+}  // namespace
+
+QrsDetector::QrsDetector(std::size_t leads, QrsDetectorOptions options)
+    : leads_(leads),
+      options_(options),
+      bandpass_(leads, BandpassSections(options)),
+      shape_(leads, ShapeSections(options)),
+      band_(leads, std::vector<float>(kBlockFrames)),
+      shaped_(leads, std::vector<float>(kBlockFrames)),
+      block_in_(leads),
+      block_band_(leads),
+      block_shaped_(leads),
+      history_(leads, std::array<float, 4>{}) {
+    const double fs = options_.sample_rate_hz;
+    window_ = std::max<std::size_t>(1, MsToSamples(options_.integration_ms, fs));
+    energy_.assign(window_, 0.0);
+    refractory_ = MsToSamples(options_.refractory_ms, fs);
+    t_wave_ = MsToSamples(kTWaveMs, fs);
+    decision_ = std::max<uint64_t>(1, MsToSamples(options_.decision_ms, fs));
+    learning_ = MsToSamples(options_.learning_ms, fs);
+    const double center_hz = std::sqrt(options_.bandpass_low_hz * options_.bandpass_high_hz);
+    group_delay_ = static_cast<uint64_t>(
+            std::max(0.0, std::round(GroupDelaySamples(ShapeSections(options_), fs, center_hz))));
+
+    // 积分峰值最早出现在 QRS 能量结束时，带通又有几十毫秒的延迟，所以回看 1.5 个窗口；
+    // 判定最多晚于峰值 decision_ 个样本
+    search_ = window_ + window_ / 2;
+    std::size_t ring = 16;
+    while (ring < search_ + decision_ + 2) {
+        ring *= 2;
+    }
+    amplitude_.assign(ring, 0.0f);
+    amplitude_mask_ = ring - 1;
+}
+
+uint64_t QrsDetector::MaxLatencySamples() const {
+    // 积分峰值最晚在 R 波之后一个回看范围内，之后最多再等 decision_
+    return search_ + decision_;
+}
+
+void QrsDetector::Reset() {
+    *this = QrsDetector(leads_, options_);
+}
+
+std::size_t QrsDetector::Process(const int32_t* const* in, std::size_t frames, std::vector<HeartBeat>& beats) {
+    const std::size_t before = beats.size();
+    for (std::size_t offset = 0; offset < frames; offset += kBlockFrames) {
+        const std::size_t n = std::min(kBlockFrames, frames - offset);
+        for (std::size_t l = 0; l < leads_; ++l) {
+            block_in_[l] = in[l] + offset;
+            block_band_[l] = band_[l].data();
+            block_shaped_[l] = shaped_[l].data();
+        }
+        bandpass_.Process(block_in_.data(), block_band_.data(), n);
+        shape_.Process(block_in_.data(), block_shaped_.data(), n);
+        for (std::size_t f = 0; f < n; ++f) {
+            ProcessFrame(f, beats);
+        }
+    }
+    return beats.size() - before;
+}
+
+void QrsDetector::ProcessFrame(std::size_t frame, std::vector<HeartBeat>& beats) {
+    const uint64_t n = sample_++;
+
+    // 五点差分 (2x[n] + x[n-1] - x[n-3] - 2x[n-4]) / 8，平方后跨导联求和
+    double energy = 0.0;
+    float amplitude = 0.0f;
+    for (std::size_t l = 0; l < leads_; ++l) {
+        const float x = band_[l][frame];
+        auto& h = history_[l];
+        const double slope = (2.0 * x + h[0] - h[2] - 2.0 * h[3]) / 8.0;
+        energy += slope * slope;
+        amplitude += std::fabs(shaped_[l][frame]);
+        h[3] = h[2];
+        h[2] = h[1];
+        h[1] = h[0];
+        h[0] = x;
+    }
+    amplitude_[n & amplitude_mask_] = amplitude;
+
+    // 滑动窗积分，浮点误差可能让和略小于 0
+    energy_sum_ += energy - energy_[energy_index_];
+    energy_[energy_index_] = energy;
+    energy_index_ = energy_index_ + 1 == window_ ? 0 : energy_index_ + 1;
+    const double integral = std::max(0.0, energy_sum_) / static_cast<double>(window_);
+
+    // 学习阶段：按最大值和均值初始化 SPKI、NPKI
+    if (n < learning_) {
+        learning_max_ = std::max(learning_max_, integral);
+        learning_sum_ += integral;
+        if (n + 1 == learning_) {
+            signal_level_ = learning_max_ / 3.0;
+            noise_level_ = learning_sum_ / static_cast<double>(learning_) / 2.0;
+            threshold_ = noise_level_ + 0.25 * (signal_level_ - noise_level_);
+        }
+    }
+
+    // 太久没有心搏时回溯：取上一拍之后最高的候选峰，没有候选就降低阈值再等
+    if (has_beat_ && rr_count_ > 0) {
+        const double rr_samples = rr_sum_ / static_cast<double>(rr_count_) * options_.sample_rate_hz;
+        if (static_cast<double>(n - last_search_) > kSearchbackRr * rr_samples) {
+            if (has_candidate_) {
+                AcceptBeat(candidate_, true, beats);
+            } else {
+                signal_level_ *= 0.5;
+                threshold_ = noise_level_ + 0.25 * (signal_level_ - noise_level_);
+                last_search_ = n;
+            }
+        }
+    }
+
+    // 积分信号的鼓包：上升时开始，回落到峰值一半以下或等待超时时结束
+    if (!in_peak_) {
+        if (integral > previous_integral_) {
+            in_peak_ = true;
+            rising_ = Peak{integral, energy, n, 0};
+        }
+    } else {
+        if (integral > rising_.value) {
+            rising_.value = integral;
+            rising_.sample = n;
+        }
+        rising_.slope = std::max(rising_.slope, energy);
+        if (integral < 0.5 * rising_.value || n - rising_.sample >= decision_) {
+            in_peak_ = false;
+            ClassifyPeak(rising_, beats);
+        }
+    }
+    previous_integral_ = integral;
+}
+
+void QrsDetector::ClassifyPeak(const Peak& peak, std::vector<HeartBeat>& beats) {
+    if (peak.sample < learning_) {
+        return;
+    }
+    if (has_beat_ && peak.sample - last_beat_peak_ < refractory_) {
+        return;
+    }
+    // 紧跟在 QRS 后、斜率不到上一拍一半的峰是 T 波（斜率是平方值，所以比较 1/4）
+    const bool t_wave = has_beat_ && peak.sample - last_beat_peak_ < t_wave_ && peak.slope < 0.25 * last_beat_slope_;
+    if (!t_wave && peak.value > threshold_) {
+        Peak located = peak;
+        located.r = LocateR(peak.sample);
+        AcceptBeat(located, false, beats);
+        return;
+    }
+    noise_level_ = 0.125 * peak.value + 0.875 * noise_level_;
+    threshold_ = noise_level_ + 0.25 * (signal_level_ - noise_level_);
+    if (!t_wave && peak.value > 0.5 * threshold_ && (!has_candidate_ || peak.value > candidate_.value)) {
+        // 等到回溯时积分窗早已移出环形缓冲区，所以现在就定位 R 波
+        candidate_ = peak;
+        candidate_.r = LocateR(peak.sample);
+        has_candidate_ = true;
+    }
+}
+
+void QrsDetector::AcceptBeat(const Peak& peak, bool searchback, std::vector<HeartBeat>& beats) {
+    // 回溯到的峰更可能偏低，更新得快一些
+    const double weight = searchback ? 0.25 : 0.125;
+    signal_level_ = weight * peak.value + (1.0 - weight) * signal_level_;
+    threshold_ = noise_level_ + 0.25 * (signal_level_ - noise_level_);
+
+    HeartBeat beat;
+    beat.sample = peak.r;
+    beat.detected_sample = sample_ - 1;
+    beat.searchback = searchback;
+    if (has_beat_ && peak.r > last_beat_r_) {
+        beat.rr_s = static_cast<double>(peak.r - last_beat_r_) / options_.sample_rate_hz;
+        if (rr_count_ == kHeartRateAverageBeats) {
+            rr_sum_ -= rr_[rr_index_];
+        } else {
+            ++rr_count_;
+        }
+        rr_[rr_index_] = beat.rr_s;
+        rr_sum_ += beat.rr_s;
+        rr_index_ = (rr_index_ + 1) % kHeartRateAverageBeats;
+        beat.instantaneous_bpm = 60.0 / beat.rr_s;
+        average_bpm_ = 60.0 * static_cast<double>(rr_count_) / rr_sum_;
+    }
+    beat.average_bpm = average_bpm_;
+    beats.push_back(beat);
+
+    has_beat_ = true;
+    has_candidate_ = false;
+    last_beat_peak_ = peak.sample;
+    last_search_ = peak.sample;
+    last_beat_r_ = peak.r;
+    last_beat_slope_ = peak.slope;
+}
+
+uint64_t QrsDetector::LocateR(uint64_t peak_sample) const {
+    const uint64_t first = peak_sample + 1 >= search_ ? peak_sample + 1 - search_ : 0;
+    uint64_t best = peak_sample;
+    float best_amplitude = -1.0f;
+    for (uint64_t i = first; i <= peak_sample; ++i) {
+        const float amplitude = amplitude_[i & amplitude_mask_];
+        if (amplitude > best_amplitude) {
+            best_amplitude = amplitude;
+            best = i;
+        }
+    }
+    return best >= group_delay_ ? best - group_delay_ : 0;
+}
+
+}  // namespace ble
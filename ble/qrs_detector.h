@@ -0,0 +1,143 @@
+﻿#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ble/ecg_filter.h"
+
+namespace ble {
+
+struct QrsDetectorOptions {
+    double sample_rate_hz = 250.0;
+    double bandpass_low_hz = 5.0;     // QRS 的能量主要在 5~15Hz
+    double bandpass_high_hz = 15.0;
+    double integration_ms = 150.0;    // 滑动窗积分的宽度，约等于最宽的 QRS
+    double refractory_ms = 200.0;     // 不应期内不会出现第二个 QRS
+    double decision_ms = 200.0;       // 积分峰值之后最多再等这么久就做出判定
+    double learning_ms = 2000.0;      // 开头这段时间只用来初始化阈值，不输出心搏
+};
+
+/**
+ * 一次检出的心搏
+ */
+struct HeartBeat {
+    uint64_t sample = 0;             // R 波顶点的样本序号（从第一次 Process 起算）
+    uint64_t detected_sample = 0;    // 做出判定时已处理到的样本序号，与 sample 的差就是检测延迟
+    double rr_s = 0.0;               // 与上一拍的间期，第一拍为 0
+    double instantaneous_bpm = 0.0;  // 60 / rr_s
+    double average_bpm = 0.0;        // 最近 kHeartRateAverageBeats 个 RR 间期的平均心率
+    bool searchback = false;         // 漏检后回溯补上的心搏，延迟会超过 MaxLatencySamples()
+};
+
+// 平均心率使用的 RR 间期个数
+constexpr std::size_t kHeartRateAverageBeats = 8;
+
+/**
+ * 增量式 Pan–Tompkins QRS 检测器
+ *
+ * 各导联先经过 5~15Hz 带通（EcgFilter），再做五点差分、平方后跨导联求和，
+ * 最后经过 150ms 滑动窗积分。积分信号每个鼓包的峰值与自适应阈值比较，
+ * 区分 QRS 和噪声，并用斜率排除紧跟在 QRS 后的 T 波；
+ * 超过 1.66 倍平均 RR 没有检出时，用较低的阈值回溯补上最高的候选峰；
+ * 连候选峰都没有（例如信号幅度突然变小）时把信号电平减半，阈值随之下降。
+ * 带通后的 QRS 是双相的，最大值可能落在 R 波后面的负瓣上，所以 R 波位置另用一路
+ * 只去基线和高频（0.5~25Hz）、基本保持波形的信号来找：在积分峰值之前约 1.5 个积分窗内
+ * 取各导联绝对值之和的最大处，再扣除这一路的群延迟。
+ *
+ * 每个样本的处理都是常数时间（定位 R 波时扫描一个积分窗，每拍只做一次），
+ * 数据可以按任意大小分块送入，结果与整块处理相同。一个检测器只应在一个线程上使用。
+ */
+class QrsDetector {
+public:
+    QrsDetector(std::size_t leads, QrsDetectorOptions options = {});
+
+    /**
+     * 处理 frames 帧，检出的心搏追加到 beats 末尾
+     * @param in 各导联输入的起始位置
+     * @param frames
+     * @param beats
+     * @return 本次检出的心搏数
+     */
+    std::size_t Process(const int32_t* const* in, std::size_t frames, std::vector<HeartBeat>& beats);
+
+    // 清空所有状态，重新进入学习阶段
+    void Reset();
+
+    // 已处理的样本数
+    uint64_t SampleIndex() const { return sample_; }
+
+    // 最近一拍的平均心率，还没有 RR 间期时为 0
+    double HeartRateBpm() const { return average_bpm_; }
+
+    // 非回溯心搏从 R 波到被判定的最大延迟（样本数）
+    uint64_t MaxLatencySamples() const;
+
+    std::size_t Leads() const { return leads_; }
+    const QrsDetectorOptions& Options() const { return options_; }
+
+private:
+    // 积分信号的一个鼓包
+    struct Peak {
+        double value = 0.0;       // 积分信号的峰值
+        double slope = 0.0;       // 鼓包内的最大平方斜率
+        uint64_t sample = 0;      // 峰值的样本序号
+        uint64_t r = 0;           // 定位出的 R 波样本序号
+    };
+
+    void ProcessFrame(std::size_t frame, std::vector<HeartBeat>& beats);
+    void ClassifyPeak(const Peak& peak, std::vector<HeartBeat>& beats);
+    void AcceptBeat(const Peak& peak, bool searchback, std::vector<HeartBeat>& beats);
+    uint64_t LocateR(uint64_t peak_sample) const;
+
+    std::size_t leads_;
+    QrsDetectorOptions options_;
+    EcgFilter bandpass_;
+    EcgFilter shape_;                             // 定位 R 波用的 0.5~25Hz 滤波
+    std::vector<std::vector<float>> band_;        // 带通输出的分块缓冲区
+    std::vector<std::vector<float>> shaped_;      // shape_ 输出的分块缓冲区
+    std::vector<const int32_t*> block_in_;
+    std::vector<float*> block_band_;
+    std::vector<float*> block_shaped_;
+    std::vector<std::array<float, 4>> history_;   // 各导联最近 4 个带通值，用于五点差分
+
+    std::size_t window_;                          // 积分窗长度（样本）
+    std::vector<double> energy_;                  // 积分窗内的平方斜率，环形
+    std::size_t energy_index_ = 0;
+    double energy_sum_ = 0.0;
+    std::vector<float> amplitude_;                // shape_ 输出的绝对值之和，环形，长度为 2 的幂
+    std::size_t amplitude_mask_;
+    uint64_t search_;                             // 定位 R 波时回看的样本数
+    uint64_t group_delay_;                        // shape_ 在 QRS 主频附近的群延迟（样本）
+    uint64_t refractory_;
+    uint64_t t_wave_;                             // 这个间隔内斜率过小的峰视为 T 波
+    uint64_t decision_;
+    uint64_t learning_;
+
+    uint64_t sample_ = 0;
+    double previous_integral_ = 0.0;
+    Peak rising_;                                 // 当前鼓包目前为止的最高点
+    bool in_peak_ = false;
+    double learning_max_ = 0.0;
+    double learning_sum_ = 0.0;
+
+    double signal_level_ = 0.0;                   // SPKI
+    double noise_level_ = 0.0;                    // NPKI
+    double threshold_ = 0.0;                      // THRESHOLD I1，回溯用它的一半
+    Peak candidate_;                              // 上一拍之后最高的回溯候选
+    bool has_candidate_ = false;
+
+    bool has_beat_ = false;
+    uint64_t last_beat_peak_ = 0;                 // 上一拍积分峰值的样本序号
+    uint64_t last_search_ = 0;                    // 上一拍或上一次回溯的样本序号，回溯超时从这里算起
+    uint64_t last_beat_r_ = 0;
+    double last_beat_slope_ = 0.0;
+    std::array<double, kHeartRateAverageBeats> rr_{};  // 最近的 RR 间期（秒），环形
+    std::size_t rr_index_ = 0;
+    std::size_t rr_count_ = 0;
+    double rr_sum_ = 0.0;
+    double average_bpm_ = 0.0;
+};
+
+}  // namespace ble
@@ -0,0 +1,320 @@
+﻿#include "ble/recording_ring.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include "ble/clock.h"
+#include "ble/cpu_features.h"
+
+#if BLE_X86
+#include <immintrin.h>
+#endif
+
+namespace ble {
+
+namespace {
+
+// CRC-32C（Castagnoli）：支持 SSE4.2 的 CPU 用 crc32 指令，否则按字节查表
+constexpr std::array<uint32_t, 256> MakeCrcTable() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1)));
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+constexpr std::array<uint32_t, 256> kCrcTable = MakeCrcTable();
+
+uint32_t Crc32cScalar(uint32_t crc, const uint8_t* data, std::size_t length) {
+    for (std::size_t i = 0; i < length; ++i) {
+        crc = kCrcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if BLE_X86
+BLE_TARGET("sse4.2")
+uint32_t Crc32cSse42(uint32_t crc, const uint8_t* data, std::size_t length) {
+#if defined(__x86_64__) || defined(_M_X64)
+    uint64_t crc64 = crc;
+    for (; length >= 8; data += 8, length -= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = static_cast<uint32_t>(crc64);
+#endif
+    for (; length > 0; ++data, --length) {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+    return crc;
+}
+#endif
+
+uint32_t Crc32c(uint32_t crc, const uint8_t* data, std::size_t length) {
+    crc = ~crc;
+#if BLE_X86
+    static const bool sse42 = CpuHasSse42();
+    if (sse42) {
+        return ~Crc32cSse42(crc, data, length);
+    }
+#endif
+    return ~Crc32cScalar(crc, data, length);
+}
+
+uint32_t RecordCrc(const RingRecordHeader& header, const uint8_t* payload) {
+    RingRecordHeader copy = header;
+    copy.crc = 0;
+    uint32_t crc = Crc32c(0, reinterpret_cast<const uint8_t*>(&copy), sizeof(copy));
+    return Crc32c(crc, payload, header.length);
+}
+
+// 64 位混合函数（splitmix64 的最后一步）
+inline uint64_t Mix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// 文件头每条记录都要更新，校验只混合会变的几个字段和尺寸，几纳秒就能算完
+uint64_t HeaderChecksum(const RecordingRingHeader& header) {
+    uint64_t h = Mix(header.blocks ^ (static_cast<uint64_t>(header.block_bytes) << 32));
+    h = Mix(h ^ header.generation);
+    h = Mix(h ^ header.write_offset);
+    return Mix(h ^ header.next_sequence);
+}
+
+}  // namespace
+
+bool RecordingRing::Open(const std::string& path, RecordingRingOptions options) {
+    Close();
+    block_bytes_ = std::max<std::size_t>(options.block_bytes & ~static_cast<std::size_t>(7), 256);
+    blocks_ = std::max<std::size_t>(options.blocks, 2);
+    if (!file_.OpenReadWrite(path, kRingHeaderBytes + block_bytes_ * blocks_)) {
+        return false;
+    }
+    header_ = reinterpret_cast<RecordingRingHeader*>(file_.MutableData());
+    data_ = file_.MutableData() + kRingHeaderBytes;
+    recovery_ = RingRecovery{};
+    appended_ = 0;
+    bytes_ = 0;
+    rejected_ = 0;
+    syncs_ = 0;
+    last_sync_ns_ = 0;
+    max_sync_ns_ = 0;
+
+    recovery_.existing = std::memcmp(header_->magic, kRingMagic, sizeof(kRingMagic)) == 0 &&
+                         header_->version == kRingVersion && header_->header_size == kRingHeaderBytes &&
+                         header_->block_bytes == block_bytes_ && header_->blocks == blocks_;
+    if (recovery_.existing) {
+        Recover();
+    } else {
+        Initialize();
+    }
+    return true;
+}
+
+void RecordingRing::Initialize() {
+    // 清掉旧内容，避免尺寸不同的旧文件里的数据被当成记录
+    std::memset(data_, 0, block_bytes_ * blocks_);
+    RecordingRingHeader header{};
+    std::memcpy(header.magic, kRingMagic, sizeof(header.magic));
+    header.version = kRingVersion;
+    header.header_size = static_cast<uint16_t>(kRingHeaderBytes);
+    header.block_bytes = static_cast<uint32_t>(block_bytes_);
+    header.blocks = blocks_;
+    *header_ = header;
+    write_offset_ = 0;
+    next_sequence_ = 1;
+    generation_ = 0;
+    PublishHeader();
+}
+
+void RecordingRing::Recover() {
+    const RecordingRingHeader header = *header_;
+    RingRecord record;
+    recovery_.header_valid = header.checksum == HeaderChecksum(header) &&
+                             header.write_offset < block_bytes_ * blocks_ && header.next_sequence > 0;
+    if (recovery_.header_valid) {
+        write_offset_ = static_cast<std::size_t>(header.write_offset);
+        next_sequence_ = header.next_sequence;
+        generation_ = header.generation;
+    } else {
+        // 文件头写到一半：找开头记录序号最大的块，从它的开头往后走
+        uint64_t best = 0;
+        std::size_t best_block = 0;
+        for (std::size_t block = 0; block < blocks_; ++block) {
+            if (ReadRecord(block * block_bytes_, best + 1, ~0ull, record)) {
+                best = record.sequence;
+                best_block = block;
+            }
+        }
+        write_offset_ = best_block * block_bytes_;
+        next_sequence_ = best > 0 ? best : 1;
+        generation_ = header.generation;
+    }
+
+    // 文件头只在每条记录提交之后更新，被杀掉时可能落后一条；断电时落后得更多。
+    // 从文件头的位置往后把已经写完的记录补上：下一条要么紧接着，要么在下一块开头
+    for (;;) {
+        const uint64_t sequence = next_sequence_.load(std::memory_order_relaxed);
+        std::size_t offset = write_offset_;
+        if (!ReadRecord(offset, sequence, sequence + 1, record)) {
+            offset = (write_offset_ / block_bytes_ + 1) % blocks_ * block_bytes_;
+            if (!ReadRecord(offset, sequence, sequence + 1, record)) {
+                break;
+            }
+            if (offset == 0) {
+                generation_ = generation_.load(std::memory_order_relaxed) + 1;
+            }
+        }
+        Advance(offset, RingRecordSize(record.length));
+        next_sequence_ = sequence + 1;
+        if (recovery_.header_valid) {
+            ++recovery_.rolled_forward;
+        }
+    }
+    PublishHeader();
+
+    ForEach([this](const RingRecord& r) {
+        if (recovery_.first_sequence == 0) {
+            recovery_.first_sequence = r.sequence;
+        }
+        recovery_.last_sequence = r.sequence;
+    });
+}
+
+bool RecordingRing::ReadRecord(std::size_t offset, uint64_t min_sequence, uint64_t max_sequence,
+                               RingRecord& record) const {
+    const std::size_t block_end = (offset / block_bytes_ + 1) * block_bytes_;
+    if (offset + sizeof(RingRecordHeader) > block_end) {
+        return false;
+    }
+    RingRecordHeader header;
+    std::memcpy(&header, data_ + offset, sizeof(header));
+    if (header.sequence < min_sequence || header.sequence >= max_sequence ||
+        offset + RingRecordSize(header.length) > block_end) {
+        return false;
+    }
+    const uint8_t* payload = data_ + offset + sizeof(RingRecordHeader);
+    if (RecordCrc(header, payload) != header.crc) {
+        return false;
+    }
+    record.sequence = header.sequence;
+    record.timestamp_ns = header.timestamp_ns;
+    record.characteristic_id = header.characteristic_id;
+    record.length = header.length;
+    record.data = payload;
+    return true;
+}
+
+uint8_t* RecordingRing::Reserve(uint16_t length) {
+    const std::size_t size = RingRecordSize(length);
+    if (header_ == nullptr || size > block_bytes_) {
+        ++rejected_;
+        return nullptr;
+    }
+    if (write_offset_ % block_bytes_ + size > block_bytes_) {
+        // 本块放不下，跳到下一块开头，覆盖最旧的一块
+        write_offset_ = (write_offset_ / block_bytes_ + 1) % blocks_ * block_bytes_;
+        if (write_offset_ == 0) {
+            generation_ = generation_.load(std::memory_order_relaxed) + 1;
+        }
+    }
+    reserved_offset_ = write_offset_;
+    reserved_length_ = length;
+    return data_ + write_offset_ + sizeof(RingRecordHeader);
+}
+
+void RecordingRing::Commit(uint64_t timestamp_ns, uint16_t characteristic_id) {
+    RingRecordHeader header{};
+    header.sequence = next_sequence_.load(std::memory_order_relaxed);
+    header.timestamp_ns = timestamp_ns;
+    header.characteristic_id = characteristic_id;
+    header.length = reserved_length_;
+    uint8_t* out = data_ + reserved_offset_;
+    const std::size_t size = RingRecordSize(reserved_length_);
+    // 对齐填充写 0，文件内容是确定的
+    std::memset(out + sizeof(RingRecordHeader) + reserved_length_, 0,
+                size - sizeof(RingRecordHeader) - reserved_length_);
+    header.crc = RecordCrc(header, out + sizeof(RingRecordHeader));
+    std::memcpy(out, &header, sizeof(header));
+
+    Advance(reserved_offset_, size);
+    next_sequence_ = header.sequence + 1;
+    PublishHeader();
+    appended_.store(appended_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    bytes_.store(bytes_.load(std::memory_order_relaxed) + size, std::memory_order_relaxed);
+}
+
+bool RecordingRing::Append(uint64_t timestamp_ns, uint16_t characteristic_id, const uint8_t* data, uint16_t length) {
+    uint8_t* payload = Reserve(length);
+    if (payload == nullptr) {
+        return false;
+    }
+    std::memcpy(payload, data, length);
+    Commit(timestamp_ns, characteristic_id);
+    return true;
+}
+
+void RecordingRing::Advance(std::size_t offset, std::size_t size) {
+    write_offset_ = offset + size;
+    if (write_offset_ == block_bytes_ * blocks_) {
+        write_offset_ = 0;
+        generation_ = generation_.load(std::memory_order_relaxed) + 1;
+    }
+}
+
+void RecordingRing::PublishHeader() {
+    RecordingRingHeader header = *header_;
+    header.generation = generation_.load(std::memory_order_relaxed);
+    header.write_offset = write_offset_;
+    header.next_sequence = next_sequence_.load(std::memory_order_relaxed);
+    header.checksum = HeaderChecksum(header);
+    *header_ = header;
+}
+
+bool RecordingRing::Sync() {
+    if (header_ == nullptr) {
+        return false;
+    }
+    const uint64_t start = MonotonicNowNs();
+    const bool ok = file_.Sync(0, file_.Size());
+    const uint64_t elapsed = MonotonicNowNs() - start;
+    syncs_.fetch_add(1, std::memory_order_relaxed);
+    last_sync_ns_.store(elapsed, std::memory_order_relaxed);
+    if (elapsed > max_sync_ns_.load(std::memory_order_relaxed)) {
+        max_sync_ns_.store(elapsed, std::memory_order_relaxed);
+    }
+    return ok;
+}
+
+void RecordingRing::Close() {
+    if (header_ == nullptr) {
+        return;
+    }
+    Sync();
+    file_.Close();
+    header_ = nullptr;
+    data_ = nullptr;
+}
+
+RecordingRingStats RecordingRing::Stats() const {
+    RecordingRingStats stats;
+    stats.appended = appended_.load(std::memory_order_relaxed);
+    stats.bytes = bytes_.load(std::memory_order_relaxed);
+    stats.rejected = rejected_.load(std::memory_order_relaxed);
+    stats.generation = generation_.load(std::memory_order_relaxed);
+    stats.next_sequence = next_sequence_.load(std::memory_order_relaxed);
+    stats.syncs = syncs_.load(std::memory_order_relaxed);
+    stats.last_sync_ns = last_sync_ns_.load(std::memory_order_relaxed);
+    stats.max_sync_ns = max_sync_ns_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+}  // namespace ble
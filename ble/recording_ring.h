@@ -0,0 +1,211 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "ble/mapped_file.h"
+
+namespace ble {
+
+/*
+ * 循环录制文件格式（小端序，大小固定）
+ *
+ *   RecordingRingHeader        占满第一个 4KB 页
+ *   数据区：blocks 个 block_bytes 字节的块
+ *
+ * 记录（RingRecordHeader + 载荷，按 8 字节对齐）不跨块；块里放不下下一条记录时，写指针跳到下一块开头，
+ * 最后一块之后回到第一块，覆盖最旧的一块。所以写指针所在块的下一块就是最旧的数据。
+ * 每条记录带有连续递增的序号和 CRC-32C，进程在写入途中被杀掉时只会丢失正在写的那一条；
+ * 读取时序号不递增或 CRC 不对的记录（未写完的或上一轮留下的旧数据）都会被跳过。
+ */
+
+constexpr char kRingMagic[8] = {'B', 'L', 'E', 'R', 'I', 'N', 'G', '\0'};
+constexpr uint16_t kRingVersion = 1;
+constexpr std::size_t kRingHeaderBytes = 4096;
+
+struct RecordingRingHeader {
+    char magic[8];
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t block_bytes;
+    uint64_t blocks;
+    uint64_t generation;       // 写指针回到第一块的次数
+    uint64_t write_offset;     // 数据区内下一条记录的位置
+    uint64_t next_sequence;    // 下一条记录的序号，从 1 开始
+    uint64_t reserved;
+    uint64_t checksum;         // 前面各字段的校验，写到一半被杀掉时对不上
+};
+
+struct RingRecordHeader {
+    uint64_t sequence;         // 0 表示没有写过
+    uint64_t timestamp_ns;
+    uint16_t characteristic_id;
+    uint16_t length;
+    uint32_t crc;              // 本头部（crc 字段按 0 计）和载荷的 CRC-32C
+};
+
+static_assert(sizeof(RecordingRingHeader) == 64, "unexpected ring header size");
+static_assert(sizeof(RingRecordHeader) == 24, "unexpected ring record size");
+
+constexpr std::size_t RingRecordSize(std::size_t payload_length) {
+    return (sizeof(RingRecordHeader) + payload_length + 7) & ~static_cast<std::size_t>(7);
+}
+
+struct RecordingRingOptions {
+    std::size_t block_bytes = 64 * 1024;   // 8 的倍数，至少 256；比一块还长的记录会被拒绝
+    std::size_t blocks = 1024;             // 至少 2
+};
+
+/**
+ * 打开已有文件时的恢复结果
+ */
+struct RingRecovery {
+    bool existing = false;          // 文件原本就是同样尺寸的循环录制文件
+    bool header_valid = false;      // 文件头校验通过；否则是逐块扫描找到的写入位置
+    uint64_t rolled_forward = 0;    // 文件头之后、崩溃之前已经写完的记录数（文件头还没来得及更新）
+    uint64_t first_sequence = 0;    // 文件里最旧和最新的有效记录序号，没有记录时都为 0
+    uint64_t last_sequence = 0;
+};
+
+struct RecordingRingStats {
+    uint64_t appended = 0;          // 本次打开以来写入的记录数
+    uint64_t bytes = 0;
+    uint64_t rejected = 0;          // 比一块还长、无法写入的记录数
+    uint64_t generation = 0;
+    uint64_t next_sequence = 0;
+    uint64_t syncs = 0;
+    uint64_t last_sync_ns = 0;
+    uint64_t max_sync_ns = 0;
+};
+
+/**
+ * 一条记录，data 直接指向映射内存
+ */
+struct RingRecord {
+    uint64_t sequence;
+    uint64_t timestamp_ns;
+    uint16_t characteristic_id;
+    uint16_t length;
+    const uint8_t* data;
+};
+
+/**
+ * 固定大小的内存映射循环录制文件
+ *
+ * 写入就是把数据复制进映射内存（Reserve() 直接给出文件里的位置，没有中间缓冲区），
+ * 不做系统调用；进程被杀掉后内核照样会把这些页写回文件。Sync() 把修改写到磁盘，
+ * 防止断电丢失，由别的线程定期调用，写入线程不等待磁盘。
+ * 重新打开时从文件头记录的位置继续，并把文件头之后已经写完的记录补上。
+ * 写入只能在一个线程上进行（多个线程写入需要外部加锁）。
+ */
+class RecordingRing {
+public:
+    RecordingRing() = default;
+    ~RecordingRing() { Close(); }
+
+    RecordingRing(const RecordingRing&) = delete;
+    RecordingRing& operator=(const RecordingRing&) = delete;
+
+    /**
+     * 打开或创建录制文件，尺寸不同的旧文件会被清空重建
+     * @param path
+     * @param options
+     */
+    bool Open(const std::string& path, RecordingRingOptions options = {});
+
+    // 同步到磁盘后关闭
+    void Close();
+
+    bool IsOpen() const { return header_ != nullptr; }
+
+    /**
+     * 预留一条记录，返回载荷在映射内存里的位置；Commit() 之前这条记录不可见
+     * @param length
+     * @return 记录比一块还长时返回 nullptr
+     */
+    uint8_t* Reserve(uint16_t length);
+
+    /**
+     * 写完载荷后提交，填写记录头和校验并更新文件头
+     * @param timestamp_ns
+     * @param characteristic_id
+     */
+    void Commit(uint64_t timestamp_ns, uint16_t characteristic_id);
+
+    // Reserve + 复制 + Commit
+    bool Append(uint64_t timestamp_ns, uint16_t characteristic_id, const uint8_t* data, uint16_t length);
+
+    /**
+     * 把修改过的页写到磁盘，可以在其他线程上调用
+     * @return 失败时返回 false
+     */
+    bool Sync();
+
+    /**
+     * 从最旧到最新遍历有效记录，fn(const RingRecord&)，返回记录数；不能与写入同时进行
+     * @param fn
+     */
+    template <typename Fn>
+    std::size_t ForEach(Fn&& fn) const {
+        std::size_t count = 0;
+        uint64_t expected = 1;
+        const std::size_t start = (write_offset_ / block_bytes_ + 1) % blocks_;
+        for (std::size_t i = 0; i < blocks_; ++i) {
+            const std::size_t block = (start + i) % blocks_;
+            std::size_t offset = block * block_bytes_;
+            const std::size_t end = block == write_offset_ / block_bytes_ ? write_offset_ : offset + block_bytes_;
+            RingRecord record;
+            while (offset < end && ReadRecord(offset, expected, next_sequence_.load(std::memory_order_relaxed), record)) {
+                fn(static_cast<const RingRecord&>(record));
+                expected = record.sequence + 1;
+                offset += RingRecordSize(record.length);
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    const RingRecovery& Recovery() const { return recovery_; }
+
+    // 写入线程以外的线程也可以调用
+    RecordingRingStats Stats() const;
+
+    std::size_t CapacityBytes() const { return blocks_ * block_bytes_; }
+
+private:
+    /**
+     * 读取数据区 offset 处的记录：序号在 [min_sequence, max_sequence) 之内、不跨块、CRC 正确才算有效
+     */
+    bool ReadRecord(std::size_t offset, uint64_t min_sequence, uint64_t max_sequence, RingRecord& record) const;
+    void Initialize();
+    void Recover();
+    // 写指针移到 offset 处长度为 size 的记录之后，到数据区末尾时回到开头
+    void Advance(std::size_t offset, std::size_t size);
+    void PublishHeader();
+
+    MappedFile file_;
+    RecordingRingHeader* header_ = nullptr;
+    uint8_t* data_ = nullptr;
+    std::size_t block_bytes_ = 0;
+    std::size_t blocks_ = 0;
+
+    // 写入状态，只由写入线程修改；序号和轮数也给 Stats() 读取
+    std::size_t write_offset_ = 0;
+    std::atomic<uint64_t> next_sequence_{1};
+    std::atomic<uint64_t> generation_{0};
+    std::size_t reserved_offset_ = 0;
+    uint16_t reserved_length_ = 0;
+    RingRecovery recovery_;
+
+    // 统计，其他线程可以读取
+    std::atomic<uint64_t> appended_{0};
+    std::atomic<uint64_t> bytes_{0};
+    std::atomic<uint64_t> rejected_{0};
+    std::atomic<uint64_t> syncs_{0};
+    std::atomic<uint64_t> last_sync_ns_{0};
+    std::atomic<uint64_t> max_sync_ns_{0};
+};
+
+}  // namespace ble
@@ -0,0 +1,34 @@
+﻿#include "ble/replay_source.h"
+
+#include <chrono>
+#include <thread>
+
+namespace ble {
+
+uint64_t ReplaySource::Run(const Callback& callback, double speed) {
+    using Clock = std::chrono::steady_clock;
+    const auto start = Clock::now();
+    bool have_first = false;
+    uint64_t first_timestamp_ns = 0;
+    uint64_t count = 0;
+
+    std::size_t offset = reader_.Begin();
+    CaptureRecord record;
+    while (reader_.Next(offset, record)) {
+        if (speed > 0.0) {
+            if (!have_first) {
+                first_timestamp_ns = record.timestamp_ns;
+                have_first = true;
+            }
+            // 按记录时间戳相对第一条记录的偏移安排投递时刻
+            double offset_ns = static_cast<double>(record.timestamp_ns - first_timestamp_ns) / speed;
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double, std::nano>(offset_ns)));
+        }
+        callback(record);
+        ++count;
+    }
+    return count;
+}
+
+}  // namespace ble
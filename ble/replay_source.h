@@ -0,0 +1,34 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "ble/capture_file.h"
+
+namespace ble {
+
+/**
+ * 把抓包文件里的通知按原来的顺序重新投递一遍，用来在 Linux 上回放真实 ECG-7 会话
+ */
+class ReplaySource {
+public:
+    using Callback = std::function<void(const CaptureRecord& record)>;
+
+    bool Open(const std::string& path) { return reader_.Open(path); }
+
+    /**
+     * 在调用线程上回放全部通知
+     * @param callback
+     * @param speed 回放倍速：1 按原始时间间隔，10 表示快 10 倍，0 表示不等待尽快回放
+     * @return 回放的通知条数
+     */
+    uint64_t Run(const Callback& callback, double speed = 0.0);
+
+    CaptureReader& Reader() { return reader_; }
+
+private:
+    CaptureReader reader_;
+};
+
+}  // namespace ble
@@ -0,0 +1,215 @@
+﻿#include "ble/sequence_tracker.h"
+
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace ble {
+
+namespace {
+
+// 位图能区分重复和迟到的范围
+constexpr uint64_t kWindow = 64;
+
+unsigned HighestBit(uint64_t value) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return static_cast<unsigned>(index);
+#else
+    return 63u - static_cast<unsigned>(__builtin_clzll(value));
+#endif
+}
+
+}  // namespace
+
+bool SequenceField::Extract(const uint8_t* data, std::size_t length, uint32_t& sequence) const {
+    if (bytes == 0 || bytes > 4 || offset + bytes > length) {
+        return false;
+    }
+    uint32_t value = 0;
+    for (std::size_t i = 0; i < bytes; ++i) {
+        const uint32_t byte = data[offset + (big_endian ? i : bytes - 1 - i)];
+        value = (value << 8) | byte;
+    }
+    sequence = value;
+    return true;
+}
+
+double SequenceStats::LossRate() const {
+    return expected > 0 ? static_cast<double>(lost) / static_cast<double>(expected) : 0.0;
+}
+
+double SequenceStats::InterArrivalPercentileUs(double p) const {
+    uint64_t total = 0;
+    for (uint64_t count : inter_arrival) {
+        total += count;
+    }
+    if (total == 0) {
+        return 0.0;
+    }
+    // 第 rank 个（从 1 起）间隔所在的桶
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(p / 100.0 * static_cast<double>(total) + 0.5));
+    uint64_t seen = 0;
+    for (std::size_t b = 0; b < kInterArrivalBuckets; ++b) {
+        seen += inter_arrival[b];
+        if (seen >= rank) {
+            return static_cast<double>(SequenceTracker::BucketLowerUs(b) + SequenceTracker::BucketUpperUs(b)) / 2.0;
+        }
+    }
+    return static_cast<double>(SequenceTracker::BucketUpperUs(kInterArrivalBuckets - 1));
+}
+
+double SequenceStats::InterArrivalMaxUs() const {
+    for (std::size_t b = kInterArrivalBuckets; b-- > 0;) {
+        if (inter_arrival[b] > 0) {
+            return static_cast<double>(SequenceTracker::BucketUpperUs(b));
+        }
+    }
+    return 0.0;
+}
+
+SequenceStats SequenceStats::Since(const SequenceStats& before) const {
+    SequenceStats delta = *this;
+    delta.packets -= before.packets;
+    delta.expected -= before.expected;
+    // 迟到的包补上后 lost 会变小，区间内的值可能是负数，这里截到 0
+    delta.lost = lost > before.lost ? lost - before.lost : 0;
+    delta.duplicates -= before.duplicates;
+    delta.reordered -= before.reordered;
+    delta.stale -= before.stale;
+    delta.gaps -= before.gaps;
+    delta.resyncs -= before.resyncs;
+    for (std::size_t b = 0; b < kInterArrivalBuckets; ++b) {
+        delta.inter_arrival[b] -= before.inter_arrival[b];
+    }
+    return delta;
+}
+
+SequenceTracker::SequenceTracker(unsigned sequence_bits)
+    : bits_(std::min(sequence_bits, 32u)), mask_(bits_ == 0 ? 0 : (~0ull >> (64 - bits_))) {}
+
+std::size_t SequenceTracker::BucketOf(uint64_t interval_us) {
+    if (interval_us < 4) {
+        return static_cast<std::size_t>(interval_us);
+    }
+    const unsigned exponent = HighestBit(interval_us);
+    const std::size_t sub = static_cast<std::size_t>((interval_us >> (exponent - 2)) & 3);
+    return std::min<std::size_t>(4 + (exponent - 2) * 4 + sub, kInterArrivalBuckets - 1);
+}
+
+uint64_t SequenceTracker::BucketLowerUs(std::size_t bucket) {
+    if (bucket < 4) {
+        return bucket;
+    }
+    const unsigned exponent = static_cast<unsigned>((bucket - 4) / 4 + 2);
+    const uint64_t sub = (bucket - 4) % 4;
+    return (1ull << exponent) + sub * (1ull << (exponent - 2));
+}
+
+uint64_t SequenceTracker::BucketUpperUs(std::size_t bucket) {
+    return BucketLowerUs(bucket + 1);
+}
+
+void SequenceTracker::RecordArrival(uint64_t timestamp_ns) {
+    Add(packets_, 1);
+    if (last_arrival_ns_ != 0 && timestamp_ns >= last_arrival_ns_) {
+        Add(inter_arrival_[BucketOf((timestamp_ns - last_arrival_ns_) / 1000)], 1);
+    }
+    last_arrival_ns_ = timestamp_ns;
+}
+
+void SequenceTracker::Record(uint64_t timestamp_ns) {
+    RecordArrival(timestamp_ns);
+}
+
+void SequenceTracker::Record(uint32_t sequence, uint64_t timestamp_ns) {
+    RecordArrival(timestamp_ns);
+    if (bits_ == 0) {
+        return;
+    }
+    const uint64_t value = sequence & mask_;
+    if (!started_) {
+        started_ = true;
+        highest_ = value;
+        first_ = value;
+        received_ = 1;
+        Add(expected_, 1);
+        return;
+    }
+
+    const uint64_t delta = (value - highest_) & mask_;
+    const uint64_t half = (mask_ >> 1) + 1;
+    const uint64_t back = mask_ + 1 - delta;
+    if (delta < half || back < kWindow) {
+        // 回到了当前序号附近，之前大幅回退的包只是迟到
+        resync_count_ = 0;
+    }
+    if (delta == 0) {
+        Add(duplicates_, 1);
+    } else if (delta < half) {
+        // 前进：中间跳过的序号先记为丢失
+        highest_ += delta;
+        Add(expected_, delta);
+        const uint64_t gap = delta - 1;
+        if (gap > 0) {
+            Add(lost_, gap);
+            Add(gaps_, 1);
+            if (gap > max_gap_.load(std::memory_order_relaxed)) {
+                max_gap_.store(gap, std::memory_order_relaxed);
+            }
+        }
+        received_ = delta >= kWindow ? 1 : (received_ << delta) | 1;
+    } else {
+        if (back >= kWindow) {
+            Add(stale_, 1);
+            if (resync_count_ > 0 && value == ((resync_first_ + resync_count_) & mask_)) {
+                ++resync_count_;
+            } else {
+                resync_first_ = value;
+                resync_count_ = 1;
+            }
+            if (resync_count_ == kResyncPackets) {
+                // 设备重新计数：从连续递增的这几个包重新开始，它们不再算 stale
+                stale_.store(stale_.load(std::memory_order_relaxed) - kResyncPackets, std::memory_order_relaxed);
+                Add(resyncs_, 1);
+                Add(expected_, kResyncPackets);
+                first_ = resync_first_;
+                highest_ = first_ + kResyncPackets - 1;
+                received_ = (1ull << kResyncPackets) - 1;
+                resync_count_ = 0;
+            }
+        } else if (back > highest_ - first_) {
+            // 比第一个包还早，开始统计前就已发出
+            Add(expected_, 1);
+            Add(reordered_, 1);
+        } else if ((received_ >> back) & 1) {
+            Add(duplicates_, 1);
+        } else {
+            // 迟到的包补上了之前记为丢失的空缺
+            received_ |= 1ull << back;
+            Add(reordered_, 1);
+            lost_.store(lost_.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+        }
+    }
+}
+
+SequenceStats SequenceTracker::Snapshot() const {
+    SequenceStats stats;
+    stats.packets = packets_.load(std::memory_order_relaxed);
+    stats.expected = expected_.load(std::memory_order_relaxed);
+    stats.lost = lost_.load(std::memory_order_relaxed);
+    stats.duplicates = duplicates_.load(std::memory_order_relaxed);
+    stats.reordered = reordered_.load(std::memory_order_relaxed);
+    stats.stale = stale_.load(std::memory_order_relaxed);
+    stats.gaps = gaps_.load(std::memory_order_relaxed);
+    stats.max_gap = max_gap_.load(std::memory_order_relaxed);
+    stats.resyncs = resyncs_.load(std::memory_order_relaxed);
+    for (std::size_t b = 0; b < kInterArrivalBuckets; ++b) {
+        stats.inter_arrival[b] = inter_arrival_[b].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+}  // namespace ble
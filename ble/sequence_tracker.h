@@ -0,0 +1,132 @@
+﻿#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace ble {
+
+/**
+ * 载荷里包序号的位置，bytes 为 0 表示没有序号（只统计到达间隔）
+ */
+struct SequenceField {
+    std::size_t offset = 0;
+    std::size_t bytes = 0;        // 1~4
+    bool big_endian = false;
+
+    /**
+     * 从载荷中取出序号
+     * @return 没有序号或载荷太短时返回 false
+     */
+    bool Extract(const uint8_t* data, std::size_t length, uint32_t& sequence) const;
+
+    unsigned Bits() const { return static_cast<unsigned>(bytes * 8); }
+};
+
+// ECG-7 的前 2 字节是小端序包序号
+constexpr SequenceField kEcg7SequenceField{0, 2, false};
+
+// 序号大幅回退后，连续这么多个包都接着新的序号递增才重新同步
+constexpr uint64_t kResyncPackets = 3;
+
+// 到达间隔直方图的桶数：<4us 每微秒一个桶，之后每个 2 的幂区间再分 4 个桶，最大约 2^31 us
+constexpr std::size_t kInterArrivalBuckets = 128;
+
+/**
+ * 一个通知流的序号和到达间隔统计（快照）
+ *
+ * 所有计数都是累计值，两次快照相减（Since）就是这段时间内的统计。
+ */
+struct SequenceStats {
+    uint64_t packets = 0;       // 收到的通知数，包括重复的
+    uint64_t expected = 0;      // 按序号应当收到的通知数（第一个到最大序号）
+    uint64_t lost = 0;          // 目前仍未收到的序号数，迟到的包补上后会减回去
+    uint64_t duplicates = 0;    // 序号已经收到过的包
+    uint64_t reordered = 0;     // 晚于更大序号到达、补上空缺的包
+    uint64_t stale = 0;         // 比位图范围还早的包，分不清是迟到还是重复，不影响其他计数
+    uint64_t gaps = 0;          // 序号跳跃的次数
+    uint64_t max_gap = 0;       // 一次跳过的最多序号数
+    uint64_t resyncs = 0;       // 序号大幅回退（设备重启或重新计数）后重新同步的次数
+    std::array<uint64_t, kInterArrivalBuckets> inter_arrival{};  // 相邻通知到达间隔的直方图
+
+    double LossRate() const;
+
+    // 到达间隔的百分位数（微秒，取桶的中点），p 为 0~100，没有数据时返回 0
+    double InterArrivalPercentileUs(double p) const;
+
+    // 到达间隔的最大值所在桶的上界（微秒）
+    double InterArrivalMaxUs() const;
+
+    // 这次快照减去更早的一次快照；max_gap 不能相减，取这次的值
+    SequenceStats Since(const SequenceStats& before) const;
+};
+
+/**
+ * 通知流的丢包、重复、乱序和到达间隔统计
+ *
+ * Record() 只在解码线程上调用（单写者），每个通知只做几次比较、移位和计数，
+ * 不加锁、不分配内存；计数用 relaxed 原子变量保存，其他线程随时可以 Snapshot()。
+ * 序号按 sequence_bits 位回绕，往前跳不到序号空间一半的算前进，否则算回退。
+ * 最近 64 个序号用位图记录，回退在这个范围内时据此区分重复和迟到；
+ * 回退更多的单个包只记为 stale，不改变当前的序号基准，一个严重迟到的包不会让后面的包被算成大段丢失；
+ * 只有连续 kResyncPackets 个包都从回退后的位置接着递增，才当作设备重新计数，从这些包重新同步。
+ */
+class SequenceTracker {
+public:
+    /**
+     * @param sequence_bits 序号的位数（1~32），0 表示没有序号
+     */
+    explicit SequenceTracker(unsigned sequence_bits = 16);
+
+    SequenceTracker(const SequenceTracker&) = delete;
+    SequenceTracker& operator=(const SequenceTracker&) = delete;
+
+    /**
+     * 记录一个带序号的通知
+     * @param sequence 只使用低 sequence_bits 位
+     * @param timestamp_ns 到达时间
+     */
+    void Record(uint32_t sequence, uint64_t timestamp_ns);
+
+    // 记录一个没有序号的通知，只统计数量和到达间隔
+    void Record(uint64_t timestamp_ns);
+
+    SequenceStats Snapshot() const;
+
+    // 到达间隔（微秒）所在的桶，以及桶的 [下界, 上界) 范围
+    static std::size_t BucketOf(uint64_t interval_us);
+    static uint64_t BucketLowerUs(std::size_t bucket);
+    static uint64_t BucketUpperUs(std::size_t bucket);
+
+private:
+    static void Add(std::atomic<uint64_t>& counter, uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    void RecordArrival(uint64_t timestamp_ns);
+
+    // 以下只由写者访问
+    unsigned bits_;
+    uint64_t mask_;
+    bool started_ = false;
+    uint64_t highest_ = 0;        // 展开成 64 位后的最大序号
+    uint64_t first_ = 0;
+    uint64_t received_ = 0;       // highest_ 和之前 63 个序号是否收到，第 0 位是 highest_
+    uint64_t last_arrival_ns_ = 0;
+    uint64_t resync_first_ = 0;   // 回退后连续递增的包：第一个序号和个数
+    uint64_t resync_count_ = 0;
+
+    std::atomic<uint64_t> packets_{0};
+    std::atomic<uint64_t> expected_{0};
+    std::atomic<uint64_t> lost_{0};
+    std::atomic<uint64_t> duplicates_{0};
+    std::atomic<uint64_t> reordered_{0};
+    std::atomic<uint64_t> stale_{0};
+    std::atomic<uint64_t> gaps_{0};
+    std::atomic<uint64_t> max_gap_{0};
+    std::atomic<uint64_t> resyncs_{0};
+    std::array<std::atomic<uint64_t>, kInterArrivalBuckets> inter_arrival_{};
+};
+
+}  // namespace ble
@@ -0,0 +1,265 @@
+﻿#include "ble/shared_samples.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#include "ble/clock.h"
+
+namespace ble {
+
+namespace {
+
+constexpr std::size_t AlignCacheLine(std::size_t bytes) {
+    return (bytes + 63) & ~static_cast<std::size_t>(63);
+}
+
+std::size_t RoundUpPowerOfTwo(std::size_t value) {
+    std::size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+// 旧对象还被读取方映射着：标记关闭后删除名字，读取方的映射仍然有效
+void RetireExisting(const std::string& name) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= sizeof(SharedSampleHeader)) {
+        void* mapping = mmap(nullptr, sizeof(SharedSampleHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping != MAP_FAILED) {
+            auto* header = static_cast<SharedSampleHeader*>(mapping);
+            if (std::memcmp(header->magic, kSharedSampleMagic, sizeof(kSharedSampleMagic)) == 0) {
+                header->closed.store(1, std::memory_order_release);
+            }
+            munmap(mapping, sizeof(SharedSampleHeader));
+        }
+    }
+    close(fd);
+    shm_unlink(name.c_str());
+}
+
+}  // namespace
+
+bool SharedSampleWriter::Create(const std::string& name, std::size_t leads, std::size_t capacity,
+                                double sample_rate_hz) {
+    Close();
+    if (name.size() < 2 || name[0] != '/' || leads == 0 || leads > kMaxEcgLeads || capacity == 0) {
+        return false;
+    }
+    capacity = RoundUpPowerOfTwo(capacity);
+    const std::size_t timestamps_offset = sizeof(SharedSampleHeader);
+    const std::size_t samples_offset = AlignCacheLine(timestamps_offset + capacity * sizeof(uint64_t));
+    const std::size_t lead_stride = AlignCacheLine(capacity * sizeof(int32_t));
+    const std::size_t size = samples_offset + leads * lead_stride;
+
+    RetireExisting(name);
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    base_ = static_cast<uint8_t*>(mapping);
+    header_ = new (base_) SharedSampleHeader();
+    header_->version = kSharedSampleVersion;
+    header_->header_size = sizeof(SharedSampleHeader);
+    header_->leads = static_cast<uint32_t>(leads);
+    header_->capacity = capacity;
+    header_->lead_stride = lead_stride;
+    header_->timestamps_offset = timestamps_offset;
+    header_->samples_offset = samples_offset;
+    header_->total_bytes = size;
+    header_->sample_rate_hz = sample_rate_hz;
+    header_->created_ns = MonotonicNowNs();
+    header_->reserve.store(0, std::memory_order_relaxed);
+    header_->head.store(0, std::memory_order_relaxed);
+    header_->closed.store(0, std::memory_order_relaxed);
+    // 魔数最后写，读取方看到魔数时其余字段都已就绪
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header_->magic, kSharedSampleMagic, sizeof(kSharedSampleMagic));
+
+    name_ = name;
+    size_ = size;
+    leads_ = leads;
+    capacity_ = capacity;
+    head_ = 0;
+    return true;
+}
+
+void SharedSampleWriter::Write(const int32_t* const* in, std::size_t frames, uint64_t timestamp_ns) {
+    if (header_ == nullptr || frames == 0) {
+        return;
+    }
+    // 一次写入超过整个环时，前面的帧写了也会立即被覆盖
+    const std::size_t skip = frames > capacity_ ? frames - capacity_ : 0;
+    const uint64_t end = head_ + frames;
+
+    // 先公布要覆盖到哪里，读取方据此判断读到的帧是否被改写过
+    header_->reserve.store(end, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    auto* timestamps = reinterpret_cast<uint64_t*>(base_ + header_->timestamps_offset);
+    uint8_t* samples = base_ + header_->samples_offset;
+    const std::size_t mask = capacity_ - 1;
+    uint64_t frame = head_ + skip;
+    std::size_t done = skip;
+    while (done < frames) {
+        const std::size_t index = static_cast<std::size_t>(frame & mask);
+        const std::size_t n = std::min(frames - done, capacity_ - index);
+        for (std::size_t lead = 0; lead < leads_; ++lead) {
+            auto* out = reinterpret_cast<int32_t*>(samples + lead * header_->lead_stride);
+            std::memcpy(out + index, in[lead] + done, n * sizeof(int32_t));
+        }
+        std::fill(timestamps + index, timestamps + index + n, timestamp_ns);
+        frame += n;
+        done += n;
+    }
+
+    header_->head.store(end, std::memory_order_release);
+    head_ = end;
+}
+
+void SharedSampleWriter::Close() {
+    if (header_ == nullptr) {
+        return;
+    }
+    header_->closed.store(1, std::memory_order_release);
+    munmap(base_, size_);
+    shm_unlink(name_.c_str());
+    header_ = nullptr;
+    base_ = nullptr;
+    size_ = 0;
+}
+
+bool SharedSampleReader::Open(const std::string& name) {
+    Close();
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(SharedSampleHeader)) {
+        close(fd);
+        return false;
+    }
+    const std::size_t size = static_cast<std::size_t>(st.st_size);
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    const auto* header = static_cast<const SharedSampleHeader*>(mapping);
+    const bool valid = std::memcmp(header->magic, kSharedSampleMagic, sizeof(kSharedSampleMagic)) == 0 &&
+                       header->version == kSharedSampleVersion &&
+                       header->header_size == sizeof(SharedSampleHeader) && header->leads > 0 &&
+                       header->leads <= kMaxEcgLeads && header->capacity > 0 &&
+                       (header->capacity & (header->capacity - 1)) == 0 && header->total_bytes <= size &&
+                       header->timestamps_offset + header->capacity * sizeof(uint64_t) <= header->samples_offset &&
+                       header->lead_stride >= header->capacity * sizeof(int32_t) &&
+                       header->samples_offset + header->leads * header->lead_stride <= header->total_bytes;
+    if (!valid) {
+        munmap(mapping, size);
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    header_ = header;
+    base_ = static_cast<const uint8_t*>(mapping);
+    size_ = size;
+    capacity_ = static_cast<std::size_t>(header->capacity);
+    return true;
+}
+
+void SharedSampleReader::Close() {
+    if (header_ == nullptr) {
+        return;
+    }
+    munmap(const_cast<uint8_t*>(base_), size_);
+    header_ = nullptr;
+    base_ = nullptr;
+    size_ = 0;
+}
+
+uint64_t SharedSampleReader::Oldest() const {
+    const uint64_t reserve = header_->reserve.load(std::memory_order_acquire);
+    return reserve > capacity_ ? reserve - capacity_ : 0;
+}
+
+bool SharedSampleReader::Peek(uint64_t from, std::size_t max_frames, SampleSpan& span) const {
+    span.first_frame = from;
+    span.frames = 0;
+    const uint64_t head = header_->head.load(std::memory_order_acquire);
+    if (header_->reserve.load(std::memory_order_relaxed) > from + capacity_) {
+        return false;
+    }
+    if (from >= head) {
+        return true;
+    }
+    const std::size_t index = static_cast<std::size_t>(from & (capacity_ - 1));
+    span.frames = static_cast<std::size_t>(std::min<uint64_t>({head - from, max_frames, capacity_ - index}));
+    span.timestamps = reinterpret_cast<const uint64_t*>(base_ + header_->timestamps_offset) + index;
+    const uint8_t* samples = base_ + header_->samples_offset;
+    for (std::size_t lead = 0; lead < header_->leads; ++lead) {
+        span.leads[lead] = reinterpret_cast<const int32_t*>(samples + lead * header_->lead_stride) + index;
+    }
+    return true;
+}
+
+bool SharedSampleReader::Valid(const SampleSpan& span) const {
+    // 读数据在前、读 reserve 在后，与写入方的顺序相反
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return header_->reserve.load(std::memory_order_relaxed) <= span.first_frame + capacity_;
+}
+
+std::size_t SharedSampleReader::Read(uint64_t& from, std::size_t max_frames, int32_t* const* out,
+                                     uint64_t* timestamps, uint64_t* skipped) const {
+    std::size_t copied = 0;
+    while (copied < max_frames) {
+        SampleSpan span;
+        if (!Peek(from, max_frames - copied, span)) {
+            const uint64_t oldest = Oldest();
+            if (skipped != nullptr) {
+                *skipped += oldest - from;
+            }
+            from = oldest;
+            continue;
+        }
+        if (span.frames == 0) {
+            break;
+        }
+        for (std::size_t lead = 0; lead < header_->leads; ++lead) {
+            std::memcpy(out[lead] + copied, span.leads[lead], span.frames * sizeof(int32_t));
+        }
+        if (timestamps != nullptr) {
+            std::memcpy(timestamps + copied, span.timestamps, span.frames * sizeof(uint64_t));
+        }
+        if (!Valid(span)) {
+            // 复制的过程中被覆盖，这一段作废，从还没被覆盖的地方重新读
+            continue;
+        }
+        copied += span.frames;
+        from += span.frames;
+    }
+    return copied;
+}
+
+}  // namespace ble
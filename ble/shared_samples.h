@@ -0,0 +1,189 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "ble/ecg_decoder.h"
+
+namespace ble {
+
+/*
+ * 共享内存里的解码样本环（POSIX shm_open + mmap）
+ *
+ *   SharedSampleHeader                  256 字节
+ *   uint64_t timestamp_ns[capacity]     每帧所属通知的接收时间（MonotonicNowNs，跨进程可比）
+ *   int32_t  lead0[capacity]            各导联的样本，每个导联从新的缓存行开始
+ *   int32_t  lead1[capacity]
+ *   ...
+ *
+ * 帧序号从 0 开始单调递增，第 f 帧存放在下标 f % capacity 处（capacity 是 2 的幂）。
+ * 写入方按序锁（seqlock）协议发布：先把 reserve 推进到这次要写到的帧，再写数据，最后把 head 推进到同一位置。
+ * 读取方直接读映射里的数据，读完再看 reserve：只要 reserve <= 第一帧 + capacity，
+ * 读到的帧在读的过程中就没有被覆盖，否则这段数据作废。读取方只映射只读内存，不修改任何共享状态，
+ * 写入方也不知道有多少读取方，读取方再慢也不会影响写入方。
+ */
+
+constexpr char kSharedSampleMagic[8] = {'B', 'L', 'E', 'S', 'A', 'M', 'P', '\1'};
+constexpr uint32_t kSharedSampleVersion = 1;
+
+struct SharedSampleHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t leads;
+    uint32_t reserved;
+    uint64_t capacity;             // 帧数，2 的幂
+    uint64_t lead_stride;          // 相邻导联之间的字节数
+    uint64_t timestamps_offset;    // 相对映射起点的字节偏移
+    uint64_t samples_offset;
+    uint64_t total_bytes;
+    double sample_rate_hz;
+    uint64_t created_ns;           // 写入方创建时的 MonotonicNowNs，同名对象被重建时会变
+    uint8_t pad0[48];
+    alignas(64) std::atomic<uint64_t> reserve;   // 写入方正在写、写完后要发布到的帧序号
+    uint8_t pad1[56];
+    alignas(64) std::atomic<uint64_t> head;      // 已经发布的帧数
+    std::atomic<uint32_t> closed;                // 写入方关闭后为 1，不会再有新数据
+    uint8_t pad2[52];
+};
+
+static_assert(sizeof(SharedSampleHeader) == 256, "unexpected shared sample header size");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared counters must be lock free");
+
+/**
+ * 读取方拿到的一段连续帧，指针直接指向共享内存，不跨越环的末尾
+ */
+struct SampleSpan {
+    uint64_t first_frame = 0;
+    std::size_t frames = 0;
+    const uint64_t* timestamps = nullptr;
+    const int32_t* leads[kMaxEcgLeads] = {};
+};
+
+/**
+ * 写入方：创建共享内存对象并发布解码后的样本。一个对象只应有一个写入方，Write 只在一个线程上调用
+ */
+class SharedSampleWriter {
+public:
+    SharedSampleWriter() = default;
+    ~SharedSampleWriter() { Close(); }
+
+    SharedSampleWriter(const SharedSampleWriter&) = delete;
+    SharedSampleWriter& operator=(const SharedSampleWriter&) = delete;
+
+    /**
+     * 创建共享内存对象。同名对象已经存在时先把它标记为关闭再删除名字，
+     * 还映射着旧对象的读取方会看到 Closed()，重新 Open 就能接上新对象
+     * @param name shm_open 的名字，以 / 开头
+     * @param leads 不超过 kMaxEcgLeads
+     * @param capacity 环能容纳的帧数，向上取整到 2 的幂
+     * @param sample_rate_hz 只是记录下来供读取方参考
+     */
+    bool Create(const std::string& name, std::size_t leads, std::size_t capacity, double sample_rate_hz);
+
+    /**
+     * 发布 frames 帧，超过 capacity 时只有最后 capacity 帧有意义
+     * @param in 各导联样本的起始位置
+     * @param frames
+     * @param timestamp_ns 这些帧所属通知的接收时间
+     */
+    void Write(const int32_t* const* in, std::size_t frames, uint64_t timestamp_ns);
+
+    // 标记关闭、解除映射并删除名字
+    void Close();
+
+    bool IsOpen() const { return header_ != nullptr; }
+    uint64_t Frames() const { return head_; }
+    std::size_t Capacity() const { return capacity_; }
+    const std::string& Name() const { return name_; }
+
+private:
+    std::string name_;
+    SharedSampleHeader* header_ = nullptr;
+    uint8_t* base_ = nullptr;
+    std::size_t size_ = 0;
+    std::size_t leads_ = 0;
+    std::size_t capacity_ = 0;
+    uint64_t head_ = 0;
+};
+
+/**
+ * 读取方：只读映射写入方创建的对象，按帧序号读取，不与写入方或其他读取方协调。
+ * 可以在任意多个进程里同时使用，一个读取方对象只应在一个线程上使用
+ *
+ * 零复制的用法：
+ *
+ *   SampleSpan span;
+ *   if (reader.Peek(cursor, max, span)) {
+ *       ... 直接使用 span.leads[] ...
+ *       if (reader.Valid(span)) cursor += span.frames;   // 读的过程中没有被覆盖
+ *       else cursor = reader.Oldest();                    // 读得太慢，跳到还没被覆盖的位置
+ *   } else {
+ *       cursor = reader.Oldest();
+ *   }
+ */
+class SharedSampleReader {
+public:
+    SharedSampleReader() = default;
+    ~SharedSampleReader() { Close(); }
+
+    SharedSampleReader(const SharedSampleReader&) = delete;
+    SharedSampleReader& operator=(const SharedSampleReader&) = delete;
+
+    // 对象不存在或格式不对时返回 false
+    bool Open(const std::string& name);
+
+    void Close();
+
+    bool IsOpen() const { return header_ != nullptr; }
+
+    std::size_t Leads() const { return header_->leads; }
+    std::size_t Capacity() const { return capacity_; }
+    double SampleRateHz() const { return header_->sample_rate_hz; }
+    uint64_t CreatedNs() const { return header_->created_ns; }
+
+    // 已发布的帧数，新读取方通常从这里开始
+    uint64_t Head() const { return header_->head.load(std::memory_order_acquire); }
+
+    // 还没有被覆盖（也没有正在被覆盖）的最早帧
+    uint64_t Oldest() const;
+
+    bool Closed() const { return header_->closed.load(std::memory_order_acquire) != 0; }
+
+    /**
+     * 取出从 from 开始的一段已发布的连续帧，不复制
+     * @param from
+     * @param max_frames
+     * @param span 没有新数据时 frames 为 0
+     * @return from 已经被覆盖时返回 false
+     */
+    bool Peek(uint64_t from, std::size_t max_frames, SampleSpan& span) const;
+
+    /**
+     * 用完 span 之后调用：读取期间这些帧没有被写入方覆盖时返回 true，否则读到的数据可能不完整
+     * @param span
+     */
+    bool Valid(const SampleSpan& span) const;
+
+    /**
+     * 复制从 from 开始的最多 max_frames 帧，内部完成 Peek 和 Valid
+     * @param from 读完后前进到下一帧；已被覆盖时先跳到 Oldest()
+     * @param max_frames
+     * @param out 各导联的输出位置
+     * @param timestamps 可以为 nullptr
+     * @param skipped 因为被覆盖而跳过的帧数，可以为 nullptr
+     * @return 复制的帧数
+     */
+    std::size_t Read(uint64_t& from, std::size_t max_frames, int32_t* const* out, uint64_t* timestamps = nullptr,
+                     uint64_t* skipped = nullptr) const;
+
+private:
+    const SharedSampleHeader* header_ = nullptr;
+    const uint8_t* base_ = nullptr;
+    std::size_t size_ = 0;
+    std::size_t capacity_ = 0;
+};
+
+}  // namespace ble
@@ -0,0 +1,463 @@
+﻿#include "ble/sim_transport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+#include "ble/advertisement_data.h"
+#include "ble/clock.h"
+
+namespace ble {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+void SleepUs(uint32_t us) {
+    if (us > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+    }
+}
+
+// 每个订阅/设备独立的 xorshift 随机数，结果可复现
+struct XorShift32 {
+    uint32_t state;
+
+    explicit XorShift32(uint64_t seed) : state(static_cast<uint32_t>(seed ^ (seed >> 32)) | 1u) {}
+
+    uint32_t Next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    // [0, 1)
+    double NextUnit() { return static_cast<double>(Next()) / 4294967296.0; }
+};
+
+// 按 AD 结构格式构造广播数据：Flags + 完整名称 + 16 位服务 UUID 列表
+std::vector<uint8_t> BuildRawAdvertisement(const SimDeviceConfig& config) {
+    std::vector<uint8_t> raw = {0x02, 0x01, 0x06};
+    std::size_t name_length = std::min<std::size_t>(config.name.size(), 29);
+    raw.push_back(static_cast<uint8_t>(name_length + 1));
+    raw.push_back(0x09);
+    raw.insert(raw.end(), config.name.begin(), config.name.begin() + name_length);
+
+    std::vector<uint16_t> short_uuids;
+    for (const auto& service : config.services) {
+        Guid base = ShortUuid(0);
+        base.Data1 = service.uuid.Data1;
+        if (service.uuid.Data1 <= 0xFFFF && base == service.uuid) {
+            short_uuids.push_back(static_cast<uint16_t>(service.uuid.Data1));
+        }
+    }
+    if (!short_uuids.empty()) {
+        raw.push_back(static_cast<uint8_t>(short_uuids.size() * 2 + 1));
+        raw.push_back(0x03);
+        for (uint16_t uuid : short_uuids) {
+            raw.push_back(static_cast<uint8_t>(uuid & 0xFF));
+            raw.push_back(static_cast<uint8_t>(uuid >> 8));
+        }
+    }
+    return raw;
+}
+
+/**
+ * 模拟的连接：按配置的服务布局分配句柄，每个订阅一个通知线程
+ */
+class SimConnection : public BleConnection, public std::enable_shared_from_this<SimConnection> {
+public:
+    SimConnection(const SimDeviceConfig& config, std::shared_ptr<std::atomic<uint64_t>> request_count)
+        : config_(config), request_count_(std::move(request_count)) {
+        if (!config_.payload_generator) {
+            config_.payload_generator = DefaultEcg7Payload;
+        }
+        // 与真实 GATT 数据库一样顺序分配句柄：服务声明、特性声明、特性值、CCCD
+        uint16_t handle = 1;
+        for (const auto& service : config_.services) {
+            GattServiceInfo service_info;
+            service_info.uuid = service.uuid;
+            service_info.handle = handle++;
+            services_.push_back(service_info);
+            for (const auto& characteristic : service.characteristics) {
+                ++handle;
+                GattCharacteristicInfo info;
+                info.uuid = characteristic.uuid;
+                info.handle = handle++;
+                info.service_handle = service_info.handle;
+                info.properties = characteristic.properties;
+                characteristics_.push_back(info);
+                if ((characteristic.properties & (kPropertyNotify | kPropertyIndicate)) != 0) {
+                    ++handle;
+                }
+            }
+        }
+    }
+
+    ~SimConnection() override { Disconnect(); }
+
+    uint64_t Address() const override { return config_.address; }
+
+    std::string Name() const override { return config_.name; }
+
+    std::future<ServicesResult> DiscoverServicesAsync() override {
+        auto self = shared_from_this();
+        return std::async(std::launch::async, [self] {
+            self->CountRequest();
+            ServicesResult result;
+            if (!self->connected_.load()) {
+                return result;
+            }
+            result.status = GattStatus::Success;
+            result.services = self->services_;
+            return result;
+        });
+    }
+
+    std::future<CharacteristicsResult> DiscoverCharacteristicsAsync(const GattServiceInfo& service) override {
+        auto self = shared_from_this();
+        uint16_t service_handle = service.handle;
+        return std::async(std::launch::async, [self, service_handle] {
+            self->CountRequest();
+            CharacteristicsResult result;
+            if (!self->connected_.load()) {
+                return result;
+            }
+            result.status = GattStatus::Success;
+            for (const auto& characteristic : self->characteristics_) {
+                if (characteristic.service_handle == service_handle) {
+                    result.characteristics.push_back(characteristic);
+                }
+            }
+            return result;
+        });
+    }
+
+    std::future<GattStatus> RestoreCharacteristicsAsync(
+            const std::vector<GattCharacteristicInfo>& characteristics) override {
+        // 本地核对，不算 GATT 请求，也没有请求延迟
+        std::promise<GattStatus> promise;
+        GattStatus status = connected_.load() ? GattStatus::Success : GattStatus::Unreachable;
+        for (const auto& characteristic : characteristics) {
+            if (status != GattStatus::Success) {
+                break;
+            }
+            const GattCharacteristicInfo* info = FindCharacteristic(characteristic.handle);
+            if (info == nullptr || info->uuid != characteristic.uuid) {
+                status = GattStatus::ProtocolError;
+            }
+        }
+        promise.set_value(status);
+        return promise.get_future();
+    }
+
+    std::future<GattStatus> SubscribeAsync(const GattCharacteristicInfo& characteristic, SubscriptionKind kind,
+                                           NotificationHandler handler) override {
+        auto self = shared_from_this();
+        uint16_t handle = characteristic.handle;
+        return std::async(std::launch::async, [self, handle, kind, handler = std::move(handler)]() mutable {
+            self->CountRequest();
+            if (!self->connected_.load()) {
+                return GattStatus::Unreachable;
+            }
+            const GattCharacteristicInfo* info = self->FindCharacteristic(handle);
+            CharacteristicProperty needed = kind == SubscriptionKind::Notify ? kPropertyNotify : kPropertyIndicate;
+            if (info == nullptr || !info->Has(needed)) {
+                return GattStatus::ProtocolError;
+            }
+            self->StartSubscription(handle, std::move(handler));
+            return GattStatus::Success;
+        });
+    }
+
+    void Unsubscribe(const GattCharacteristicInfo& characteristic) override {
+        std::unique_ptr<Subscription> subscription;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = std::find_if(subscriptions_.begin(), subscriptions_.end(),
+                                   [&](const std::unique_ptr<Subscription>& s) {
+                                       return s->handle == characteristic.handle;
+                                   });
+            if (it == subscriptions_.end()) {
+                return;
+            }
+            subscription = std::move(*it);
+            subscriptions_.erase(it);
+        }
+        StopSubscription(*subscription);
+    }
+
+    void Disconnect() override {
+        connected_.store(false);
+        std::vector<std::unique_ptr<Subscription>> subscriptions;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            subscriptions.swap(subscriptions_);
+        }
+        for (auto& subscription : subscriptions) {
+            StopSubscription(*subscription);
+        }
+    }
+
+private:
+    struct Subscription {
+        uint16_t handle = 0;
+        std::atomic<bool> running{true};
+        std::thread thread;
+    };
+
+    void CountRequest() {
+        request_count_->fetch_add(1, std::memory_order_relaxed);
+        SleepUs(config_.request_latency_us);
+    }
+
+    const GattCharacteristicInfo* FindCharacteristic(uint16_t handle) const {
+        for (const auto& characteristic : characteristics_) {
+            if (characteristic.handle == handle) {
+                return &characteristic;
+            }
+        }
+        return nullptr;
+    }
+
+    void StartSubscription(uint16_t handle, NotificationHandler handler) {
+        auto subscription = std::make_unique<Subscription>();
+        subscription->handle = handle;
+        Subscription* raw = subscription.get();
+
+        std::unique_ptr<Subscription> replaced;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            // 重复订阅同一个特性时替换旧的订阅
+            for (auto& existing : subscriptions_) {
+                if (existing->handle == handle) {
+                    replaced = std::move(existing);
+                    existing = std::move(subscription);
+                    break;
+                }
+            }
+            if (subscription) {
+                subscriptions_.push_back(std::move(subscription));
+            }
+            raw->thread = std::thread(&SimConnection::RunSubscription, this, raw, std::move(handler));
+        }
+        if (replaced) {
+            StopSubscription(*replaced);
+        }
+    }
+
+    static void StopSubscription(Subscription& subscription) {
+        subscription.running.store(false);
+        if (subscription.thread.joinable()) {
+            subscription.thread.join();
+        }
+    }
+
+    void RunSubscription(Subscription* subscription, NotificationHandler handler) {
+        XorShift32 rng(config_.address * 0x9E3779B97F4A7C15ull + subscription->handle);
+        std::vector<uint8_t> payload(std::max<std::size_t>(config_.payload_size, 1));
+        std::vector<uint8_t> held(payload.size());  // 被扣下准备乱序送出的包
+        bool holding = false;
+
+        const bool paced = config_.notification_rate_hz > 0.0;
+        const auto period = paced ? std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(1.0 / config_.notification_rate_hz)) : Clock::duration::zero();
+        const auto jitter = std::chrono::microseconds(config_.jitter_us);
+        auto next = Clock::now();
+
+        for (uint64_t sequence = 0; subscription->running.load(std::memory_order_relaxed); ++sequence) {
+            if (paced) {
+                next += period;
+                auto deadline = next;
+                if (config_.jitter_us > 0) {
+                    deadline += std::chrono::duration_cast<Clock::duration>(jitter * (2.0 * rng.NextUnit() - 1.0));
+                }
+                std::this_thread::sleep_until(deadline);
+                if (!subscription->running.load(std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            if (config_.loss_rate > 0.0 && rng.NextUnit() < config_.loss_rate) {
+                continue;
+            }
+            config_.payload_generator(sequence, payload.data(), config_.payload_size);
+            if (!holding && config_.reorder_rate > 0.0 && rng.NextUnit() < config_.reorder_rate) {
+                held.swap(payload);
+                holding = true;
+                continue;
+            }
+            handler(subscription->handle, MonotonicNowNs(), payload.data(), config_.payload_size);
+            if (config_.duplicate_rate > 0.0 && rng.NextUnit() < config_.duplicate_rate) {
+                handler(subscription->handle, MonotonicNowNs(), payload.data(), config_.payload_size);
+            }
+            if (holding) {
+                handler(subscription->handle, MonotonicNowNs(), held.data(), config_.payload_size);
+                holding = false;
+            }
+        }
+    }
+
+    SimDeviceConfig config_;
+    std::shared_ptr<std::atomic<uint64_t>> request_count_;
+    std::vector<GattServiceInfo> services_;
+    std::vector<GattCharacteristicInfo> characteristics_;
+    std::atomic<bool> connected_{true};
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Subscription>> subscriptions_;
+};
+
+}  // namespace
+
+std::vector<SimServiceSpec> Ecg7Services() {
+    return {
+            {ShortUuid(0x1800), {{ShortUuid(0x2A00), kPropertyRead}, {ShortUuid(0x2A01), kPropertyRead}}},
+            {ShortUuid(0x180A), {{ShortUuid(0x2A29), kPropertyRead}, {ShortUuid(0x2A24), kPropertyRead}}},
+            {ShortUuid(0xFFF0), {{ShortUuid(0xFFF1), kPropertyRead | kPropertyNotify},
+                                 {ShortUuid(0xFFF2), kPropertyWrite | kPropertyWriteWithoutResponse}}},
+    };
+}
+
+void DefaultEcg7Payload(uint64_t sequence, uint8_t* payload, std::size_t size) {
+    XorShift32 rng((sequence + 1) * 0x9E3779B97F4A7C15ull);
+    for (std::size_t i = 0; i < size; ++i) {
+        payload[i] = static_cast<uint8_t>(rng.Next());
+    }
+    if (size >= 2) {
+        payload[0] = static_cast<uint8_t>(sequence & 0xFF);
+        payload[1] = static_cast<uint8_t>((sequence >> 8) & 0xFF);
+    }
+}
+
+PayloadGenerator SyntheticEcg7Payload(SyntheticEcgOptions options) {
+    // 同一设备配置的各个连接共用一个生成器，重新连接后序号从 0 开始，信号也从头开始
+    struct State {
+        std::mutex mutex;
+        SyntheticEcgOptions options;
+        std::unique_ptr<SyntheticEcg> ecg;
+        std::vector<int32_t> frame;
+    };
+    auto state = std::make_shared<State>();
+    state->options = options;
+    state->frame.resize(options.leads);
+    return [state](uint64_t sequence, uint8_t* payload, std::size_t size) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        const std::size_t leads = state->options.leads;
+        const std::size_t frames = size >= 2 && leads > 0 ? (size - 2) / (leads * 2) : 0;
+        const uint64_t first = sequence * frames;
+        if (!state->ecg || state->ecg->SampleIndex() > first) {
+            state->ecg = std::make_unique<SyntheticEcg>(state->options);
+        }
+        while (state->ecg->SampleIndex() < first) {
+            state->ecg->Next(state->frame.data());
+        }
+        std::fill(payload, payload + size, 0);
+        if (size >= 2) {
+            payload[0] = static_cast<uint8_t>(sequence & 0xFF);
+            payload[1] = static_cast<uint8_t>((sequence >> 8) & 0xFF);
+        }
+        uint8_t* out = payload + 2;
+        for (std::size_t f = 0; f < frames; ++f) {
+            state->ecg->Next(state->frame.data());
+            for (std::size_t l = 0; l < leads; ++l) {
+                int32_t value = std::max(-32768, std::min(32767, state->frame[l]));
+                *out++ = static_cast<uint8_t>(value & 0xFF);
+                *out++ = static_cast<uint8_t>((value >> 8) & 0xFF);
+            }
+        }
+    };
+}
+
+SimulatedTransport::SimulatedTransport(std::vector<SimDeviceConfig> devices, double advertisement_rate_hz)
+    : advertisement_rate_hz_(advertisement_rate_hz) {
+    for (auto& config : devices) {
+        AddDevice(std::move(config));
+    }
+}
+
+SimulatedTransport::~SimulatedTransport() {
+    StopScan();
+}
+
+void SimulatedTransport::AddDevice(SimDeviceConfig config) {
+    SimDevice device;
+    device.raw_advertisement = BuildRawAdvertisement(config);
+    device.config = std::move(config);
+    devices_.push_back(std::move(device));
+}
+
+bool SimulatedTransport::StartScan(AdvertisementHandler handler) {
+    StopScan();
+    if (devices_.empty()) {
+        return false;
+    }
+    scan_handler_ = std::move(handler);
+    scanning_.store(true);
+    scan_thread_ = std::thread(&SimulatedTransport::ScanLoop, this);
+    return true;
+}
+
+void SimulatedTransport::StopScan() {
+    scanning_.store(false);
+    // 在广播回调里停止扫描时不能 join 自己，线程会在当前回调返回后自行退出
+    if (scan_thread_.joinable() && scan_thread_.get_id() != std::this_thread::get_id()) {
+        scan_thread_.join();
+    }
+}
+
+void SimulatedTransport::ScanLoop() {
+    const bool paced = advertisement_rate_hz_ > 0.0;
+    const auto period = paced ? std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(1.0 / advertisement_rate_hz_)) : Clock::duration::zero();
+    auto next = Clock::now();
+    std::size_t index = 0;
+    while (scanning_.load(std::memory_order_relaxed)) {
+        const SimDevice& device = devices_[index];
+        index = (index + 1) % devices_.size();
+
+        Advertisement advertisement;
+        advertisement.address = device.config.address;
+        advertisement.rssi = device.config.rssi;
+        advertisement.timestamp_ns = MonotonicNowNs();
+        advertisement.raw = device.raw_advertisement.data();
+        advertisement.raw_length = device.raw_advertisement.size();
+        // 与真实扫描一样从原始广播数据里取名称（超过 29 字节的名称在广播里是截断的）
+        AdvertisementData fields;
+        ParseAdvertisementData(advertisement.raw, advertisement.raw_length, fields);
+        advertisement.local_name = fields.local_name;
+        scan_handler_(advertisement);
+
+        if (paced) {
+            next += period;
+            std::this_thread::sleep_until(next);
+        }
+    }
+}
+
+std::future<std::shared_ptr<BleConnection>> SimulatedTransport::ConnectAsync(uint64_t address) {
+    const SimDevice* device = nullptr;
+    for (const auto& candidate : devices_) {
+        if (candidate.config.address == address) {
+            device = &candidate;
+            break;
+        }
+    }
+    if (device == nullptr) {
+        std::promise<std::shared_ptr<BleConnection>> failed;
+        failed.set_value(nullptr);
+        return failed.get_future();
+    }
+    // 连接对象持有请求计数器的共享指针，传输层先析构也不会悬空
+    auto counter = request_counter_;
+    SimDeviceConfig copy = device->config;
+    const bool fail = device->connect_attempts->fetch_add(1) < copy.connect_failures;
+    return std::async(std::launch::async, [copy, counter, fail]() -> std::shared_ptr<BleConnection> {
+        SleepUs(copy.connect_latency_us);
+        if (fail) {
+            return nullptr;
+        }
+        return std::make_shared<SimConnection>(copy, counter);
+    });
+}
+
+}  // namespace ble
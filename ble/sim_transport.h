@@ -0,0 +1,115 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ble/synthetic_ecg.h"
+#include "ble/transport.h"
+
+namespace ble {
+
+/**
+ * 生成第 sequence 个通知的载荷
+ * @param sequence 每个订阅从 0 开始递增，丢包时也会递增
+ */
+using PayloadGenerator = std::function<void(uint64_t sequence, uint8_t* payload, std::size_t size)>;
+
+struct SimCharacteristicSpec {
+    Guid uuid;
+    uint32_t properties = 0;
+};
+
+struct SimServiceSpec {
+    Guid uuid;
+    std::vector<SimCharacteristicSpec> characteristics;
+};
+
+// 用 16 位短 UUID 生成蓝牙基础 UUID（0000xxxx-0000-1000-8000-00805F9B34FB）
+constexpr Guid ShortUuid(uint16_t short_uuid) {
+    return Guid{short_uuid, 0x0000, 0x1000, {0x80, 0x00, 0x00, 0x80, 0x5F, 0x9B, 0x34, 0xFB}};
+}
+
+// ECG-7 的服务布局：GAP、设备信息，以及 FFF0 数据服务（FFF1 通知数据、FFF2 写命令）
+std::vector<SimServiceSpec> Ecg7Services();
+
+/**
+ * 默认的 ECG-7 载荷：前 2 字节是小端序包序号，其余是可复现的伪随机数据
+ */
+void DefaultEcg7Payload(uint64_t sequence, uint8_t* payload, std::size_t size);
+
+/**
+ * 载荷为合成心电的 ECG-7 生成器：2 字节序号之后是 16 位小端样本，按帧交织，
+ * 第 sequence 个通知对应合成信号的第 sequence * 帧数 帧起的几帧（丢包的帧被跳过）
+ * @param options 合成心电的参数，采样率应等于通知速率乘以每个载荷的帧数
+ */
+PayloadGenerator SyntheticEcg7Payload(SyntheticEcgOptions options);
+
+/**
+ * 一台模拟设备的参数
+ */
+struct SimDeviceConfig {
+    uint64_t address = 0;
+    std::string name = "ECG-7";
+    int16_t rssi = -60;
+    std::vector<SimServiceSpec> services = Ecg7Services();
+
+    double notification_rate_hz = 250.0;  // 每个订阅的通知速率
+    std::size_t payload_size = 20;         // 每个通知的字节数
+    uint32_t jitter_us = 0;                // 每个通知在理想时刻上随机偏移 [-jitter, +jitter]
+    double loss_rate = 0.0;                // 丢包概率，被丢的包同样占用一个序号
+    double reorder_rate = 0.0;             // 一个包被扣下、在下一个包之后才送出的概率
+    double duplicate_rate = 0.0;           // 一个包被连续送出两次的概率
+
+    uint32_t connect_latency_us = 0;       // 建立连接的耗时
+    uint32_t connect_failures = 0;         // 前这么多次连接失败（不在范围内或被拒绝），之后才能连上
+    uint32_t request_latency_us = 0;       // 每个 GATT 请求（发现、写 CCCD）的耗时
+
+    PayloadGenerator payload_generator;    // 为空时使用 DefaultEcg7Payload
+};
+
+/**
+ * 模拟传输层：在 Linux 上按配置的速率、载荷大小、抖动、丢包、乱序和重复模拟一组设备
+ *
+ * 广播由一个扫描线程按 advertisement_rate_hz 轮流发出；
+ * 每个订阅有自己的通知线程，对应真实设备上互相独立的连接事件。
+ */
+class SimulatedTransport : public BleTransport {
+public:
+    explicit SimulatedTransport(std::vector<SimDeviceConfig> devices = {}, double advertisement_rate_hz = 100.0);
+    ~SimulatedTransport() override;
+
+    // 扫描开始前添加设备
+    void AddDevice(SimDeviceConfig config);
+
+    bool StartScan(AdvertisementHandler handler) override;
+    void StopScan() override;
+    std::future<std::shared_ptr<BleConnection>> ConnectAsync(uint64_t address) override;
+
+    // 所有连接累计处理的 GATT 请求数
+    uint64_t RequestCount() const { return request_counter_->load(std::memory_order_relaxed); }
+
+private:
+    struct SimDevice {
+        SimDeviceConfig config;
+        std::vector<uint8_t> raw_advertisement;
+        std::shared_ptr<std::atomic<uint32_t>> connect_attempts = std::make_shared<std::atomic<uint32_t>>(0);
+    };
+
+    void ScanLoop();
+
+    std::vector<SimDevice> devices_;
+    double advertisement_rate_hz_;
+    AdvertisementHandler scan_handler_;
+    std::atomic<bool> scanning_{false};
+    std::thread scan_thread_;
+    std::shared_ptr<std::atomic<uint64_t>> request_counter_ = std::make_shared<std::atomic<uint64_t>>(0);
+};
+
+}  // namespace ble
@@ -0,0 +1,672 @@
+﻿#include "ble/stream_server.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+
+#include "ble/clock.h"
+
+namespace ble {
+
+namespace {
+
+// 一次 sendmsg 最多带的批数
+constexpr std::size_t kMaxIovecs = 64;
+
+// 单个批的上限，用来拒绝格式错误的数据
+constexpr uint32_t kMaxBatchBytes = 64 * 1024 * 1024;
+
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL | MSG_DONTWAIT;
+#else
+constexpr int kSendFlags = MSG_DONTWAIT;
+#endif
+
+bool SetNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// 对端已关闭时写入返回 EPIPE 而不是发出 SIGPIPE
+void DisableSigPipe(int fd) {
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#else
+    (void)fd;
+#endif
+}
+
+// 小批量的实时数据不能等 Nagle 攒包
+void DisableNagle(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+bool FillUnixAddress(const std::string& path, sockaddr_un& address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+sockaddr_in LoopbackAddress(uint16_t port) {
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return address;
+}
+
+void CloseFd(int& fd) {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+}  // namespace
+
+struct StreamServer::Subscriber {
+    int fd = -1;
+    std::deque<Batch*> queue;         // 待发送的批，第一个可能已经发出一部分
+    std::size_t offset = 0;           // 第一个批已经发出的字节数
+    bool closing = false;
+    bool slow = false;                // 因为积压超过上限而断开
+    bool resync = false;              // 丢过批，丢掉的批里可能有流定义，下一个批之前要重发全部定义
+    StreamSubscriberStats stats;
+};
+
+StreamServer::StreamServer(StreamServerOptions options) : options_(std::move(options)), defined_(0x10000, 0) {
+    options_.batch_bytes = std::max(options_.batch_bytes, sizeof(StreamBatchHeader) + CaptureRecordSize(0));
+}
+
+StreamServer::~StreamServer() {
+    Close();
+}
+
+bool StreamServer::Open() {
+    if (IsOpen()) {
+        return true;
+    }
+    if (options_.unix_path.empty() && !options_.tcp) {
+        return false;
+    }
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0) {
+        return false;
+    }
+    wake_read_ = pipe_fds[0];
+    wake_write_ = pipe_fds[1];
+    SetNonBlocking(wake_read_);
+    SetNonBlocking(wake_write_);
+
+    bool ok = true;
+    if (!options_.unix_path.empty()) {
+        sockaddr_un address;
+        ok = FillUnixAddress(options_.unix_path, address);
+        if (ok) {
+            // 上次异常退出留下的套接字文件会让 bind 失败
+            unlink(options_.unix_path.c_str());
+            unix_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+            ok = unix_fd_ >= 0 && bind(unix_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 &&
+                 listen(unix_fd_, 64) == 0 && SetNonBlocking(unix_fd_);
+        }
+    }
+    if (ok && options_.tcp) {
+        sockaddr_in address = LoopbackAddress(options_.tcp_port);
+        tcp_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        ok = tcp_fd_ >= 0 && setsockopt(tcp_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == 0 &&
+             bind(tcp_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 &&
+             listen(tcp_fd_, 64) == 0 && SetNonBlocking(tcp_fd_);
+        socklen_t length = sizeof(address);
+        if (ok && getsockname(tcp_fd_, reinterpret_cast<sockaddr*>(&address), &length) == 0) {
+            tcp_port_ = ntohs(address.sin_port);
+        }
+    }
+    if (!ok) {
+        if (unix_fd_ >= 0) {
+            unlink(options_.unix_path.c_str());
+        }
+        CloseFd(unix_fd_);
+        CloseFd(tcp_fd_);
+        CloseFd(wake_read_);
+        CloseFd(wake_write_);
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = false;
+    }
+    thread_ = std::thread(&StreamServer::ServerLoop, this);
+    return true;
+}
+
+StreamServer::Batch* StreamServer::TakeBatchLocked() {
+    Batch* batch;
+    if (free_.empty()) {
+        batches_.push_back(std::make_unique<Batch>());
+        batch = batches_.back().get();
+        batch->data.resize(options_.batch_bytes);
+    } else {
+        batch = free_.back();
+        free_.pop_back();
+    }
+    batch->size = sizeof(StreamBatchHeader);
+    batch->records = 0;
+    batch->refs = 0;
+    batch->first_ns = 0;
+    return batch;
+}
+
+void StreamServer::SubmitLocked() {
+    if (current_ != nullptr && current_->records > 0) {
+        ready_.push_back(current_);
+        current_ = nullptr;
+    }
+}
+
+void StreamServer::AppendRecord(uint64_t timestamp_ns, uint16_t stream_id, uint8_t kind, const uint8_t* data,
+                                uint16_t length) {
+    const std::size_t record_size = CaptureRecordSize(length);
+    if (current_ != nullptr && current_->size + record_size > options_.batch_bytes) {
+        SubmitLocked();
+    }
+    if (current_ == nullptr) {
+        current_ = TakeBatchLocked();
+        current_->first_ns = MonotonicNowNs();
+    }
+    // 比整批还大的记录单独成批
+    if (current_->size + record_size > current_->data.size()) {
+        current_->data.resize(current_->size + record_size);
+    }
+    CaptureRecordHeader header{};
+    header.timestamp_ns = timestamp_ns;
+    header.characteristic_id = stream_id;
+    header.length = length;
+    header.kind = kind;
+    uint8_t* out = current_->data.data() + current_->size;
+    std::memcpy(out, &header, sizeof(header));
+    std::memcpy(out + sizeof(header), data, length);
+    std::memset(out + sizeof(header) + length, 0, record_size - sizeof(header) - length);
+    current_->size += record_size;
+    ++current_->records;
+    ++records_;
+}
+
+void StreamServer::Publish(uint64_t timestamp_ns, uint16_t stream_id, const Guid& uuid, const uint8_t* data,
+                           uint16_t length) {
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            return;
+        }
+        const bool started = current_ == nullptr;
+        const std::size_t ready = ready_.size();
+        if (!defined_[stream_id]) {
+            defined_[stream_id] = 1;
+            definitions_.emplace_back(stream_id, uuid);
+            CaptureCharacteristicDefinition definition{uuid};
+            AppendRecord(timestamp_ns, stream_id, kCaptureRecordDefinition, reinterpret_cast<const uint8_t*>(&definition),
+                         sizeof(definition));
+        }
+        AppendRecord(timestamp_ns, stream_id, kCaptureRecordNotification, data, length);
+        // 新开一批时服务器线程要按它的时限醒来，批满时要立即分发，其余情况不必唤醒
+        wake = started || ready_.size() != ready;
+    }
+    if (wake) {
+        Wake();
+    }
+}
+
+void StreamServer::Flush() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        SubmitLocked();
+    }
+    Wake();
+}
+
+void StreamServer::Wake() {
+    const uint8_t byte = 1;
+    // 管道已满说明服务器线程已经有事可做，写失败也没关系
+    ssize_t written = write(wake_write_, &byte, 1);
+    (void)written;
+}
+
+void StreamServer::Close() {
+    if (!IsOpen()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        SubmitLocked();
+        stopping_ = true;
+    }
+    Wake();
+    thread_.join();
+    if (unix_fd_ >= 0) {
+        unlink(options_.unix_path.c_str());
+    }
+    CloseFd(unix_fd_);
+    CloseFd(tcp_fd_);
+    CloseFd(wake_read_);
+    CloseFd(wake_write_);
+}
+
+void StreamServer::Release(Batch* batch) {
+    if (--batch->refs == 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_.push_back(batch);
+    }
+}
+
+void StreamServer::Distribute(Batch* batch) {
+    StreamBatchHeader header{};
+    header.magic = kStreamBatchMagic;
+    header.bytes = static_cast<uint32_t>(batch->size);
+    header.sequence = ++sequence_;
+    header.records = batch->records;
+    header.flags = 0;
+    std::memcpy(batch->data.data(), &header, sizeof(header));
+    ++published_batches_;
+    published_bytes_ += batch->size;
+
+    // 每个订阅者只是多一个引用，数据本身不复制
+    batch->refs = 1;
+    for (auto& subscriber : subscribers_) {
+        if (subscriber->closing) {
+            continue;
+        }
+        StreamSubscriberStats& stats = subscriber->stats;
+        // 流定义只随第一次出现的批发出一次，丢过批的订阅者先补一个快照批，
+        // 否则它会一直收到无法解释的流编号
+        Batch* snapshot = subscriber->resync ? MakeSnapshot() : nullptr;
+        const std::size_t snapshot_size = snapshot != nullptr ? snapshot->size : 0;
+        if (stats.queued_bytes + snapshot_size + batch->size > options_.max_queued_bytes) {
+            if (snapshot != nullptr) {
+                Release(snapshot);
+            }
+            if (options_.policy == SlowSubscriberPolicy::Disconnect) {
+                subscriber->closing = true;
+                subscriber->slow = true;
+            } else {
+                ++stats.dropped_batches;
+                stats.dropped_bytes += batch->size;
+                ++dropped_batches_;
+                subscriber->resync = true;
+            }
+            continue;
+        }
+        if (snapshot != nullptr) {
+            subscriber->queue.push_back(snapshot);
+            stats.queued_bytes += snapshot_size;
+            subscriber->resync = false;
+            ++stats.resyncs;
+        }
+        subscriber->queue.push_back(batch);
+        ++batch->refs;
+        stats.queued_bytes += batch->size;
+        stats.peak_queued_bytes = std::max(stats.peak_queued_bytes, stats.queued_bytes);
+    }
+    // 分发本身持有的引用，没有订阅者时批立即回到空闲池
+    Release(batch);
+}
+
+bool StreamServer::Send(Subscriber& subscriber) {
+    while (!subscriber.queue.empty()) {
+        iovec iov[kMaxIovecs];
+        std::size_t count = 0;
+        std::size_t total = 0;
+        for (Batch* batch : subscriber.queue) {
+            if (count == kMaxIovecs) {
+                break;
+            }
+            const std::size_t skip = count == 0 ? subscriber.offset : 0;
+            iov[count].iov_base = batch->data.data() + skip;
+            iov[count].iov_len = batch->size - skip;
+            total += iov[count].iov_len;
+            ++count;
+        }
+        msghdr message{};
+        message.msg_iov = iov;
+        message.msg_iovlen = count;
+        ssize_t sent = sendmsg(subscriber.fd, &message, kSendFlags);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // 发送缓冲区满，等 POLLOUT；其他错误说明连接已经断开
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        std::size_t remaining = static_cast<std::size_t>(sent);
+        subscriber.stats.sent_bytes += remaining;
+        subscriber.stats.queued_bytes -= remaining;
+        while (remaining > 0) {
+            Batch* batch = subscriber.queue.front();
+            const std::size_t left = batch->size - subscriber.offset;
+            if (remaining < left) {
+                subscriber.offset += remaining;
+                break;
+            }
+            remaining -= left;
+            subscriber.offset = 0;
+            subscriber.queue.pop_front();
+            ++subscriber.stats.sent_batches;
+            Release(batch);
+        }
+        if (static_cast<std::size_t>(sent) < total) {
+            return true;
+        }
+    }
+    return true;
+}
+
+StreamServer::Batch* StreamServer::MakeSnapshot() {
+    Batch* snapshot;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        snapshot = TakeBatchLocked();
+        for (const auto& definition : definitions_) {
+            const std::size_t record_size = CaptureRecordSize(sizeof(CaptureCharacteristicDefinition));
+            if (snapshot->size + record_size > snapshot->data.size()) {
+                snapshot->data.resize(snapshot->size + record_size);
+            }
+            CaptureRecordHeader header{};
+            header.characteristic_id = definition.first;
+            header.length = sizeof(CaptureCharacteristicDefinition);
+            header.kind = kCaptureRecordDefinition;
+            CaptureCharacteristicDefinition payload{definition.second};
+            uint8_t* out = snapshot->data.data() + snapshot->size;
+            std::memset(out, 0, record_size);
+            std::memcpy(out, &header, sizeof(header));
+            std::memcpy(out + sizeof(header), &payload, sizeof(payload));
+            snapshot->size += record_size;
+            ++snapshot->records;
+        }
+    }
+    StreamBatchHeader header{};
+    header.magic = kStreamBatchMagic;
+    header.bytes = static_cast<uint32_t>(snapshot->size);
+    header.sequence = 0;
+    header.records = snapshot->records;
+    header.flags = kStreamBatchSnapshot;
+    std::memcpy(snapshot->data.data(), &header, sizeof(header));
+    snapshot->refs = 1;
+    return snapshot;
+}
+
+void StreamServer::Accept(int listener) {
+    for (;;) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        if (subscribers_.size() >= options_.max_subscribers || !SetNonBlocking(fd)) {
+            close(fd);
+            continue;
+        }
+        DisableSigPipe(fd);
+        if (listener == tcp_fd_) {
+            DisableNagle(fd);
+        }
+        auto subscriber = std::make_unique<Subscriber>();
+        subscriber->fd = fd;
+        subscriber->stats.id = next_subscriber_id_++;
+        ++accepted_;
+
+        // 新订阅者先收到已有的全部定义，之后的实时批才能解释
+        Batch* snapshot = MakeSnapshot();
+        subscriber->queue.push_back(snapshot);
+        subscriber->stats.queued_bytes = snapshot->size;
+        subscriber->stats.peak_queued_bytes = snapshot->size;
+        subscribers_.push_back(std::move(subscriber));
+    }
+}
+
+void StreamServer::Disconnect(std::size_t index) {
+    Subscriber& subscriber = *subscribers_[index];
+    for (Batch* batch : subscriber.queue) {
+        Release(batch);
+    }
+    close(subscriber.fd);
+    ++disconnected_;
+    if (subscriber.slow) {
+        ++slow_disconnects_;
+    }
+    subscribers_.erase(subscribers_.begin() + static_cast<std::ptrdiff_t>(index));
+}
+
+void StreamServer::ServerLoop() {
+    std::vector<pollfd> fds;
+    std::vector<Batch*> ready;
+    for (;;) {
+        int timeout_ms = -1;
+        bool stopping;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (current_ != nullptr && current_->records > 0) {
+                const uint64_t deadline = current_->first_ns + options_.flush_interval_ms * 1000000ull;
+                const uint64_t now = MonotonicNowNs();
+                if (now >= deadline) {
+                    SubmitLocked();
+                } else {
+                    timeout_ms = static_cast<int>((deadline - now + 999999) / 1000000);
+                }
+            }
+            ready.swap(ready_);
+            stopping = stopping_;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(clients_mutex_);
+            for (Batch* batch : ready) {
+                Distribute(batch);
+            }
+            ready.clear();
+            for (auto& subscriber : subscribers_) {
+                if (!subscriber->closing && !subscriber->queue.empty() && !Send(*subscriber)) {
+                    subscriber->closing = true;
+                }
+            }
+            for (std::size_t i = subscribers_.size(); i-- > 0;) {
+                if (stopping || subscribers_[i]->closing) {
+                    Disconnect(i);
+                }
+            }
+        }
+        if (stopping) {
+            return;
+        }
+
+        fds.clear();
+        fds.push_back({wake_read_, POLLIN, 0});
+        fds.push_back({unix_fd_, POLLIN, 0});   // fd 为 -1 时 poll 忽略它
+        fds.push_back({tcp_fd_, POLLIN, 0});
+        const std::size_t first_subscriber = fds.size();
+        {
+            std::lock_guard<std::mutex> lock(clients_mutex_);
+            for (const auto& subscriber : subscribers_) {
+                fds.push_back({subscriber->fd, static_cast<short>(POLLIN | (subscriber->queue.empty() ? 0 : POLLOUT)), 0});
+            }
+        }
+        if (poll(fds.data(), fds.size(), timeout_ms) <= 0) {
+            continue;
+        }
+        if (fds[0].revents & POLLIN) {
+            uint8_t drain[256];
+            while (read(wake_read_, drain, sizeof(drain)) > 0) {
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(clients_mutex_);
+        for (std::size_t i = first_subscriber; i < fds.size(); ++i) {
+            Subscriber& subscriber = *subscribers_[i - first_subscriber];
+            const short revents = fds[i].revents;
+            if (revents & POLLIN) {
+                // 订阅者不应该发来数据，读出丢弃；读到 0 表示对方已关闭
+                uint8_t discard[256];
+                ssize_t n = recv(subscriber.fd, discard, sizeof(discard), MSG_DONTWAIT);
+                if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                    subscriber.closing = true;
+                }
+            }
+            if (revents & (POLLERR | POLLNVAL)) {
+                subscriber.closing = true;
+            }
+            if (!subscriber.closing && (revents & POLLOUT) && !Send(subscriber)) {
+                subscriber.closing = true;
+            }
+        }
+        if (fds[1].revents & POLLIN) {
+            Accept(unix_fd_);
+        }
+        if (fds[2].revents & POLLIN) {
+            Accept(tcp_fd_);
+        }
+    }
+}
+
+StreamServerStats StreamServer::Stats() const {
+    StreamServerStats stats;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats.records = records_;
+        stats.pool_batches = batches_.size();
+    }
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    stats.batches = published_batches_;
+    stats.bytes = published_bytes_;
+    stats.accepted = accepted_;
+    stats.disconnected = disconnected_;
+    stats.slow_disconnects = slow_disconnects_;
+    stats.dropped_batches = dropped_batches_;
+    stats.subscribers = subscribers_.size();
+    return stats;
+}
+
+std::vector<StreamSubscriberStats> StreamServer::Subscribers() const {
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    std::vector<StreamSubscriberStats> result;
+    result.reserve(subscribers_.size());
+    for (const auto& subscriber : subscribers_) {
+        result.push_back(subscriber->stats);
+    }
+    return result;
+}
+
+bool StreamClient::ConnectUnix(const std::string& path) {
+    Close();
+    sockaddr_un address;
+    if (!FillUnixAddress(path, address)) {
+        return false;
+    }
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd_ < 0 || connect(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool StreamClient::ConnectTcp(uint16_t port) {
+    Close();
+    sockaddr_in address = LoopbackAddress(port);
+    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd_ < 0 || connect(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        Close();
+        return false;
+    }
+    DisableNagle(fd_);
+    return true;
+}
+
+void StreamClient::SetReceiveBuffer(int bytes) {
+    if (fd_ >= 0) {
+        setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes));
+    }
+}
+
+bool StreamClient::ReadFully(void* data, std::size_t length) {
+    uint8_t* out = static_cast<uint8_t*>(data);
+    while (length > 0) {
+        ssize_t n = recv(fd_, out, length, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        out += n;
+        length -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool StreamClient::ReadBatch(StreamBatchHeader& header, std::vector<uint8_t>& records) {
+    if (fd_ < 0 || !ReadFully(&header, sizeof(header))) {
+        return false;
+    }
+    if (header.magic != kStreamBatchMagic || header.bytes < sizeof(header) || header.bytes > kMaxBatchBytes) {
+        return false;
+    }
+    records.resize(header.bytes - sizeof(header));
+    if (!ReadFully(records.data(), records.size())) {
+        return false;
+    }
+    if ((header.flags & kStreamBatchSnapshot) == 0) {
+        if (last_sequence_ != 0 && header.sequence > last_sequence_ + 1) {
+            missed_ += header.sequence - last_sequence_ - 1;
+        }
+        last_sequence_ = header.sequence;
+    }
+    return true;
+}
+
+void StreamClient::Close() {
+    CloseFd(fd_);
+    last_sequence_ = 0;
+}
+
+std::size_t ForEachStreamRecord(const uint8_t* records, std::size_t length,
+                                const std::function<bool(const CaptureRecordHeader&, const uint8_t*)>& fn) {
+    std::size_t count = 0;
+    std::size_t offset = 0;
+    while (offset + sizeof(CaptureRecordHeader) <= length) {
+        CaptureRecordHeader header;
+        std::memcpy(&header, records + offset, sizeof(header));
+        const std::size_t record_size = CaptureRecordSize(header.length);
+        if (offset + record_size > length) {
+            break;
+        }
+        ++count;
+        if (!fn(header, records + offset + sizeof(header))) {
+            break;
+        }
+        offset += record_size;
+    }
+    return count;
+}
+
+}  // namespace ble
@@ -0,0 +1,241 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ble/capture_file.h"
+#include "ble/guid.h"
+
+namespace ble {
+
+/*
+ * 本地实时数据流的传输格式（小端序）
+ *
+ *   { StreamBatchHeader + 若干条记录 } 重复
+ *
+ * 记录与抓包文件完全相同：CaptureRecordHeader + 载荷，按 8 字节对齐（capture_file.h），
+ * characteristic_id 是 (设备编号 << 8) | 流编号。每个流第一次出现时先有一条 kCaptureRecordDefinition
+ * 记录给出它的 UUID；新连接的订阅者先收到一个 kStreamBatchSnapshot 批，里面是已有的全部定义，
+ * 因为读得太慢被丢弃过批的订阅者在下一个送达的实时批之前也会再收到一个快照批。
+ * 实时批的 sequence 从 1 开始连续编号，订阅者据此发现因为读得太慢被丢弃的批；快照批的 sequence 为 0。
+ */
+
+constexpr uint32_t kStreamBatchMagic = 0x53454C42;  // "BLES"
+constexpr uint32_t kStreamBatchSnapshot = 1;
+
+struct StreamBatchHeader {
+    uint32_t magic;
+    uint32_t bytes;        // 包括本头部在内的总长度
+    uint64_t sequence;
+    uint32_t records;
+    uint32_t flags;
+};
+
+static_assert(sizeof(StreamBatchHeader) == 24, "unexpected stream batch header size");
+
+// 订阅者读得太慢、待发送数据超过上限时的处理方式
+enum class SlowSubscriberPolicy {
+    Drop,         // 丢弃新的批并计数，订阅者能从 sequence 的缺口看出来
+    Disconnect,   // 断开连接
+};
+
+struct StreamServerOptions {
+    std::string unix_path;                    // Unix 域套接字路径，为空时不监听
+    bool tcp = false;                         // 是否监听 127.0.0.1
+    uint16_t tcp_port = 0;                    // 0 表示由系统分配，实际端口见 TcpPort()
+    std::size_t batch_bytes = 16 * 1024;      // 每批的大小上限
+    uint32_t flush_interval_ms = 5;           // 未满的批最多等这么久就发出
+    std::size_t max_queued_bytes = 4 * 1024 * 1024;  // 每个订阅者最多积压的数据量
+    SlowSubscriberPolicy policy = SlowSubscriberPolicy::Drop;
+    std::size_t max_subscribers = 256;
+};
+
+struct StreamSubscriberStats {
+    uint64_t id = 0;                  // 连接编号，从 1 开始
+    uint64_t sent_bytes = 0;
+    uint64_t sent_batches = 0;        // 完整发出的批数
+    uint64_t dropped_batches = 0;
+    uint64_t dropped_bytes = 0;
+    std::size_t queued_bytes = 0;     // 当前积压（还没发出的部分）
+    std::size_t peak_queued_bytes = 0;
+    uint64_t resyncs = 0;             // 丢批后补发定义快照的次数
+};
+
+/**
+ * 服务器统计，除 subscribers 和 pool_batches 外都是累计的
+ */
+struct StreamServerStats {
+    uint64_t records = 0;             // Publish 的记录数，包括定义记录
+    uint64_t batches = 0;             // 发出的实时批数
+    uint64_t bytes = 0;               // 实时批的总字节数（每批只算一次，与订阅者数无关）
+    uint64_t accepted = 0;
+    uint64_t disconnected = 0;        // 订阅者断开或因为太慢被断开的次数
+    uint64_t slow_disconnects = 0;    // 其中因为太慢被断开的次数
+    uint64_t dropped_batches = 0;     // 所有订阅者被丢弃的批数之和
+    std::size_t subscribers = 0;
+    std::size_t pool_batches = 0;     // 已分配的批缓冲区个数
+};
+
+/**
+ * 把通知实时分发给多个本地订阅者（查看器、录制、分析工具）的服务器
+ *
+ * 解码线程调用 Publish 只是在持锁时把一条记录复制进当前批，不做任何 I/O。
+ * 批写满或超过 flush_interval_ms 后由服务器线程分发：同一个批缓冲区被所有订阅者共享，
+ * 只增加引用计数、挂到各自的发送队列上，用 sendmsg 直接从共享缓冲区发出，没有按订阅者的复制；
+ * 所有订阅者都发完后缓冲区回到空闲池，稳定运行时不再分配内存。
+ * 每个订阅者有自己的发送队列和积压上限，一个订阅者读得慢只影响它自己：
+ * 超过上限后按 policy 丢弃新的批或断开它，其他订阅者和解码线程都不受影响。
+ *
+ * 所有套接字都是非阻塞的，由一个服务器线程用 poll 处理。只在 POSIX 系统上提供。
+ */
+class StreamServer {
+public:
+    explicit StreamServer(StreamServerOptions options = {});
+    ~StreamServer();
+
+    StreamServer(const StreamServer&) = delete;
+    StreamServer& operator=(const StreamServer&) = delete;
+
+    /**
+     * 开始监听并启动服务器线程
+     * @return 套接字创建或绑定失败时返回 false
+     */
+    bool Open();
+
+    bool IsOpen() const { return thread_.joinable(); }
+
+    /**
+     * 发布一条记录，可以在多个线程上调用；流第一次出现时先发布它的定义记录
+     * @param timestamp_ns
+     * @param stream_id 记录里的 characteristic_id
+     * @param uuid
+     * @param data
+     * @param length
+     */
+    void Publish(uint64_t timestamp_ns, uint16_t stream_id, const Guid& uuid, const uint8_t* data, uint16_t length);
+
+    // 立即发出当前未满的批
+    void Flush();
+
+    // 发出剩余数据（不等待慢订阅者），断开所有订阅者并停止服务器线程
+    void Close();
+
+    // Open() 之后有效
+    uint16_t TcpPort() const { return tcp_port_; }
+    const StreamServerOptions& Options() const { return options_; }
+
+    StreamServerStats Stats() const;
+    std::vector<StreamSubscriberStats> Subscribers() const;
+
+private:
+    struct Batch {
+        std::vector<uint8_t> data;
+        std::size_t size = 0;
+        uint32_t records = 0;
+        uint32_t refs = 0;            // 还没发完的订阅者数，只由服务器线程修改
+        uint64_t first_ns = 0;        // 第一条记录写入的时间
+    };
+
+    struct Subscriber;
+
+    void AppendRecord(uint64_t timestamp_ns, uint16_t stream_id, uint8_t kind, const uint8_t* data, uint16_t length);
+    void SubmitLocked();                  // 持 mutex_ 调用：把当前批交给服务器线程
+    Batch* TakeBatchLocked();             // 持 mutex_ 调用：从空闲池取一个批
+    void Wake();
+    void ServerLoop();
+    void Accept(int listener);
+    Batch* MakeSnapshot();                // 已有的全部定义组成的快照批，引用计数为 1
+    void Distribute(Batch* batch);
+    bool Send(Subscriber& subscriber);
+    void Release(Batch* batch);
+    void Disconnect(std::size_t index);
+
+    StreamServerOptions options_;
+    int unix_fd_ = -1;
+    int tcp_fd_ = -1;
+    int wake_read_ = -1;                  // 自唤醒管道
+    int wake_write_ = -1;
+    uint16_t tcp_port_ = 0;
+    std::thread thread_;
+
+    // 发布端：当前批、待分发的批、空闲池和已有的定义
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<Batch>> batches_;   // 所有分配过的批，只增不减
+    std::vector<Batch*> free_;
+    std::vector<Batch*> ready_;           // 按提交顺序分发
+    Batch* current_ = nullptr;
+    std::vector<uint8_t> defined_;        // 下标是流编号，非零表示已经发布过定义
+    std::vector<std::pair<uint16_t, Guid>> definitions_;
+    uint64_t records_ = 0;
+    bool stopping_ = true;                // 没有打开或已经关闭时 Publish 直接返回
+
+    // 服务器线程：订阅者和分发统计，Stats() 读取时持 clients_mutex_
+    mutable std::mutex clients_mutex_;
+    std::vector<std::unique_ptr<Subscriber>> subscribers_;
+    uint64_t next_subscriber_id_ = 1;
+    uint64_t sequence_ = 0;
+    uint64_t published_batches_ = 0;
+    uint64_t published_bytes_ = 0;
+    uint64_t accepted_ = 0;
+    uint64_t disconnected_ = 0;
+    uint64_t slow_disconnects_ = 0;
+    uint64_t dropped_batches_ = 0;
+};
+
+/**
+ * 订阅端：连接到 StreamServer，按批读出记录。阻塞读取，一个客户端只应在一个线程上使用
+ */
+class StreamClient {
+public:
+    StreamClient() = default;
+    ~StreamClient() { Close(); }
+
+    StreamClient(const StreamClient&) = delete;
+    StreamClient& operator=(const StreamClient&) = delete;
+
+    bool ConnectUnix(const std::string& path);
+    bool ConnectTcp(uint16_t port);
+
+    /**
+     * 读出下一个完整的批
+     * @param header
+     * @param records 批内全部记录（不含批头），可以用 ForEachStreamRecord 遍历
+     * @return 连接关闭或数据格式错误时返回 false
+     */
+    bool ReadBatch(StreamBatchHeader& header, std::vector<uint8_t>& records);
+
+    // 收到的实时批里 sequence 的缺口之和，就是服务器因为本客户端太慢丢弃的批数
+    uint64_t MissedBatches() const { return missed_; }
+
+    // 调整接收缓冲区大小（字节），在连接之后调用
+    void SetReceiveBuffer(int bytes);
+
+    void Close();
+
+    int Fd() const { return fd_; }
+
+private:
+    bool ReadFully(void* data, std::size_t length);
+
+    int fd_ = -1;
+    uint64_t last_sequence_ = 0;
+    uint64_t missed_ = 0;
+};
+
+/**
+ * 遍历一个批里的记录
+ * @param records StreamClient::ReadBatch 读出的记录部分
+ * @param length
+ * @param fn 参数是记录头和载荷，返回 false 时停止
+ * @return 遍历的记录数
+ */
+std::size_t ForEachStreamRecord(const uint8_t* records, std::size_t length,
+                                const std::function<bool(const CaptureRecordHeader&, const uint8_t*)>& fn);
+
+}  // namespace ble
@@ -0,0 +1,158 @@
+﻿#include "ble/subscription.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <utility>
+
+#include "ble/clock.h"
+
+namespace ble {
+
+const char* SubscriptionStateName(SubscriptionState state) {
+    switch (state) {
+        case SubscriptionState::Pending:
+            return "Pending";
+        case SubscriptionState::Active:
+            return "Active";
+        case SubscriptionState::Failed:
+            return "Failed";
+        case SubscriptionState::TimedOut:
+            return "TimedOut";
+        case SubscriptionState::Removed:
+            return "Removed";
+    }
+    return "Unknown";
+}
+
+bool PreferredSubscriptionKind(const GattCharacteristicInfo& characteristic, SubscriptionKind& kind) {
+    if (characteristic.Has(kPropertyNotify)) {
+        kind = SubscriptionKind::Notify;
+        return true;
+    }
+    if (characteristic.Has(kPropertyIndicate)) {
+        kind = SubscriptionKind::Indicate;
+        return true;
+    }
+    return false;
+}
+
+SubscriptionSet::SubscriptionSet(std::shared_ptr<BleConnection> connection, AbandonedRequests* abandoned)
+    : connection_(std::move(connection)), abandoned_(abandoned != nullptr ? abandoned : &own_abandoned_) {}
+
+SubscriptionSet::~SubscriptionSet() {
+    UnsubscribeAll();
+}
+
+std::size_t SubscriptionSet::Activate(std::vector<SubscriptionRequest> requests, uint32_t timeout_ms) {
+    const uint64_t start = MonotonicNowNs();
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+    std::size_t first;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        first = records_.size();
+        for (const auto& request : requests) {
+            SubscriptionRecord record;
+            record.characteristic = request.characteristic;
+            record.kind = request.kind;
+            records_.push_back(record);
+        }
+    }
+
+    // 全部请求先发出去，协议栈可以把 CCCD 写入排进连续的连接事件；
+    // 每个请求在完成时记下时间戳，启用耗时不受收集顺序影响。
+    // handoff 由完成的任务和超时放弃的收集方各置一次，后置位的一方负责取消迟到的订阅：
+    // 不论成功与否，回调都可能已经注册，失败的也要取消
+    using Completion = std::pair<GattStatus, uint64_t>;
+    std::vector<std::future<Completion>> pending;
+    std::vector<std::shared_ptr<std::atomic<bool>>> handoffs;
+    pending.reserve(requests.size());
+    handoffs.reserve(requests.size());
+    for (auto& request : requests) {
+        auto future = connection_->SubscribeAsync(request.characteristic, request.kind, std::move(request.handler));
+        auto handoff = std::make_shared<std::atomic<bool>>(false);
+        pending.push_back(std::async(std::launch::async, [connection = connection_, characteristic = request.characteristic,
+                                                          handoff, future = std::move(future)]() mutable {
+            GattStatus status = future.get();
+            if (handoff->exchange(true)) {
+                connection->Unsubscribe(characteristic);
+            }
+            return Completion(status, MonotonicNowNs());
+        }));
+        handoffs.push_back(std::move(handoff));
+    }
+
+    std::size_t activated = 0;
+    for (std::size_t i = 0; i < pending.size(); ++i) {
+        SubscriptionState state;
+        GattStatus status;
+        uint64_t done_ns;
+        if (pending[i].wait_until(deadline) == std::future_status::ready) {
+            Completion completion = pending[i].get();
+            status = completion.first;
+            done_ns = completion.second;
+            state = status == GattStatus::Success ? SubscriptionState::Active : SubscriptionState::Failed;
+            if (state == SubscriptionState::Failed) {
+                // 回调可能已经注册，失败时也要清掉
+                connection_->Unsubscribe(requests[i].characteristic);
+            }
+        } else {
+            status = GattStatus::Timeout;
+            state = SubscriptionState::TimedOut;
+            done_ns = MonotonicNowNs();
+            // 迟到的结果立即取消，避免登记表之外还有回调；任务已经结束时（不论成功与否）在这里取消，
+            // 还没结束时由它自己取消
+            if (handoffs[i]->exchange(true)) {
+                connection_->Unsubscribe(requests[i].characteristic);
+            } else {
+                abandoned_->Add(std::move(pending[i]));
+            }
+        }
+
+        double activation_ms = static_cast<double>(done_ns - start) / 1e6;
+        std::lock_guard<std::mutex> lock(mutex_);
+        SubscriptionRecord& record = records_[first + i];
+        record.state = state;
+        record.status = status;
+        record.activation_ms = activation_ms;
+        if (state == SubscriptionState::Active) {
+            ++activated;
+        }
+    }
+    return activated;
+}
+
+std::vector<SubscriptionRecord> SubscriptionSet::Records() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return records_;
+}
+
+std::size_t SubscriptionSet::ActiveCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::size_t count = 0;
+    for (const auto& record : records_) {
+        if (record.state == SubscriptionState::Active) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+void SubscriptionSet::UnsubscribeAll() {
+    std::vector<GattCharacteristicInfo> active;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& record : records_) {
+            if (record.state == SubscriptionState::Active) {
+                record.state = SubscriptionState::Removed;
+                active.push_back(record.characteristic);
+            }
+        }
+    }
+    for (const auto& characteristic : active) {
+        connection_->Unsubscribe(characteristic);
+    }
+}
+
+}  // namespace ble
@@ -0,0 +1,91 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "ble/transport.h"
+
+namespace ble {
+
+enum class SubscriptionState {
+    Pending,    // CCCD 写入已发出
+    Active,
+    Failed,
+    TimedOut,   // 超时后放弃，迟到的成功会被立即取消
+    Removed,
+};
+
+const char* SubscriptionStateName(SubscriptionState state);
+
+struct SubscriptionRequest {
+    GattCharacteristicInfo characteristic;
+    SubscriptionKind kind = SubscriptionKind::Notify;
+    NotificationHandler handler;
+};
+
+/**
+ * 订阅登记表中的一项
+ */
+struct SubscriptionRecord {
+    GattCharacteristicInfo characteristic;
+    SubscriptionKind kind = SubscriptionKind::Notify;
+    SubscriptionState state = SubscriptionState::Pending;
+    GattStatus status = GattStatus::Unreachable;
+    double activation_ms = 0.0;   // 从发出请求到 CCCD 写入完成
+};
+
+/**
+ * 特性支持通知时用通知，只支持指示时用指示，都不支持返回 false
+ * @param characteristic
+ * @param kind
+ */
+bool PreferredSubscriptionKind(const GattCharacteristicInfo& characteristic, SubscriptionKind& kind);
+
+/**
+ * 一个连接上的订阅集合
+ *
+ * Activate() 同时发出所有 CCCD 写入，等它们全部完成或超时后返回，
+ * 不会停在某一个特性上；结果记录在登记表里，可以随时查询各订阅的状态和启用耗时。
+ * 超时的请求交给 AbandonedRequests 等待，迟到的成功由等待结果的任务自己取消。
+ * 析构时取消全部订阅。
+ */
+class SubscriptionSet {
+public:
+    /**
+     * @param connection
+     * @param abandoned 超时的请求放到这里，在 SubscriptionSet 之后销毁；为 nullptr 时由本对象析构时等待
+     */
+    explicit SubscriptionSet(std::shared_ptr<BleConnection> connection, AbandonedRequests* abandoned = nullptr);
+    ~SubscriptionSet();
+
+    SubscriptionSet(const SubscriptionSet&) = delete;
+    SubscriptionSet& operator=(const SubscriptionSet&) = delete;
+
+    /**
+     * 启用一组订阅，回调在返回前就可能开始触发
+     * @param requests
+     * @param timeout_ms 整组请求的超时
+     * @return 本次成功启用的订阅数
+     */
+    std::size_t Activate(std::vector<SubscriptionRequest> requests, uint32_t timeout_ms = 5000);
+
+    // 登记表的副本，顺序与 Activate 的请求顺序一致
+    std::vector<SubscriptionRecord> Records() const;
+
+    std::size_t ActiveCount() const;
+
+    // 取消全部仍然有效的订阅，返回后不会再有回调
+    void UnsubscribeAll();
+
+private:
+    std::shared_ptr<BleConnection> connection_;
+    mutable std::mutex mutex_;
+    std::vector<SubscriptionRecord> records_;
+    AbandonedRequests own_abandoned_;
+    AbandonedRequests* abandoned_;
+};
+
+}  // namespace ble
@@ -0,0 +1,92 @@
+﻿#include "ble/synthetic_ecg.h"
+
+#include <cmath>
+
+namespace ble {
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+// 相对 R 波的位置（秒）、宽度（秒）和幅度（相对 R 波）
+struct Wave {
+    double offset_s;
+    double width_s;
+    double amplitude;
+};
+
+constexpr Wave kWaves[] = {
+        {-0.20, 0.025, 0.12},   // P
+        {-0.035, 0.010, -0.15}, // Q
+        {0.0, 0.012, 1.0},      // R
+        {0.035, 0.010, -0.25},  // S
+        {0.25, 0.045, 0.30},    // T
+};
+
+}  // namespace
+
+SyntheticEcg::SyntheticEcg(SyntheticEcgOptions options) : options_(options), rng_(options.seed | 1) {
+    // 类似 I、II、III 导联的幅度差异，更多导联依次循环
+    const double gains[] = {1.0, 1.4, 0.6, -0.5, 0.8, 1.2, 0.9, 0.7};
+    for (std::size_t l = 0; l < options_.leads; ++l) {
+        lead_gain_.push_back(gains[l % 8]);
+    }
+    next_beat_ = options_.sample_rate_hz * 0.3;
+}
+
+double SyntheticEcg::NextUniform() {
+    rng_ ^= rng_ << 13;
+    rng_ ^= rng_ >> 7;
+    rng_ ^= rng_ << 17;
+    return static_cast<double>(rng_ >> 11) / 9007199254740992.0;
+}
+
+void SyntheticEcg::ScheduleBeat() {
+    previous_beat_ = current_beat_;
+    current_beat_ = next_beat_;
+    beats_.push_back(static_cast<uint64_t>(std::llround(current_beat_)));
+    double rr = 60.0 / options_.heart_rate_bpm * (1.0 + options_.rr_variability * (2.0 * NextUniform() - 1.0));
+    next_beat_ = current_beat_ + rr * options_.sample_rate_hz;
+}
+
+void SyntheticEcg::Next(int32_t* frame) {
+    const double fs = options_.sample_rate_hz;
+    const double n = static_cast<double>(sample_);
+    // 提前 0.3 秒安排下一拍，P 波可以在 R 波之前出现
+    while (n >= next_beat_ - 0.3 * fs) {
+        ScheduleBeat();
+    }
+
+    double beat = 0.0;
+    // 当前时刻只可能落在最近两拍的波形范围内
+    for (double center : {previous_beat_, current_beat_}) {
+        for (const Wave& wave : kWaves) {
+            double t = (n - center) / fs - wave.offset_s;
+            if (std::fabs(t) < 5.0 * wave.width_s) {
+                beat += wave.amplitude * std::exp(-t * t / (2.0 * wave.width_s * wave.width_s));
+            }
+        }
+    }
+
+    const double seconds = n / fs;
+    const double interference = options_.baseline_offset +
+                                options_.wander_amplitude * std::sin(2.0 * kPi * 0.3 * seconds) +
+                                options_.mains_amplitude * std::sin(2.0 * kPi * options_.mains_hz * seconds);
+    for (std::size_t l = 0; l < options_.leads; ++l) {
+        double noise = options_.noise_amplitude * (2.0 * NextUniform() - 1.0);
+        frame[l] = static_cast<int32_t>(std::lround(lead_gain_[l] * options_.r_amplitude * beat + interference + noise));
+    }
+    ++sample_;
+}
+
+void SyntheticEcg::Generate(int32_t* const* leads, std::size_t frames) {
+    frame_.resize(options_.leads);
+    for (std::size_t f = 0; f < frames; ++f) {
+        Next(frame_.data());
+        for (std::size_t l = 0; l < options_.leads; ++l) {
+            leads[l][f] = frame_[l];
+        }
+    }
+}
+
+}  // namespace ble
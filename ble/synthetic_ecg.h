@@ -0,0 +1,67 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ble {
+
+/**
+ * 合成心电信号的参数，幅度单位是 ADC 计数
+ */
+struct SyntheticEcgOptions {
+    double sample_rate_hz = 250.0;
+    std::size_t leads = 3;
+    double heart_rate_bpm = 72.0;
+    double rr_variability = 0.05;      // RR 间期的随机变化比例
+    double r_amplitude = 1000.0;       // R 波幅度
+    double baseline_offset = 2000.0;   // 直流偏置
+    double wander_amplitude = 300.0;   // 基线漂移（0.3Hz 正弦）
+    double mains_hz = 50.0;
+    double mains_amplitude = 200.0;    // 工频干扰
+    double noise_amplitude = 10.0;     // 均匀分布的白噪声
+    uint64_t seed = 1;
+};
+
+/**
+ * 逐帧生成多导联合成心电
+ *
+ * 每个心搏由 P、Q、R、S、T 五个高斯波叠加而成，各导联的幅度比例不同，
+ * 再叠加基线漂移、工频和噪声。R 波顶点的样本序号都被记录下来，用作检测算法的真值。
+ */
+class SyntheticEcg {
+public:
+    explicit SyntheticEcg(SyntheticEcgOptions options);
+
+    /**
+     * 生成下一帧
+     * @param frame 至少 leads 个元素
+     */
+    void Next(int32_t* frame);
+
+    // 生成 frames 帧，按导联分开写入 leads[l][0..frames)
+    void Generate(int32_t* const* leads, std::size_t frames);
+
+    uint64_t SampleIndex() const { return sample_; }
+
+    // 目前为止已生成的 R 波顶点样本序号
+    const std::vector<uint64_t>& Beats() const { return beats_; }
+
+    const SyntheticEcgOptions& Options() const { return options_; }
+
+private:
+    double NextUniform();
+    void ScheduleBeat();
+
+    SyntheticEcgOptions options_;
+    uint64_t sample_ = 0;
+    uint64_t rng_;
+    double next_beat_ = 0.0;           // 下一个 R 波的样本位置
+    double current_beat_ = -1e9;
+    double previous_beat_ = -1e9;
+    std::vector<double> lead_gain_;
+    std::vector<uint64_t> beats_;
+    std::vector<int32_t> frame_;
+};
+
+}  // namespace ble
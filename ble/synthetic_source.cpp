@@ -0,0 +1,65 @@
+﻿#include "ble/synthetic_source.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace ble {
+
+void SyntheticNotificationSource::Start(Callback callback) {
+    Stop();
+    callback_ = std::move(callback);
+    produced_.store(0, std::memory_order_relaxed);
+    running_.store(true, std::memory_order_release);
+    thread_ = std::thread(&SyntheticNotificationSource::Run, this);
+}
+
+void SyntheticNotificationSource::Stop() {
+    running_.store(false, std::memory_order_release);
+    Join();
+}
+
+void SyntheticNotificationSource::Join() {
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void SyntheticNotificationSource::Run() {
+    std::vector<uint8_t> payload(std::max<std::size_t>(options_.payload_size, 2));
+    uint32_t rng = 0x12345678u;
+
+    using Clock = std::chrono::steady_clock;
+    const bool paced = options_.rate_hz > 0.0;
+    const auto period = paced ? std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(1.0 / options_.rate_hz)) : Clock::duration::zero();
+    auto next = Clock::now();
+
+    uint64_t seq = 0;
+    while (running_.load(std::memory_order_acquire)) {
+        if (options_.max_count != 0 && seq >= options_.max_count) {
+            break;
+        }
+
+        // 包序号 + xorshift 伪随机数据
+        payload[0] = static_cast<uint8_t>(seq & 0xFF);
+        payload[1] = static_cast<uint8_t>((seq >> 8) & 0xFF);
+        for (std::size_t i = 2; i < payload.size(); ++i) {
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            payload[i] = static_cast<uint8_t>(rng);
+        }
+
+        callback_(payload.data(), options_.payload_size);
+        ++seq;
+        produced_.store(seq, std::memory_order_relaxed);
+
+        if (paced) {
+            next += period;
+            std::this_thread::sleep_until(next);
+        }
+    }
+}
+
+}  // namespace ble
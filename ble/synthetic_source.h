@@ -0,0 +1,55 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+namespace ble {
+
+/**
+ * 在 Linux 上代替真实设备的通知来源：独立线程按固定速率产生通知
+ * 载荷前 2 字节是小端序的包序号，其余为确定性的伪随机数据
+ */
+class SyntheticNotificationSource {
+public:
+    struct Options {
+        double rate_hz = 0.0;          // 通知速率，0 表示不限速
+        std::size_t payload_size = 20; // 每个通知的字节数
+        uint64_t max_count = 0;        // 产生多少个通知后自动停止，0 表示不限
+    };
+
+    using Callback = std::function<void(const uint8_t* data, std::size_t length)>;
+
+    explicit SyntheticNotificationSource(Options options) : options_(options) {}
+    ~SyntheticNotificationSource() { Stop(); }
+
+    SyntheticNotificationSource(const SyntheticNotificationSource&) = delete;
+    SyntheticNotificationSource& operator=(const SyntheticNotificationSource&) = delete;
+
+    /**
+     * 启动生产线程，callback 在该线程上被调用（相当于 GATT 回调线程）
+     * @param callback
+     */
+    void Start(Callback callback);
+
+    // 停止并等待生产线程退出
+    void Stop();
+
+    // 等待 max_count 个通知全部产生完毕
+    void Join();
+
+    uint64_t Produced() const { return produced_.load(std::memory_order_relaxed); }
+
+private:
+    void Run();
+
+    Options options_;
+    Callback callback_;
+    std::atomic<bool> running_{false};
+    std::atomic<uint64_t> produced_{0};
+    std::thread thread_;
+};
+
+}  // namespace ble
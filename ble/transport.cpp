@@ -0,0 +1,47 @@
+﻿#include "ble/transport.h"
+
+#include <algorithm>
+
+namespace ble {
+
+const char* GattStatusName(GattStatus status) {
+    switch (status) {
+        case GattStatus::Success:
+            return "Success";
+        case GattStatus::Unreachable:
+            return "Unreachable";
+        case GattStatus::ProtocolError:
+            return "ProtocolError";
+        case GattStatus::AccessDenied:
+            return "AccessDenied";
+        case GattStatus::Timeout:
+            return "Timeout";
+    }
+    return "Unknown";
+}
+
+void AbandonedRequests::ReapLocked() {
+    requests_.erase(std::remove_if(requests_.begin(), requests_.end(),
+                                   [](const std::unique_ptr<Request>& request) { return request->Done(); }),
+                    requests_.end());
+}
+
+void AbandonedRequests::Drain() {
+    std::vector<std::unique_ptr<Request>> requests;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        requests.swap(requests_);
+    }
+    // 不持锁等待，等待期间其他线程仍然可以 Add
+    for (const auto& request : requests) {
+        request->Wait();
+    }
+}
+
+std::size_t AbandonedRequests::Pending() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ReapLocked();
+    return requests_.size();
+}
+
+}  // namespace ble
@@ -0,0 +1,217 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ble/guid.h"
+
+namespace ble {
+
+/*
+ * 与具体蓝牙协议栈无关的传输层接口
+ *
+ * 扫描、连接、服务/特性发现和通知投递都通过这里完成，
+ * Windows 上由 WinRtTransport 实现，Linux 上由 SimulatedTransport 模拟 ECG-7，
+ * 这样上层的处理流程在两个平台上完全一样。
+ * 异步操作统一返回 std::future，需要同步时直接 .get()，与 WinRT 的用法一致。
+ */
+
+/**
+ * 一条广播，所有视图只在回调期间有效
+ */
+struct Advertisement {
+    uint64_t address = 0;           // 48 位蓝牙地址
+    int16_t rssi = 0;               // dBm
+    uint64_t timestamp_ns = 0;      // 收到广播的单调时间戳
+    std::string_view local_name;    // 广播名称，可能为空
+    const uint8_t* raw = nullptr;   // 原始 AD 结构数据（后端提供时才有）
+    std::size_t raw_length = 0;
+};
+
+// 特性属性位，数值与蓝牙规范及 GattCharacteristicProperties 相同
+enum CharacteristicProperty : uint32_t {
+    kPropertyBroadcast = 0x01,
+    kPropertyRead = 0x02,
+    kPropertyWriteWithoutResponse = 0x04,
+    kPropertyWrite = 0x08,
+    kPropertyNotify = 0x10,
+    kPropertyIndicate = 0x20,
+};
+
+// 与 GattCommunicationStatus 对应，另外加上超时
+enum class GattStatus {
+    Success,
+    Unreachable,
+    ProtocolError,
+    AccessDenied,
+    Timeout,
+};
+
+const char* GattStatusName(GattStatus status);
+
+struct GattServiceInfo {
+    Guid uuid;
+    uint16_t handle = 0;
+};
+
+struct GattCharacteristicInfo {
+    Guid uuid;
+    uint16_t handle = 0;          // 特性值句柄，在一个连接内唯一
+    uint16_t service_handle = 0;
+    uint32_t properties = 0;      // CharacteristicProperty 的组合
+
+    bool Has(CharacteristicProperty property) const { return (properties & property) != 0; }
+};
+
+struct ServicesResult {
+    GattStatus status = GattStatus::Unreachable;
+    std::vector<GattServiceInfo> services;
+};
+
+struct CharacteristicsResult {
+    GattStatus status = GattStatus::Unreachable;
+    std::vector<GattCharacteristicInfo> characteristics;
+};
+
+// 写 CCCD 时选择通知还是指示
+enum class SubscriptionKind {
+    Notify,
+    Indicate,
+};
+
+/**
+ * 通知回调，在后端的事件线程上调用，实现里不要阻塞
+ * @param characteristic_handle 产生通知的特性值句柄
+ * @param timestamp_ns 后端收到通知时的单调时间戳
+ */
+using NotificationHandler = std::function<void(uint16_t characteristic_handle, uint64_t timestamp_ns,
+                                               const uint8_t* data, std::size_t length)>;
+
+using AdvertisementHandler = std::function<void(const Advertisement& advertisement)>;
+
+/**
+ * 一个已连接的设备
+ */
+class BleConnection {
+public:
+    virtual ~BleConnection() = default;
+
+    virtual uint64_t Address() const = 0;
+    virtual std::string Name() const = 0;
+
+    virtual std::future<ServicesResult> DiscoverServicesAsync() = 0;
+
+    virtual std::future<CharacteristicsResult> DiscoverCharacteristicsAsync(const GattServiceInfo& service) = 0;
+
+    /**
+     * 用之前发现（或缓存）的特性代替发现，让后续的 SubscribeAsync 可以直接使用这些句柄
+     *
+     * 不产生 GATT 请求：WinRT 从系统的属性缓存里取出对应的对象，模拟传输层只核对句柄。
+     * 某个特性在设备上已不存在（UUID 或句柄对不上）时结果为 ProtocolError。
+     * @param characteristics
+     */
+    virtual std::future<GattStatus> RestoreCharacteristicsAsync(
+            const std::vector<GattCharacteristicInfo>& characteristics) = 0;
+
+    /**
+     * 写 CCCD 启用通知/指示并注册回调，回调在 future 完成前就可能开始触发
+     * @param characteristic
+     * @param kind
+     * @param handler
+     */
+    virtual std::future<GattStatus> SubscribeAsync(const GattCharacteristicInfo& characteristic,
+                                                   SubscriptionKind kind, NotificationHandler handler) = 0;
+
+    // 取消订阅；返回后不会再有该特性的回调
+    virtual void Unsubscribe(const GattCharacteristicInfo& characteristic) = 0;
+
+    // 断开连接并取消所有订阅
+    virtual void Disconnect() = 0;
+};
+
+/**
+ * 超时后放弃的请求
+ *
+ * 后端用 std::async 实现的 future 析构时会等待任务结束，超时后不能直接丢掉，
+ * 也不应交给分离的线程去等：反复超时会攒下越来越多的线程，退出时它们还可能在运行。
+ * 放弃的 future 收在这里，不占用线程；每次 Add 时顺便清掉已经完成的，
+ * 由持有者（DeviceManager 等）在关闭时 Drain()，析构时也会等待剩下的请求。
+ */
+class AbandonedRequests {
+public:
+    AbandonedRequests() = default;
+    ~AbandonedRequests() { Drain(); }
+
+    AbandonedRequests(const AbandonedRequests&) = delete;
+    AbandonedRequests& operator=(const AbandonedRequests&) = delete;
+
+    // 收下一个超时的 future，迟到的结果被丢弃
+    template <typename T>
+    void Add(std::future<T> future) {
+        auto request = std::make_unique<Typed<T>>(std::move(future));
+        std::lock_guard<std::mutex> lock(mutex_);
+        ReapLocked();
+        requests_.push_back(std::move(request));
+    }
+
+    // 等待全部放弃的请求结束
+    void Drain();
+
+    // 还没结束的请求数
+    std::size_t Pending();
+
+private:
+    struct Request {
+        virtual ~Request() = default;
+        virtual bool Done() const = 0;
+        virtual void Wait() const = 0;
+    };
+
+    template <typename T>
+    struct Typed : Request {
+        explicit Typed(std::future<T> f) : future(std::move(f)) {}
+        bool Done() const override {
+            return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        }
+        void Wait() const override { future.wait(); }
+        std::future<T> future;
+    };
+
+    void ReapLocked();
+
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Request>> requests_;
+};
+
+/**
+ * 传输层：扫描广播并建立连接
+ */
+class BleTransport {
+public:
+    virtual ~BleTransport() = default;
+
+    /**
+     * 开始扫描，handler 在后端的事件线程上对每条广播调用一次
+     * @param handler
+     */
+    virtual bool StartScan(AdvertisementHandler handler) = 0;
+
+    // 停止扫描；除非在广播回调里调用，返回后不会再有广播回调
+    virtual void StopScan() = 0;
+
+    /**
+     * 连接指定地址的设备，失败时 future 的结果为 nullptr
+     * @param address
+     */
+    virtual std::future<std::shared_ptr<BleConnection>> ConnectAsync(uint64_t address) = 0;
+};
+
+}  // namespace ble
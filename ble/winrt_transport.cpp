@@ -0,0 +1,368 @@
+﻿#include "ble/winrt_transport.h"
+
+#include <windows.h>
+#include <winrt/Windows.Foundation.Collections.h>
+#include <winrt/Windows.Foundation.h>
+#include <winrt/Windows.Devices.Bluetooth.h>
+#include <winrt/Windows.Devices.Bluetooth.Advertisement.h>
+#include <winrt/Windows.Devices.Bluetooth.GenericAttributeProfile.h>
+#include <winrt/Windows.Storage.Streams.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "ble/advertisement_data.h"
+#include "ble/clock.h"
+
+using namespace winrt;
+using namespace Windows::Devices::Bluetooth;
+using namespace Windows::Devices::Bluetooth::Advertisement;
+using namespace Windows::Devices::Bluetooth::GenericAttributeProfile;
+using namespace Windows::Foundation::Collections;
+using namespace Windows::Storage::Streams;
+
+namespace ble {
+
+namespace {
+
+Guid ToGuid(const winrt::guid& g) {
+    Guid result;
+    std::memcpy(&result, &g, sizeof(result));
+    return result;
+}
+
+GattStatus ToStatus(GattCommunicationStatus status) {
+    switch (status) {
+        case GattCommunicationStatus::Success:
+            return GattStatus::Success;
+        case GattCommunicationStatus::Unreachable:
+            return GattStatus::Unreachable;
+        case GattCommunicationStatus::ProtocolError:
+            return GattStatus::ProtocolError;
+        case GattCommunicationStatus::AccessDenied:
+            return GattStatus::AccessDenied;
+    }
+    return GattStatus::ProtocolError;
+}
+
+/**
+ * WinRT 连接：缓存发现到的服务和特性对象，句柄用 AttributeHandle()
+ */
+class WinRtConnection : public BleConnection, public std::enable_shared_from_this<WinRtConnection> {
+public:
+    explicit WinRtConnection(BluetoothLEDevice device)
+        : device_(std::move(device)), name_(to_string(device_.Name())) {}
+
+    ~WinRtConnection() override { Disconnect(); }
+
+    uint64_t Address() const override { return device_.BluetoothAddress(); }
+
+    std::string Name() const override { return name_; }
+
+    std::future<ServicesResult> DiscoverServicesAsync() override {
+        auto self = shared_from_this();
+        return std::async(std::launch::async, [self] {
+            ServicesResult result;
+            try {
+                auto services = self->device_.GetGattServicesAsync().get();
+                result.status = ToStatus(services.Status());
+                if (result.status != GattStatus::Success) {
+                    return result;
+                }
+                std::lock_guard<std::mutex> lock(self->mutex_);
+                for (auto const& service : services.Services()) {
+                    GattServiceInfo info;
+                    info.uuid = ToGuid(service.Uuid());
+                    info.handle = service.AttributeHandle();
+                    self->services_.emplace_back(info.handle, service);
+                    result.services.push_back(info);
+                }
+            } catch (const hresult_error&) {
+                result.status = GattStatus::Unreachable;
+            }
+            return result;
+        });
+    }
+
+    std::future<CharacteristicsResult> DiscoverCharacteristicsAsync(const GattServiceInfo& service) override {
+        auto self = shared_from_this();
+        uint16_t service_handle = service.handle;
+        return std::async(std::launch::async, [self, service_handle] {
+            CharacteristicsResult result;
+            GattDeviceService service = self->FindService(service_handle);
+            if (!service) {
+                result.status = GattStatus::ProtocolError;
+                return result;
+            }
+            try {
+                auto characteristics = service.GetCharacteristicsAsync().get();
+                result.status = ToStatus(characteristics.Status());
+                if (result.status != GattStatus::Success) {
+                    return result;
+                }
+                std::lock_guard<std::mutex> lock(self->mutex_);
+                for (auto const& characteristic : characteristics.Characteristics()) {
+                    GattCharacteristicInfo info;
+                    info.uuid = ToGuid(characteristic.Uuid());
+                    info.handle = characteristic.AttributeHandle();
+                    info.service_handle = service_handle;
+                    info.properties = static_cast<uint32_t>(characteristic.CharacteristicProperties());
+                    self->characteristics_.emplace_back(info.handle, characteristic);
+                    result.characteristics.push_back(info);
+                }
+            } catch (const hresult_error&) {
+                result.status = GattStatus::Unreachable;
+            }
+            return result;
+        });
+    }
+
+    std::future<GattStatus> RestoreCharacteristicsAsync(
+            const std::vector<GattCharacteristicInfo>& characteristics) override {
+        auto self = shared_from_this();
+        return std::async(std::launch::async, [self, characteristics] {
+            try {
+                // Cached 模式只读系统的属性缓存，不产生空中请求
+                auto services = self->device_.GetGattServicesAsync(BluetoothCacheMode::Cached).get();
+                if (services.Status() != GattCommunicationStatus::Success) {
+                    return ToStatus(services.Status());
+                }
+                std::vector<std::pair<uint16_t, GattDeviceService>> found_services;
+                std::vector<std::pair<uint16_t, GattCharacteristic>> found_characteristics;
+                for (auto const& service : services.Services()) {
+                    const uint16_t service_handle = service.AttributeHandle();
+                    bool needed = false;
+                    for (const auto& info : characteristics) {
+                        needed = needed || info.service_handle == service_handle;
+                    }
+                    if (!needed) {
+                        continue;
+                    }
+                    found_services.emplace_back(service_handle, service);
+                    auto result = service.GetCharacteristicsAsync(BluetoothCacheMode::Cached).get();
+                    if (result.Status() != GattCommunicationStatus::Success) {
+                        return ToStatus(result.Status());
+                    }
+                    for (auto const& characteristic : result.Characteristics()) {
+                        found_characteristics.emplace_back(characteristic.AttributeHandle(), characteristic);
+                    }
+                }
+                // 每个特性都要在系统缓存里找到句柄和 UUID 都相同的对象
+                for (const auto& info : characteristics) {
+                    bool matched = false;
+                    for (const auto& characteristic : found_characteristics) {
+                        matched = matched || (characteristic.first == info.handle &&
+                                              ToGuid(characteristic.second.Uuid()) == info.uuid);
+                    }
+                    if (!matched) {
+                        return GattStatus::ProtocolError;
+                    }
+                }
+                std::lock_guard<std::mutex> lock(self->mutex_);
+                self->services_.insert(self->services_.end(), found_services.begin(), found_services.end());
+                self->characteristics_.insert(self->characteristics_.end(), found_characteristics.begin(),
+                                              found_characteristics.end());
+                return GattStatus::Success;
+            } catch (const hresult_error&) {
+                return GattStatus::Unreachable;
+            }
+        });
+    }
+
+    std::future<GattStatus> SubscribeAsync(const GattCharacteristicInfo& info, SubscriptionKind kind,
+                                           NotificationHandler handler) override {
+        auto self = shared_from_this();
+        uint16_t handle = info.handle;
+        return std::async(std::launch::async, [self, handle, kind, handler = std::move(handler)] {
+            GattCharacteristic characteristic = self->FindCharacteristic(handle);
+            if (!characteristic) {
+                return GattStatus::ProtocolError;
+            }
+            try {
+                // 先注册回调再写 CCCD，避免丢掉启用后的第一个通知
+                event_token token = characteristic.ValueChanged(
+                        [handle, handler](GattCharacteristic const&, GattValueChangedEventArgs const& args) {
+                            uint64_t timestamp_ns = MonotonicNowNs();
+                            IBuffer buffer = args.CharacteristicValue();
+                            handler(handle, timestamp_ns, buffer.data(), buffer.Length());
+                        });
+                self->AddToken(handle, characteristic, token);
+
+                auto value = kind == SubscriptionKind::Notify
+                             ? GattClientCharacteristicConfigurationDescriptorValue::Notify
+                             : GattClientCharacteristicConfigurationDescriptorValue::Indicate;
+                return ToStatus(characteristic.WriteClientCharacteristicConfigurationDescriptorAsync(value).get());
+            } catch (const hresult_error&) {
+                return GattStatus::Unreachable;
+            }
+        });
+    }
+
+    void Unsubscribe(const GattCharacteristicInfo& info) override {
+        std::vector<Token> removed;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto it = tokens_.begin(); it != tokens_.end();) {
+                if (it->handle == info.handle) {
+                    removed.push_back(*it);
+                    it = tokens_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        for (auto& token : removed) {
+            token.characteristic.ValueChanged(token.token);
+            try {
+                token.characteristic.WriteClientCharacteristicConfigurationDescriptorAsync(
+                        GattClientCharacteristicConfigurationDescriptorValue::None).get();
+            } catch (const hresult_error&) {
+            }
+        }
+    }
+
+    void Disconnect() override {
+        std::vector<Token> tokens;
+        std::vector<std::pair<uint16_t, GattDeviceService>> services;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tokens.swap(tokens_);
+            services.swap(services_);
+            characteristics_.clear();
+        }
+        for (auto& token : tokens) {
+            token.characteristic.ValueChanged(token.token);
+        }
+        // 关闭服务和设备对象后 Windows 才会真正断开连接
+        for (auto& service : services) {
+            service.second.Close();
+        }
+        if (device_) {
+            device_.Close();
+        }
+    }
+
+private:
+    struct Token {
+        uint16_t handle;
+        GattCharacteristic characteristic{nullptr};
+        event_token token;
+    };
+
+    GattDeviceService FindService(uint16_t handle) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& service : services_) {
+            if (service.first == handle) {
+                return service.second;
+            }
+        }
+        return nullptr;
+    }
+
+    GattCharacteristic FindCharacteristic(uint16_t handle) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& characteristic : characteristics_) {
+            if (characteristic.first == handle) {
+                return characteristic.second;
+            }
+        }
+        return nullptr;
+    }
+
+    void AddToken(uint16_t handle, const GattCharacteristic& characteristic, event_token token) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tokens_.push_back(Token{handle, characteristic, token});
+    }
+
+    BluetoothLEDevice device_;
+    std::string name_;
+    std::mutex mutex_;
+    std::vector<std::pair<uint16_t, GattDeviceService>> services_;
+    std::vector<std::pair<uint16_t, GattCharacteristic>> characteristics_;
+    std::vector<Token> tokens_;
+};
+
+}  // namespace
+
+struct WinRtTransport::Impl {
+    BluetoothLEAdvertisementWatcher watcher;
+    event_token received_token{};
+    bool scanning = false;
+};
+
+WinRtTransport::WinRtTransport() : impl_(std::make_unique<Impl>()) {
+    impl_->watcher.ScanningMode(BluetoothLEScanningMode::Active);
+}
+
+WinRtTransport::~WinRtTransport() {
+    StopScan();
+}
+
+bool WinRtTransport::StartScan(AdvertisementHandler handler) {
+    StopScan();
+    impl_->received_token = impl_->watcher.Received(
+            [handler = std::move(handler)](BluetoothLEAdvertisementWatcher const&,
+                                           BluetoothLEAdvertisementReceivedEventArgs const& args) {
+                // WinRT 不提供原始广播数据，只能逐个 DataSection 取出再按 AD 结构拼回，
+                // 每一段都会创建一个 WinRT 对象（section 和它的 IBuffer），这部分分配省不掉；
+                // 拼回之后名称等字段由 ParseAdvertisementData 直接指向 raw，不再调用 LocalName() 等
+                // 各自返回 hstring 的属性，解析本身不分配
+                uint8_t raw[256];
+                std::size_t length = 0;
+                for (const auto& section : args.Advertisement().DataSections()) {
+                    const auto data = section.Data();
+                    const std::size_t size = data.Length();
+                    if (size > 254 || length + 2 + size > sizeof(raw)) {
+                        break;
+                    }
+                    raw[length] = static_cast<uint8_t>(size + 1);
+                    raw[length + 1] = section.DataType();
+                    std::memcpy(raw + length + 2, data.data(), size);
+                    length += 2 + size;
+                }
+                AdvertisementData fields;
+                ParseAdvertisementData(raw, length, fields);
+                Advertisement advertisement;
+                advertisement.address = args.BluetoothAddress();
+                advertisement.rssi = args.RawSignalStrengthInDBm();
+                advertisement.timestamp_ns = MonotonicNowNs();
+                advertisement.local_name = fields.local_name;
+                advertisement.raw = raw;
+                advertisement.raw_length = length;
+                handler(advertisement);
+            });
+    try {
+        impl_->watcher.Start();
+    } catch (const hresult_error&) {
+        impl_->watcher.Received(impl_->received_token);
+        return false;
+    }
+    impl_->scanning = true;
+    return true;
+}
+
+void WinRtTransport::StopScan() {
+    if (!impl_->scanning) {
+        return;
+    }
+    impl_->scanning = false;
+    impl_->watcher.Stop();
+    impl_->watcher.Received(impl_->received_token);
+}
+
+std::future<std::shared_ptr<BleConnection>> WinRtTransport::ConnectAsync(uint64_t address) {
+    return std::async(std::launch::async, [address]() -> std::shared_ptr<BleConnection> {
+        try {
+            auto device = BluetoothLEDevice::FromBluetoothAddressAsync(address).get();
+            if (!device) {
+                return nullptr;
+            }
+            return std::make_shared<WinRtConnection>(device);
+        } catch (const hresult_error&) {
+            return nullptr;
+        }
+    });
+}
+
+}  // namespace ble
@@ -0,0 +1,28 @@
+﻿#pragma once
+
+#include <memory>
+#include <mutex>
+
+#include "ble/transport.h"
+
+namespace ble {
+
+/**
+ * 基于 Windows.Devices.Bluetooth 的传输层实现，只在 Windows 上编译
+ * 调用前需要先 init_apartment()
+ */
+class WinRtTransport : public BleTransport {
+public:
+    WinRtTransport();
+    ~WinRtTransport() override;
+
+    bool StartScan(AdvertisementHandler handler) override;
+    void StopScan() override;
+    std::future<std::shared_ptr<BleConnection>> ConnectAsync(uint64_t address) override;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}  // namespace ble
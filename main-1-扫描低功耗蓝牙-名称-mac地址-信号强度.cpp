@@ -5,20 +5,14 @@
 #include <iomanip> // 用于格式化输出
 #include <sstream>
 
+#include "ble/advertisement_table.h"
+#include "ble/clock.h"
+
 using namespace winrt;
 using namespace Windows::Devices::Bluetooth::Advertisement;
 
-std::wstring FormatBluetoothAddress(uint64_t address) {
-    std::wstringstream ss;
-    ss << std::hex << std::setfill(L'0');
-    for (int i = 5; i >= 0; i--) {
-        ss << std::setw(2) << ((address >> (i * 8)) & 0xFF);
-        if (i > 0) {
-            ss << L":";
-        }
-    }
-    return ss.str();
-}
+// 按 MAC 地址汇总所有广播：次数、名称、平滑后的信号强度
+ble::AdvertisementTable advertisement_table(4096);
 
 int main() {
     init_apartment(); // 初始化 WinRT 环境
@@ -26,28 +20,32 @@ int main() {
     BluetoothLEAdvertisementWatcher watcher;
     watcher.ScanningMode(BluetoothLEScanningMode::Active);
 
-    // 设置设备发现的回调
+    // 设置设备发现的回调：只做一次常数时间的表更新，不再每条广播打印两行
     watcher.Received([](BluetoothLEAdvertisementWatcher const&,
                         BluetoothLEAdvertisementReceivedEventArgs const& args) {
-
-
-        // 获取设备的广播名称
-        std::wcout << L"Device found: "
-                   << args.Advertisement().LocalName().c_str()<<std::endl;
-        // 格式化 MAC 地址
-        std::wcout << L"Device MAC Address: "
-                   << FormatBluetoothAddress(args.BluetoothAddress())
-                   << L", RSSI: "
-                   << args.RawSignalStrengthInDBm()
-                   << L" dBm" << std::endl;
+        // 获取设备的广播名称，转成 UTF-8 放在栈上
+        hstring name = args.Advertisement().LocalName();
+        char utf8_name[64];
+        int name_length = WideCharToMultiByte(CP_UTF8, 0, name.c_str(), static_cast<int>(name.size()),
+                                              utf8_name, sizeof(utf8_name), nullptr, nullptr);
+
+        ble::Advertisement advertisement;
+        advertisement.address = args.BluetoothAddress();
+        advertisement.rssi = args.RawSignalStrengthInDBm();
+        advertisement.timestamp_ns = ble::MonotonicNowNs();
+        advertisement.local_name = std::string_view(utf8_name, name_length > 0 ? name_length : 0);
+        advertisement_table.Update(advertisement);
     });
 
     // 启动扫描
     watcher.Start();
     std::wcout << L"Scanning for BLE devices..." << std::endl;
 
-    // 等待扫描一段时间
-    Sleep(10000); // 扫描 10 秒
+    // 扫描 10 秒，每秒刷新一次设备汇总表
+    for (int i = 0; i < 10; ++i) {
+        Sleep(1000);
+        ble::RenderAdvertisementTable(advertisement_table.Snapshot(), ble::MonotonicNowNs(), stdout);
+    }
     watcher.Stop();
     std::wcout << L"Scan stopped." << std::endl;
 
@@ -13,6 +13,7 @@
 #include <thread>
 #include <mutex>
 #include <future>
+#include <vector>
 
 using namespace winrt;
 using namespace Windows::Devices::Bluetooth;
@@ -74,25 +75,29 @@ void OnCharacteristicValueChanged(const GattCharacteristic& characteristic, cons
 
 }
 
+// 已启用通知的特性，程序退出前一直保持
+std::vector<GattCharacteristic> subscribed_characteristics;
+
 // 启用特性通知
 void EnableNotifications(const GattCharacteristic& characteristic) {
     // 检查特性是否支持通知
     if ((characteristic.CharacteristicProperties() & GattCharacteristicProperties::Notify) == GattCharacteristicProperties::Notify) {
-        // 订阅特性值变化事件
+        // 先订阅特性值变化事件再写 CCCD，避免丢掉启用后的第一个通知
         characteristic.ValueChanged({ OnCharacteristicValueChanged });
 
+        // CCCD 只需写一次。以前收不到消息是因为特性对象在函数返回后被释放、事件随之失效，
+        // 不停地重写 CCCD 只是让函数永远不返回，特性对象才一直活着
+        auto result = characteristic.WriteClientCharacteristicConfigurationDescriptorAsync(
+                GattClientCharacteristicConfigurationDescriptorValue::Notify
+        ).get();
 
-        while (true){
-            // 启用通知
-            auto result = characteristic.WriteClientCharacteristicConfigurationDescriptorAsync(
-                    GattClientCharacteristicConfigurationDescriptorValue::Notify
-            ).get();
+        if (result == GattCommunicationStatus::Success) {
+            std::wcout << L"Notifications enabled for characteristic UUID: " << GuidToString(characteristic.Uuid()) << std::endl;
 
-            if (result == GattCommunicationStatus::Success) {
-                std::wcout << L"Notifications enabled for characteristic UUID: " << GuidToString(characteristic.Uuid()) << std::endl;
-            } else {
-                std::wcout << L"Failed to enable notifications for characteristic UUID: " << GuidToString(characteristic.Uuid()) << std::endl;
-            }
+            // 特性对象释放后事件也会失效，保存起来后直接返回，继续订阅其他特性
+            subscribed_characteristics.push_back(characteristic);
+        } else {
+            std::wcout << L"Failed to enable notifications for characteristic UUID: " << GuidToString(characteristic.Uuid()) << std::endl;
         }
 
     } else {
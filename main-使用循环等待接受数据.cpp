@@ -13,6 +13,7 @@
 #include <thread>
 #include <mutex>
 #include <future>
+#include <vector>
 
 using namespace winrt;
 using namespace Windows::Devices::Bluetooth;
@@ -74,6 +75,9 @@ void OnCharacteristicValueChanged(const GattCharacteristic& characteristic, cons
 
 }
 
+// 已启用通知的特性，程序退出前一直保持
+std::vector<GattCharacteristic> subscribed_characteristics;
+
 // 启用特性通知
 void EnableNotifications(const GattCharacteristic& characteristic) {
     // 检查特性是否支持通知
@@ -82,6 +86,9 @@ void EnableNotifications(const GattCharacteristic& characteristic) {
 
 
 
+        // 先订阅特性值变化事件再写 CCCD，避免丢掉启用后的第一个通知
+        characteristic.ValueChanged({ OnCharacteristicValueChanged });
+
         // 启用通知
         auto result = characteristic.WriteClientCharacteristicConfigurationDescriptorAsync(
                 GattClientCharacteristicConfigurationDescriptorValue::Notify
@@ -90,35 +97,12 @@ void EnableNotifications(const GattCharacteristic& characteristic) {
         if (result == GattCommunicationStatus::Success) {
             std::wcout << L"Notifications enabled for characteristic UUID: " << GuidToString(characteristic.Uuid()) << std::endl;
 
-//            while (true){
-                // 订阅特性值变化事件
-//                characteristic.ValueChanged({ OnCharacteristicValueChanged });
-//            }
-
+            // 特性对象释放后事件也会失效，保存起来后直接返回，继续订阅其他特性
+            subscribed_characteristics.push_back(characteristic);
         } else {
             std::wcout << L"Failed to enable notifications for characteristic UUID: " << GuidToString(characteristic.Uuid()) << std::endl;
         }
 
-
-        // 订阅特性值变化事件，只需订阅一次
-        characteristic.ValueChanged({ OnCharacteristicValueChanged });
-        // 保持连接，等待事件触发
-        std::wcout << L"Waiting for notifications..." << std::endl;
-//        std::this_thread::sleep_for(std::chrono::minutes(5));  // 等待一段时间，保持主线程运行
-
-
-/*running 是一个布尔值，当你需要退出程序时，可以将其设置为 false，从而退出循环*/
-//        while (running) {
-//            std::this_thread::sleep_for(std::chrono::seconds(1));  // 每秒钟检查一次
-//            // 可以在这里添加一些定期检查的逻辑
-//        }
-
-        while (true) {
-            std::this_thread::sleep_for(std::chrono::seconds(1));  // 每秒钟等待一次，保持主线程运行
-        }
-
-
-
     } else {
         std::wcout << L"Characteristic UUID " << GuidToString(characteristic.Uuid()) << L" does not support notifications." << std::endl;
     }
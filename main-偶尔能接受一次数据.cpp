@@ -13,6 +13,13 @@
 #include <thread>
 #include <mutex>
 #include <future>
+#include <memory>
+#include <chrono>
+#include <cstdio>
+
+#include "ble/clock.h"
+#include "ble/hex_dump.h"
+#include "ble/notification_ring.h"
 
 using namespace winrt;
 using namespace Windows::Devices::Bluetooth;
@@ -24,8 +31,13 @@ using namespace Windows::Storage::Streams;
 std::atomic<bool> keep_running(true);  // 控制程序是否继续运行
 
 
-std::mutex print_mutex;  // 用于保护打印数据的临界区
-std::vector<uint8_t> received_data;  // 用于存储接收到的数据
+// 回调线程（生产者）与打印线程（消费者）之间的无锁队列，回调里不加锁也不分配内存。
+// WinRT 在线程池线程上触发 ValueChanged，不同特性的回调可能同时运行，
+// 所以每个订阅的特性一个队列，保证每个队列只有一个生产者（与 DeviceManager 相同）
+constexpr std::size_t kMaxStreams = 16;
+std::unique_ptr<ble::SpscRing<ble::NotificationSlot>> notification_rings[kMaxStreams];
+std::atomic<std::size_t> stream_count(0);   // 打印线程只读前 stream_count 个队列
+std::mutex stream_mutex;                    // 订阅时分配队列
 
 // 格式化 MAC 地址
 std::wstring FormatBluetoothAddress(uint64_t address) {
@@ -53,34 +65,52 @@ std::wstring GuidToString(const winrt::guid& g) {
 }
 
 // 处理特性值变化的回调
-void OnCharacteristicValueChanged(const GattCharacteristic& characteristic, const GattValueChangedEventArgs& args) {
-    std::wcout << L"Notification received for characteristic UUID: " << GuidToString(characteristic.Uuid()) << std::endl;
-
+void OnCharacteristicValueChanged(ble::SpscRing<ble::NotificationSlot>& ring, uint16_t characteristic_id,
+                                  const GattValueChangedEventArgs& args) {
     // 获取接收到的值
     IBuffer buffer = args.CharacteristicValue();
     const uint8_t* data = buffer.data();
     uint32_t length = buffer.Length();
 
-    // 打印接收到的数据
-    for (uint32_t i = 0; i < length; ++i) {
-        std::wcout << L"Data byte: " << (int)data[i] << std::endl;
-    }
+    // 只把数据放进这个特性自己的队列，打印交给 PrintReceivedData 线程；队列满时丢弃并计数
+    ble::PushNotification(ring, ble::MonotonicNowNs(), characteristic_id, data, length);
+}
 
-    // 打印接收到的数据（16进制格式）
-//    std::wcout << L"Received Data (Hex format): ";
-    for (uint32_t i = 0; i < length; ++i) {
-        std::wcout << std::hex << std::setw(2) << std::setfill(L'0') << (int)data[i] << L" ";
+/**
+ * 给一个特性分配队列，之后它的回调只写这个队列
+ * @param characteristic_id 输出：队列编号
+ * @return 队列已经用完时返回 nullptr
+ */
+ble::SpscRing<ble::NotificationSlot>* AllocateStream(uint16_t& characteristic_id) {
+    std::lock_guard<std::mutex> lock(stream_mutex);
+    std::size_t index = stream_count.load(std::memory_order_relaxed);
+    if (index == kMaxStreams) {
+        return nullptr;
     }
-
-
+    notification_rings[index] = std::make_unique<ble::SpscRing<ble::NotificationSlot>>(1024);
+    characteristic_id = static_cast<uint16_t>(index);
+    // 队列构造完成后才对打印线程可见
+    stream_count.store(index + 1, std::memory_order_release);
+    return notification_rings[index].get();
 }
 
 // 启用特性通知
 void EnableNotifications(const GattCharacteristic& characteristic) {
     // 检查特性是否支持通知
     if ((characteristic.CharacteristicProperties() & GattCharacteristicProperties::Notify) == GattCharacteristicProperties::Notify) {
+        uint16_t characteristic_id = 0;
+        ble::SpscRing<ble::NotificationSlot>* ring = AllocateStream(characteristic_id);
+        if (ring == nullptr) {
+            std::wcout << L"Too many notify characteristics (at most " << kMaxStreams << L"), skipping UUID: "
+                       << GuidToString(characteristic.Uuid()) << std::endl;
+            return;
+        }
+
         // 订阅特性值变化事件
-        characteristic.ValueChanged({ OnCharacteristicValueChanged });
+        characteristic.ValueChanged([ring, characteristic_id](GattCharacteristic const&,
+                                                              GattValueChangedEventArgs const& args) {
+            OnCharacteristicValueChanged(*ring, characteristic_id, args);
+        });
 
         // 启用通知
         auto result = characteristic.WriteClientCharacteristicConfigurationDescriptorAsync(
@@ -191,17 +221,41 @@ void StartDeviceScanning() {
 }
 // 打印接收到的通知数据
 void PrintReceivedData() {
-    while (keep_running) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(20));  // 每 20 毫秒打印一次（50Hz）
-
-        // 打印存储的数据
-        std::lock_guard<std::mutex> lock(print_mutex);
-        if (!received_data.empty()) {
-            std::wcout << L"Received Data (Hex format): ";
-            for (auto byte : received_data) {
-                std::wcout << std::hex << std::setw(2) << std::setfill(L'0') << (int)byte << L" ";
-            }
-            std::wcout << std::endl;
+    // 轮流从各特性的队列成批取出通知，同一特性内按到达顺序打印，不会重复也不会互相覆盖；
+    // 一轮取出的全部通知编码到同一个缓冲区，一轮只写一次控制台。
+    // 队列为空时先自旋，再让出时间片，最后短暂休眠（与 DrainRing 相同）
+    ble::HexDumpWriter hex_writer(stdout);
+    auto print = [&](const ble::NotificationSlot& slot) {
+        char prefix[48];
+        std::snprintf(prefix, sizeof(prefix), "Received Data #%u (Hex format): ", slot.characteristic_id);
+        hex_writer.AppendPacket(slot.data, slot.length, prefix);
+    };
+    unsigned idle_rounds = 0;
+    for (;;) {
+        const bool running = keep_running.load(std::memory_order_acquire);
+        const std::size_t count = stream_count.load(std::memory_order_acquire);
+        std::size_t n = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            n += notification_rings[i]->PopBatch(print, 64);
+        }
+        if (n > 0) {
+            hex_writer.Flush();
+            idle_rounds = 0;
+            continue;
+        }
+        // 停止后还要再取一轮，全部队列都空了才退出
+        if (!running) {
+            return;
+        }
+        if (idle_rounds < 128) {
+            ++idle_rounds;
+        }
+        if (idle_rounds < 64) {
+            continue;
+        } else if (idle_rounds < 128) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
         }
     }
 }
@@ -209,6 +263,9 @@ void PrintReceivedData() {
 int main() {
     init_apartment(); // 初始化 WinRT 环境
 
+    // 启动打印线程
+    std::thread printer(PrintReceivedData);
+
     // 启动设备扫描
     StartDeviceScanning();
 
@@ -217,7 +274,8 @@ int main() {
     std::wcout << L"Press any key to stop..." << std::endl;
     std::wcin.get();
 
-
+    keep_running = false;
+    printer.join();
 
     std::cout<<"finished!!"<<std::endl;
     return 0;
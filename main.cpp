@@ -1,248 +1,864 @@
-﻿#include <windows.h>
-#include <winrt/Windows.Foundation.Collections.h>
+﻿#ifdef _WIN32
+#include <windows.h>
 #include <winrt/Windows.Foundation.h>
-#include <winrt/Windows.Devices.Bluetooth.h>
-#include <winrt/Windows.Devices.Bluetooth.Advertisement.h>
-#include <winrt/Windows.Devices.Bluetooth.GenericAttributeProfile.h>
-#include <winrt/Windows.Storage.Streams.h>
+#endif
 
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
 #include <atomic>
 #include <thread>
+#include <memory>
 #include <mutex>
 #include <future>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <string>
+#include <vector>
+
+#include "ble/advertisement_filter.h"
+#include "ble/async_output.h"
+#include "ble/capture_file.h"
+#include "ble/clock.h"
+#include "ble/device_manager.h"
+#include "ble/ecg_codec.h"
+#include "ble/ecg_decoder.h"
+#include "ble/ecg_filter.h"
+#include "ble/format.h"
+#include "ble/gatt_cache.h"
+#include "ble/hex_dump.h"
+#include "ble/latency_histogram.h"
+#include "ble/lifecycle.h"
+#include "ble/minmax_pyramid.h"
+#include "ble/notification_ring.h"
+#include "ble/qrs_detector.h"
+#include "ble/recording_ring.h"
+#include "ble/transport.h"
+#ifdef _WIN32
+#include "ble/winrt_transport.h"
+#else
+#include "ble/shared_samples.h"
+#include "ble/sim_transport.h"
+#include "ble/stream_server.h"
+#endif
+
+ble::Lifecycle lifecycle;  // 程序的运行阶段，请求停止时立即唤醒主线程
+
+// 抓包文件：保存每个通知的时间戳和原始数据，可以在 Linux 上回放
+ble::CaptureWriter capture_writer;
+std::mutex capture_mutex;
+std::vector<uint32_t> capture_streams;  // 下标就是抓包文件里的 characteristic_id，值是 (设备编号 << 8) | 流编号
+// --ring=文件名：最近一段时间的通知循环保存在固定大小的映射文件里，进程被杀掉也不会丢失，
+// 重新启动后接着写；大小由 --ring-mb 指定。记录的 characteristic_id 是 (设备编号 << 8) | 流编号
+ble::RecordingRing recording_ring;
+std::mutex ring_mutex;
+
+#ifndef _WIN32
+// --serve=套接字路径 / --serve-tcp=端口：把收到的通知实时分发给本地的查看、录制和分析工具，
+// 记录的 characteristic_id 与循环录制相同，是 (设备编号 << 8) | 流编号
+std::unique_ptr<ble::StreamServer> stream_server;
+// --shm=名字：各设备解码后的样本发布到共享内存 /名字-设备编号，同一台机器上的分析进程直接映射读取
+std::string shared_samples_prefix;
+#endif
+
+// --gatt-cache=文件名：按设备地址保存发现到的服务/特性布局，再次连接时跳过特性发现直接订阅
+std::shared_ptr<ble::GattCache> gatt_cache;
+
+// --plot=秒数：每 10 秒用字符画出各设备最近这段时间的波形
+double plot_seconds = 0.0;
+
+// --record=compressed：ECG 数据流不存原始通知，改存按块压缩的解码后样本，其他特性仍存原始通知
+bool capture_compressed = false;
+
+// 十六进制输出：解码线程只把编码好的行放进缓冲块，由单独的线程写到终端或文件，
+// 终端滚动慢或被暂停时不会拖慢通知处理
+std::unique_ptr<ble::AsyncOutput> hex_output;
+
+// 每个解码线程先把十六进制行攒成一批，攒满 kHexBatchPackets 个包、或者最早的一行已经等了 kHexBatchNs
+// 就整批交给 hex_output，加锁和复制按批而不是按包进行。收到通知时和解码线程空闲时（worker_idle）都会检查，
+// 设备停发后剩下的行最多再等 kHexBatchNs；解码线程退出时交出最后一批，Stop() 之后的 Flush 会把它们写出
+constexpr std::size_t kHexBatchPackets = 32;
+constexpr uint64_t kHexBatchNs = 20000000;
+
+struct HexBatch {
+    // 容量放得下整批最长的行，HexDumpWriter 不会在批中间自动刷新（没有输出文件时那会丢掉数据）
+    static constexpr std::size_t kLineBytes =
+            sizeof(ble::MacString) + 1 + ble::kMaxNotificationPayload * ble::kHexCharsPerByte + 1;
+
+    ble::HexDumpWriter lines{nullptr, kHexBatchPackets * kLineBytes};
+    std::size_t packets = 0;
+    uint64_t first_ns = 0;
+
+    ~HexBatch() { Submit(); }
+
+    void Submit() {
+        if (lines.Pending() > 0) {
+            hex_output->Append(lines.Data(), lines.Pending());
+            lines.Clear();
+        }
+        packets = 0;
+    }
 
-using namespace winrt;
-using namespace Windows::Devices::Bluetooth;
-using namespace Windows::Devices::Bluetooth::Advertisement;
-using namespace Windows::Devices::Bluetooth::GenericAttributeProfile;
-using namespace Windows::Foundation::Collections;
-using namespace Windows::Storage::Streams;
+    // 满一批或最早的一行已经超时就交出
+    void SubmitIfDue(uint64_t now_ns) {
+        if (packets == kHexBatchPackets || (packets > 0 && now_ns - first_ns >= kHexBatchNs)) {
+            Submit();
+        }
+    }
+};
+
+thread_local HexBatch hex_batch;
+
+
+
+
+// ECG-7 的采样率（每个通知 3 帧），滤波和 R 波检测都按这个频率设计
+constexpr double kEcg7SampleRateHz = 250.0;
+
+// 每台设备一个 ECG 解码器，设备固定由一个解码线程处理，所以不需要加锁
+struct EcgChannel {
+    ble::EcgDecoder decoder{ble::kEcg7Format};
+    ble::EcgLeadBuffer samples{ble::kEcg7Format.leads, 1024};  // 按导联分开的样本，写满后从头开始
+    // 去基线漂移、工频陷波和低通，滤波状态跨通知保留
+    ble::EcgFilter filter{ble::kEcg7Format.leads, ble::EcgFilterConfig{kEcg7SampleRateHz}};
+    // R 波检测，检出的心搏只保留到下一个通知
+    ble::QrsDetector detector{ble::kEcg7Format.leads, ble::QrsDetectorOptions{kEcg7SampleRateHz}};
+    std::vector<ble::HeartBeat> beats;
+    // 状态显示线程读取
+    std::atomic<uint64_t> beat_count{0};
+    std::atomic<double> heart_rate_bpm{0.0};
+    std::vector<std::vector<float>> filtered =
+            std::vector<std::vector<float>>(ble::kEcg7Format.leads, std::vector<float>(1024));  // 与 samples 同位置
+    // 最近 24 小时的波形概览，显示任意时间范围时只读与列数成正比的桶；
+    // 每个导联最多约 14MB，随数据增长。解码线程写、主线程读，用 overview_mutex 保护
+    ble::MinMaxPyramid overview{ble::kEcg7Format.leads,
+                                ble::MinMaxPyramidOptions{16, 4, static_cast<uint64_t>(kEcg7SampleRateHz * 86400)}};
+    std::mutex overview_mutex;
+    // 压缩录制，凑满一块才写入抓包文件
+    ble::EcgBlockEncoder recorder{ble::kEcg7Format.leads};
+    uint16_t record_stream = 0;
+    ble::Guid record_uuid{};
+#ifndef _WIN32
+    // 第一次解出样本时创建，约 4 分钟的环
+    std::unique_ptr<ble::SharedSampleWriter> shared;
+#endif
+};
+std::vector<std::unique_ptr<EcgChannel>> ecg_channels;  // 下标是设备编号
+
+// 一个通知在各处理阶段的耗时：queue 是从回调收到到解码线程取出，total 是从回调收到到输出完成
+enum LatencyStage : std::size_t {
+    kStageQueue,
+    kStageCapture,
+    kStageDecode,
+    kStageFilter,
+    kStageDetect,
+    kStageOutput,
+    kStageTotal,
+};
+ble::LatencyProbes latency_probes({"queue", "capture", "decode", "filter", "detect", "output", "total"});
+
+using ble::GuidToString;
 
-std::atomic<bool> keep_running(true);  // 控制程序是否继续运行
+/**
+ * 查找流在抓包文件里的编号，每台设备的每个流第一次出现时先登记 UUID；调用时要持有 capture_mutex
+ * @param device_index
+ * @param stream_index
+ * @param uuid
+ */
+uint16_t CaptureStreamId(std::size_t device_index, uint16_t stream_index, const ble::Guid& uuid) {
+    const uint32_t key = static_cast<uint32_t>(device_index << 8) | stream_index;
+    uint16_t id = 0;
+    while (id < capture_streams.size() && capture_streams[id] != key) {
+        ++id;
+    }
+    if (id == capture_streams.size()) {
+        capture_streams.push_back(key);
+        capture_writer.DefineCharacteristic(id, uuid);
+    }
+    return id;
+}
 
+/**
+ * 把一个通知写入抓包文件
+ * @param device_index
+ * @param stream_index
+ * @param uuid
+ * @param timestamp_ns
+ * @param data
+ * @param length
+ */
+void CaptureNotification(std::size_t device_index, uint16_t stream_index, const ble::Guid& uuid,
+                         uint64_t timestamp_ns, const uint8_t* data, std::size_t length) {
+    std::lock_guard<std::mutex> lock(capture_mutex);
+    if (!capture_writer.IsOpen()) {
+        return;
+    }
+    capture_writer.Append(timestamp_ns, CaptureStreamId(device_index, stream_index, uuid), data,
+                          static_cast<uint16_t>(length));
+}
 
+/**
+ * 把一块压缩后的 ECG 样本写入抓包文件
+ * @param device_index
+ * @param stream_index
+ * @param uuid
+ * @param timestamp_ns
+ * @param block
+ * @param length
+ */
+void CaptureEcgBlock(std::size_t device_index, uint16_t stream_index, const ble::Guid& uuid,
+                     uint64_t timestamp_ns, const uint8_t* block, std::size_t length) {
+    std::lock_guard<std::mutex> lock(capture_mutex);
+    if (!capture_writer.IsOpen()) {
+        return;
+    }
+    capture_writer.AppendEcgBlock(timestamp_ns, CaptureStreamId(device_index, stream_index, uuid), block,
+                                  static_cast<uint16_t>(length));
+}
 
+/**
+ * 处理特性值变化，在 DeviceManager 的解码线程上调用
+ * @param manager
+ * @param device_index
+ * @param slot
+ */
+void OnCharacteristicValueChanged(const ble::DeviceManager& manager, std::size_t device_index,
+                                  const ble::NotificationSlot& slot) {
+    const uint64_t dequeued_ns = ble::MonotonicNowNs();
+    const uint64_t start = ble::TickNow();
+    latency_probes.Record(kStageQueue, dequeued_ns > slot.timestamp_ns ? dequeued_ns - slot.timestamp_ns : 0);
+    uint64_t lap = start;
+
+    ble::Guid uuid{};
+    manager.StreamUuid(device_index, slot.characteristic_id, uuid);
+//    std::wcout << L"Notification received for characteristic UUID: " << GuidToString(uuid).data() << std::endl;
+
+    // 压缩录制时 ECG 数据在解码之后按块写入
+    if (!capture_compressed || uuid != ble::kEcg7DataUuid) {
+        CaptureNotification(device_index, slot.characteristic_id, uuid, slot.timestamp_ns, slot.data, slot.length);
+        lap = latency_probes.Lap(kStageCapture, lap);
+    }
+    // 循环录制：从通知槽直接复制进映射文件，没有系统调用
+    if (recording_ring.IsOpen()) {
+        std::lock_guard<std::mutex> lock(ring_mutex);
+        recording_ring.Append(slot.timestamp_ns, static_cast<uint16_t>((device_index << 8) | slot.characteristic_id),
+                              slot.data, slot.length);
+    }
+#ifndef _WIN32
+    if (stream_server) {
+        stream_server->Publish(slot.timestamp_ns, static_cast<uint16_t>((device_index << 8) | slot.characteristic_id),
+                               uuid, slot.data, slot.length);
+    }
+#endif
 
-// 格式化 MAC 地址
-std::wstring FormatBluetoothAddress(uint64_t address) {
-    std::wstringstream ss;
-    ss << std::hex << std::setfill(L'0');
-    for (int i = 5; i >= 0; i--) {
-        ss << std::setw(2) << ((address >> (i * 8)) & 0xFF);
-        if (i > 0) {
-            ss << L":";
+    // 解出各导联的样本
+    if (uuid == ble::kEcg7DataUuid) {
+        EcgChannel& channel = *ecg_channels[device_index];
+        if (channel.samples.Available() * channel.decoder.Format().FrameBytes() < slot.length) {
+            channel.samples.Clear();
+        }
+        std::size_t first = channel.samples.Size();
+        std::size_t frames = channel.decoder.Decode(slot.data, slot.length, channel.samples);
+        lap = latency_probes.Lap(kStageDecode, lap);
+        const int32_t* in[ble::kMaxEcgLeads];
+        float* out[ble::kMaxEcgLeads];
+        for (std::size_t lead = 0; lead < channel.samples.Leads(); ++lead) {
+            in[lead] = channel.samples.Lead(lead) + first;
+            out[lead] = channel.filtered[lead].data() + first;
+        }
+        if (capture_compressed) {
+            channel.record_stream = slot.characteristic_id;
+            channel.record_uuid = uuid;
+            channel.recorder.Append(in, frames, [&](const uint8_t* block, std::size_t length) {
+                CaptureEcgBlock(device_index, slot.characteristic_id, uuid, slot.timestamp_ns, block, length);
+            });
+            lap = latency_probes.Lap(kStageCapture, lap);
         }
+        {
+            std::lock_guard<std::mutex> lock(channel.overview_mutex);
+            channel.overview.Append(in, frames);
+        }
+#ifndef _WIN32
+        if (!shared_samples_prefix.empty()) {
+            if (!channel.shared) {
+                channel.shared = std::make_unique<ble::SharedSampleWriter>();
+                const std::string name = "/" + shared_samples_prefix + "-" + std::to_string(device_index);
+                if (!channel.shared->Create(name, channel.samples.Leads(), 1 << 16, kEcg7SampleRateHz)) {
+                    std::fprintf(stderr, "Failed to create shared memory %s, samples will not be published\n",
+                                 name.c_str());
+                }
+            }
+            channel.shared->Write(in, frames, slot.timestamp_ns);
+        }
+#endif
+        channel.filter.Process(in, out, frames);
+        lap = latency_probes.Lap(kStageFilter, lap);
+
+        channel.beats.clear();
+        if (channel.detector.Process(in, frames, channel.beats) > 0) {
+            channel.beat_count.fetch_add(channel.beats.size(), std::memory_order_relaxed);
+            channel.heart_rate_bpm.store(channel.beats.back().average_bpm, std::memory_order_relaxed);
+        }
+        lap = latency_probes.Lap(kStageDetect, lap);
     }
-    return ss.str();
-}
 
-std::wstring GuidToString(const winrt::guid& g) {
-    std::wostringstream oss;
-    // 格式化 GUID 为标准的 8-4-4-4-12 字符串
-    oss << std::hex << std::uppercase
-        << g.Data1 << L"-" << g.Data2 << L"-" << g.Data3 << L"-"
-        << static_cast<int>(g.Data4[0]) << static_cast<int>(g.Data4[1]) << L"-"
-        << static_cast<int>(g.Data4[2]) << static_cast<int>(g.Data4[3])
-        << static_cast<int>(g.Data4[4]) << static_cast<int>(g.Data4[5])
-        << static_cast<int>(g.Data4[6]) << static_cast<int>(g.Data4[7]);
-    return oss.str();
+    // 打印接收到的数据（16进制格式），每行以设备 MAC 开头区分多台设备
+    ble::MacString mac = ble::FormatBluetoothAddress(manager.DeviceAddress(device_index));
+    char prefix[sizeof(mac) + 2];
+    std::snprintf(prefix, sizeof(prefix), "%s ", mac.data());
+    if (hex_batch.packets == 0) {
+        hex_batch.first_ns = dequeued_ns;
+    }
+    hex_batch.lines.AppendPacket(slot.data, slot.length, prefix);
+    ++hex_batch.packets;
+    hex_batch.SubmitIfDue(dequeued_ns);
+    lap = latency_probes.Lap(kStageOutput, lap);
+
+    const double processing_ns = static_cast<double>(lap - start) * ble::NsPerTick();
+    latency_probes.Record(kStageTotal, (dequeued_ns - std::min(dequeued_ns, slot.timestamp_ns)) +
+                                               static_cast<uint64_t>(processing_ns));
 }
 
 /**
- * 处理特性值变化的回调
- * @param characteristic
- * @param args
+ * 打印一台设备的订阅登记表：每个特性的订阅方式、结果和启用耗时
+ * @param manager
+ * @param device_index
  */
-void OnCharacteristicValueChanged(const GattCharacteristic& characteristic, const GattValueChangedEventArgs& args) {
-//    std::wcout << L"Notification received for characteristic UUID: " << GuidToString(characteristic.Uuid()) << std::endl;
+void PrintSubscriptions(const ble::DeviceManager& manager, std::size_t device_index) {
+    ble::MacString mac = ble::FormatBluetoothAddress(manager.DeviceAddress(device_index));
+    for (const auto& record : manager.Subscriptions(device_index)) {
+        std::fprintf(stderr, "%s %s %s %s (%.1f ms)\n", mac.data(),
+                     record.kind == ble::SubscriptionKind::Notify ? "notify" : "indicate",
+                     GuidToString(record.characteristic.uuid).data(), ble::SubscriptionStateName(record.state),
+                     record.activation_ms);
+    }
+}
 
-    // 获取接收到的值
-    IBuffer buffer = args.CharacteristicValue();
-    const uint8_t* data = buffer.data();
-    uint32_t length = buffer.Length();
+/**
+ * 打印各设备的状态和吞吐
+ * @param manager
+ */
+void PrintDeviceStats(const ble::DeviceManager& manager) {
+    for (const auto& stats : manager.Stats()) {
+        ble::MacString mac = ble::FormatBluetoothAddress(stats.address);
+        const EcgChannel& channel = *ecg_channels[stats.index];
+        std::fprintf(stderr, "[%zu] %s %-12s streams=%zu rx=%llu %.1f/s latency avg=%.1fus max=%.1fus dropped=%llu"
+                             " lost=%llu dup=%llu reordered=%llu beats=%llu hr=%.1fbpm\n",
+                     stats.index, mac.data(), ble::DeviceStateName(stats.state), stats.streams,
+                     static_cast<unsigned long long>(stats.notifications), stats.notifications_per_s,
+                     stats.latency_avg_us, stats.latency_max_us, static_cast<unsigned long long>(stats.dropped),
+                     static_cast<unsigned long long>(stats.lost), static_cast<unsigned long long>(stats.duplicates),
+                     static_cast<unsigned long long>(stats.reordered),
+                     static_cast<unsigned long long>(channel.beat_count.load(std::memory_order_relaxed)),
+                     channel.heart_rate_bpm.load(std::memory_order_relaxed));
+    }
+}
 
-//    // 打印接收到的数据
-//    for (uint32_t i = 0; i < length; ++i) {
-//        std::wcout << L"Data byte: " << (int)data[i] << std::endl;
-//    }
+/**
+ * 打印十六进制输出的写出情况：追加和丢弃的批数（每批最多 kHexBatchPackets 行）以及从进入缓冲到写出的延迟
+ * @param output
+ */
+void PrintOutputStats(const ble::AsyncOutput& output) {
+    ble::AsyncOutputStats stats = output.Stats();
+    std::fprintf(stderr, "output appends=%llu bytes=%llu dropped_appends=%llu (%llu bytes) blocks=%llu"
+                         " delay p99=%.1fms max=%.1fms write max=%.1fms\n",
+                 static_cast<unsigned long long>(stats.appends), static_cast<unsigned long long>(stats.bytes),
+                 static_cast<unsigned long long>(stats.dropped_appends),
+                 static_cast<unsigned long long>(stats.dropped_bytes),
+                 static_cast<unsigned long long>(stats.blocks_written), static_cast<double>(stats.delay.p99_ns) / 1e6,
+                 static_cast<double>(stats.delay.max_ns) / 1e6, static_cast<double>(stats.write.max_ns) / 1e6);
+}
 
-    // 打印接收到的数据（16进制格式）
-//    std::wcout << L"Received Data (Hex format): ";
-    for (uint32_t i = 0; i < length; ++i) {
-        std::wcout << std::hex << std::setw(2) << std::setfill(L'0') << (int)data[i] << L" ";
+#ifndef _WIN32
+/**
+ * 打印数据流服务器的订阅者数和各订阅者的积压、丢弃情况
+ * @param server
+ */
+void PrintServerStats(const ble::StreamServer& server) {
+    ble::StreamServerStats stats = server.Stats();
+    std::fprintf(stderr, "stream subscribers=%zu batches=%llu bytes=%llu dropped=%llu slow disconnects=%llu\n",
+                 stats.subscribers, static_cast<unsigned long long>(stats.batches),
+                 static_cast<unsigned long long>(stats.bytes), static_cast<unsigned long long>(stats.dropped_batches),
+                 static_cast<unsigned long long>(stats.slow_disconnects));
+    for (const auto& subscriber : server.Subscribers()) {
+        std::fprintf(stderr, "  subscriber %llu sent=%llu batches queued=%zu peak=%zu dropped=%llu\n",
+                     static_cast<unsigned long long>(subscriber.id),
+                     static_cast<unsigned long long>(subscriber.sent_batches), subscriber.queued_bytes,
+                     subscriber.peak_queued_bytes, static_cast<unsigned long long>(subscriber.dropped_batches));
     }
-    std::wcout << std::endl;
-
 }
+#endif
 
 /**
- * 启用特性通知
- * @param characteristic
+ * 用各设备的波形概览画出最近 seconds 秒的第一导联
+ * @param manager
+ * @param seconds
  */
-void EnableNotifications(const GattCharacteristic& characteristic) {
-    // 检查特性是否支持通知
-    if ((characteristic.CharacteristicProperties() & GattCharacteristicProperties::Notify) == GattCharacteristicProperties::Notify) {
+void PlotRecentWaveforms(const ble::DeviceManager& manager, double seconds) {
+    constexpr std::size_t kColumns = 100;
+    ble::MinMax columns[kColumns];
+    for (const auto& stats : manager.Stats()) {
+        EcgChannel& channel = *ecg_channels[stats.index];
+        std::size_t touched = 0;
+        std::size_t count = 0;
+        {
+            std::lock_guard<std::mutex> lock(channel.overview_mutex);
+            const uint64_t last = channel.overview.Samples();
+            const uint64_t span = static_cast<uint64_t>(seconds * kEcg7SampleRateHz);
+            if (last == 0) {
+                continue;
+            }
+            // 每列至少一个最细的桶，时间范围很短时列数相应减少
+            count = static_cast<std::size_t>(
+                    std::min<uint64_t>(kColumns, std::max<uint64_t>(1, span / channel.overview.BucketSamples(0))));
+            touched = channel.overview.Query(0, last > span ? last - span : 0, last, columns, count);
+        }
+        ble::MacString mac = ble::FormatBluetoothAddress(stats.address);
+        std::fprintf(stderr, "%s lead 0, last %.0f s (%zu buckets)\n", mac.data(), seconds, touched);
+        ble::RenderMinMaxColumns(columns, count, 8, stderr);
+    }
+}
 
+/**
+ * 打印上一次调用以来各个流的丢包、重复、乱序和到达间隔分布
+ * @param manager
+ * @param previous 各设备各流上一次的累计统计，调用后更新为这一次的
+ */
+void PrintSequenceStats(const ble::DeviceManager& manager, std::vector<std::vector<ble::SequenceStats>>& previous) {
+    for (const auto& stats : manager.Stats()) {
+        if (previous.size() <= stats.index) {
+            previous.resize(stats.index + 1);
+        }
+        auto& before = previous[stats.index];
+        for (const auto& stream : manager.SequenceStatistics(stats.index)) {
+            if (before.size() <= stream.stream) {
+                before.resize(stream.stream + 1);
+            }
+            ble::SequenceStats interval = stream.stats.Since(before[stream.stream]);
+            before[stream.stream] = stream.stats;
+            if (interval.packets == 0) {
+                continue;
+            }
+            std::fprintf(stderr, "    stream %u %s rx=%llu lost=%llu (%.2f%%) dup=%llu reordered=%llu gaps=%llu"
+                                 " interval p50=%.0fus p99=%.0fus max<%.0fus\n",
+                         stream.stream, GuidToString(stream.characteristic).data(),
+                         static_cast<unsigned long long>(interval.packets),
+                         static_cast<unsigned long long>(interval.lost), interval.LossRate() * 100.0,
+                         static_cast<unsigned long long>(interval.duplicates),
+                         static_cast<unsigned long long>(interval.reordered),
+                         static_cast<unsigned long long>(interval.gaps), interval.InterArrivalPercentileUs(50),
+                         interval.InterArrivalPercentileUs(99), interval.InterArrivalMaxUs());
+        }
+    }
+}
 
+/**
+ * 启动设备扫描，所有匹配的目标设备都会并发连接并接收通知
+ * @param transport
+ * @param targets
+ * @param filters 额外的广播过滤规则，匹配任意一条的设备也会连接
+ */
+void StartDeviceScanning(ble::BleTransport& transport, std::vector<ble::DeviceTarget> targets,
+                         std::vector<ble::AdvertisementRule> filters) {
+    ble::DeviceManagerOptions options;
+    options.targets = std::move(targets);
+    options.filters = std::move(filters);
+    options.sequence_field = ble::kEcg7SequenceField;
+    options.gatt_cache = gatt_cache;
+    ecg_channels.resize(options.max_devices);
+    for (auto& channel : ecg_channels) {
+        channel = std::make_unique<EcgChannel>();
+    }
+    // 设备停发或断开时，解码线程空闲下来也会交出超时的十六进制行
+    options.worker_idle = [] {
+        hex_batch.SubmitIfDue(ble::MonotonicNowNs());
+    };
+    options.state_listener = [](std::size_t, ble::DeviceState state) {
+        if (state == ble::DeviceState::Connecting) {
+            lifecycle.Advance(ble::LifecycleState::Connecting);
+        } else if (state == ble::DeviceState::Streaming) {
+            lifecycle.Advance(ble::LifecycleState::Streaming);
+        }
+    };
+    ble::DeviceManager manager(transport, options, [&manager](std::size_t device_index, const ble::NotificationSlot& slot) {
+        OnCharacteristicValueChanged(manager, device_index, slot);
+    });
 
+    // 启动扫描
+    std::wcout << L"Scanning for BLE devices..." << std::endl;
+    if (!manager.Start()) {
+        std::fprintf(stderr, "Too many targets and filters (at most %zu)\n", ble::kMaxAdvertisementRules);
+        lifecycle.RequestStop();
+    }
 
-        // 启用通知
-        auto result = characteristic.WriteClientCharacteristicConfigurationDescriptorAsync(
-                GattClientCharacteristicConfigurationDescriptorValue::Notify
-        ).get();
+    // 扫描一直进行，新出现的目标设备也会被连接；每秒打印一次各设备的统计，
+    // 设备刚开始接收时先打印它的订阅情况。请求停止时立即醒来，不必等满一秒
+    std::vector<bool> reported;
+    std::vector<std::vector<ble::SequenceStats>> sequence_before;
+    for (unsigned seconds = 1; !lifecycle.WaitForStop(std::chrono::seconds(1)); ++seconds) {
+        for (const auto& stats : manager.Stats()) {
+            if (reported.size() <= stats.index) {
+                reported.resize(stats.index + 1, false);
+            }
+            if (!reported[stats.index] && stats.state == ble::DeviceState::Streaming) {
+                std::fprintf(stderr, "%s connected in %.1f ms (discovery %.1f ms%s, subscribe %.1f ms)\n",
+                             ble::FormatBluetoothAddress(stats.address).data(), stats.connect_ms,
+                             stats.discovery.total_ms, stats.gatt_cache_hit ? " from cache" : "",
+                             stats.subscribe_ms);
+                PrintSubscriptions(manager, stats.index);
+                reported[stats.index] = true;
+            }
+        }
+        PrintDeviceStats(manager);
+        PrintSequenceStats(manager, sequence_before);
+        PrintOutputStats(*hex_output);
+#ifndef _WIN32
+        if (stream_server) {
+            PrintServerStats(*stream_server);
+        }
+#endif
+        // 循环录制文件每秒同步一次到磁盘，断电时最多丢失最近一秒
+        if (recording_ring.IsOpen()) {
+            recording_ring.Sync();
+        }
+        // 各阶段延迟的累计分布每 10 秒打印一次
+        if (seconds % 10 == 0) {
+            ble::RenderLatencyTable(latency_probes.Stages(), latency_probes.Summaries(), stderr);
+            if (plot_seconds > 0.0) {
+                PlotRecentWaveforms(manager, plot_seconds);
+            }
+        }
+    }
 
-        if (result == GattCommunicationStatus::Success) {
-            std::wcout << L"Notifications enabled for characteristic UUID: " << GuidToString(characteristic.Uuid()) << std::endl;
+    // 停止扫描、断开设备，解码线程处理完队列里剩余的通知后才返回
+    lifecycle.Advance(ble::LifecycleState::Draining);
+    manager.Stop();
+    hex_output->Flush();
+    PrintDeviceStats(manager);
+    PrintOutputStats(*hex_output);
+    ble::RenderLatencyTable(latency_probes.Stages(), latency_probes.Summaries(), stderr);
+    std::wcout << L"Scan has been stopped." << std::endl;
+}
 
-//            while (true){
-                // 订阅特性值变化事件
-//                characteristic.ValueChanged({ OnCharacteristicValueChanged });
-//            }
+/**
+ * 命令行参数是要连接的设备，MAC 地址按地址匹配，其他按广播名称匹配；既没有设备也没有 --filter 时连接所有 ECG-7。
+ * 以 -- 开头的是选项，不是设备
+ * @param argc
+ * @param argv
+ * @param has_filters 命令行上有 --filter
+ */
+std::vector<ble::DeviceTarget> ParseTargets(int argc, char* argv[], bool has_filters) {
+    std::vector<ble::DeviceTarget> targets;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--", 2) == 0) {
+            continue;
+        }
+        ble::DeviceTarget target;
+        if (!ble::ParseBluetoothAddress(argv[i], target.address)) {
+            target.name = argv[i];
+        }
+        targets.push_back(target);
+    }
+    if (targets.empty() && !has_filters) {
+        targets.push_back({"ECG-7", 0});
+    }
+    return targets;
+}
 
+/**
+ * 广播过滤规则：每个 --filter=规则 一条，例如 --filter=oui=c0:ff:ee,service=FFF0,rssi=-80，
+ * 格式见 ParseAdvertisementRule。写错的规则打印出来后忽略
+ * @param argc
+ * @param argv
+ */
+std::vector<ble::AdvertisementRule> ParseFilters(int argc, char* argv[]) {
+    std::vector<ble::AdvertisementRule> filters;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--filter=", 9) != 0) {
+            continue;
+        }
+        ble::AdvertisementRule rule;
+        std::string error;
+        ble::AdvertisementFilter check;
+        if (!ble::ParseAdvertisementRule(argv[i] + 9, rule)) {
+            std::fprintf(stderr, "Ignoring malformed filter: %s\n", argv[i] + 9);
+        } else if (!check.Compile({rule}, &error)) {
+            std::fprintf(stderr, "Ignoring filter %s: %s\n", argv[i] + 9, error.c_str());
         } else {
-            std::wcout << L"Failed to enable notifications for characteristic UUID: " << GuidToString(characteristic.Uuid()) << std::endl;
+            filters.push_back(std::move(rule));
         }
+    }
+    return filters;
+}
 
+/**
+ * 会话结束时把各设备不满一块的样本写入抓包文件，并打印压缩率
+ */
+void FlushRecordings() {
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    for (std::size_t device_index = 0; device_index < ecg_channels.size(); ++device_index) {
+        EcgChannel& channel = *ecg_channels[device_index];
+        channel.recorder.Flush([&](const uint8_t* block, std::size_t length) {
+            CaptureEcgBlock(device_index, channel.record_stream, channel.record_uuid, ble::MonotonicNowNs(), block,
+                            length);
+        });
+        frames += channel.recorder.Frames();
+        bytes += channel.recorder.EncodedBytes();
+    }
+    if (bytes > 0) {
+        const double raw = static_cast<double>(frames * ble::kEcg7Format.FrameBytes());
+        std::fprintf(stderr, "Recorded %llu ECG frames in %llu bytes, %.2fx smaller than the raw samples\n",
+                     static_cast<unsigned long long>(frames), static_cast<unsigned long long>(bytes),
+                     raw / static_cast<double>(bytes));
+    }
+}
 
-        // 订阅特性值变化事件，只需订阅一次
-        characteristic.ValueChanged({ OnCharacteristicValueChanged });
-        // 保持连接，等待事件触发
-        std::wcout << L"Waiting for notifications..." << std::endl;
-//        std::this_thread::sleep_for(std::chrono::minutes(5));  // 等待一段时间，保持主线程运行
-
-
-/*running 是一个布尔值，当你需要退出程序时，可以将其设置为 false，从而退出循环*/
-//        while (running) {
-//            std::this_thread::sleep_for(std::chrono::seconds(1));  // 每秒钟检查一次
-//            // 可以在这里添加一些定期检查的逻辑
-//        }
-
-        while (true) {
-            std::this_thread::sleep_for(std::chrono::seconds(1));  // 每秒钟等待一次，保持主线程运行
+/**
+ * 打开 GATT 布局缓存：--gatt-cache=文件名，文件不存在时在第一次完整发现后创建
+ * @param argc
+ * @param argv
+ */
+void OpenGattCache(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--gatt-cache=", 13) != 0) {
+            continue;
+        }
+        gatt_cache = std::make_shared<ble::GattCache>();
+        if (gatt_cache->Open(argv[i] + 13)) {
+            std::fprintf(stderr, "GATT cache %s: %zu devices\n", argv[i] + 13, gatt_cache->Stats().entries);
         }
-
-
-
-    } else {
-        std::wcout << L"Characteristic UUID " << GuidToString(characteristic.Uuid()) << L" does not support notifications." << std::endl;
     }
 }
 
-
-
-// 打印特性
-void PrintCharacteristics(const GattDeviceService& service) {
-    auto result = service.GetCharacteristicsAsync().get();
-
-    if (result.Status() == GattCommunicationStatus::Success) {
-        IVectorView<GattCharacteristic> characteristics = result.Characteristics();
-        for (auto const& characteristic : characteristics) {
-//            std::wcout << L"  - Characteristic UUID: " << GuidToString(characteristic.Uuid()) << std::endl;
-//            std::wcout << L"      Properties: ";
-//
-//            GattCharacteristicProperties properties = characteristic.CharacteristicProperties();
-//            if ((properties & GattCharacteristicProperties::Read) == GattCharacteristicProperties::Read) {
-//                std::wcout << L"Read ";
-//            }
-//            if ((properties & GattCharacteristicProperties::Write) == GattCharacteristicProperties::Write) {
-//                std::wcout << L"Write ";
-//            }
-//            if ((properties & GattCharacteristicProperties::Notify) == GattCharacteristicProperties::Notify) {
-//                std::wcout << L"Notify ";
-//            }
-//            if ((properties & GattCharacteristicProperties::Indicate) == GattCharacteristicProperties::Indicate) {
-//                std::wcout << L"Indicate ";
-//            }
-            std::wcout << std::endl;
-
-//            // 启用通知
-            EnableNotifications(characteristic);
+/**
+ * 打开循环录制文件：--ring=文件名 --ring-mb=大小（默认 256MB）
+ * @param argc
+ * @param argv
+ */
+void OpenRecordingRing(int argc, char* argv[]) {
+    std::string path;
+    std::size_t megabytes = 256;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--ring=", 7) == 0) {
+            path = argv[i] + 7;
+        } else if (std::strncmp(argv[i], "--ring-mb=", 10) == 0) {
+            megabytes = std::max<std::size_t>(1, std::strtoul(argv[i] + 10, nullptr, 10));
         }
+    }
+    if (path.empty()) {
+        return;
+    }
+    ble::RecordingRingOptions options;
+    options.blocks = megabytes * 1024 * 1024 / options.block_bytes;
+    if (!recording_ring.Open(path, options)) {
+        std::wcerr << L"Failed to open the recording ring, notifications will not be kept." << std::endl;
+        return;
+    }
+    const ble::RingRecovery& recovery = recording_ring.Recovery();
+    if (recovery.existing) {
+        std::fprintf(stderr, "Recording ring %s: recovered records %llu..%llu (%s, %llu after the header)\n",
+                     path.c_str(), static_cast<unsigned long long>(recovery.first_sequence),
+                     static_cast<unsigned long long>(recovery.last_sequence),
+                     recovery.header_valid ? "header ok" : "header damaged, scanned",
+                     static_cast<unsigned long long>(recovery.rolled_forward));
     } else {
-        std::wcout << L"Failed to retrieve characteristics for service: " << GuidToString(service.Uuid()) << std::endl;
+        std::fprintf(stderr, "Recording ring %s: created %zu MB\n", path.c_str(),
+                     recording_ring.CapacityBytes() / (1024 * 1024));
     }
 }
 
+#ifndef _WIN32
 /**
- * 打印服务列表
- * @param device
+ * 启动本地数据流服务器：--serve=Unix 套接字路径 和/或 --serve-tcp=端口（只监听 127.0.0.1）
+ * @param argc
+ * @param argv
  */
-void PrintGattServices(BluetoothLEDevice device) {
-    std::wcout << L"Connected to device: " << device.Name().c_str() << std::endl;
-    auto result = device.GetGattServicesAsync().get();
-
-    if (result.Status() == GattCommunicationStatus::Success) {
-        IVectorView<GattDeviceService> services = result.Services();
-
-        std::wcout << L"Found " << services.Size() << L" services:" << std::endl;
-
-        for (auto const& service : services) {
-//            std::wcout << L" - Service UUID: " << GuidToString(service.Uuid()) << std::endl;
-            PrintCharacteristics(service);
+void OpenStreamServer(int argc, char* argv[]) {
+    ble::StreamServerOptions options;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--serve=", 8) == 0) {
+            options.unix_path = argv[i] + 8;
+        } else if (std::strncmp(argv[i], "--serve-tcp=", 12) == 0) {
+            options.tcp = true;
+            options.tcp_port = static_cast<uint16_t>(std::strtoul(argv[i] + 12, nullptr, 10));
         }
-    } else {
-        std::wcout << L"Failed to retrieve services. Status: " << (int)result.Status() << std::endl;
+    }
+    if (options.unix_path.empty() && !options.tcp) {
+        return;
+    }
+    stream_server = std::make_unique<ble::StreamServer>(options);
+    if (!stream_server->Open()) {
+        std::wcerr << L"Failed to start the stream server, notifications will not be served." << std::endl;
+        stream_server.reset();
+        return;
+    }
+    if (!options.unix_path.empty()) {
+        std::fprintf(stderr, "Serving notifications on %s\n", options.unix_path.c_str());
+    }
+    if (options.tcp) {
+        std::fprintf(stderr, "Serving notifications on 127.0.0.1:%u\n", static_cast<unsigned>(stream_server->TcpPort()));
     }
 }
 
 /**
- * 启动设备扫描并连接到目标设备
+ * 共享内存的名字前缀：--shm=名字，不给时不发布；开头的 / 可以省略
+ * @param argc
+ * @param argv
  */
-void StartDeviceScanning() {
-    BluetoothLEAdvertisementWatcher watcher;
-    watcher.ScanningMode(BluetoothLEScanningMode::Active);
-
-    watcher.Received([&](BluetoothLEAdvertisementWatcher const&,
-                         BluetoothLEAdvertisementReceivedEventArgs const& args) {
-        hstring deviceName = args.Advertisement().LocalName();
-        auto macAddress = FormatBluetoothAddress(args.BluetoothAddress());
-
-        // 如果是目标设备，连接设备并停止扫描
-        if (deviceName == L"ECG-7") {
-            std::wcout << L"Target device found, connecting..." << std::endl;
-            try {
-                // 连接到设备
-                auto device = BluetoothLEDevice::FromBluetoothAddressAsync(args.BluetoothAddress()).get();
-                PrintGattServices(device); // 打印服务列表
-
-                // 停止扫描
-                watcher.Stop();
-                std::wcout << L"Scanning stopped after connecting to device." << std::endl;
-            } catch (const hresult_error& ex) {
-                std::wcerr << L"Failed to connect to device. Error: " << ex.message().c_str() << std::endl;
-            }
+std::string ParseSharedSamples(int argc, char* argv[]) {
+    std::string prefix;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--shm=", 6) == 0) {
+            prefix = argv[i] + 6;
         }
-    });
-
-    // 启动扫描
-    watcher.Start();
-    std::wcout << L"Scanning for BLE devices..." << std::endl;
-
-    // 程序将在此等待，直到扫描到目标设备后停止扫描
-    while (keep_running) {
-        Sleep(100); // 等待一段时间，防止高CPU占用
     }
-
-    std::wcout << L"Scan has been stopped." << std::endl;
+    return prefix.empty() || prefix[0] != '/' ? prefix : prefix.substr(1);
 }
+#endif
 
+/**
+ * 波形显示的时间范围：--plot=秒数，不给时不显示
+ * @param argc
+ * @param argv
+ */
+double ParsePlotSeconds(int argc, char* argv[]) {
+    double seconds = 0.0;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--plot=", 7) == 0) {
+            seconds = std::max(0.0, std::strtod(argv[i] + 7, nullptr));
+        }
+    }
+    return seconds;
+}
 
-int main() {
-    init_apartment(); // 初始化 WinRT 环境
+/**
+ * 抓包文件里 ECG 数据的存储方式：--record=raw（默认，原始通知）或 --record=compressed
+ * @param argc
+ * @param argv
+ */
+bool ParseRecordCompressed(int argc, char* argv[]) {
+    bool compressed = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--record=compressed") == 0) {
+            compressed = true;
+        } else if (std::strcmp(argv[i], "--record=raw") == 0) {
+            compressed = false;
+        }
+    }
+    return compressed;
+}
 
-    // 启动设备扫描
-    StartDeviceScanning();
+/**
+ * 十六进制输出的目标：--output=console（默认）、--output=null 或 --output=文件名
+ * @param argc
+ * @param argv
+ */
+ble::AsyncOutputOptions ParseOutput(int argc, char* argv[]) {
+    ble::AsyncOutputOptions options;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--output=", 9) != 0) {
+            continue;
+        }
+        const char* value = argv[i] + 9;
+        if (std::strcmp(value, "console") == 0) {
+            options.target = ble::OutputTarget::Console;
+        } else if (std::strcmp(value, "null") == 0) {
+            options.target = ble::OutputTarget::Null;
+        } else {
+            options.target = ble::OutputTarget::File;
+            options.path = value;
+        }
+    }
+    return options;
+}
 
+int main(int argc, char* argv[]) {
+    // 要在创建任何线程之前调用
+    ble::StopOnInterrupt(lifecycle);
+
+#ifdef _WIN32
+    winrt::init_apartment(); // 初始化 WinRT 环境
+    ble::WinRtTransport transport;
+#else
+    // glibc 的 stdout 一旦被 std::wcout 设为宽字符模式，十六进制输出的 fwrite 就会失效，
+    // 让 iostream 使用自己的缓冲区，不去改变 stdout 的模式
+    std::ios::sync_with_stdio(false);
+
+    // 没有 Windows 蓝牙协议栈时模拟几台 ECG-7，发送心率各不相同的合成心电
+    ble::SimulatedTransport transport;
+    for (uint64_t i = 0; i < 4; ++i) {
+        ble::SimDeviceConfig ecg7;
+        ecg7.address = 0xC0FFEE000007 + i;
+        ecg7.notification_rate_hz = kEcg7SampleRateHz / 3;
+        ble::SyntheticEcgOptions ecg;
+        ecg.sample_rate_hz = kEcg7SampleRateHz;
+        ecg.heart_rate_bpm = 60.0 + 20.0 * static_cast<double>(i);
+        ecg.seed = i + 1;
+        ecg7.payload_generator = ble::SyntheticEcg7Payload(ecg);
+        transport.AddDevice(ecg7);
+    }
+#endif
+
+    capture_compressed = ParseRecordCompressed(argc, argv);
+    OpenRecordingRing(argc, argv);
+    plot_seconds = ParsePlotSeconds(argc, argv);
+    OpenGattCache(argc, argv);
+#ifndef _WIN32
+    OpenStreamServer(argc, argv);
+    shared_samples_prefix = ParseSharedSamples(argc, argv);
+#endif
+    if (!capture_writer.Open("ecg7_capture.blecap")) {
+        std::wcerr << L"Failed to create capture file, notifications will not be recorded." << std::endl;
+    }
 
-    // 程序将一直运行，直到用户按下任意键
-    std::wcout << L"Press any key to stop..." << std::endl;
-    std::wcin.get();
+    hex_output = std::make_unique<ble::AsyncOutput>(ParseOutput(argc, argv));
+    if (!hex_output->Open()) {
+        std::wcerr << L"Failed to open output file, hex dump goes to the console." << std::endl;
+        hex_output = std::make_unique<ble::AsyncOutput>();
+        hex_output->Open();
+    }
 
+    // 程序将一直运行，直到用户按下回车或 Ctrl+C；标准输入已关闭时只响应 Ctrl+C
+    std::wcout << L"Press Enter or Ctrl+C to stop..." << std::endl;
+    std::thread([] {
+        if (std::wcin.get() != WEOF) {
+            lifecycle.RequestStop();
+        }
+    }).detach();
+
+    // 启动设备扫描，收到停止请求并排空数据后返回
+    std::vector<ble::AdvertisementRule> filters = ParseFilters(argc, argv);
+    std::vector<ble::DeviceTarget> targets = ParseTargets(argc, argv, !filters.empty());
+    StartDeviceScanning(transport, std::move(targets), std::move(filters));
+    if (capture_compressed) {
+        FlushRecordings();
+    }
+#ifndef _WIN32
+    // 标记关闭并删除共享内存的名字，还在读的进程能读完已发布的样本
+    for (auto& channel : ecg_channels) {
+        channel->shared.reset();
+    }
+#endif
 
+    {
+        std::lock_guard<std::mutex> lock(capture_mutex);
+        capture_writer.Close();
+    }
+    hex_output->Close();
+    recording_ring.Close();
+#ifndef _WIN32
+    if (stream_server) {
+        stream_server->Close();
+    }
+#endif
+    lifecycle.Advance(ble::LifecycleState::Stopped);
 
+    double stop_ms = static_cast<double>(ble::MonotonicNowNs() - lifecycle.StopRequestedNs()) / 1e6;
+    std::fprintf(stderr, "Stopped %.1f ms after stop request\n", stop_ms);
     std::cout<<"finished!!"<<std::endl;
     return 0;
 }